@@ -3,84 +3,267 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
 
 #include <Controller.hpp>
+#include <GaussianFilter.hpp>
+#include <Benchmark.hpp>
+#include <Options.hpp>
+#include <BatchProcessor.hpp>
+#include <TiledProcessor.hpp>
+#include <MultiDeviceProcessor.hpp>
+#include <Readback.hpp>
+#include <FilterDaemon.hpp>
+#include <FilterGraph.hpp>
+#include <Histogram.hpp>
+#include <KernelFusion.hpp>
+#include <StreamProcessor.hpp>
+#include <HostFilter.hpp>
+#include <IntegralImage.hpp>
+#include <ImagePyramid.hpp>
+#include <PlanarConverter.hpp>
+#include <Resizer.hpp>
+#include <RegressionHarness.hpp>
+
+#include <memory>
 
 // CONSTANTS
 #define PLATFORM_INDEX 0
 #define DEVICE_INDEX 0
-#define USE_MAPPING 0
+#define VERIFY_MIN_PSNR 45.0
+#define VERIFY_MIN_PSNR_RECURSIVE 30.0
 
-cl_mem LoadImage(cl_context context, char* filename, int &width, int &height){
-    // Initialise format and image from file
-    FREE_IMAGE_FORMAT format = FreeImage_GetFileType(filename, 0);
-    FIBITMAP* image = FreeImage_Load(format, filename);
+// Filter a single image on the host, used without an image-capable OpenCL device
+static int runOnHost(const Options& options)
+{
+    if(options.benchmark || !options.batch_dir.empty() || options.stream || !options.graph.empty() || !options.fuse.empty() || options.box || options.pyramid ||
+       options.equalize || options.planes != PlaneMode::RGBA || !options.thumbnails.empty() || !options.regression_dir.empty() || options.tile_size > 0 ||
+       options.multi_device || !options.serve_socket.empty()){
+        std::cerr << "The host backend only filters single images with the Gaussian filter" << std::endl;
+        FreeImage_DeInitialise();
+        return 1;
+    }
+
+    int width, height;
+    std::vector<char> input, output;
+    auto result = ImageIO::Decode(options.input, input, width, height);
+    if(result){
+        HostFilter host(options.threads);
+        output.resize(input.size());
+
+        auto start = std::chrono::high_resolution_clock::now();
+        host.Apply(input.data(), output.data(), width, height, options.algorithm, options.radius, options.sigma);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        std::cout << "Filtered " << width << "x" << height << " image on the host (" << HostFilter::InstructionSetName(host.GetInstructionSet())
+                  << ", " << host.GetThreadCount() << " threads) in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+        result = ImageIO::Encode(options.output, output.data(), width, height, width * 4);
+    }
+
+    std::cout << (result ? "Successfully saved image to " : "Failed to save image to ") << options.output << std::endl;
+    FreeImage_DeInitialise();
+    return result ? 0 : 1;
+}
+
+// Build the pyramid of the input image and save every level next to the output
+static bool buildPyramid(const Options& options, Controller& controller, cl_context context, cl_device_id device, cl_mem src_image, int width, int height, bool as_buffer)
+{
+    if(as_buffer){
+        std::cerr << "The pyramid needs the input as an image, not with the " << GaussianFilter::AlgorithmName(options.algorithm) << " filter" << std::endl;
+        return false;
+    }
+
+    auto program = controller.CreateProgram(context, device, "pyramid.cl");
+    if(program == NULL){
+        return false;
+    }
 
-    // Convert to 32-bit image
-    FIBITMAP *temp = image;
-    image = FreeImage_ConvertTo32Bits(image);
-    FreeImage_Unload(temp);
+    auto result = false;
+    {
+        ImagePyramid pyramid(controller, context, device, program);
+        result = pyramid.Build(src_image, width, height);
+        if(result){
+            pyramid.DisplayStatistics();
+        }
+
+        std::filesystem::path output(options.output);
+        for(int level = 1; level < pyramid.GetLevelCount() && result; level++){
+            int level_width, level_height;
+            std::vector<char> pixels;
+            pyramid.GetLevelSize(level, level_width, level_height);
+
+            auto filename = output.parent_path() / (output.stem().string() + "_level" + std::to_string(level) + output.extension().string());
+            result = pyramid.ReadLevel(level, pixels) && ImageIO::Encode(filename.string(), pixels.data(), level_width, level_height, level_width * 4);
+        }
+        std::cout << (result ? "Saved " : "Failed to save ") << pyramid.GetLevelCount() - 1 << " pyramid levels" << std::endl;
+    }
+
+    clReleaseProgram(program);
+    return result;
+}
+
+// Resize the input to every thumbnail size in one batch and save them next to the output
+static bool saveThumbnails(const Options& options, Controller& controller, cl_context context, cl_device_id device, cl_command_queue queue, cl_mem src_image, int width, int height, bool as_buffer)
+{
+    if(as_buffer){
+        std::cerr << "Thumbnails need the input as an image, not with the " << GaussianFilter::AlgorithmName(options.algorithm) << " filter" << std::endl;
+        return false;
+    }
 
-    // Get dimensions of image
-    width = FreeImage_GetWidth(image);
-    height = FreeImage_GetHeight(image);
+    std::vector<std::pair<int, int>> sizes;
+    if(!Resizer::ParseSizes(options.thumbnails, sizes)){
+        return false;
+    }
 
-    // Allocate memory
-    char *buffer = new char[width * height * 4];
-    std::memcpy(buffer, FreeImage_GetBits(image), width * height & 4);
+    auto program = controller.CreateProgram(context, device, "resize.cl");
+    if(program == NULL){
+        return false;
+    }
 
-    // Unload memory
-    FreeImage_Unload(image);
+    auto result = false;
+    {
+        Resizer resizer(controller, context, program);
+        resizer.SetMethod(options.resize_method);
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::vector<std::vector<char>> outputs;
+        result = resizer.Resize(queue, src_image, width, height, sizes) && resizer.ReadOutputs(queue, outputs);
+        auto end = std::chrono::high_resolution_clock::now();
+
+        std::filesystem::path output(options.output);
+        for(int i = 0; i < resizer.GetOutputCount() && result; i++){
+            int thumbnail_width, thumbnail_height;
+            resizer.GetOutputSize(i, thumbnail_width, thumbnail_height);
+
+            auto size = std::to_string(thumbnail_width) + "x" + std::to_string(thumbnail_height);
+            auto filename = output.parent_path() / (output.stem().string() + "_" + size + output.extension().string());
+            result = ImageIO::Encode(filename.string(), outputs[i].data(), thumbnail_width, thumbnail_height, thumbnail_width * 4);
+        }
+        std::cout << (result ? "Saved " : "Failed to save ") << resizer.GetOutputCount() << " thumbnails, resized and read back in "
+                  << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+    }
 
-    // Create an OpenCL image
+    clReleaseProgram(program);
+    return result;
+}
+
+// Replace the input image with its equalized copy, the histogram and the lookup table stay on the device
+static bool equalizeInput(Controller& controller, cl_context context, cl_device_id device, cl_command_queue queue, cl_mem& src_image, int width, int height, bool as_buffer)
+{
+    if(as_buffer){
+        std::cerr << "Equalization needs the input as an image, use a filter that reads images" << std::endl;
+        return false;
+    }
+
+    auto program = controller.CreateProgram(context, device, "histogram.cl");
+    if(program == NULL){
+        return false;
+    }
+
+    cl_int err_num;
     cl_image_format clImageFormat;
     clImageFormat.image_channel_order = CL_RGBA;
     clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+    cl_mem equalized = clCreateImage2D(context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, &err_num);
 
-    // Initialise OpenCL variables
-    cl_int err_num;
-    cl_mem cl_image;
-    cl_image = clCreateImage2D(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &clImageFormat, width, height, 0, buffer, &err_num);
+    if(err_num == CL_SUCCESS){
+        Histogram histogram(controller, context, device, program);
+        err_num = histogram.Equalize(queue, src_image, equalized, width, height);
+        clFinish(queue);
+    }
+    clReleaseProgram(program);
 
     if(err_num != CL_SUCCESS){
-        std::cerr << "Error creating CL Image object" << std::endl;
-        return 0;
+        std::cerr << "Error equalizing the input (" << err_num << ")" << std::endl;
+        if(equalized != 0)
+            clReleaseMemObject(equalized);
+        return false;
     }
 
-    return cl_image;
+    clReleaseMemObject(src_image);
+    src_image = equalized;
+    std::cout << "Equalized the input histograms" << std::endl;
+    return true;
 }
 
-bool SaveImage(char* filename, char* buffer, int width, int height, int row_pitch = 0){
-    // Retrieve format
-    FREE_IMAGE_FORMAT format = FreeImage_GetFIFFromFilename(filename);
-    auto pitch = width * 4;
+// Compare the device result with the host filter as an oracle
+static bool verifyOnHost(const Options& options, GaussianFilter& filter, const char* buffer, size_t row_pitch, int width, int height)
+{
+    std::vector<char> input, expected, actual((size_t)width * height * 4);
+    if(!ImageIO::Decode(options.input, input, width, height)){
+        return false;
+    }
 
-    if(USE_MAPPING){
-        pitch = row_pitch;
+    // The recursive filter is not truncated at the radius, compare it with a Gaussian reaching four sigma
+    int radius = filter.GetRadius();
+    if(filter.GetAlgorithm() == FilterAlgorithm::RECURSIVE){
+        radius = std::max(radius, (int)std::ceil(4.0f * filter.GetSigma()));
     }
-    FIBITMAP *image = FreeImage_ConvertFromRawBits((BYTE*)buffer, width, height, width * 4, 32, 0xFF000000, 0x00FF0000, 0x0000FF00);
 
-    return (FreeImage_Save(format, image, filename) == TRUE) ? true: false;
-}
+    HostFilter host(options.threads);
+    expected.resize(input.size());
+    host.Apply(input.data(), expected.data(), width, height, filter.GetAlgorithm(), radius, filter.GetSigma());
 
-size_t RoundUp(int group_size, int global_size){
-    int r = global_size % group_size;
-    
-    if(r == 0){
-        return global_size;
-    } else{
-        return global_size + group_size - r;
+    // The readback may be padded
+    for(int y = 0; y < height; y++){
+        std::memcpy(&actual[(size_t)y * width * 4], buffer + y * row_pitch, (size_t)width * 4);
     }
+
+    double psnr = ImageIO::PSNR((const unsigned char*)expected.data(), (const unsigned char*)actual.data(), expected.size());
+    std::cout << "Host verification PSNR: " << (std::isinf(psnr) ? std::string("exact") : std::to_string(psnr) + " dB") << std::endl;
+
+    // The recursive filter only approximates the Gaussian, most closely for large sigma
+    return psnr >= (filter.GetAlgorithm() == FilterAlgorithm::RECURSIVE ? VERIFY_MIN_PSNR_RECURSIVE : VERIFY_MIN_PSNR);
 }
 
 int main(int argc, char** argv)
 {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Parse the command-line options
+    Options options;
+    if(!options.Parse(argc, argv)){
+        options.PrintUsage(argv[0]);
+        return 1;
+    }
+
+    // Clients forward their options to the daemon without touching the device
+    if(!options.client_socket.empty()){
+        std::vector<std::string> args;
+        for(int i = 1; i < argc; i++){
+            if(std::string(argv[i]) == "--client"){
+                i++;
+            } else{
+                args.push_back(argv[i]);
+            }
+        }
+        return FilterDaemon::Submit(options.client_socket, args);
+    }
+
+    // Keep stdout for the frames when streaming to it
+    if(options.stream && options.output == "-"){
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+
     std::cout << "Hello from 2DImageFilter" << std::endl;
 
     // Initialise FreeImage
     FreeImage_Initialise();
     std::cout << "FreeImage version: " << FreeImage_GetVersion() << std::endl;
 
+    // Fall back to the host filter without an OpenCL platform
+    cl_uint num_platforms = 0;
+    if(options.host || clGetPlatformIDs(0, NULL, &num_platforms) != CL_SUCCESS || num_platforms == 0){
+        if(!options.host){
+            std::cerr << "No OpenCL platform found, using the host filter" << std::endl;
+        }
+        return runOnHost(options);
+    }
+
     // Initialise OpenCL variables
     Controller controller;
 
@@ -93,128 +276,382 @@ int main(int argc, char** argv)
     std::cout << "\nApplication will use:\nPLATFORM INDEX:\t" << PLATFORM_INDEX << "\nDEVICE INDEX:\t" << DEVICE_INDEX << "\n" << std::endl;
     
     auto devices = controller.GetDevices(platforms[PLATFORM_INDEX]);
+    if(devices.size() <= DEVICE_INDEX){
+        std::cerr << "No OpenCL device at index " << DEVICE_INDEX << ", using the host filter" << std::endl;
+        return runOnHost(options);
+    }
+
     // Query device for Image support
     cl_bool image_support = CL_FALSE;
     clGetDeviceInfo(devices[DEVICE_INDEX], CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &image_support, NULL);
     if(image_support != CL_TRUE){
-        std::cerr << "Device does not support images" << std::endl;
+        std::cerr << "Device does not support images, using the host filter" << std::endl;
+        return runOnHost(options);
     }
     std::cout << "Device supports images" << std::endl;
 
+    // Multi-device mode keeps every NUMA node of a CPU runtime busy with its own sub-device
+    if(options.multi_device){
+        devices = controller.PartitionDevices(devices);
+    }
+
     // Get OpenCL mandatory properties
     auto context = controller.CreateContext(platforms[PLATFORM_INDEX], devices);
     auto command_queue = controller.CreateCommandQueue(context, devices[DEVICE_INDEX]);
     auto program = controller.CreateProgram(context, devices[DEVICE_INDEX], "gaussian_filter.cl");
-    auto kernel = controller.CreateKernel(program, "gaussian_filter");
+    controller.GetMemoryPool(context).SetCapacity((size_t)options.pool_mb << 20);
+
+    // Configure the Gaussian filter
+    GaussianFilter filter(controller, context, devices[DEVICE_INDEX], program);
+    if(!filter.SetParameters(options.radius, options.sigma)){
+        controller.Cleanup(context, command_queue, program);
+        return 1;
+    }
+    filter.SetAlgorithm(options.algorithm);
+
+    // Dispatch to the fastest variant that matches the float result. The filter graph, Y4M streams, the pyramid,
+    // equalization, planar modes and thumbnails need the input as an image
+    auto allow_buffers = options.graph.empty() && !(options.stream && options.stream_format == StreamFormat::Y4M) &&
+                         !options.pyramid && !options.equalize && options.planes == PlaneMode::RGBA && options.thumbnails.empty();
+    if(options.precision == FilterPrecision::AUTO){
+        filter.SelectPrecision(command_queue, allow_buffers);
+    } else if(!filter.SetPrecision(options.precision)){
+        controller.Cleanup(context, command_queue, program);
+        return 1;
+    }
+    std::cout << "Using " << GaussianFilter::AlgorithmName(options.algorithm) << " Gaussian filter (radius " << filter.GetRadius()
+              << ", " << GaussianFilter::PrecisionName(filter.GetPrecision()) << " precision)" << std::endl;
+
+    // The daemon keeps everything above alive and serves jobs until a client stops it
+    if(!options.serve_socket.empty()){
+        auto result = false;
+        {
+            FilterDaemon daemon(controller, context, command_queue, filter, std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+            result = daemon.Serve(options.serve_socket);
+        }
+
+        controller.Cleanup(context, command_queue, program);
+        FreeImage_DeInitialise();
+        return result ? 0 : 1;
+    }
+
+    // Batch mode overlaps upload, filtering and readback of several images
+    if(!options.batch_dir.empty()){
+        auto result = false;
+        {
+            BatchProcessor batch(controller, context, devices[DEVICE_INDEX], filter, options.batch_depth, options.queue_mode);
+            result = batch.Run(options.batch_dir, options.output_dir);
+        }
+
+        controller.Cleanup(context, command_queue, program);
+        FreeImage_DeInitialise();
+        return result ? 0 : 1;
+    }
+
+    // Regression mode checks every algorithm against the golden images and the timing baseline
+    if(!options.regression_dir.empty()){
+        auto result = false;
+        {
+            HostFilter host(options.threads);
+            RegressionHarness harness(controller, context, devices[DEVICE_INDEX], filter, host);
+            result = harness.Run(options.regression_dir, options.update_baseline);
+        }
+
+        controller.Cleanup(context, command_queue, program);
+        FreeImage_DeInitialise();
+        return result ? 0 : 1;
+    }
+
+    // Streaming mode keeps the device objects alive across raw or Y4M frames
+    if(options.stream){
+        auto result = false;
+        {
+            StreamProcessor stream(controller, context, devices[DEVICE_INDEX], command_queue, filter);
+            result = stream.Run(options.input, options.output, options.stream_format, options.stream_width, options.stream_height);
+        }
+
+        controller.Cleanup(context, command_queue, program);
+        FreeImage_DeInitialise();
+        return result ? 0 : 1;
+    }
+
+    // Multi-device mode filters horizontal bands of the image on every device at once
+    int width, height;
+    if(options.multi_device){
+        std::vector<char> input, output;
+        auto result = ImageIO::Decode(options.input, input, width, height);
+        if(result){
+            MultiDeviceProcessor multi(controller, context, devices, filter);
+            result = multi.Calibrate(width, height) && multi.Process(input, output, width, height);
+        }
+        if(result && options.verify && !verifyOnHost(options, filter, output.data(), (size_t)width * 4, width, height)){
+            std::cerr << "Device result differs from the host filter" << std::endl;
+            result = false;
+        }
+        if(result){
+            result = ImageIO::Encode(options.output, output.data(), width, height, width * 4);
+        }
+
+        std::cout << (result ? "Successfully saved image to " : "Failed to save image to ") << options.output << std::endl;
+        controller.Cleanup(context, command_queue, program);
+        FreeImage_DeInitialise();
+        return result ? 0 : 1;
+    }
+
+    // Images beyond the device limits are streamed through a fixed pool of tiles
+    if(ImageIO::ReadDimensions(options.input, width, height) &&
+       (options.tile_size > 0 || TiledProcessor::NeedsTiling(devices[DEVICE_INDEX], width, height))){
+        std::vector<char> input, output;
+        auto result = ImageIO::Decode(options.input, input, width, height);
+        if(result){
+            TiledProcessor tiled(controller, context, devices[DEVICE_INDEX], filter, options.tile_size, options.batch_depth);
+            result = tiled.Process(input, output, width, height);
+        }
+        if(result){
+            result = ImageIO::Encode(options.output, output.data(), width, height, width * 4);
+        }
+
+        std::cout << (result ? "Successfully saved image to " : "Failed to save image to ") << options.output << std::endl;
+        controller.Cleanup(context, command_queue, program);
+        FreeImage_DeInitialise();
+        return result ? 0 : 1;
+    }
+
+    // Optional chain of stages run on the device between the input and output images
+    cl_program graph_program = NULL;
+    std::unique_ptr<FilterGraph> graph;
+    if(!options.graph.empty()){
+        graph_program = controller.CreateProgram(context, devices[DEVICE_INDEX], "image_filters.cl");
+        if(graph_program == NULL){
+            controller.Cleanup(context, command_queue, program);
+            return 1;
+        }
+
+        graph.reset(new FilterGraph(controller, context, graph_program));
+        if(!graph->Parse(options.graph, filter) || !graph->Compile()){
+            graph.reset();
+            clReleaseProgram(graph_program);
+            controller.Cleanup(context, command_queue, program);
+            return 1;
+        }
+    }
+
+    // Optional sequence of operations generated into a single kernel
+    std::unique_ptr<KernelFusion> fusion;
+    if(!options.fuse.empty()){
+        fusion.reset(new KernelFusion(controller, context, devices[DEVICE_INDEX]));
+        if(!fusion->Parse(options.fuse, filter.GetRadius(), filter.GetSigma()) || !fusion->Build()){
+            fusion.reset();
+            controller.Cleanup(context, command_queue, program);
+            return 1;
+        }
+        std::cout << "Fused " << fusion->GetPassCount() << " passes into one kernel: " << fusion->Describe() << std::endl;
+    }
+
+    // Optional box passes over a summed-area table approximating the Gaussian
+    cl_program integral_program = NULL;
+    std::unique_ptr<IntegralImage> integral;
+    if(options.box){
+        integral_program = controller.CreateProgram(context, devices[DEVICE_INDEX], "integral_image.cl");
+        if(integral_program == NULL){
+            controller.Cleanup(context, command_queue, program);
+            return 1;
+        }
+
+        integral.reset(new IntegralImage(controller, context, devices[DEVICE_INDEX], integral_program));
+        integral->SetSigma(filter.GetSigma());
+
+        std::cout << "Approximating sigma " << filter.GetSigma() << " with box radii";
+        for(auto box_radius : integral->GetRadii()){
+            std::cout << " " << box_radius;
+        }
+        std::cout << std::endl;
+    }
+
+    // Optional single channel planes the filter runs on instead of the RGBA image
+    cl_program planar_program = NULL;
+    std::unique_ptr<PlanarConverter> planar;
+    if(options.planes != PlaneMode::RGBA){
+        if(filter.UsesBuffers()){
+            std::cerr << "Planar modes need an image-based filter, not " << GaussianFilter::AlgorithmName(filter.GetAlgorithm()) << std::endl;
+            controller.Cleanup(context, command_queue, program);
+            return 1;
+        }
+
+        planar_program = controller.CreateProgram(context, devices[DEVICE_INDEX], "color_convert.cl");
+        if(planar_program == NULL){
+            controller.Cleanup(context, command_queue, program);
+            return 1;
+        }
+        planar.reset(new PlanarConverter(controller, context, planar_program));
+    }
 
     // Load input image from file and load it into an OpenCL image object
     cl_int err_num;
-    int width, height;
     cl_mem image_objects[2] = {0, 0};
 
-    // TODO: Change this back to argv[1]
-    image_objects[0] = LoadImage(context, "blurry_photo.jpeg", width, height);
-    // image_objects[0] = LoadImage(context, argv[1], width, height);
+    image_objects[0] = ImageIO::LoadImage(context, command_queue, options.input, width, height, options.ingest, filter.UsesBuffers() && !fusion && !integral);
     if (image_objects[0] == 0){
-        std::cerr << "Error loading: " << std::string(argv[1]) << std::endl;
+        std::cerr << "Error loading: " << options.input << std::endl;
         return 1;
     }
+    std::cout << "Loaded " << width << "x" << height << " image using " << ImageIO::IngestModeName(options.ingest) << " ingest" << std::endl;
     
-    // Create output image objects
-    cl_image_format clImageFormat;
-    clImageFormat.image_channel_order = CL_RGBA;
-    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+    // Create output image objects for the selected readback strategy
+    Readback readback(context, command_queue, options.readback, filter.UsesBuffers() && !fusion && !integral);
+    std::cout << "Using " << Readback::StrategyName(readback.Select(width, height)) << " readback" << std::endl;
 
-    if(USE_MAPPING){
-        image_objects[1] = clCreateImage2D(context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, &err_num);
-    } else{
-        image_objects[1] = clCreateImage2D(context, CL_MEM_WRITE_ONLY, &clImageFormat, width, height, 0, NULL, &err_num);
-    }
+    image_objects[1] = readback.CreateOutput(width, height, &err_num);
     if (err_num != CL_SUCCESS){
         std::cerr << "Error creating CL output image object." << std::endl;
         return 1;
     }
     std::cout << "Succesfully created OpenCL output image object" << std::endl;
 
-    // Create sampler object
-    auto sampler = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &err_num);
-    if(err_num != CL_SUCCESS){
-        std::cerr << "Error creating OpenCL sampler object" << std::endl;
-        controller.Cleanup(context, command_queue, program, kernel, sampler, image_objects, 2);
+    if(planar && !planar->SetMode(options.planes, width, height)){
+        controller.Cleanup(context, command_queue, program, 0, 0, image_objects, 2);
         return 1;
     }
-    std::cout << "Succesfully created a sampler object" << std::endl;
 
-    // Set the kernel arguments
-    err_num = clSetKernelArg(kernel, 0, sizeof(cl_mem), &image_objects[0]);
-    err_num |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &image_objects[1]);
-    err_num |= clSetKernelArg(kernel, 2, sizeof(cl_sampler), &sampler);
-    err_num |= clSetKernelArg(kernel, 3, sizeof(cl_int), &width);
-    err_num |= clSetKernelArg(kernel, 4, sizeof(cl_int), &height);
-    if(err_num != CL_SUCCESS){
-        std::cerr << "Error setting kernel arguments." << std::endl;
-        controller.Cleanup(context, command_queue, program, kernel, sampler, image_objects, 2);
+    // Auto-level the input before any filter sees it
+    if(options.equalize && !equalizeInput(controller, context, devices[DEVICE_INDEX], command_queue, image_objects[0], width, height, filter.UsesBuffers() && !fusion && !integral)){
+        controller.Cleanup(context, command_queue, program, 0, 0, image_objects, 2);
         return 1;
     }
-    std::cout << "Successfully set kernel arguments" << std::endl;
 
-    // Initialise the work-size
-    size_t local_work_size[2] = {16, 16};
-    size_t global_work_size[2] = {RoundUp(local_work_size[0], width), RoundUp(local_work_size[1], height)};
+    // Compare the filter paths and readback strategies on an image of the same size
+    if(options.benchmark){
+        Benchmark benchmark(command_queue, options.benchmark_iterations);
+        benchmark.CompareGaussian(filter, width, height);
+        benchmark.CompareTiled(controller, filter, width, height);
+        benchmark.ComparePrecision(filter, width, height);
+        benchmark.CompareRecursive(filter, width, height);
+
+        HostFilter host(options.threads);
+        benchmark.CompareHost(controller, filter, host, width, height);
+        benchmark.CompareHistogram(controller, width, height);
+        benchmark.CompareReadback(width, height, filter.UsesBuffers() && !fusion && !integral);
+        benchmark.CompareScheduling(controller, filter, width, height);
+        if(fusion){
+            benchmark.CompareFusion(*fusion, width, height);
+        }
+        if(integral){
+            benchmark.CompareIntegral(filter, *integral, width, height);
+        }
+        if(planar){
+            benchmark.ComparePlanes(filter, *planar, width, height);
+        }
+        if(!options.thumbnails.empty()){
+            benchmark.CompareResize(controller, width, height);
+        }
+    }
+
+    // Multi-scale levels of the input, the pyramid builds them on its own queue
+    if(options.pyramid){
+        clFinish(command_queue);
+        if(!buildPyramid(options, controller, context, devices[DEVICE_INDEX], image_objects[0], width, height, filter.UsesBuffers() && !fusion && !integral)){
+            controller.Cleanup(context, command_queue, program, 0, 0, image_objects, 2);
+            return 1;
+        }
+    }
+
+    // Thumbnails of the input from the image already on the device
+    if(!options.thumbnails.empty()){
+        if(!saveThumbnails(options, controller, context, devices[DEVICE_INDEX], command_queue, image_objects[0], width, height, filter.UsesBuffers() && !fusion && !integral)){
+            controller.Cleanup(context, command_queue, program, 0, 0, image_objects, 2);
+            return 1;
+        }
+    }
 
     // Execute the kernel
-    err_num = clEnqueueNDRangeKernel(command_queue, kernel, 2, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+    if(fusion){
+        err_num = fusion->Enqueue(command_queue, image_objects[0], image_objects[1], width, height);
+    } else if(integral){
+        err_num = integral->Enqueue(command_queue, image_objects[0], image_objects[1], width, height);
+    } else if(graph){
+        err_num = graph->Enqueue(command_queue, image_objects[0], image_objects[1], width, height);
+    } else if(planar){
+        // Gray stays a single plane, luma goes back to RGBA with the original chroma
+        err_num = planar->Enqueue(command_queue, filter, image_objects[0], (options.planes == PlaneMode::LUMA) ? image_objects[1] : 0, width, height);
+    } else{
+        err_num = filter.Enqueue(command_queue, image_objects[0], image_objects[1], width, height);
+    }
     if(err_num != CL_SUCCESS){
         std::cerr << "Error executing the kernel" << std::endl;
-        controller.Cleanup(context, command_queue, program, kernel, sampler, image_objects, 2);
+        controller.Cleanup(context, command_queue, program, 0, 0, image_objects, 2);
         return 1;
     }
     std::cout << "Successfully executed kernel" << std::endl;
 
-    // Read the output buffer back from device to host memory
-    size_t origin[3] = {0, 0, 0};
-    size_t region[3] = {width, height, 1};
-    size_t row_pitch = 0;
-    char* buffer;
-
-    if(USE_MAPPING){
-        buffer = (char*) clEnqueueMapImage(command_queue, image_objects[1], CL_TRUE, CL_MAP_READ, origin, region, &row_pitch, NULL, 0, NULL, NULL, &err_num);
-    } else{
-        buffer = new char [width * height * 4];
-        err_num = clEnqueueReadImage(command_queue, image_objects[1], CL_TRUE, origin, region, 0, 0, buffer, 0, NULL, NULL);
+    // The gray plane is saved as it is, without converting it back to RGBA
+    if(planar && options.planes == PlaneMode::GRAY){
+        std::vector<char> pixels;
+        auto result = planar->ReadPlane(command_queue, planar->GetFilteredPlane(), pixels) &&
+                      ImageIO::EncodeGray(options.output, pixels.data(), width, height, width);
+        std::cout << (result ? "Successfully saved image to " : "Failed to save image to ") << options.output << std::endl;
+
+        planar.reset();
+        clReleaseProgram(planar_program);
+        controller.Cleanup(context, command_queue, program, 0, 0, image_objects, 2);
+        FreeImage_DeInitialise();
+        return result ? 0 : 1;
     }
+
+    // Read the output back from device to host memory
+    size_t row_pitch = 0;
+    char* buffer = readback.Acquire(image_objects[1], width, height, row_pitch, &err_num);
     if(err_num != CL_SUCCESS){
         std::cerr << "Error reading the result buffer" << std::endl;
-        controller.Cleanup(context, command_queue, program, kernel, sampler, image_objects, 2);
+        controller.Cleanup(context, command_queue, program, 0, 0, image_objects, 2);
         return 1;
     }
     std::cout << "Successfully read the result buffer" << std::endl;
 
-    // Saving the image
-    auto result = false;
-    if(USE_MAPPING){
-        result = SaveImage("edited.jpeg", buffer, width, height, row_pitch);
-    } else{
-        result = SaveImage("edited.jpeg", buffer, width, height);
+    // Check the device result against the host filter
+    if(options.verify){
+        if(graph || fusion || integral || planar || options.equalize){
+            std::cout << "Verification only covers the Gaussian filter, skipping" << std::endl;
+        } else if(!verifyOnHost(options, filter, buffer, row_pitch, width, height)){
+            std::cerr << "Device result differs from the host filter" << std::endl;
+            readback.Release(image_objects[1], buffer);
+            controller.Cleanup(context, command_queue, program, 0, 0, image_objects, 2);
+            return 1;
+        }
     }
+
+    // Saving the image with the row pitch of the readback
+    auto result = ImageIO::Encode(options.output, buffer, width, height, (int)row_pitch);
     if(!result){
-        std::cerr << "Failed to save image to edited.jpeg" << std::endl;
-        controller.Cleanup(context, command_queue, program, kernel, sampler, image_objects, 2);
+        std::cerr << "Failed to save image to " << options.output << std::endl;
+        readback.Release(image_objects[1], buffer);
+        controller.Cleanup(context, command_queue, program, 0, 0, image_objects, 2);
         return 1;
     }
-    std::cout << "Successfully saved image to edited.jpeg" << std::endl;
+    std::cout << "Successfully saved image to " << options.output << std::endl;
 
-    if(USE_MAPPING){
-        // Unmap the image buffer
-        err_num = clEnqueueUnmapMemObject(command_queue, image_objects[1], buffer, 0, NULL, NULL);
-        std::cout << "Successfully unmaped image buffer" << std::endl;
-    }
+    err_num = readback.Release(image_objects[1], buffer);
     if(err_num != CL_SUCCESS){
         std::cerr << "Failed to unmap the result buffer" << std::endl;
-        controller.Cleanup(context, command_queue, program, kernel, sampler, image_objects, 2);
+        controller.Cleanup(context, command_queue, program, 0, 0, image_objects, 2);
         return 1;
     }
 
+    clFinish(command_queue);
+    if(graph){
+        graph.reset();
+        clReleaseProgram(graph_program);
+    }
+    fusion.reset();
+    if(integral){
+        integral.reset();
+        clReleaseProgram(integral_program);
+    }
+    if(planar){
+        planar.reset();
+        clReleaseProgram(planar_program);
+    }
+    controller.Cleanup(context, command_queue, program, 0, 0, image_objects, 2);
+
     FreeImage_DeInitialise();
     std::cout << "\nProgram executed succesfully" << std::endl;
     return 0;
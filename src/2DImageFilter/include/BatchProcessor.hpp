@@ -0,0 +1,72 @@
+#ifndef BATCHPROCESSOR_H
+#define BATCHPROCESSOR_H
+
+#include <CL/cl.h>
+#include <chrono>
+#include <filesystem>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <CommandScheduler.hpp>
+#include <Controller.hpp>
+#include <EventFuture.hpp>
+#include <GaussianFilter.hpp>
+#include <ImageIO.hpp>
+#include <ThreadPool.hpp>
+
+class BatchProcessor
+{
+public:
+    // Out-of-order queues let the upload of one image overlap the kernels of another, in-order lanes are the fallback
+    BatchProcessor(Controller& controller, cl_context context, cl_device_id device, GaussianFilter& filter, int depth, QueueMode mode = QueueMode::AUTO);
+    ~BatchProcessor();
+
+    // Filter every supported image in `input_dir` and write the results into `output_dir`
+    bool Run(const std::string& input_dir, const std::string& output_dir);
+
+private:
+    // One image in flight: host staging memory, device objects and the events chaining its stages
+    struct Slot
+    {
+        std::string output;
+        std::vector<char> host_input;
+        std::vector<char> host_output;
+        MemoryLease src, dst;
+        int width, height;
+        int upload_node, kernel_node, readback_node;
+        cl_event kernel_start;
+        EventFuture upload, readback;
+
+        // Encoding runs on the encoder pool as soon as the readback ends
+        std::future<void> encoded;
+        bool saved;
+        double encode_ms;
+        bool busy;
+    };
+
+    bool submit(Slot& slot, const std::string& input, const std::string& output);
+    bool complete(Slot& slot);
+    bool allocate(Slot& slot, int width, int height);
+    void releaseEvents(Slot& slot);
+    void displayStatistics(int images, double wall_ms);
+
+    GaussianFilter& m_filter;
+    MemoryPool& m_pool;
+
+    // Uploads, kernels and readbacks are chained by their events so that different images overlap
+    CommandScheduler m_scheduler;
+    int m_last_kernel;
+
+    std::vector<Slot> m_slots;
+
+    // Declared after the slots so that queued encodes are drained before the slots go away
+    ThreadPool m_encoders;
+
+    // Busy time per stage in milliseconds
+    double m_decode_ms, m_upload_ms, m_kernel_ms, m_readback_ms, m_encode_ms;
+};
+
+#endif // BATCHPROCESSOR_H
@@ -0,0 +1,69 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <CL/cl.h>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+
+#include <CommandScheduler.hpp>
+#include <Controller.hpp>
+#include <GaussianFilter.hpp>
+#include <Histogram.hpp>
+#include <HostFilter.hpp>
+#include <IntegralImage.hpp>
+#include <KernelFusion.hpp>
+#include <PlanarConverter.hpp>
+#include <Readback.hpp>
+#include <Resizer.hpp>
+
+class Benchmark
+{
+public:
+    Benchmark(cl_command_queue queue, int iterations);
+
+    // Average time in milliseconds of an enqueue function, measured on the host after clFinish
+    double Time(std::function<cl_int()> enqueue);
+    double Time(cl_command_queue queue, std::function<cl_int()> enqueue);
+
+    void CompareGaussian(GaussianFilter& filter, int width, int height);
+    // Profiled kernel time of the sampler and tiled paths on the OpenCL CPU device (or the current device without one)
+    void CompareTiled(Controller& controller, GaussianFilter& filter, int width, int height);
+    void ComparePrecision(GaussianFilter& filter, int width, int height);
+
+    // Throughput of the recursive filter per sigma, with its PSNR against the direct Gaussian
+    void CompareRecursive(GaussianFilter& filter, int width, int height);
+    void CompareReadback(int width, int height, bool as_buffer);
+    void CompareFusion(KernelFusion& fusion, int width, int height);
+
+    // Gaussian kernels against the stacked box passes over a summed-area table of the same sigma
+    void CompareIntegral(GaussianFilter& filter, IntegralImage& integral, int width, int height);
+
+    // The filter on RGBA against a single CL_R plane, alone and with the conversions of the planar modes
+    void ComparePlanes(GaussianFilter& filter, PlanarConverter& planar, int width, int height);
+
+    // Bilinear sampler against area averaging per reduction factor
+    void CompareResize(Controller& controller, int width, int height);
+
+    // Host implementation per instruction set against the OpenCL CPU device (or the current device without one)
+    void CompareHost(Controller& controller, GaussianFilter& filter, HostFilter& host, int width, int height);
+
+    // Histogram throughput per work-group size on the OpenCL CPU device (or the current device without one)
+    void CompareHistogram(Controller& controller, int width, int height);
+
+    // Upload, filter and readback of several images on one serial queue, in-order lanes and an out-of-order queue
+    void CompareScheduling(Controller& controller, GaussianFilter& filter, int width, int height);
+
+private:
+    cl_mem createImage(int width, int height, cl_context context = 0);
+    cl_mem createBuffer(size_t size, cl_context context = 0);
+    void displayDevice(cl_command_queue queue = 0);
+    void findCPUDevice(cl_platform_id& cpu_platform, cl_device_id& cpu_device);
+
+    cl_command_queue m_queue;
+    cl_context m_context;
+    int m_iterations;
+};
+
+#endif // BENCHMARK_H
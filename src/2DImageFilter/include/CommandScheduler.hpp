@@ -0,0 +1,64 @@
+#ifndef COMMANDSCHEDULER_H
+#define COMMANDSCHEDULER_H
+
+#include <CL/cl.h>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Controller.hpp>
+
+enum class QueueMode {
+    OUT_OF_ORDER,       // One CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE queue, commands are ordered by their wait lists only
+    IN_ORDER,           // One in-order queue per lane, commands of different lanes overlap
+    SERIAL,             // A single in-order queue, every command waits for the previous one
+    AUTO                // Out-of-order where the device supports it, in-order lanes otherwise
+};
+
+// Enqueues commands as a DAG: every command names the commands it depends on and gets their events as
+// its wait list. Lanes group the commands that an in-order fallback may serialise, e.g. uploads,
+// kernels and readbacks, they are ignored by the out-of-order queue.
+class CommandScheduler
+{
+public:
+    static const int DEFAULT_LANES = 3;
+
+    // Enqueues one command on `queue` after `wait_list` and returns its event in `event`
+    typedef std::function<cl_int(cl_command_queue queue, cl_uint num_events, const cl_event* wait_list, cl_event* event)> Command;
+
+    // `properties` are added to those of every queue, e.g. CL_QUEUE_PROFILING_ENABLE
+    CommandScheduler(Controller& controller, cl_context context, cl_device_id device, QueueMode mode = QueueMode::AUTO, int lanes = DEFAULT_LANES,
+                     cl_command_queue_properties properties = 0);
+    ~CommandScheduler();
+
+    static bool ParseMode(const std::string& name, QueueMode& mode);
+    static std::string ModeName(QueueMode mode);
+
+    // The mode in use, OUT_OF_ORDER falls back to IN_ORDER on devices without out-of-order queues
+    QueueMode GetMode() const;
+
+    // Enqueue `command` once the `dependencies` have completed, returns its node or -1 if it failed
+    int Add(int lane, const std::vector<int>& dependencies, const Command& command);
+
+    // Event of a node, 0 once it has been released
+    cl_event GetEvent(int node) const;
+
+    // Release the event of a node that has completed, later dependencies on it are dropped
+    void Release(int node);
+
+    // Wait for every command and release their events, node numbers start again at 0
+    cl_int Finish();
+
+private:
+    void releaseEvents();
+
+    QueueMode m_mode;
+    std::vector<cl_command_queue> m_queues;
+
+    // Event and queue of every node, indexed by node
+    std::vector<cl_event> m_events;
+    std::vector<int> m_node_queues;
+};
+
+#endif // COMMANDSCHEDULER_H
@@ -6,30 +6,71 @@
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
 #include <vector>
 
+#include <EventFuture.hpp>
 #include <InfoPlatform.hpp>
+#include <MemoryPool.hpp>
 
 class Controller
 {
 public:
     Controller();
+    ~Controller();
 
     void CheckError(cl_int err, const char* name);
     
     std::vector<cl_platform_id> GetPlatforms();
     std::vector<cl_device_id> GetDevices(cl_platform_id platform);
 
+    // Split devices spanning several NUMA nodes into one sub-device per node, released with the controller
+    std::vector<cl_device_id> PartitionDevices(const std::vector<cl_device_id>& devices);
+
     cl_context CreateContext(cl_platform_id platform, std::vector<cl_device_id> devices);
-    cl_command_queue CreateCommandQueue(cl_context context, cl_device_id device);
-    cl_program CreateProgram(cl_context context, cl_device_id device, const char* filename);
+    // Whether the device reports CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE among its queue properties
+    static bool SupportsOutOfOrder(cl_device_id device);
+    cl_command_queue CreateCommandQueue(cl_context context, cl_device_id device, cl_command_queue_properties properties = 0);
+    cl_program CreateProgram(cl_context context, cl_device_id device, const char* filename, const std::string& build_options = "");
+    // Programs are cached per context, device, source and options; every call returns a retained program
+    // Built binaries are also kept on disk in FILTER_PROGRAM_CACHE, keyed by source, options, device, driver and platform
+    // The default cache is per user, a cache other users can write to is skipped
+    cl_program CreateProgramWithSource(cl_context context, cl_device_id device, const std::string& source, const std::string& build_options = "");
     cl_kernel CreateKernel(cl_program program, const char* kernel_name);
 
+    // Pool of reusable images and buffers of a context, dropped by Cleanup together with the context
+    MemoryPool& GetMemoryPool(cl_context context);
+
+    // Run `enqueue` with the event it should signal, flush the queue and hand back a future of that event.
+    // A failed enqueue gives a future that has already ended with its error.
+    static EventFuture EnqueueAsync(cl_command_queue queue, const std::function<cl_int(cl_event* event)>& enqueue, cl_int* err_num = NULL);
+
+    // Non-blocking transfers of RGBA8 images and buffers, the host memory must stay valid until the future ends
+    static EventFuture WriteImageAsync(cl_command_queue queue, cl_mem image, int width, int height, const void* ptr, size_t row_pitch = 0, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_int* err_num = NULL);
+    static EventFuture ReadImageAsync(cl_command_queue queue, cl_mem image, int width, int height, void* ptr, size_t row_pitch = 0, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_int* err_num = NULL);
+    static EventFuture WriteBufferAsync(cl_command_queue queue, cl_mem buffer, size_t size, const void* ptr, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_int* err_num = NULL);
+    static EventFuture ReadBufferAsync(cl_command_queue queue, cl_mem buffer, size_t size, void* ptr, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_int* err_num = NULL);
+
     void DisplayPlatformInformation(cl_platform_id platform);
+    static size_t RoundUp(int group_size, int global_size);
+    static cl_ulong GetProfilingTime(cl_event event, cl_profiling_info name);
     void Cleanup(cl_context context = 0, cl_command_queue commandQueue = 0, cl_program program = 0, cl_kernel kernel = 0, cl_sampler sampler = 0, cl_mem* mem_objects = 0, int num_mem_objects = 0);
 
 private:
+    std::string binaryKey(cl_device_id device, const std::string& source, const std::string& build_options);
+    cl_program loadBinary(cl_context context, cl_device_id device, const std::filesystem::path& path, const std::string& key, const std::string& build_options);
+    void storeBinary(cl_program program, cl_device_id device, const std::filesystem::path& path, const std::string& key);
+
     cl_uint num_platforms, num_devices;
+    std::map<std::tuple<cl_context, cl_device_id, std::string, std::string>, cl_program> m_programs;
+    std::filesystem::path m_cache_directory;
+    std::map<cl_context, std::unique_ptr<MemoryPool>> m_pools;
+    std::vector<cl_device_id> m_sub_devices;
 };
 
 #endif // CONTROLLER_H
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef EVENTFUTURE_H
+#define EVENTFUTURE_H
+
+#include <CL/cl.h>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <ThreadPool.hpp>
+
+// Shared handle to an enqueued command. Completion is signalled by clSetEventCallback, so waiting on it
+// or attaching continuations never calls clFinish or clWaitForEvents on the host.
+class EventFuture
+{
+public:
+    EventFuture();
+
+    // Takes over the reference to `event`, whose queue must be flushed for the callback to fire
+    explicit EventFuture(cl_event event);
+
+    // Already completed with `err_num`, for commands that could not be enqueued
+    static EventFuture Failed(cl_int err_num);
+
+    bool Valid() const;
+    cl_event GetEvent() const;
+    bool IsReady() const;
+
+    // Block until the command has ended, returns CL_COMPLETE or the negative error it ended with
+    cl_int Wait() const;
+
+    // Run `continuation` on `pool` once the command has ended, right away if it already has.
+    // The pool must outlive the command, the future reports the end of the continuation.
+    std::future<void> Then(ThreadPool& pool, std::function<void(cl_int status)> continuation) const;
+
+private:
+    struct State
+    {
+        cl_event event;
+        std::mutex mutex;
+        std::condition_variable done;
+        bool complete;
+        cl_int status;
+        std::vector<std::function<void(cl_int status)>> continuations;
+
+        ~State();
+    };
+
+    static void CL_CALLBACK onComplete(cl_event event, cl_int status, void* user_data);
+    void finish(cl_int status) const;
+
+    std::shared_ptr<State> m_state;
+};
+
+#endif // EVENTFUTURE_H
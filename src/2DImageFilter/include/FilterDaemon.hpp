@@ -0,0 +1,61 @@
+#ifndef FILTERDAEMON_H
+#define FILTERDAEMON_H
+
+#include <CL/cl.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Controller.hpp>
+#include <GaussianFilter.hpp>
+#include <ImageIO.hpp>
+#include <Options.hpp>
+
+// Long-lived process that keeps the context, the built program and the filter warm and serves
+// filter jobs over a Unix domain socket. A job is one line: the working directory of the client
+// followed by its command-line options, tab separated. The reply is one line, "ok <job ms> <startup ms>"
+// or "error <message>".
+class FilterDaemon
+{
+public:
+    FilterDaemon(Controller& controller, cl_context context, cl_command_queue queue, GaussianFilter& filter, double startup_ms);
+    ~FilterDaemon();
+
+    // Accept jobs until a client sends --stop
+    bool Serve(const std::string& socket_path);
+
+    // Send one job to a running daemon and print its latency, returns the exit code of the client
+    static int Submit(const std::string& socket_path, const std::vector<std::string>& args);
+
+private:
+    struct Job
+    {
+        std::string input;
+        int width, height;
+        double decode_ms, filter_ms, encode_ms, total_ms;
+    };
+
+    bool runJob(const std::string& directory, const std::vector<std::string>& args, Job& job, std::string& error);
+    bool configure(const Options& options, std::string& error);
+    void displayStatistics() const;
+
+    static bool readLine(int socket, std::string& line);
+    static bool writeLine(int socket, const std::string& line);
+
+    cl_command_queue m_queue;
+    GaussianFilter& m_filter;
+    MemoryPool& m_pool;
+
+    // Time from process start until the first job could be accepted
+    double m_startup_ms;
+
+    // AUTO precision is selected once per algorithm
+    std::map<FilterAlgorithm, FilterPrecision> m_precisions;
+
+    std::vector<Job> m_jobs;
+};
+
+#endif // FILTERDAEMON_H
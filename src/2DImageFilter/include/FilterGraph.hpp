@@ -0,0 +1,75 @@
+#ifndef FILTERGRAPH_H
+#define FILTERGRAPH_H
+
+#include <CL/cl.h>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Controller.hpp>
+#include <GaussianFilter.hpp>
+
+class FilterGraph
+{
+public:
+    // Node index that refers to the graph's input image
+    static const int GRAPH_INPUT = -1;
+
+    FilterGraph(Controller& controller, cl_context context, cl_program program);
+    ~FilterGraph();
+
+    // Add a stage running a kernel of image_filters.cl over earlier nodes; returns its node index
+    int AddStage(const std::string& kernel_name, std::vector<int> inputs, std::vector<float> parameters = {});
+    int AddGaussian(GaussianFilter& filter, int input);
+
+    // Build a graph from a comma separated list of stages, e.g. "blur,sharpen,edge,grayscale"
+    bool Parse(const std::string& spec, GaussianFilter& filter);
+
+    // Mark the node whose result is written to the output image (the last node by default)
+    void SetOutput(int node);
+
+    // Plan the intermediate images from the live range of every node
+    bool Compile();
+
+    cl_int Enqueue(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_event* event = NULL);
+
+    int GetStageCount() const;
+    int GetIntermediateCount() const;
+
+private:
+    struct Node
+    {
+        std::string name;
+        cl_kernel kernel;
+        GaussianFilter* gaussian;
+        std::vector<int> inputs;
+        std::vector<float> parameters;
+
+        // Results of Compile(): whether the node contributes to the output, the index of
+        // the last node reading its result, and the intermediate image it writes to
+        bool live;
+        int last_use;
+        int slot;
+    };
+
+    cl_kernel getKernel(const std::string& kernel_name);
+    bool allocateIntermediates(int width, int height);
+    void releaseIntermediates();
+
+    Controller& m_controller;
+    cl_context m_context;
+    cl_program m_program;
+    cl_sampler m_sampler;
+
+    std::vector<Node> m_nodes;
+    std::map<std::string, cl_kernel> m_kernels;
+    int m_output;
+    bool m_compiled;
+
+    int m_slot_count;
+    std::vector<cl_mem> m_intermediates;
+    int m_intermediate_width, m_intermediate_height;
+};
+
+#endif // FILTERGRAPH_H
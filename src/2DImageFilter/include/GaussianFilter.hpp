@@ -0,0 +1,112 @@
+#ifndef GAUSSIANFILTER_H
+#define GAUSSIANFILTER_H
+
+#include <CL/cl.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Controller.hpp>
+
+enum class FilterAlgorithm {
+    GAUSSIAN_3X3,       // Original hard-coded 3x3 kernel
+    GAUSSIAN_2D,        // Direct (2r+1)x(2r+1) kernel
+    SEPARABLE,          // Horizontal pass followed by a vertical pass
+    TILED,              // RGBA8 buffers, neighbourhood staged through __local memory
+    RECURSIVE           // Young-van Vliet recursive filter, constant cost per pixel for any sigma
+};
+
+enum class FilterPrecision {
+    FLOAT,              // float4 arithmetic (and a CL_FLOAT separable intermediate)
+    HALF,               // half4 arithmetic for 3x3 (cl_khr_fp16), CL_HALF_FLOAT separable intermediate, half recursive buffers
+    INTEGER,            // ushort4 arithmetic on RGBA8 buffers for 3x3
+    AUTO                // Fastest variant the device supports that passes the PSNR check
+};
+
+class GaussianFilter
+{
+public:
+    GaussianFilter(Controller& controller, cl_context context, cl_device_id device, cl_program program);
+    ~GaussianFilter();
+
+    static std::vector<float> ComputeWeights(int radius, float sigma);
+    static bool ParseAlgorithm(const std::string& name, FilterAlgorithm& algorithm);
+    static std::string AlgorithmName(FilterAlgorithm algorithm);
+    static bool ParsePrecision(const std::string& name, FilterPrecision& precision);
+    static std::string PrecisionName(FilterPrecision precision);
+
+    // Young-van Vliet coefficients (B, b1/b0, b2/b0, b3/b0) and the Triggs-Sdika boundary matrix (s0-s8)
+    static void RecursiveCoefficients(float sigma, cl_float4& coefficients, cl_float16& boundary);
+
+    bool SetParameters(int radius, float sigma);
+    void SetAlgorithm(FilterAlgorithm algorithm);
+
+    // Reduced precision variants exist for 3x3 (half, integer), separable (half) and recursive (half)
+    bool SupportsPrecision(FilterPrecision precision) const;
+    bool SetPrecision(FilterPrecision precision);
+
+    // Time every supported variant on a test pattern and keep the fastest one within MIN_PSNR of float
+    FilterPrecision SelectPrecision(cl_command_queue queue, bool allow_buffers = true);
+
+    // Run a variant on a noise test pattern, returning its average time and PSNR against the float path
+    bool CompareVariant(cl_command_queue queue, FilterPrecision precision, int width, int height, int iterations, double& time_ms, double& psnr);
+
+    // Same, but the PSNR is measured against the direct (separable, float) Gaussian of the same radius and sigma
+    bool CompareDirect(cl_command_queue queue, FilterPrecision precision, int width, int height, int iterations, double& time_ms, double& psnr);
+
+    int GetRadius() const;
+    float GetSigma() const;
+    FilterAlgorithm GetAlgorithm() const;
+    FilterPrecision GetPrecision() const;
+
+    // The tiled algorithm and the integer 3x3 variant read and write RGBA8 buffers instead of images,
+    // every other path also filters single channel (CL_R) images
+    bool UsesBuffers() const;
+
+    cl_int Enqueue(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_event* event = NULL);
+
+private:
+    cl_int enqueueKernel(cl_command_queue queue, cl_kernel kernel, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events, const cl_event* wait_list, cl_event* event);
+    cl_int enqueueTiled(cl_command_queue queue, cl_mem src_buffer, cl_mem dst_buffer, int width, int height, cl_uint num_events, const cl_event* wait_list, cl_event* event);
+    cl_int enqueueRecursive(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events, const cl_event* wait_list, cl_event* event);
+    bool createIntermediateImage(int width, int height, cl_channel_order order);
+    bool createRecursiveBuffers(size_t size);
+    static std::vector<unsigned char> testPattern(int width, int height);
+    bool runVariant(cl_command_queue queue, FilterPrecision precision, const std::vector<unsigned char>& input, std::vector<unsigned char>& output, int width, int height, int iterations, double& time_ms);
+    FilterPrecision activePrecision() const;
+
+    cl_context m_context;
+    cl_device_id m_device;
+
+    cl_kernel m_kernel_3x3;
+    cl_kernel m_kernel_2d;
+    cl_kernel m_kernel_horizontal;
+    cl_kernel m_kernel_vertical;
+    cl_kernel m_kernel_tiled;
+    cl_kernel m_kernel_uchar;
+    cl_kernel m_kernel_half;
+    cl_kernel m_kernel_recursive;
+    cl_kernel m_kernel_recursive_transpose;
+    cl_kernel m_kernel_recursive_transposed;
+    cl_sampler m_sampler;
+
+    cl_mem m_weights;
+    cl_mem m_intermediate;
+    int m_intermediate_width, m_intermediate_height;
+    cl_channel_type m_intermediate_type;
+    cl_channel_order m_intermediate_order;
+    bool m_half_images;
+
+    // Column pass output and its transpose for the recursive filter
+    cl_mem m_recursive_buffers[2];
+    size_t m_recursive_size;
+    cl_float4 m_recursive_coefficients;
+    cl_float16 m_recursive_boundary;
+
+    FilterAlgorithm m_algorithm;
+    FilterPrecision m_precision;
+    int m_radius;
+    float m_sigma;
+};
+
+#endif // GAUSSIANFILTER_H
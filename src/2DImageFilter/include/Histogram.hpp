@@ -0,0 +1,48 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <CL/cl.h>
+#include <iostream>
+#include <vector>
+
+#include <Controller.hpp>
+
+class Histogram
+{
+public:
+    // Must match HISTOGRAM_BINS and HISTOGRAM_CHANNELS in histogram.cl
+    static const int BINS = 256;
+    static const int CHANNELS = 4;
+
+    Histogram(Controller& controller, cl_context context, cl_device_id device, cl_program program);
+    ~Histogram();
+
+    // Work-items per group of the histogram kernel, 0 selects the largest the kernel allows
+    bool SetGroupSize(size_t group_size);
+    size_t GetGroupSize() const;
+    size_t GetMaxGroupSize() const;
+
+    // Accumulate the channel histograms of src_image into the device bins, channel-major
+    cl_int Enqueue(cl_command_queue queue, cl_mem src_image, int width, int height, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_event* event = NULL);
+
+    // Histogram, lookup table and remap in three launches without reading anything back
+    cl_int Equalize(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_event* event = NULL);
+
+    // Blocking read of the bins of the last Enqueue
+    bool Read(cl_command_queue queue, std::vector<cl_uint>& bins) const;
+
+private:
+    cl_kernel m_kernel_histogram;
+    cl_kernel m_kernel_lut;
+    cl_kernel m_kernel_apply;
+    cl_sampler m_sampler;
+
+    cl_mem m_bins;
+    cl_mem m_lut;
+
+    size_t m_group_size, m_max_group_size;
+    size_t m_lut_group_size;
+    cl_uint m_compute_units;
+};
+
+#endif // HISTOGRAM_H
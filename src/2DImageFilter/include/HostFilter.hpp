@@ -0,0 +1,45 @@
+#ifndef HOSTFILTER_H
+#define HOSTFILTER_H
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GaussianFilter.hpp>
+#include <ThreadPool.hpp>
+
+enum class HostInstructionSet {
+    SCALAR,
+    SSE41,
+    AVX2
+};
+
+class HostFilter
+{
+public:
+    explicit HostFilter(int threads = 0);
+
+    // Weights of the device filter: the binomial 1 2 1 kernel for 3x3, sampled Gaussian otherwise
+    static std::vector<float> Weights(FilterAlgorithm algorithm, int radius, float sigma);
+
+    // Separable float convolution of tightly packed 32-bit pixels with edge clamping, rounded like write_imagef
+    void Apply(const char* input, char* output, int width, int height, const std::vector<float>& weights);
+    void Apply(const char* input, char* output, int width, int height, FilterAlgorithm algorithm, int radius, float sigma);
+
+    static HostInstructionSet DetectInstructionSet();
+    static std::string InstructionSetName(HostInstructionSet instruction_set);
+
+    // Restrict the code path, e.g. to benchmark the scalar fallback on an AVX2 machine
+    bool SetInstructionSet(HostInstructionSet instruction_set);
+    HostInstructionSet GetInstructionSet() const;
+    int GetThreadCount() const;
+
+private:
+    void filterRows(const uint8_t* input, uint8_t* output, int width, int height, const std::vector<float>& weights, int begin, int end);
+
+    ThreadPool m_pool;
+    HostInstructionSet m_instruction_set;
+};
+
+#endif // HOSTFILTER_H
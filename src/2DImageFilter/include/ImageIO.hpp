@@ -0,0 +1,54 @@
+#ifndef IMAGEIO_H
+#define IMAGEIO_H
+
+#include <CL/cl.h>
+#include <FreeImage.h>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+enum class IngestMode {
+    COPY,               // Decode into host memory and copy it with CL_MEM_COPY_HOST_PTR
+    HOST_PTR,           // Wrap the decoded pixels with CL_MEM_USE_HOST_PTR
+    MAPPED              // Decode straight into a mapped CL_MEM_ALLOC_HOST_PTR object
+};
+
+class ImageIO
+{
+public:
+    // Decode an image file into tightly packed 32-bit pixels (FreeImage's bottom-up BGRA layout)
+    static bool Decode(const std::string& filename, std::vector<char>& pixels, int& width, int& height);
+
+    // Encode 32-bit pixels with the given row pitch, converting to 24-bit for formats that need it
+    static bool Encode(const std::string& filename, const char* pixels, int width, int height, int pitch);
+
+    // Encode 8-bit gray pixels, converting to 24-bit for formats without a gray mode
+    static bool EncodeGray(const std::string& filename, const char* pixels, int width, int height, int pitch);
+
+    // Decode an image file into an RGBA8 OpenCL image (or buffer) using the given ingest path
+    static cl_mem LoadImage(cl_context context, cl_command_queue queue, const std::string& filename, int& width, int& height, IngestMode mode, bool as_buffer = false);
+
+    // Read the dimensions from the file header without decoding the pixels where the format allows it
+    static bool ReadDimensions(const std::string& filename, int& width, int& height);
+
+    static bool IsSupported(const std::string& filename);
+
+    // Peak signal-to-noise ratio in dB between two 8-bit images, infinite when they are identical
+    static double PSNR(const unsigned char* reference, const unsigned char* test, size_t size);
+
+    // Page-aligned host memory for CL_MEM_USE_HOST_PTR objects
+    static void* AllocateAligned(size_t size);
+    static void FreeAligned(void* pointer);
+
+    static bool ParseIngestMode(const std::string& name, IngestMode& mode);
+    static std::string IngestModeName(IngestMode mode);
+
+private:
+    static FIBITMAP* load(const std::string& filename);
+    static bool writePixels(FIBITMAP* image, char* target, size_t pitch);
+
+    static void CL_CALLBACK releaseHostMemory(cl_mem memobj, void* user_data);
+};
+
+#endif // IMAGEIO_H
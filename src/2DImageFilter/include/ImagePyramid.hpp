@@ -0,0 +1,58 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <CL/cl.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Controller.hpp>
+
+class ImagePyramid
+{
+public:
+    ImagePyramid(Controller& controller, cl_context context, cl_device_id device, cl_program program);
+    ~ImagePyramid();
+
+    // Blur and decimate src_image down to 1x1, the levels stay on the device until the next Build
+    bool Build(cl_mem src_image, int width, int height);
+
+    // Level 0 is the source image, which the pyramid does not own
+    int GetLevelCount() const;
+    cl_mem GetLevel(int level) const;
+    void GetLevelSize(int level, int& width, int& height) const;
+
+    // Time of every launch and the bytes it read and wrote
+    void DisplayStatistics() const;
+
+    // Read a level into tightly packed 32-bit pixels
+    bool ReadLevel(int level, std::vector<char>& pixels) const;
+
+private:
+    struct Level
+    {
+        cl_mem image;
+        int width, height;
+
+        // Levels built by the same launch share its time, `first` marks the level that reports it
+        double time_ms;
+        size_t bytes;
+        bool first;
+    };
+
+    bool allocate(int width, int height);
+    void releaseLevels();
+
+    cl_context m_context;
+    cl_command_queue m_queue;
+    cl_kernel m_kernel_reduce;
+    cl_kernel m_kernel_tail;
+    cl_sampler m_sampler;
+    cl_mem m_placeholder;
+    size_t m_tail_group_size;
+
+    std::vector<Level> m_levels;
+};
+
+#endif // IMAGEPYRAMID_H
@@ -0,0 +1,51 @@
+#ifndef INTEGRALIMAGE_H
+#define INTEGRALIMAGE_H
+
+#include <CL/cl.h>
+#include <iostream>
+#include <vector>
+
+#include <Controller.hpp>
+
+class IntegralImage
+{
+public:
+    static const int BOX_PASSES = 3;
+
+    IntegralImage(Controller& controller, cl_context context, cl_device_id device, cl_program program);
+    ~IntegralImage();
+
+    // Radii of `passes` stacked box filters whose combined variance matches a Gaussian of sigma
+    static std::vector<int> BoxRadii(float sigma, int passes = BOX_PASSES);
+
+    bool SetSigma(float sigma);
+    float GetSigma() const;
+    std::vector<int> GetRadii() const;
+
+    // Build the summed-area table of src_image and write its (2r+1)x(2r+1) box mean to dst_image
+    cl_int EnqueueBox(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, int radius);
+
+    // Approximate Gaussian blur, the work per pixel does not depend on sigma
+    cl_int Enqueue(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height);
+
+private:
+    bool reserve(int width, int height);
+
+    cl_context m_context;
+    cl_device_id m_device;
+
+    cl_kernel m_kernel_rows;
+    cl_kernel m_kernel_columns;
+    cl_kernel m_kernel_box;
+    size_t m_rows_group_size;
+
+    // uint4 table and the images between box passes
+    cl_mem m_sat;
+    cl_mem m_intermediate[2];
+    int m_width, m_height;
+
+    float m_sigma;
+    std::vector<int> m_radii;
+};
+
+#endif // INTEGRALIMAGE_H
@@ -0,0 +1,81 @@
+#ifndef KERNELFUSION_H
+#define KERNELFUSION_H
+
+#include <CL/cl.h>
+#include <array>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Controller.hpp>
+
+enum class FusedOperation {
+    GAIN,               // Multiply the colour channels
+    GAMMA,              // Gamma encode the colour channels: c^(1/gamma)
+    COLOR_MATRIX,       // 3x3 matrix over (r, g, b)
+    THRESHOLD,          // Binarise on luminance
+    GAUSSIAN            // Stencil: (2r+1)x(2r+1) Gaussian, point-wise operations before it run on every tap
+};
+
+class KernelFusion
+{
+public:
+    struct Operation
+    {
+        FusedOperation type;
+        std::vector<float> parameters;
+    };
+
+    KernelFusion(Controller& controller, cl_context context, cl_device_id device);
+    ~KernelFusion();
+
+    void AddGain(float gain);
+    void AddGamma(float gamma);
+    void AddColorMatrix(const std::array<float, 9>& matrix);
+    void AddThreshold(float threshold);
+    bool AddGaussian(int radius, float sigma);
+
+    // Build the sequence from a comma separated list, e.g. "gain:1.2,blur,gamma:2.2,threshold:0.5"
+    bool Parse(const std::string& spec, int radius, float sigma);
+
+    // OpenCL C source of a single kernel applying the whole sequence in one read/write pass
+    std::string GenerateSource() const;
+
+    bool Build();
+    cl_int Enqueue(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_event* event = NULL);
+
+    // Run every operation as its own kernel, as a baseline for the fused kernel
+    cl_int EnqueueUnfused(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height);
+
+    // Full image passes the sequence would take without fusion
+    int GetPassCount() const;
+    std::string Describe() const;
+
+private:
+    static std::string generateSource(const std::vector<Operation>& operations);
+    static std::string generateOperation(const Operation& operation);
+    static std::string literal(float value);
+
+    cl_kernel buildKernel(const std::vector<Operation>& operations, cl_program& program);
+    cl_int enqueueKernel(cl_command_queue queue, cl_kernel kernel, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events, const cl_event* wait_list, cl_event* event);
+    void release();
+
+    Controller& m_controller;
+    cl_context m_context;
+    cl_device_id m_device;
+    cl_sampler m_sampler;
+
+    std::vector<Operation> m_operations;
+    bool m_built;
+
+    cl_program m_program;
+    cl_kernel m_kernel;
+
+    // One program per operation for the unfused baseline, built on first use
+    std::vector<cl_program> m_pass_programs;
+    std::vector<cl_kernel> m_pass_kernels;
+    cl_mem m_intermediates[2];
+    int m_intermediate_width, m_intermediate_height;
+};
+
+#endif // KERNELFUSION_H
@@ -0,0 +1,100 @@
+#ifndef MEMORYPOOL_H
+#define MEMORYPOOL_H
+
+#include <CL/cl.h>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+
+class MemoryPool;
+
+// Move-only handle to a pooled memory object, which goes back to its pool instead of being released
+class MemoryLease
+{
+public:
+    MemoryLease();
+    MemoryLease(MemoryLease&& other);
+    MemoryLease& operator=(MemoryLease&& other);
+    ~MemoryLease();
+
+    MemoryLease(const MemoryLease&) = delete;
+    MemoryLease& operator=(const MemoryLease&) = delete;
+
+    cl_mem Get() const;
+    explicit operator bool() const;
+
+    // Return the object to the pool now
+    void Reset();
+
+private:
+    friend class MemoryPool;
+    MemoryLease(MemoryPool* pool, cl_mem object);
+
+    MemoryPool* m_pool;
+    cl_mem m_object;
+};
+
+// Idle images and buffers of one context, keyed by (channel order, data type, width, height, flags).
+// Buffers use a zero format and their size as the width. The pool must outlive its leases.
+class MemoryPool
+{
+public:
+    static const size_t DEFAULT_CAPACITY = 256 * 1024 * 1024;
+
+    explicit MemoryPool(cl_context context, size_t capacity = DEFAULT_CAPACITY);
+    ~MemoryPool();
+
+    // Objects that wrap host memory cannot be shared, flags with CL_MEM_USE_HOST_PTR or CL_MEM_COPY_HOST_PTR fail
+    MemoryLease AcquireImage(cl_mem_flags flags, const cl_image_format& format, int width, int height, cl_int* err_num = NULL);
+    MemoryLease AcquireBuffer(cl_mem_flags flags, size_t size, cl_int* err_num = NULL);
+
+    // Bytes the pool may hold in leased and idle objects before least recently used idle ones are released
+    void SetCapacity(size_t capacity);
+    size_t GetCapacity() const;
+
+    // Release idle objects, least recently used first, until at most `bytes` are idle
+    void Trim(size_t bytes = 0);
+
+    size_t GetHits() const;
+    size_t GetMisses() const;
+    size_t GetIdleBytes() const;
+    size_t GetLeasedBytes() const;
+
+    void DisplayStatistics() const;
+
+private:
+    friend class MemoryLease;
+
+    typedef std::tuple<cl_channel_order, cl_channel_type, size_t, size_t, cl_mem_flags> Key;
+
+    struct Entry
+    {
+        cl_mem object;
+        Key key;
+        size_t bytes;
+    };
+
+    MemoryLease acquire(const Key& key, size_t bytes, cl_int* err_num);
+    void release(cl_mem object);
+    void trim(size_t idle_bytes);
+
+    cl_context m_context;
+    size_t m_capacity;
+
+    // Idle objects with the most recently returned at the front, and the same objects by key
+    std::list<Entry> m_idle;
+    std::multimap<Key, std::list<Entry>::iterator> m_index;
+
+    // Leased objects and how to file them when they come back
+    std::map<cl_mem, Entry> m_leased;
+
+    size_t m_idle_bytes, m_leased_bytes;
+    size_t m_hits, m_misses;
+    mutable std::mutex m_mutex;
+};
+
+#endif // MEMORYPOOL_H
@@ -0,0 +1,68 @@
+#ifndef MULTIDEVICEPROCESSOR_H
+#define MULTIDEVICEPROCESSOR_H
+
+#include <CL/cl.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <Controller.hpp>
+#include <GaussianFilter.hpp>
+#include <MemoryPool.hpp>
+
+// Filters one image on every device of a context at once. The image is split into horizontal bands,
+// one per device and sized by its measured throughput, and each band is uploaded with halo rows so
+// that the stitched result matches filtering the whole image on one device.
+class MultiDeviceProcessor
+{
+public:
+    // Every device gets its own queue, program and filter configured like `filter`
+    MultiDeviceProcessor(Controller& controller, cl_context context, const std::vector<cl_device_id>& devices, const GaussianFilter& filter);
+    ~MultiDeviceProcessor();
+
+    int GetDeviceCount() const;
+
+    // Time every device on a band of the image width and size the bands by the rows each filters per millisecond
+    bool Calibrate(int width, int height);
+
+    // Filter a host image of 32-bit pixels, all bands run concurrently and are read straight into `output`
+    bool Process(const std::vector<char>& input, std::vector<char>& output, int width, int height);
+
+    void DisplayStatistics() const;
+
+private:
+    struct Band
+    {
+        cl_device_id device;
+        std::string name;
+        cl_command_queue queue;
+        cl_program program;
+        std::unique_ptr<GaussianFilter> filter;
+
+        double rows_per_ms;
+
+        // Output rows of the band and the rows uploaded with the halo
+        int y0, rows;
+        int src_y0, src_rows;
+
+        MemoryLease src, dst;
+        cl_event upload, readback;
+        double time_ms;
+    };
+
+    void partition(int height);
+    cl_int enqueueBand(Band& band, const std::vector<char>& input, std::vector<char>& output, int width);
+    void releaseEvents(Band& band);
+
+    cl_context m_context;
+    MemoryPool& m_pool;
+    std::vector<Band> m_bands;
+
+    int m_halo;
+    double m_total_ms;
+};
+
+#endif // MULTIDEVICEPROCESSOR_H
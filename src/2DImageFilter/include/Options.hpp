@@ -0,0 +1,72 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <iostream>
+#include <string>
+
+#include <CommandScheduler.hpp>
+#include <GaussianFilter.hpp>
+#include <ImageIO.hpp>
+#include <PlanarConverter.hpp>
+#include <Readback.hpp>
+#include <Resizer.hpp>
+#include <StreamProcessor.hpp>
+
+class Options
+{
+public:
+    Options();
+
+    bool Parse(int argc, char** argv);
+    void PrintUsage(const char* program);
+
+    std::string input;
+    std::string output;
+
+    FilterAlgorithm algorithm;
+    FilterPrecision precision;
+    int radius;
+    float sigma;
+
+    bool benchmark;
+    int benchmark_iterations;
+
+    std::string batch_dir;
+    std::string output_dir;
+    int batch_depth;
+    QueueMode queue_mode;
+
+    int tile_size;
+    bool multi_device;
+    IngestMode ingest;
+    ReadbackStrategy readback;
+
+    std::string graph;
+    std::string fuse;
+    bool box;
+    bool pyramid;
+    bool equalize;
+    PlaneMode planes;
+
+    std::string thumbnails;
+    ResizeMethod resize_method;
+
+    bool host;
+    bool verify;
+    int threads;
+
+    bool stream;
+    StreamFormat stream_format;
+    int stream_width, stream_height;
+
+    std::string regression_dir;
+    bool update_baseline;
+
+    int pool_mb;
+
+    std::string serve_socket;
+    std::string client_socket;
+    bool stop;
+};
+
+#endif // OPTIONS_H
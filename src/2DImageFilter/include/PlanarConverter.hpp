@@ -0,0 +1,69 @@
+#ifndef PLANARCONVERTER_H
+#define PLANARCONVERTER_H
+
+#include <CL/cl.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Controller.hpp>
+#include <GaussianFilter.hpp>
+
+enum class PlaneMode {
+    RGBA,               // Filter the RGBA8 image as is
+    GRAY,               // Filter a single gray plane and keep the result gray
+    LUMA                // Filter the Y plane of full-range Y'CbCr planes, the chroma is left untouched
+};
+
+class PlanarConverter
+{
+public:
+    PlanarConverter(Controller& controller, cl_context context, cl_program program);
+    ~PlanarConverter();
+
+    static bool ParseMode(const std::string& name, PlaneMode& mode);
+    static std::string ModeName(PlaneMode mode);
+
+    // Single channel CL_R / CL_UNORM_INT8 image
+    static cl_mem CreatePlane(cl_context context, int width, int height, cl_int* err_num);
+
+    // Allocate the planes of a mode, RGBA needs none
+    bool SetMode(PlaneMode mode, int width, int height);
+    PlaneMode GetMode() const;
+
+    // Split src_image into the planes of the mode: gray, or Y, Cb and Cr
+    cl_int Split(cl_command_queue queue, cl_mem src_image, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_event* event = NULL);
+
+    // Rebuild an RGBA image from a filtered gray or luma plane and the chroma planes of the last Split
+    cl_int Merge(cl_command_queue queue, cl_mem plane, cl_mem dst_image, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_event* event = NULL);
+
+    // Split, filter the first plane into the filtered plane and merge into dst_image unless it is 0
+    cl_int Enqueue(cl_command_queue queue, GaussianFilter& filter, cl_mem src_image, cl_mem dst_image, int width, int height);
+
+    // First plane of the last Split and the filter output of the last Enqueue
+    cl_mem GetPlane() const;
+    cl_mem GetFilteredPlane() const;
+
+    // Blocking read of a plane into tightly packed 8-bit pixels
+    bool ReadPlane(cl_command_queue queue, cl_mem plane, std::vector<char>& pixels) const;
+
+private:
+    cl_int enqueueKernel(cl_command_queue queue, cl_kernel kernel, const std::vector<cl_mem>& images, cl_uint num_events, const cl_event* wait_list, cl_event* event);
+    void releasePlanes();
+
+    cl_context m_context;
+    cl_kernel m_kernel_gray;
+    cl_kernel m_kernel_planes;
+    cl_kernel m_kernel_merge;
+    cl_kernel m_kernel_gray_merge;
+    cl_sampler m_sampler;
+
+    PlaneMode m_mode;
+    int m_width, m_height;
+
+    // Gray or Y, Cb, Cr, followed by the filtered plane
+    std::vector<cl_mem> m_planes;
+    cl_mem m_filtered;
+};
+
+#endif // PLANARCONVERTER_H
@@ -0,0 +1,58 @@
+#ifndef READBACK_H
+#define READBACK_H
+
+#include <CL/cl.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <ImageIO.hpp>
+
+enum class ReadbackStrategy {
+    READ,               // clEnqueueReadImage into host memory
+    MAP,                // clEnqueueMapImage of a device-allocated image
+    HOST_PTR,           // clEnqueueMapImage of a CL_MEM_USE_HOST_PTR image
+    AUTO                // Probe the strategies and pick the fastest
+};
+
+class Readback
+{
+public:
+    Readback(cl_context context, cl_command_queue queue, ReadbackStrategy strategy, bool as_buffer = false);
+
+    // Resolve AUTO by probing every strategy for this device and output size
+    ReadbackStrategy Select(int width, int height);
+
+    // Create an output object suited to the selected strategy
+    cl_mem CreateOutput(int width, int height, cl_int* err_num);
+
+    // Make the output pixels available on the host; `row_pitch` is the pitch of the returned pixels
+    char* Acquire(cl_mem output, int width, int height, size_t& row_pitch, cl_int* err_num);
+    cl_int Release(cl_mem output, char* pixels);
+
+    // Achieved readback bandwidth in GB/s of a strategy for this output size
+    double MeasureBandwidth(ReadbackStrategy strategy, int width, int height, int iterations);
+
+    ReadbackStrategy GetStrategy() const;
+
+    static bool ParseStrategy(const std::string& name, ReadbackStrategy& strategy);
+    static std::string StrategyName(ReadbackStrategy strategy);
+
+private:
+    static void CL_CALLBACK releaseHostMemory(cl_mem memobj, void* user_data);
+
+    cl_context m_context;
+    cl_command_queue m_queue;
+    ReadbackStrategy m_strategy;
+    bool m_as_buffer;
+    std::vector<char> m_host;
+
+    // Probe results per (device, width, height) shared by every Readback of the process
+    static std::map<std::tuple<cl_device_id, int, int, bool>, ReadbackStrategy> s_probed;
+};
+
+#endif // READBACK_H
@@ -0,0 +1,61 @@
+#ifndef REGRESSIONHARNESS_H
+#define REGRESSIONHARNESS_H
+
+#include <CL/cl.h>
+#include <chrono>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Controller.hpp>
+#include <GaussianFilter.hpp>
+#include <HostFilter.hpp>
+#include <ImageIO.hpp>
+
+class RegressionHarness
+{
+public:
+    RegressionHarness(Controller& controller, cl_context context, cl_device_id device, GaussianFilter& filter, HostFilter& host);
+    ~RegressionHarness();
+
+    // Filter the synthetic corpus in `directory`, compare with the golden images and the timing baseline.
+    // `update` regenerates the golden images from the host filter and saves the timings as the new baseline
+    bool Run(const std::string& directory, bool update);
+
+private:
+    struct Case
+    {
+        std::string name;
+        std::string corpus;
+        FilterAlgorithm algorithm;
+        int radius;
+    };
+
+    // Best time in milliseconds of each stage and the comparison with the golden image
+    struct Result
+    {
+        std::map<std::string, double> stages;
+        double psnr;
+        int max_error;
+        bool passed;
+    };
+
+    typedef std::map<std::string, std::map<std::string, double>> Timings;
+
+    bool createCorpus(const std::string& directory, std::vector<Case>& cases);
+    bool runCase(const Case& testcase, const std::string& directory, bool update, Result& result);
+    bool runStages(const std::vector<char>& input, std::vector<char>& output, int width, int height, std::map<std::string, double>& stages);
+    bool writeTimings(const std::string& filename, const std::map<std::string, Result>& results);
+    static bool readTimings(const std::string& filename, Timings& timings);
+
+    cl_context m_context;
+    cl_device_id m_device;
+    cl_command_queue m_queue;
+    GaussianFilter& m_filter;
+    HostFilter& m_host;
+};
+
+#endif // REGRESSIONHARNESS_H
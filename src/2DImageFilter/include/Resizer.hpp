@@ -0,0 +1,67 @@
+#ifndef RESIZER_H
+#define RESIZER_H
+
+#include <CL/cl.h>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Controller.hpp>
+
+enum class ResizeMethod {
+    LINEAR,             // One bilinear read per pixel through a CL_FILTER_LINEAR sampler
+    AREA,               // Coverage-weighted average of every source pixel under the output pixel
+    AUTO                // Area beyond AREA_THRESHOLD reduction in either direction, linear otherwise
+};
+
+class Resizer
+{
+public:
+    Resizer(Controller& controller, cl_context context, cl_program program);
+    ~Resizer();
+
+    static bool ParseMethod(const std::string& name, ResizeMethod& method);
+    static std::string MethodName(ResizeMethod method);
+
+    // Comma separated list of WxH sizes, or of single numbers for the longest side keeping the aspect ratio
+    static bool ParseSizes(const std::string& list, std::vector<std::pair<int, int>>& sizes);
+    static std::pair<int, int> FitSize(const std::pair<int, int>& size, int width, int height);
+
+    // Method AUTO picks for a reduction from the source to the output size
+    static ResizeMethod SelectMethod(int src_width, int src_height, int dst_width, int dst_height);
+
+    void SetMethod(ResizeMethod method);
+    ResizeMethod GetMethod() const;
+
+    cl_int Enqueue(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int src_width, int src_height, int dst_width, int dst_height, cl_uint num_events = 0, const cl_event* wait_list = NULL, cl_event* event = NULL);
+
+    // Enqueue every output size from the same source image back to back, the outputs stay on the device
+    bool Resize(cl_command_queue queue, cl_mem src_image, int width, int height, const std::vector<std::pair<int, int>>& sizes);
+
+    int GetOutputCount() const;
+    void GetOutputSize(int index, int& width, int& height) const;
+
+    // Read every output with one wait, into tightly packed 32-bit pixels
+    bool ReadOutputs(cl_command_queue queue, std::vector<std::vector<char>>& outputs) const;
+
+private:
+    struct Output
+    {
+        cl_mem image;
+        int width, height;
+    };
+
+    void releaseOutputs();
+
+    cl_context m_context;
+    cl_kernel m_kernel_linear;
+    cl_kernel m_kernel_area;
+    cl_sampler m_sampler_linear;
+    cl_sampler m_sampler_nearest;
+    ResizeMethod m_method;
+
+    std::vector<Output> m_outputs;
+};
+
+#endif // RESIZER_H
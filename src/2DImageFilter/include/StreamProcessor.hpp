@@ -0,0 +1,68 @@
+#ifndef STREAMPROCESSOR_H
+#define STREAMPROCESSOR_H
+
+#include <CL/cl.h>
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <Controller.hpp>
+#include <GaussianFilter.hpp>
+
+enum class StreamFormat {
+    RAW_RGBA,           // Headerless frames of width * height * 4 bytes
+    Y4M                 // YUV4MPEG2 with 4:2:0 or 4:4:4 planar frames
+};
+
+class StreamProcessor
+{
+public:
+    StreamProcessor(Controller& controller, cl_context context, cl_device_id device, cl_command_queue queue, GaussianFilter& filter);
+    ~StreamProcessor();
+
+    // Filter every frame of `input` into `output`, "-" selects stdin/stdout; raw frames need the size up-front
+    bool Run(const std::string& input, const std::string& output, StreamFormat format, int width, int height);
+
+    static bool ParseFormat(const std::string& name, StreamFormat& format);
+    static std::string FormatName(StreamFormat format);
+
+private:
+    // Host side of one frame in flight: the device works on one frame while the next is read
+    struct Slot
+    {
+        std::vector<char> input;
+        std::vector<char> output;
+        cl_event done;
+        std::chrono::high_resolution_clock::time_point start;
+        bool busy;
+    };
+
+    bool readHeader(FILE* input, std::string& header, int& width, int& height, int& chroma_shift);
+    bool readFrame(FILE* input, std::vector<char>& frame);
+    bool allocate(int width, int height, size_t frame_size);
+    bool submit(Slot& slot, int width, int height);
+    bool complete(Slot& slot, FILE* output);
+    void displayStatistics(int frames, double wall_ms);
+
+    cl_context m_context;
+    cl_command_queue m_queue;
+    GaussianFilter& m_filter;
+
+    cl_program m_program;
+    cl_kernel m_kernel_to_rgba;
+    cl_kernel m_kernel_to_yuv;
+    cl_sampler m_sampler;
+
+    // Device objects live for the whole stream, the in-order queue serialises their reuse
+    cl_mem m_src, m_dst;
+    cl_mem m_frame_in, m_frame_out;
+
+    StreamFormat m_format;
+    int m_chroma_shift;
+    std::vector<double> m_latencies;
+};
+
+#endif // STREAMPROCESSOR_H
@@ -0,0 +1,40 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool
+{
+public:
+    // Zero threads uses one worker per hardware thread
+    explicit ThreadPool(int threads = 0);
+    ~ThreadPool();
+
+    int GetThreadCount() const;
+
+    // Split [0, count) into one contiguous range per worker and return once every range is done
+    void ParallelFor(int count, const std::function<void(int begin, int end)>& function);
+
+    // Run a task on a worker without waiting for it, the future reports its end (and rethrows what it threw)
+    std::future<void> Submit(std::function<void()> task);
+
+private:
+    void worker();
+
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_task_available;
+    // Signalled whenever a range of ParallelFor ends
+    std::condition_variable m_tasks_done;
+    bool m_stop;
+};
+
+#endif // THREADPOOL_H
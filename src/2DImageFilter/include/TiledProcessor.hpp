@@ -0,0 +1,51 @@
+#ifndef TILEDPROCESSOR_H
+#define TILEDPROCESSOR_H
+
+#include <CL/cl.h>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include <Controller.hpp>
+#include <GaussianFilter.hpp>
+
+class TiledProcessor
+{
+public:
+    TiledProcessor(Controller& controller, cl_context context, cl_device_id device, GaussianFilter& filter, int max_tile_size = 0, int pool_size = 2);
+    ~TiledProcessor();
+
+    // Whether an image of this size exceeds the device image or allocation limits
+    static bool NeedsTiling(cl_device_id device, int width, int height);
+
+    // Filter a host image of 32-bit pixels tile by tile, stitching the result into `output`
+    bool Process(const std::vector<char>& input, std::vector<char>& output, int width, int height);
+
+private:
+    // A device tile of the fixed pool with its host staging memory
+    struct Tile
+    {
+        std::vector<char> staging;
+        cl_mem src, dst;
+        cl_event readback;
+    };
+
+    bool computeTileSize(int width, int height);
+    bool allocatePool();
+    void pack(const std::vector<char>& input, int width, int height, int x0, int y0, Tile& tile);
+
+    cl_context m_context;
+    cl_device_id m_device;
+    cl_command_queue m_queue;
+    GaussianFilter& m_filter;
+
+    std::vector<Tile> m_pool;
+    int m_max_tile_size;
+
+    // Tile extent including the halo on every side
+    int m_tile_width, m_tile_height;
+    int m_halo;
+};
+
+#endif // TILEDPROCESSOR_H
@@ -0,0 +1,153 @@
+/* Colour space conversion between planar Y'CbCr frames and RGBA8 images.
+   Frames hold the Y plane followed by the Cb and Cr planes, which are
+   subsampled by 1 << chroma_shift in both directions (1 for 4:2:0, 0 for 4:4:4).
+   Conversions use BT.601 with studio swing (Y 16..235, Cb/Cr 16..240), the
+   default of Y4M streams.
+
+   Images hold (b, g, r, a) like the 32-bit FreeImage pixels of the rest of the
+   application. */
+
+__kernel void yuv_to_rgba(__global const uchar* frame,
+                          __write_only image2d_t dst_image,
+                          int chroma_shift,
+                          int width, int height)
+{
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(coord.x < width && coord.y < height){
+        int chroma_width = (width + (1 << chroma_shift) - 1) >> chroma_shift;
+        int chroma_height = (height + (1 << chroma_shift) - 1) >> chroma_shift;
+        int chroma_index = (coord.y >> chroma_shift) * chroma_width + (coord.x >> chroma_shift);
+
+        float y = 1.164f * ((float)frame[coord.y * width + coord.x] - 16.0f);
+        float cb = (float)frame[width * height + chroma_index] - 128.0f;
+        float cr = (float)frame[width * height + chroma_width * chroma_height + chroma_index] - 128.0f;
+
+        float4 colour = (float4)(y + 2.017f * cb,
+                                 y - 0.392f * cb - 0.813f * cr,
+                                 y + 1.596f * cr,
+                                 255.0f) / 255.0f;
+
+        write_imagef(dst_image, coord, clamp(colour, 0.0f, 1.0f));
+    }
+}
+
+__kernel void rgba_to_yuv(__read_only image2d_t src_image,
+                          sampler_t sampler,
+                          __global uchar* frame,
+                          int chroma_shift,
+                          int width, int height)
+{
+    // Every work-item produces one chroma sample and the luma samples it covers
+    int2 chroma_coord = (int2)(get_global_id(0), get_global_id(1));
+    int chroma_width = (width + (1 << chroma_shift) - 1) >> chroma_shift;
+    int chroma_height = (height + (1 << chroma_shift) - 1) >> chroma_shift;
+
+    if(chroma_coord.x < chroma_width && chroma_coord.y < chroma_height){
+        float cb = 0.0f, cr = 0.0f;
+        int samples = 0;
+
+        for(int dy = 0; dy < (1 << chroma_shift); dy++){
+            for(int dx = 0; dx < (1 << chroma_shift); dx++){
+                int2 coord = (chroma_coord << chroma_shift) + (int2)(dx, dy);
+                if(coord.x >= width || coord.y >= height)
+                    continue;
+
+                float4 colour = read_imagef(src_image, sampler, coord) * 255.0f;
+                float b = colour.x, g = colour.y, r = colour.z;
+
+                frame[coord.y * width + coord.x] = convert_uchar_sat_rte(16.0f + 0.257f * r + 0.504f * g + 0.098f * b);
+                cb += 128.0f - 0.148f * r - 0.291f * g + 0.439f * b;
+                cr += 128.0f + 0.439f * r - 0.368f * g - 0.071f * b;
+                samples++;
+            }
+        }
+
+        int chroma_index = chroma_coord.y * chroma_width + chroma_coord.x;
+        frame[width * height + chroma_index] = convert_uchar_sat_rte(cb / samples);
+        frame[width * height + chroma_width * chroma_height + chroma_index] = convert_uchar_sat_rte(cr / samples);
+    }
+}
+
+/* Planar CL_R images for filters that only need one channel. Unlike the
+   frames above these use full-range BT.601 (the JPEG convention), so a plane
+   holds every value a Y'CbCr image decoded from an 8-bit file can take and the
+   round trip does not clip. Gray is the luma plane on its own. */
+
+inline float4 luma_chroma(float4 colour)
+{
+    float b = colour.x, g = colour.y, r = colour.z;
+
+    return (float4)(0.299f * r + 0.587f * g + 0.114f * b,
+                    0.5f - 0.168736f * r - 0.331264f * g + 0.5f * b,
+                    0.5f + 0.5f * r - 0.418688f * g - 0.081312f * b,
+                    0.0f);
+}
+
+__kernel void rgba_to_gray(__read_only image2d_t src_image,
+                           __write_only image2d_t gray_plane,
+                           sampler_t sampler,
+                           int width, int height)
+{
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(coord.x < width && coord.y < height){
+        write_imagef(gray_plane, coord, luma_chroma(read_imagef(src_image, sampler, coord)).xxxx);
+    }
+}
+
+__kernel void rgba_to_planes(__read_only image2d_t src_image,
+                             __write_only image2d_t y_plane,
+                             __write_only image2d_t cb_plane,
+                             __write_only image2d_t cr_plane,
+                             sampler_t sampler,
+                             int width, int height)
+{
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(coord.x < width && coord.y < height){
+        float4 ycc = luma_chroma(read_imagef(src_image, sampler, coord));
+
+        write_imagef(y_plane, coord, ycc.xxxx);
+        write_imagef(cb_plane, coord, ycc.yyyy);
+        write_imagef(cr_plane, coord, ycc.zzzz);
+    }
+}
+
+// The filtered luma with the chroma of the source, alpha is opaque
+__kernel void planes_to_rgba(__read_only image2d_t y_plane,
+                             __read_only image2d_t cb_plane,
+                             __read_only image2d_t cr_plane,
+                             __write_only image2d_t dst_image,
+                             sampler_t sampler,
+                             int width, int height)
+{
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(coord.x < width && coord.y < height){
+        float y = read_imagef(y_plane, sampler, coord).x;
+        float cb = read_imagef(cb_plane, sampler, coord).x - 0.5f;
+        float cr = read_imagef(cr_plane, sampler, coord).x - 0.5f;
+
+        float4 colour = (float4)(y + 1.772f * cb,
+                                 y - 0.344136f * cb - 0.714136f * cr,
+                                 y + 1.402f * cr,
+                                 1.0f);
+
+        write_imagef(dst_image, coord, clamp(colour, 0.0f, 1.0f));
+    }
+}
+
+// Gray replicated into the colour channels
+__kernel void gray_to_rgba(__read_only image2d_t gray_plane,
+                           __write_only image2d_t dst_image,
+                           sampler_t sampler,
+                           int width, int height)
+{
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(coord.x < width && coord.y < height){
+        float gray = read_imagef(gray_plane, sampler, coord).x;
+        write_imagef(dst_image, coord, (float4)(gray, gray, gray, 1.0f));
+    }
+}
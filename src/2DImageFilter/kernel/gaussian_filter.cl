@@ -33,4 +33,305 @@ __kernel void gaussian_filter(__read_only image2d_t src_image,
         // Write output value to the image
         write_imagef(dst_image, out_image_coord, out_colour);
     }
-}
\ No newline at end of file
+}
+
+__kernel void gaussian_filter_uchar(__global const uchar4* src_buffer,
+                                    __global uchar4* dst_buffer,
+                                    int width, int height)
+{
+    /* Same 3x3 kernel as gaussian_filter in 16-bit integer arithmetic:
+       the weights sum to 16 and 255 * 16 fits into a ushort */
+    int2 out_coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(out_coord.x < width && out_coord.y < height){
+        int left = max(out_coord.x - 1, 0);
+        int right = min(out_coord.x + 1, width - 1);
+        ushort4 out_colour = (ushort4)(0);
+
+        // Go through the rows with weights 1 2 1, the centre row counts twice
+        for(int y = -1; y <= 1; y++){
+            int row = clamp(out_coord.y + y, 0, height - 1) * width;
+            ushort4 row_colour = convert_ushort4(src_buffer[row + left])
+                               + (convert_ushort4(src_buffer[row + out_coord.x]) << (ushort)1)
+                               + convert_ushort4(src_buffer[row + right]);
+            out_colour += (y == 0) ? (row_colour << (ushort)1) : row_colour;
+        }
+
+        // Divide by 16, rounding to nearest
+        dst_buffer[out_coord.y * width + out_coord.x] = convert_uchar4((out_colour + (ushort)8) >> (ushort)4);
+    }
+}
+
+#ifdef cl_khr_fp16
+#pragma OPENCL EXTENSION cl_khr_fp16 : enable
+
+__kernel void gaussian_filter_half(__read_only image2d_t src_image,
+                                   __write_only image2d_t dst_image,
+                                   sampler_t sampler,
+                                   int width, int height)
+{
+    // Same 3x3 kernel as gaussian_filter, the weights and the sum of 16 are exact in half precision
+    half kernel_weights[9] = {1, 2, 1,
+                              2, 4, 2,
+                              1, 2, 1};
+
+    int2 out_image_coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(out_image_coord.x < width && out_image_coord.y < height){
+        int weight = 0;
+        half4 out_colour = (half4)(0);
+
+        // Go through the coordinates
+        for(int y = -1; y <= 1; y++){
+            for(int x = -1; x <= 1; x++){
+                out_colour += read_imageh(src_image, sampler, out_image_coord + (int2)(x, y)) * kernel_weights[weight];
+                weight += 1;
+            }
+        }
+
+        // Write output value to the image, dividing by 16 is exact
+        write_imageh(dst_image, out_image_coord, out_colour * (half)0.0625f);
+    }
+}
+#endif
+
+__kernel void gaussian_filter_2d(__read_only image2d_t src_image,
+                                 __write_only image2d_t dst_image,
+                                 sampler_t sampler,
+                                 __constant float* weights,
+                                 int radius,
+                                 int width, int height)
+{
+    // Set work-items
+    int2 out_image_coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(out_image_coord.x < width && out_image_coord.y < height){
+        float4 out_colour = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+
+        // Weights are separable, so the 2D weight is the product of the row and column weights
+        for(int y = -radius; y <= radius; y++){
+            float4 row_colour = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+            for(int x = -radius; x <= radius; x++){
+                row_colour += read_imagef(src_image, sampler, out_image_coord + (int2)(x, y)) * weights[x + radius];
+            }
+            out_colour += row_colour * weights[y + radius];
+        }
+
+        // Write output value to the image
+        write_imagef(dst_image, out_image_coord, out_colour);
+    }
+}
+
+__kernel void gaussian_filter_horizontal(__read_only image2d_t src_image,
+                                         __write_only image2d_t dst_image,
+                                         sampler_t sampler,
+                                         __constant float* weights,
+                                         int radius,
+                                         int width, int height)
+{
+    // Set work-items
+    int2 out_image_coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(out_image_coord.x < width && out_image_coord.y < height){
+        float4 out_colour = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+
+        // Go through the row
+        for(int x = -radius; x <= radius; x++){
+            out_colour += read_imagef(src_image, sampler, out_image_coord + (int2)(x, 0)) * weights[x + radius];
+        }
+
+        // Write output value to the image
+        write_imagef(dst_image, out_image_coord, out_colour);
+    }
+}
+
+__kernel void gaussian_filter_vertical(__read_only image2d_t src_image,
+                                       __write_only image2d_t dst_image,
+                                       sampler_t sampler,
+                                       __constant float* weights,
+                                       int radius,
+                                       int width, int height)
+{
+    // Set work-items
+    int2 out_image_coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(out_image_coord.x < width && out_image_coord.y < height){
+        float4 out_colour = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+
+        // Go through the column
+        for(int y = -radius; y <= radius; y++){
+            out_colour += read_imagef(src_image, sampler, out_image_coord + (int2)(0, y)) * weights[y + radius];
+        }
+
+        // Write output value to the image
+        write_imagef(dst_image, out_image_coord, out_colour);
+    }
+}
+
+__kernel void gaussian_filter_tiled(__global const uchar4* src_buffer,
+                                    __global uchar4* dst_buffer,
+                                    __constant float* weights,
+                                    int radius,
+                                    int width, int height,
+                                    __local uchar4* tile)
+{
+    // Set work-items
+    int local_x = get_local_id(0);
+    int local_y = get_local_id(1);
+    int group_x = get_group_id(0) * get_local_size(0);
+    int group_y = get_group_id(1) * get_local_size(1);
+
+    // The tile holds the work-group's pixels plus a halo of `radius` pixels on every side
+    int tile_width = get_local_size(0) + 2 * radius;
+    int tile_height = get_local_size(1) + 2 * radius;
+
+    // Cooperatively load the tile, clamping to the edge like the image sampler does
+    for(int tile_y = local_y; tile_y < tile_height; tile_y += get_local_size(1)){
+        int y = clamp(group_y + tile_y - radius, 0, height - 1);
+        for(int tile_x = local_x; tile_x < tile_width; tile_x += get_local_size(0)){
+            int x = clamp(group_x + tile_x - radius, 0, width - 1);
+            tile[tile_y * tile_width + tile_x] = src_buffer[y * width + x];
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int2 out_coord = (int2)(group_x + local_x, group_y + local_y);
+
+    if(out_coord.x < width && out_coord.y < height){
+        float4 out_colour = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+
+        // Go through the neighbourhood in local memory
+        for(int y = 0; y <= 2 * radius; y++){
+            float4 row_colour = (float4)(0.0f, 0.0f, 0.0f, 0.0f);
+            for(int x = 0; x <= 2 * radius; x++){
+                row_colour += convert_float4(tile[(local_y + y) * tile_width + local_x + x]) * weights[x];
+            }
+            out_colour += row_colour * weights[y];
+        }
+
+        // Write output value to the buffer
+        dst_buffer[out_coord.y * width + out_coord.x] = convert_uchar4_sat_rte(out_colour);
+    }
+}
+
+
+/* Recursive Gaussian (Young & van Vliet): a causal and an anti-causal third
+   order recursion per column, so the work per pixel does not depend on sigma.
+   coefficients holds (B, b1/b0, b2/b0, b3/b0). The intermediate buffers hold
+   float4 pixels, or half4 pixels through vload_half/vstore_half (no
+   cl_khr_fp16 needed) when half_storage is set. */
+
+inline float4 recursive_load(__global const float* data, size_t index, int half_storage)
+{
+    return half_storage ? vload_half4(index, (__global const half*)data) : vload4(index, data);
+}
+
+inline void recursive_store(__global float* data, size_t index, float4 value, int half_storage)
+{
+    if(half_storage){
+        vstore_half4(value, index, (__global half*)data);
+    } else{
+        vstore4(value, index, data);
+    }
+}
+
+// Anti-causal history for a column continuing with its last input value (Triggs & Sdika boundary matrix)
+inline void recursive_boundary(float16 boundary, float4 last, float4 w1, float4 w2, float4 w3, float4* y1, float4* y2, float4* y3)
+{
+    float4 d1 = w1 - last, d2 = w2 - last, d3 = w3 - last;
+    *y1 = last + boundary.s0 * d1 + boundary.s1 * d2 + boundary.s2 * d3;
+    *y2 = last + boundary.s3 * d1 + boundary.s4 * d2 + boundary.s5 * d3;
+    *y3 = last + boundary.s6 * d1 + boundary.s7 * d2 + boundary.s8 * d3;
+}
+
+// Filter the image columns into a buffer of the same layout, one work-item per column
+__kernel void gaussian_filter_recursive(__read_only image2d_t src_image,
+                                        sampler_t sampler,
+                                        __global float* dst_buffer,
+                                        float4 coefficients,
+                                        float16 boundary,
+                                        int half_storage,
+                                        int width, int height)
+{
+    int x = get_global_id(0);
+
+    if(x < width){
+        // Causal pass, the history starts in the steady state of the replicated first pixel
+        float4 in_colour = read_imagef(src_image, sampler, (int2)(x, 0));
+        float4 w1 = in_colour, w2 = in_colour, w3 = in_colour;
+        for(int y = 0; y < height; y++){
+            in_colour = read_imagef(src_image, sampler, (int2)(x, y));
+            float4 w = coefficients.x * in_colour + coefficients.y * w1 + coefficients.z * w2 + coefficients.w * w3;
+            recursive_store(dst_buffer, (size_t)y * width + x, w, half_storage);
+            w3 = w2; w2 = w1; w1 = w;
+        }
+
+        // Anti-causal pass in place
+        float4 y1, y2, y3;
+        recursive_boundary(boundary, in_colour, w1, w2, w3, &y1, &y2, &y3);
+        for(int y = height - 1; y >= 0; y--){
+            size_t index = (size_t)y * width + x;
+            float4 out_colour = coefficients.x * recursive_load(dst_buffer, index, half_storage) + coefficients.y * y1 + coefficients.z * y2 + coefficients.w * y3;
+            recursive_store(dst_buffer, index, out_colour, half_storage);
+            y3 = y2; y2 = y1; y1 = out_colour;
+        }
+    }
+}
+
+// Transpose the width x height buffer through __local tiles so that the rows become columns
+__kernel void gaussian_filter_recursive_transpose(__global const float* src_buffer,
+                                                  __global float* dst_buffer,
+                                                  int half_storage,
+                                                  int width, int height)
+{
+    __local float4 tile[16][17];
+
+    int local_x = get_local_id(0);
+    int local_y = get_local_id(1);
+    int group_x = get_group_id(0) * 16;
+    int group_y = get_group_id(1) * 16;
+
+    if(group_x + local_x < width && group_y + local_y < height){
+        tile[local_y][local_x] = recursive_load(src_buffer, (size_t)(group_y + local_y) * width + group_x + local_x, half_storage);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int x = group_y + local_x;
+    int y = group_x + local_y;
+    if(x < height && y < width){
+        recursive_store(dst_buffer, (size_t)y * height + x, tile[local_x][local_y], half_storage);
+    }
+}
+
+// Filter the columns of the transposed buffer (the image rows) and write them back transposed into the image
+__kernel void gaussian_filter_recursive_transposed(__global float* src_buffer,
+                                                   __write_only image2d_t dst_image,
+                                                   float4 coefficients,
+                                                   float16 boundary,
+                                                   int half_storage,
+                                                   int width, int height)
+{
+    int x = get_global_id(0);
+
+    if(x < width){
+        // Causal pass
+        float4 in_colour = recursive_load(src_buffer, x, half_storage);
+        float4 w1 = in_colour, w2 = in_colour, w3 = in_colour;
+        for(int y = 0; y < height; y++){
+            size_t index = (size_t)y * width + x;
+            in_colour = recursive_load(src_buffer, index, half_storage);
+            float4 w = coefficients.x * in_colour + coefficients.y * w1 + coefficients.z * w2 + coefficients.w * w3;
+            recursive_store(src_buffer, index, w, half_storage);
+            w3 = w2; w2 = w1; w1 = w;
+        }
+
+        // Anti-causal pass straight into the output image
+        float4 y1, y2, y3;
+        recursive_boundary(boundary, in_colour, w1, w2, w3, &y1, &y2, &y3);
+        for(int y = height - 1; y >= 0; y--){
+            float4 out_colour = coefficients.x * recursive_load(src_buffer, (size_t)y * width + x, half_storage) + coefficients.y * y1 + coefficients.z * y2 + coefficients.w * y3;
+            write_imagef(dst_image, (int2)(y, x), out_colour);
+            y3 = y2; y2 = y1; y1 = out_colour;
+        }
+    }
+}
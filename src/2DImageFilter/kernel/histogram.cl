@@ -0,0 +1,147 @@
+/* Channel histograms and histogram equalization.
+
+   histogram_local gives every work-group a private copy of the 4 x 256 bins
+   in __local memory. The work-items stride over the image and increment the
+   private bins with local atomics, then each group adds its non-zero bins to
+   the global histogram once, so global atomics scale with the number of
+   groups instead of the number of pixels.
+
+   histogram_lut turns the histogram into a lookup table per channel (one
+   work-group per channel) and histogram_apply remaps the image through it,
+   the histogram never leaves the device. Alpha keeps an identity table. */
+
+#define HISTOGRAM_BINS 256
+#define HISTOGRAM_CHANNELS 4
+
+inline uint4 histogram_bins(float4 colour)
+{
+    return convert_uint4_sat_rte(colour * 255.0f);
+}
+
+__kernel void histogram_local(__read_only image2d_t src_image,
+                              sampler_t sampler,
+                              __global uint* histogram,
+                              int width, int height)
+{
+    __local uint local_histogram[HISTOGRAM_CHANNELS * HISTOGRAM_BINS];
+
+    int local_id = get_local_id(0);
+    int local_size = get_local_size(0);
+
+    for(int i = local_id; i < HISTOGRAM_CHANNELS * HISTOGRAM_BINS; i += local_size){
+        local_histogram[i] = 0;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Consecutive work-items read consecutive pixels of a row
+    int pixels = width * height;
+    for(int i = get_global_id(0); i < pixels; i += get_global_size(0)){
+        uint4 bins = histogram_bins(read_imagef(src_image, sampler, (int2)(i % width, i / width)));
+
+        atomic_inc(&local_histogram[bins.x]);
+        atomic_inc(&local_histogram[HISTOGRAM_BINS + bins.y]);
+        atomic_inc(&local_histogram[2 * HISTOGRAM_BINS + bins.z]);
+        atomic_inc(&local_histogram[3 * HISTOGRAM_BINS + bins.w]);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Merge the private copy, empty bins cost no global atomic
+    for(int i = local_id; i < HISTOGRAM_CHANNELS * HISTOGRAM_BINS; i += local_size){
+        uint count = local_histogram[i];
+        if(count != 0){
+            atomic_add(&histogram[i], count);
+        }
+    }
+}
+
+// Launched with one work-group per channel, the group size must be a power of two of at most HISTOGRAM_BINS
+__kernel void histogram_lut(__global const uint* histogram,
+                            __global uchar* lut,
+                            int pixels)
+{
+    __local uint partial[HISTOGRAM_BINS];
+    __local uint first;
+
+    int channel = get_group_id(0);
+    int local_id = get_local_id(0);
+    int local_size = get_local_size(0);
+    int per_item = HISTOGRAM_BINS / local_size;
+
+    __global const uint* bins = histogram + channel * HISTOGRAM_BINS;
+    __global uchar* table = lut + channel * HISTOGRAM_BINS;
+
+    // Alpha is not equalized
+    if(channel == HISTOGRAM_CHANNELS - 1){
+        for(int i = local_id; i < HISTOGRAM_BINS; i += local_size){
+            table[i] = (uchar)i;
+        }
+        return;
+    }
+
+    // Each work-item sums a run of consecutive bins
+    uint sum = 0;
+    for(int i = 0; i < per_item; i++){
+        sum += bins[local_id * per_item + i];
+    }
+    partial[local_id] = sum;
+    if(local_id == 0){
+        first = pixels;
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Inclusive Hillis-Steele scan of the run sums
+    for(int offset = 1; offset < local_size; offset *= 2){
+        uint value = (local_id >= offset) ? partial[local_id - offset] : 0;
+        barrier(CLK_LOCAL_MEM_FENCE);
+        partial[local_id] += value;
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    // The cumulative count of the darkest occupied bin maps to 0
+    uint cdf = partial[local_id] - sum;
+    for(int i = 0; i < per_item; i++){
+        cdf += bins[local_id * per_item + i];
+        if(cdf != 0){
+            atomic_min(&first, cdf);
+            break;
+        }
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // A channel with a single value keeps its values
+    cdf = partial[local_id] - sum;
+    float scale = (first < (uint)pixels) ? 255.0f / (float)(pixels - first) : 0.0f;
+    for(int i = 0; i < per_item; i++){
+        int bin = local_id * per_item + i;
+        cdf += bins[bin];
+        table[bin] = (scale > 0.0f) ? convert_uchar_sat_rte((float)(cdf - min(cdf, first)) * scale) : (uchar)bin;
+    }
+}
+
+__kernel void histogram_apply(__read_only image2d_t src_image,
+                              __write_only image2d_t dst_image,
+                              sampler_t sampler,
+                              __global const uchar* lut,
+                              int width, int height)
+{
+    __local uchar local_lut[HISTOGRAM_CHANNELS * HISTOGRAM_BINS];
+
+    // Stage the tables once per work-group
+    int local_id = get_local_id(1) * get_local_size(0) + get_local_id(0);
+    int local_size = get_local_size(0) * get_local_size(1);
+    for(int i = local_id; i < HISTOGRAM_CHANNELS * HISTOGRAM_BINS; i += local_size){
+        local_lut[i] = lut[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+    if(coord.x < width && coord.y < height){
+        uint4 bins = histogram_bins(read_imagef(src_image, sampler, coord));
+        float4 out_colour = (float4)(local_lut[bins.x],
+                                     local_lut[HISTOGRAM_BINS + bins.y],
+                                     local_lut[2 * HISTOGRAM_BINS + bins.z],
+                                     local_lut[3 * HISTOGRAM_BINS + bins.w]) / 255.0f;
+
+        write_imagef(dst_image, coord, out_colour);
+    }
+}
@@ -0,0 +1,96 @@
+/* Point-wise and stencil image filters used by the filter graph.
+   Every kernel takes its input images, then the output image, the sampler,
+   the image size and finally any scalar parameters.
+
+   FreeImage stores 32-bit pixels as BGRA, which a CL_RGBA image exposes as
+   (b, g, r, a), so the luminance weights below are in that order. */
+
+__constant float4 LUMINANCE_WEIGHTS = (float4)(0.114f, 0.587f, 0.299f, 0.0f);
+
+__kernel void sharpen(__read_only image2d_t src_image,
+                      __write_only image2d_t dst_image,
+                      sampler_t sampler,
+                      int width, int height)
+{
+    /* Sharpen Kernel
+         0 -1  0
+        -1  5 -1
+         0 -1  0
+    */
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(coord.x < width && coord.y < height){
+        float4 centre = read_imagef(src_image, sampler, coord);
+        float4 out_colour = 5.0f * centre
+                          - read_imagef(src_image, sampler, coord + (int2)(-1, 0))
+                          - read_imagef(src_image, sampler, coord + (int2)(1, 0))
+                          - read_imagef(src_image, sampler, coord + (int2)(0, -1))
+                          - read_imagef(src_image, sampler, coord + (int2)(0, 1));
+
+        // Keep the original alpha
+        out_colour.w = centre.w;
+        write_imagef(dst_image, coord, clamp(out_colour, 0.0f, 1.0f));
+    }
+}
+
+__kernel void sobel_edge(__read_only image2d_t src_image,
+                         __write_only image2d_t dst_image,
+                         sampler_t sampler,
+                         int width, int height)
+{
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(coord.x < width && coord.y < height){
+        // Luminance of the 3x3 neighbourhood
+        float l[9];
+        int index = 0;
+        for(int y = -1; y <= 1; y++){
+            for(int x = -1; x <= 1; x++){
+                l[index++] = dot(read_imagef(src_image, sampler, coord + (int2)(x, y)), LUMINANCE_WEIGHTS);
+            }
+        }
+
+        // Sobel gradients
+        float gx = (l[2] + 2.0f * l[5] + l[8]) - (l[0] + 2.0f * l[3] + l[6]);
+        float gy = (l[6] + 2.0f * l[7] + l[8]) - (l[0] + 2.0f * l[1] + l[2]);
+        float magnitude = clamp(sqrt(gx * gx + gy * gy), 0.0f, 1.0f);
+
+        float alpha = read_imagef(src_image, sampler, coord).w;
+        write_imagef(dst_image, coord, (float4)(magnitude, magnitude, magnitude, alpha));
+    }
+}
+
+__kernel void grayscale(__read_only image2d_t src_image,
+                        __write_only image2d_t dst_image,
+                        sampler_t sampler,
+                        int width, int height)
+{
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(coord.x < width && coord.y < height){
+        float4 colour = read_imagef(src_image, sampler, coord);
+        float luminance = dot(colour, LUMINANCE_WEIGHTS);
+
+        write_imagef(dst_image, coord, (float4)(luminance, luminance, luminance, colour.w));
+    }
+}
+
+__kernel void blend(__read_only image2d_t src_image_a,
+                    __read_only image2d_t src_image_b,
+                    __write_only image2d_t dst_image,
+                    sampler_t sampler,
+                    int width, int height,
+                    float weight_a, float weight_b)
+{
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(coord.x < width && coord.y < height){
+        float4 a = read_imagef(src_image_a, sampler, coord);
+        float4 b = read_imagef(src_image_b, sampler, coord);
+        float4 out_colour = clamp(weight_a * a + weight_b * b, 0.0f, 1.0f);
+
+        // Keep the alpha of the first input
+        out_colour.w = a.w;
+        write_imagef(dst_image, coord, out_colour);
+    }
+}
@@ -0,0 +1,82 @@
+/* Summed-area table (integral image) of an RGBA8 image and the box filter
+   reading it. The table holds uint4 sums; they may wrap around for very
+   large images, but every box sum is taken modulo 2^32 as well, so it stays
+   exact as long as a single box sums to less than 2^32. */
+
+__constant sampler_t NEAREST_SAMPLER = CLK_NORMALIZED_COORDS_FALSE | CLK_ADDRESS_CLAMP_TO_EDGE | CLK_FILTER_NEAREST;
+
+// Inclusive prefix sum of every row, one work-group per row walking it in chunks of the work-group size
+__kernel void sat_rows(__read_only image2d_t src_image,
+                       __global uint4* sat,
+                       __local uint4* scratch,
+                       int width, int height)
+{
+    const int y = get_group_id(0);
+    const int lid = get_local_id(0);
+    const int size = get_local_size(0);
+    uint4 carry = (uint4)(0);
+
+    for(int base = 0; base < width; base += size){
+        const int x = base + lid;
+        scratch[lid] = x < width ? convert_uint4_sat_rte(read_imagef(src_image, NEAREST_SAMPLER, (int2)(x, y)) * 255.0f) : (uint4)(0);
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        // Hillis-Steele scan of the chunk
+        for(int offset = 1; offset < size; offset <<= 1){
+            uint4 addend = lid >= offset ? scratch[lid - offset] : (uint4)(0);
+            barrier(CLK_LOCAL_MEM_FENCE);
+            scratch[lid] += addend;
+            barrier(CLK_LOCAL_MEM_FENCE);
+        }
+
+        if(x < width){
+            sat[(size_t)y * width + x] = scratch[lid] + carry;
+        }
+        carry += scratch[size - 1];
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+}
+
+// Prefix sum down every column in place, neighbouring work-items walk neighbouring columns so the accesses coalesce
+__kernel void sat_columns(__global uint4* sat,
+                          int width, int height)
+{
+    const int x = get_global_id(0);
+
+    if(x < width){
+        uint4 sum = (uint4)(0);
+        for(int y = 0; y < height; y++){
+            const size_t index = (size_t)y * width + x;
+            sum += sat[index];
+            sat[index] = sum;
+        }
+    }
+}
+
+// Mean of the (2r+1)x(2r+1) box from four table corners, averaging only the pixels inside the image
+__kernel void box_filter(__global const uint4* sat,
+                         __write_only image2d_t dst_image,
+                         int width, int height,
+                         int radius)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+
+    if(x < width && y < height){
+        const int x0 = max(x - radius, 0) - 1;
+        const int y0 = max(y - radius, 0) - 1;
+        const int x1 = min(x + radius, width - 1);
+        const int y1 = min(y + radius, height - 1);
+
+        uint4 sum = sat[(size_t)y1 * width + x1];
+        if(x0 >= 0)
+            sum -= sat[(size_t)y1 * width + x0];
+        if(y0 >= 0)
+            sum -= sat[(size_t)y0 * width + x1];
+        if(x0 >= 0 && y0 >= 0)
+            sum += sat[(size_t)y0 * width + x0];
+
+        const float count = (float)((x1 - x0) * (y1 - y0));
+        write_imagef(dst_image, (int2)(x, y), convert_float4(sum) / (count * 255.0f));
+    }
+}
@@ -0,0 +1,126 @@
+/* Image pyramid: every level is the previous one blurred with the binomial
+   [1 3 3 1] x [1 3 3 1] / 64 kernel and decimated by two in one step, so the
+   blur is only evaluated at the pixels that survive the decimation.
+
+   Large levels take one launch each. Once a level fits into TAIL_SIZE x
+   TAIL_SIZE, pyramid_tail builds it and every smaller level down to 1x1 in a
+   single work-group, keeping the levels in __local memory. */
+
+#define TAIL_SIZE 32
+#define TAIL_LEVELS 6
+
+__constant float REDUCE_WEIGHTS[4] = {0.125f, 0.375f, 0.375f, 0.125f};
+
+__kernel void pyramid_reduce(__read_only image2d_t src_image,
+                             __write_only image2d_t dst_image,
+                             sampler_t sampler,
+                             int dst_width, int dst_height)
+{
+    int2 out_coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(out_coord.x < dst_width && out_coord.y < dst_height){
+        // The taps straddle the 2x2 source block of the output pixel, the sampler clamps at the edges
+        int2 origin = 2 * out_coord - (int2)(1, 1);
+        float4 out_colour = (float4)(0.0f);
+
+        for(int y = 0; y < 4; y++){
+            float4 row_colour = (float4)(0.0f);
+            for(int x = 0; x < 4; x++){
+                row_colour += read_imagef(src_image, sampler, origin + (int2)(x, y)) * REDUCE_WEIGHTS[x];
+            }
+            out_colour += row_colour * REDUCE_WEIGHTS[y];
+        }
+
+        write_imagef(dst_image, out_coord, out_colour);
+    }
+}
+
+// Same reduction reading a level kept in local memory
+inline float4 reduce_local(__local const float4* level, int width, int height, int2 out_coord)
+{
+    int2 origin = 2 * out_coord - (int2)(1, 1);
+    float4 out_colour = (float4)(0.0f);
+
+    for(int y = 0; y < 4; y++){
+        int row = clamp(origin.y + y, 0, height - 1) * width;
+        float4 row_colour = (float4)(0.0f);
+        for(int x = 0; x < 4; x++){
+            row_colour += level[row + clamp(origin.x + x, 0, width - 1)] * REDUCE_WEIGHTS[x];
+        }
+        out_colour += row_colour * REDUCE_WEIGHTS[y];
+    }
+
+    return out_colour;
+}
+
+inline void write_tail(__write_only image2d_t dst0, __write_only image2d_t dst1, __write_only image2d_t dst2,
+                       __write_only image2d_t dst3, __write_only image2d_t dst4, __write_only image2d_t dst5,
+                       int level, int2 coord, float4 colour)
+{
+    switch(level){
+    case 0: write_imagef(dst0, coord, colour); break;
+    case 1: write_imagef(dst1, coord, colour); break;
+    case 2: write_imagef(dst2, coord, colour); break;
+    case 3: write_imagef(dst3, coord, colour); break;
+    case 4: write_imagef(dst4, coord, colour); break;
+    default: write_imagef(dst5, coord, colour); break;
+    }
+}
+
+// One work-group builds up to TAIL_LEVELS levels, unused image arguments are never written
+__kernel void pyramid_tail(__read_only image2d_t src_image,
+                           __write_only image2d_t dst0, __write_only image2d_t dst1, __write_only image2d_t dst2,
+                           __write_only image2d_t dst3, __write_only image2d_t dst4, __write_only image2d_t dst5,
+                           sampler_t sampler,
+                           int src_width, int src_height,
+                           int levels)
+{
+    // Levels alternate between two buffers, each level is at most a quarter of the one before
+    __local float4 even_levels[TAIL_SIZE * TAIL_SIZE];
+    __local float4 odd_levels[TAIL_SIZE * TAIL_SIZE / 4];
+
+    int lid = get_local_id(1) * get_local_size(0) + get_local_id(0);
+    int local_size = get_local_size(0) * get_local_size(1);
+
+    int width = max(src_width / 2, 1);
+    int height = max(src_height / 2, 1);
+
+    // First level from the source image
+    for(int i = lid; i < width * height; i += local_size){
+        int2 coord = (int2)(i % width, i / width);
+        int2 origin = 2 * coord - (int2)(1, 1);
+        float4 out_colour = (float4)(0.0f);
+
+        for(int y = 0; y < 4; y++){
+            float4 row_colour = (float4)(0.0f);
+            for(int x = 0; x < 4; x++){
+                row_colour += read_imagef(src_image, sampler, origin + (int2)(x, y)) * REDUCE_WEIGHTS[x];
+            }
+            out_colour += row_colour * REDUCE_WEIGHTS[y];
+        }
+
+        even_levels[i] = out_colour;
+        write_tail(dst0, dst1, dst2, dst3, dst4, dst5, 0, coord, out_colour);
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    // Remaining levels from local memory
+    for(int level = 1; level < levels; level++){
+        __local float4* src_level = (level % 2) ? even_levels : odd_levels;
+        __local float4* dst_level = (level % 2) ? odd_levels : even_levels;
+        int next_width = max(width / 2, 1);
+        int next_height = max(height / 2, 1);
+
+        for(int i = lid; i < next_width * next_height; i += local_size){
+            int2 coord = (int2)(i % next_width, i / next_width);
+            float4 out_colour = reduce_local(src_level, width, height, coord);
+
+            dst_level[i] = out_colour;
+            write_tail(dst0, dst1, dst2, dst3, dst4, dst5, level, coord, out_colour);
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+
+        width = next_width;
+        height = next_height;
+    }
+}
@@ -0,0 +1,54 @@
+/* Image resizing.
+
+   resize_linear samples the source with normalized coordinates and a
+   CL_FILTER_LINEAR sampler, so the texture unit does the bilinear
+   interpolation in a single read. Beyond a 2x reduction bilinear taps skip
+   source pixels and alias, resize_area then averages every source pixel the
+   output pixel covers, weighted by the covered fraction. */
+
+__kernel void resize_linear(__read_only image2d_t src_image,
+                            __write_only image2d_t dst_image,
+                            sampler_t sampler,
+                            int dst_width, int dst_height)
+{
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(coord.x < dst_width && coord.y < dst_height){
+        // Pixel centres map onto pixel centres
+        float2 position = ((float2)(coord.x, coord.y) + 0.5f) / (float2)(dst_width, dst_height);
+
+        write_imagef(dst_image, coord, read_imagef(src_image, sampler, position));
+    }
+}
+
+__kernel void resize_area(__read_only image2d_t src_image,
+                          __write_only image2d_t dst_image,
+                          sampler_t sampler,
+                          int src_width, int src_height,
+                          int dst_width, int dst_height)
+{
+    int2 coord = (int2)(get_global_id(0), get_global_id(1));
+
+    if(coord.x < dst_width && coord.y < dst_height){
+        float2 scale = (float2)((float)src_width / dst_width, (float)src_height / dst_height);
+        float2 start = (float2)(coord.x, coord.y) * scale;
+        float2 end = start + scale;
+
+        int x0 = (int)floor(start.x), x1 = min((int)ceil(end.x), src_width);
+        int y0 = (int)floor(start.y), y1 = min((int)ceil(end.y), src_height);
+
+        float4 out_colour = (float4)(0.0f);
+        for(int y = y0; y < y1; y++){
+            float weight_y = fmin(y + 1.0f, end.y) - fmax((float)y, start.y);
+            float4 row_colour = (float4)(0.0f);
+
+            for(int x = x0; x < x1; x++){
+                float weight_x = fmin(x + 1.0f, end.x) - fmax((float)x, start.x);
+                row_colour += read_imagef(src_image, sampler, (int2)(x, y)) * weight_x;
+            }
+            out_colour += row_colour * weight_y;
+        }
+
+        write_imagef(dst_image, coord, out_colour / (scale.x * scale.y));
+    }
+}
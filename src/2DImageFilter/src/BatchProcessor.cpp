@@ -0,0 +1,289 @@
+#include "BatchProcessor.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    // Lanes of the scheduler, in-order queues give each its own queue
+    const int LANE_UPLOAD = 0;
+    const int LANE_COMPUTE = 1;
+    const int LANE_DOWNLOAD = 2;
+}
+
+BatchProcessor::BatchProcessor(Controller& controller, cl_context context, cl_device_id device, GaussianFilter& filter, int depth, QueueMode mode)
+    : m_filter{filter}, m_pool{controller.GetMemoryPool(context)},
+      m_scheduler{controller, context, device, mode, CommandScheduler::DEFAULT_LANES, CL_QUEUE_PROFILING_ENABLE}, m_last_kernel{-1},
+      m_encoders{std::max(depth, 1)}, m_decode_ms{0.0}, m_upload_ms{0.0}, m_kernel_ms{0.0}, m_readback_ms{0.0}, m_encode_ms{0.0}
+{
+    m_slots.resize(std::max(depth, 1));
+    for(auto& slot : m_slots){
+        slot.width = slot.height = 0;
+        slot.upload_node = slot.kernel_node = slot.readback_node = -1;
+        slot.kernel_start = 0;
+        slot.saved = false;
+        slot.encode_ms = 0.0;
+        slot.busy = false;
+    }
+}
+
+BatchProcessor::~BatchProcessor()
+{
+    for(auto& slot : m_slots){
+        if(slot.encoded.valid())
+            slot.encoded.wait();
+        releaseEvents(slot);
+    }
+}
+
+bool BatchProcessor::Run(const std::string &input_dir, const std::string &output_dir)
+{
+    namespace fs = std::filesystem;
+    std::error_code error;
+
+    // Collect the images of the input directory
+    std::vector<fs::path> files;
+    for(auto& entry : fs::directory_iterator(input_dir, error)){
+        if(entry.is_regular_file() && ImageIO::IsSupported(entry.path().string())){
+            files.push_back(entry.path());
+        }
+    }
+    if(error || files.empty()){
+        std::cerr << "No images found in " << input_dir << std::endl;
+        return false;
+    }
+    std::sort(files.begin(), files.end());
+
+    fs::create_directories(output_dir, error);
+    if(error){
+        std::cerr << "Failed to create output directory " << output_dir << std::endl;
+        return false;
+    }
+
+    std::cout << "Processing " << files.size() << " images with " << m_slots.size() << " images in flight on "
+              << CommandScheduler::ModeName(m_scheduler.GetMode()) << " queues" << std::endl;
+
+    int processed = 0;
+    int depth = (int)m_slots.size();
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for(int i = 0; i < (int)files.size(); i++){
+        Slot& slot = m_slots[i % depth];
+
+        // Retire the image that previously used this slot before reusing its memory
+        if(slot.busy){
+            processed += complete(slot) ? 1 : 0;
+        }
+
+        auto output = (fs::path(output_dir) / files[i].filename()).string();
+        if(!submit(slot, files[i].string(), output)){
+            std::cerr << "Failed to submit " << files[i].string() << std::endl;
+        }
+    }
+
+    // Drain the remaining images in submission order
+    for(int i = 0; i < depth; i++){
+        Slot& slot = m_slots[(files.size() + i) % depth];
+        if(slot.busy){
+            processed += complete(slot) ? 1 : 0;
+        }
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    displayStatistics(processed, std::chrono::duration<double, std::milli>(end - start).count());
+
+    return processed == (int)files.size();
+}
+
+bool BatchProcessor::submit(Slot &slot, const std::string &input, const std::string &output)
+{
+    int width, height;
+
+    // Decode on the host while the device works on the images already in flight
+    auto decode_start = std::chrono::high_resolution_clock::now();
+    if(!ImageIO::Decode(input, slot.host_input, width, height)){
+        return false;
+    }
+    m_decode_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - decode_start).count();
+
+    if(!allocate(slot, width, height)){
+        return false;
+    }
+    slot.host_output.resize(slot.host_input.size());
+
+    // The futures keep their own reference to the events handed to the scheduler
+    auto share = [](const EventFuture& future, cl_event* event){
+        *event = future.GetEvent();
+        if(*event != 0)
+            clRetainEvent(*event);
+    };
+
+    // Upload on the transfer lane, the host input stays untouched until the slot completes
+    slot.upload_node = m_scheduler.Add(LANE_UPLOAD, {}, [&](cl_command_queue queue, cl_uint num_events, const cl_event* wait_list, cl_event* event){
+        cl_int err_num;
+        if(m_filter.UsesBuffers()){
+            slot.upload = Controller::WriteBufferAsync(queue, slot.src.Get(), slot.host_input.size(), slot.host_input.data(), num_events, wait_list, &err_num);
+        } else{
+            slot.upload = Controller::WriteImageAsync(queue, slot.src.Get(), width, height, slot.host_input.data(), 0, num_events, wait_list, &err_num);
+        }
+        share(slot.upload, event);
+        return err_num;
+    });
+
+    // Filter once the upload has finished. The kernels of consecutive images share the intermediate objects
+    // of the filter, so they also wait for those of the previous image. The marker records when they may start
+    if(slot.upload_node >= 0){
+        std::vector<int> dependencies = {slot.upload_node};
+        if(m_last_kernel >= 0)
+            dependencies.push_back(m_last_kernel);
+
+        slot.kernel_node = m_scheduler.Add(LANE_COMPUTE, dependencies, [&](cl_command_queue queue, cl_uint num_events, const cl_event* wait_list, cl_event* event){
+            cl_int err_num = clEnqueueMarkerWithWaitList(queue, num_events, wait_list, &slot.kernel_start);
+            if(err_num == CL_SUCCESS){
+                err_num = m_filter.Enqueue(queue, slot.src.Get(), slot.dst.Get(), width, height, num_events, wait_list, event);
+            }
+            return err_num;
+        });
+    }
+
+    // Read back once the kernels have finished, the readback event signals the encoder
+    if(slot.kernel_node >= 0){
+        m_last_kernel = slot.kernel_node;
+        slot.readback_node = m_scheduler.Add(LANE_DOWNLOAD, {slot.kernel_node}, [&](cl_command_queue queue, cl_uint num_events, const cl_event* wait_list, cl_event* event){
+            cl_int err_num;
+            if(m_filter.UsesBuffers()){
+                slot.readback = Controller::ReadBufferAsync(queue, slot.dst.Get(), slot.host_output.size(), slot.host_output.data(), num_events, wait_list, &err_num);
+            } else{
+                slot.readback = Controller::ReadImageAsync(queue, slot.dst.Get(), width, height, slot.host_output.data(), 0, num_events, wait_list, &err_num);
+            }
+            share(slot.readback, event);
+            return err_num;
+        });
+    }
+
+    // The stages already enqueued still use the slot, wait for them before it is reused
+    if(slot.readback_node < 0){
+        std::cerr << "Error enqueueing batch stages" << std::endl;
+        slot.upload.Wait();
+        cl_event kernel = m_scheduler.GetEvent(slot.kernel_node);
+        if(kernel != 0)
+            clWaitForEvents(1, &kernel);
+        releaseEvents(slot);
+        return false;
+    }
+
+    // Encode on the host as soon as the image is back, while the next images are decoded
+    slot.output = output;
+    slot.saved = false;
+    slot.encode_ms = 0.0;
+    slot.encoded = slot.readback.Then(m_encoders, [&slot](cl_int status){
+        if(status != CL_COMPLETE){
+            return;
+        }
+
+        auto encode_start = std::chrono::high_resolution_clock::now();
+        slot.saved = ImageIO::Encode(slot.output, slot.host_output.data(), slot.width, slot.height, slot.width * 4);
+        slot.encode_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - encode_start).count();
+    });
+
+    slot.busy = true;
+    return true;
+}
+
+bool BatchProcessor::complete(Slot &slot)
+{
+    // The encoder has run once this returns, the readback has ended before it
+    slot.encoded.wait();
+    cl_int err_num = slot.readback.Wait();
+    slot.busy = false;
+
+    if(err_num != CL_COMPLETE){
+        std::cerr << "Error waiting for " << slot.output << " (" << err_num << ")" << std::endl;
+        releaseEvents(slot);
+        return false;
+    }
+
+    // Accumulate the device time of each stage
+    cl_event upload = slot.upload.GetEvent();
+    cl_event kernel = m_scheduler.GetEvent(slot.kernel_node);
+    cl_event readback = slot.readback.GetEvent();
+    m_upload_ms += (Controller::GetProfilingTime(upload, CL_PROFILING_COMMAND_END) - Controller::GetProfilingTime(upload, CL_PROFILING_COMMAND_START)) * 1e-6;
+    m_kernel_ms += (Controller::GetProfilingTime(kernel, CL_PROFILING_COMMAND_END) - Controller::GetProfilingTime(slot.kernel_start, CL_PROFILING_COMMAND_END)) * 1e-6;
+    m_readback_ms += (Controller::GetProfilingTime(readback, CL_PROFILING_COMMAND_END) - Controller::GetProfilingTime(readback, CL_PROFILING_COMMAND_START)) * 1e-6;
+    m_encode_ms += slot.encode_ms;
+    releaseEvents(slot);
+
+    if(!slot.saved){
+        std::cerr << "Failed to save image to " << slot.output << std::endl;
+    }
+    return slot.saved;
+}
+
+bool BatchProcessor::allocate(Slot &slot, int width, int height)
+{
+    if(slot.src && slot.width == width && slot.height == height){
+        return true;
+    }
+
+    // Objects of the previous size go back to the pool for later images of that size
+    slot.src.Reset();
+    slot.dst.Reset();
+
+    cl_int err_num, err_num_dst;
+    if(m_filter.UsesBuffers()){
+        slot.src = m_pool.AcquireBuffer(CL_MEM_READ_ONLY, (size_t)width * height * 4, &err_num);
+        slot.dst = m_pool.AcquireBuffer(CL_MEM_WRITE_ONLY, (size_t)width * height * 4, &err_num_dst);
+    } else{
+        cl_image_format clImageFormat;
+        clImageFormat.image_channel_order = CL_RGBA;
+        clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+        slot.src = m_pool.AcquireImage(CL_MEM_READ_ONLY, clImageFormat, width, height, &err_num);
+        slot.dst = m_pool.AcquireImage(CL_MEM_WRITE_ONLY, clImageFormat, width, height, &err_num_dst);
+    }
+
+    if(err_num != CL_SUCCESS || err_num_dst != CL_SUCCESS){
+        std::cerr << "Error creating batch memory objects for " << width << "x" << height << std::endl;
+        slot.src.Reset();
+        slot.dst.Reset();
+        return false;
+    }
+
+    slot.width = width;
+    slot.height = height;
+    return true;
+}
+
+void BatchProcessor::releaseEvents(Slot &slot)
+{
+    if(slot.kernel_start != 0){
+        clReleaseEvent(slot.kernel_start);
+        slot.kernel_start = 0;
+    }
+
+    // Released nodes have completed, later images no longer wait for them
+    for(auto node : {&slot.upload_node, &slot.kernel_node, &slot.readback_node}){
+        m_scheduler.Release(*node);
+        *node = -1;
+    }
+    slot.upload = EventFuture();
+    slot.readback = EventFuture();
+}
+
+void BatchProcessor::displayStatistics(int images, double wall_ms)
+{
+    auto utilisation = [wall_ms](double busy_ms){ return (wall_ms > 0.0) ? 100.0 * busy_ms / wall_ms : 0.0; };
+
+    std::cout << "\nBATCH STATISTICS:" << std::endl;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "\tImages:\t\t" << images << std::endl;
+    std::cout << "\tWall time:\t" << wall_ms << " ms" << std::endl;
+    std::cout << "\tThroughput:\t" << ((wall_ms > 0.0) ? images / (wall_ms * 1e-3) : 0.0) << " images/s" << std::endl;
+    std::cout << "\tStage\t\tbusy (ms)\tutilisation" << std::endl;
+    std::cout << "\tdecode (host)\t" << m_decode_ms << "\t\t" << utilisation(m_decode_ms) << "%" << std::endl;
+    std::cout << "\tupload\t\t" << m_upload_ms << "\t\t" << utilisation(m_upload_ms) << "%" << std::endl;
+    std::cout << "\tkernel\t\t" << m_kernel_ms << "\t\t" << utilisation(m_kernel_ms) << "%" << std::endl;
+    std::cout << "\treadback\t" << m_readback_ms << "\t\t" << utilisation(m_readback_ms) << "%" << std::endl;
+    std::cout << "\tencode (host)\t" << m_encode_ms << "\t\t" << utilisation(m_encode_ms) << "%" << std::endl;
+    std::cout << "\t";
+    m_pool.DisplayStatistics();
+}
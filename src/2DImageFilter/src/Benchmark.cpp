@@ -0,0 +1,951 @@
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const int BENCHMARK_RADII[] = {1, 2, 3, 4, 6, 8, 12, 16, 24, 32};
+
+    // The summed-area table is meant for wide blurs, the direct 2D kernel is skipped above MAX_2D_RADIUS
+    const int INTEGRAL_RADII[] = {1, 2, 4, 8, 16, 32, 64, 128};
+    const int MAX_2D_RADIUS = 32;
+
+    // The recursive filter is compared with a separable Gaussian truncated at RECURSIVE_EXTENT sigma
+    const float RECURSIVE_SIGMAS[] = {1.0f, 2.0f, 4.0f, 8.0f, 16.0f, 32.0f, 64.0f};
+    const float RECURSIVE_EXTENT = 3.0f;
+
+    const size_t HISTOGRAM_GROUP_SIZES[] = {16, 32, 64, 128, 256, 512, 1024};
+
+    // Reduction factors from the source size to the thumbnail size
+    const float RESIZE_FACTORS[] = {1.5f, 2.0f, 3.0f, 4.0f, 8.0f, 16.0f, 32.0f};
+
+    // Images of the scheduling workload and the lanes of its stages
+    const int SCHEDULING_IMAGES = 8;
+    const int LANE_UPLOAD = 0;
+    const int LANE_COMPUTE = 1;
+    const int LANE_DOWNLOAD = 2;
+}
+
+Benchmark::Benchmark(cl_command_queue queue, int iterations) : m_queue{queue}, m_context{0}, m_iterations{iterations}
+{
+    clGetCommandQueueInfo(queue, CL_QUEUE_CONTEXT, sizeof(cl_context), &m_context, NULL);
+}
+
+double Benchmark::Time(std::function<cl_int()> enqueue)
+{
+    return Time(m_queue, enqueue);
+}
+
+double Benchmark::Time(cl_command_queue queue, std::function<cl_int()> enqueue)
+{
+    // Warm-up run so that lazy allocations are not measured
+    if(enqueue() != CL_SUCCESS){
+        return -1.0;
+    }
+    clFinish(queue);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < m_iterations; i++){
+        if(enqueue() != CL_SUCCESS){
+            return -1.0;
+        }
+    }
+    clFinish(queue);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    return std::chrono::duration<double, std::milli>(end - start).count() / m_iterations;
+}
+
+void Benchmark::CompareGaussian(GaussianFilter &filter, int width, int height)
+{
+    auto algorithm = filter.GetAlgorithm();
+    auto radius = filter.GetRadius();
+    auto sigma = filter.GetSigma();
+    double megapixels = (double)width * height * 1e-6;
+
+    cl_mem src_image = createImage(width, height);
+    cl_mem dst_image = createImage(width, height);
+    if(src_image == 0 || dst_image == 0){
+        std::cerr << "Error creating benchmark images" << std::endl;
+        return;
+    }
+
+    std::cout << "\nGAUSSIAN BENCHMARK (" << width << "x" << height << ", " << m_iterations << " iterations):" << std::endl;
+    displayDevice();
+    std::cout << "\tradius\t2d (ms)\t\tseparable (ms)\tspeed-up\t2d (MP/s)\tseparable (MP/s)" << std::endl;
+
+    for(auto r : BENCHMARK_RADII){
+        if(!filter.SetParameters(r, 0.0f)){
+            break;
+        }
+
+        filter.SetAlgorithm(FilterAlgorithm::GAUSSIAN_2D);
+        double time_2d = Time([&](){ return filter.Enqueue(m_queue, src_image, dst_image, width, height); });
+
+        filter.SetAlgorithm(FilterAlgorithm::SEPARABLE);
+        double time_separable = Time([&](){ return filter.Enqueue(m_queue, src_image, dst_image, width, height); });
+
+        if(time_2d < 0.0 || time_separable < 0.0){
+            std::cerr << "Error executing the benchmark kernels" << std::endl;
+            break;
+        }
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << "\t" << r << "\t" << time_2d << "\t\t" << time_separable << "\t\t" << time_2d / time_separable << "x"
+                  << "\t\t" << megapixels / (time_2d * 1e-3) << "\t\t" << megapixels / (time_separable * 1e-3) << std::endl;
+    }
+
+    // Restore the filter configuration
+    filter.SetParameters(radius, sigma);
+    filter.SetAlgorithm(algorithm);
+
+    clReleaseMemObject(src_image);
+    clReleaseMemObject(dst_image);
+}
+
+void Benchmark::CompareTiled(Controller &controller, GaussianFilter &filter, int width, int height)
+{
+    size_t image_size = (size_t)width * height * 4;
+
+    // The tiled path targets CPU devices, run both paths there or on the current device when there is none
+    cl_platform_id cpu_platform = 0;
+    cl_device_id cpu_device = 0, current_device = 0;
+    clGetCommandQueueInfo(m_queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &current_device, NULL);
+    findCPUDevice(cpu_platform, cpu_device);
+
+    std::cout << "\nTILED BENCHMARK (" << width << "x" << height << ", " << m_iterations << " iterations):" << std::endl;
+
+    cl_context context = m_context;
+    cl_device_id device = current_device;
+    cl_program program = 0;
+    if(cpu_device != 0 && cpu_device != current_device){
+        context = controller.CreateContext(cpu_platform, {cpu_device});
+        device = cpu_device;
+        program = controller.CreateProgram(context, cpu_device, "gaussian_filter.cl");
+    } else if(cpu_device == 0){
+        std::cout << "\tNo OpenCL CPU device found, measuring the current device" << std::endl;
+    }
+
+    // Kernel times come from profiling events, so the queue is our own
+    cl_command_queue queue = (context != 0) ? controller.CreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE) : 0;
+    if(queue == 0 || (program == 0 && context != m_context)){
+        std::cerr << "Error creating the tiled benchmark queue" << std::endl;
+        if(context != m_context){
+            controller.Cleanup(context, queue, program);
+        } else if(queue != 0){
+            clReleaseCommandQueue(queue);
+        }
+        return;
+    }
+    displayDevice(queue);
+
+    auto algorithm = filter.GetAlgorithm();
+    auto radius = filter.GetRadius();
+    auto sigma = filter.GetSigma();
+    GaussianFilter* device_filter = &filter;
+    GaussianFilter* cpu_filter = NULL;
+    if(context != m_context){
+        cpu_filter = new GaussianFilter(controller, context, cpu_device, program);
+        device_filter = cpu_filter;
+    }
+
+    cl_mem src_image = createImage(width, height, context);
+    cl_mem dst_image = createImage(width, height, context);
+    cl_mem src_buffer = createBuffer(image_size, context);
+    cl_mem dst_buffer = createBuffer(image_size, context);
+
+    // Average kernel time in milliseconds between the start and end of each profiled launch
+    auto kernelTime = [&](cl_mem src, cl_mem dst){
+        if(device_filter->Enqueue(queue, src, dst, width, height) != CL_SUCCESS){
+            return -1.0;
+        }
+        clFinish(queue);
+
+        std::vector<cl_event> events(m_iterations, (cl_event)0);
+        cl_int err_num = CL_SUCCESS;
+        for(int i = 0; i < m_iterations && err_num == CL_SUCCESS; i++){
+            err_num = device_filter->Enqueue(queue, src, dst, width, height, 0, NULL, &events[i]);
+        }
+        clFinish(queue);
+
+        cl_ulong total_ns = 0;
+        for(auto event : events){
+            if(event != 0){
+                total_ns += Controller::GetProfilingTime(event, CL_PROFILING_COMMAND_END) - Controller::GetProfilingTime(event, CL_PROFILING_COMMAND_START);
+                clReleaseEvent(event);
+            }
+        }
+        return (err_num == CL_SUCCESS) ? total_ns * 1e-6 / m_iterations : -1.0;
+    };
+
+    // Kernel times are measured. Fetches and bytes are estimates: the sampler path reads the whole
+    // neighbourhood for every pixel, the tiled path each 16x16 tile plus halo once per work-group
+    std::cout << "\tradius\tsampler (ms)\ttiled (ms)\tspeed-up\test. fetches/pixel\test. MB moved\test. tiled GB/s" << std::endl;
+
+    for(auto r : BENCHMARK_RADII){
+        if(src_image == 0 || dst_image == 0 || src_buffer == 0 || dst_buffer == 0){
+            std::cerr << "Error creating benchmark memory objects" << std::endl;
+            break;
+        }
+        if(!device_filter->SetParameters(r, 0.0f)){
+            break;
+        }
+
+        device_filter->SetAlgorithm(FilterAlgorithm::GAUSSIAN_2D);
+        double time_sampler = kernelTime(src_image, dst_image);
+
+        device_filter->SetAlgorithm(FilterAlgorithm::TILED);
+        double time_tiled = kernelTime(src_buffer, dst_buffer);
+
+        if(time_sampler < 0.0 || time_tiled < 0.0){
+            std::cerr << "Error executing the benchmark kernels" << std::endl;
+            break;
+        }
+
+        double sampler_fetches = (2.0 * r + 1) * (2.0 * r + 1);
+        double tiled_fetches = (16.0 + 2 * r) * (16.0 + 2 * r) / 256.0;
+        double sampler_bytes = image_size * (sampler_fetches + 1.0);
+        double tiled_bytes = image_size * (tiled_fetches + 1.0);
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << "\t" << r << "\t" << time_sampler << "\t\t" << time_tiled << "\t\t" << time_sampler / time_tiled << "x"
+                  << "\t\t" << sampler_fetches << "->" << tiled_fetches << "\t" << sampler_bytes * 1e-6 << "->" << tiled_bytes * 1e-6
+                  << "\t" << tiled_bytes / (time_tiled * 1e6) << std::endl;
+    }
+
+    for(auto object : {src_image, dst_image, src_buffer, dst_buffer}){
+        if(object != 0)
+            clReleaseMemObject(object);
+    }
+
+    // Restore the filter configuration
+    if(cpu_filter != NULL){
+        delete cpu_filter;
+        controller.Cleanup(context, queue, program);
+    } else{
+        filter.SetParameters(radius, sigma);
+        filter.SetAlgorithm(algorithm);
+        clReleaseCommandQueue(queue);
+    }
+}
+
+void Benchmark::ComparePrecision(GaussianFilter &filter, int width, int height)
+{
+    auto algorithm = filter.GetAlgorithm();
+    auto precision = filter.GetPrecision();
+    double megapixels = (double)width * height * 1e-6;
+
+    // PSNR is measured against the float path on a noise pattern of the same size
+    std::cout << "\nPRECISION BENCHMARK (" << width << "x" << height << ", " << m_iterations << " iterations):" << std::endl;
+    displayDevice();
+    std::cout << "\talgorithm\tprecision\ttime (ms)\tMP/s\t\tPSNR (dB)" << std::endl;
+
+    for(auto candidate_algorithm : {FilterAlgorithm::GAUSSIAN_3X3, FilterAlgorithm::SEPARABLE, FilterAlgorithm::RECURSIVE}){
+        filter.SetAlgorithm(candidate_algorithm);
+
+        for(auto candidate : {FilterPrecision::FLOAT, FilterPrecision::HALF, FilterPrecision::INTEGER}){
+            if(!filter.SupportsPrecision(candidate)){
+                continue;
+            }
+
+            double time_ms = 0.0, psnr = 0.0;
+            std::cout << "\t" << GaussianFilter::AlgorithmName(candidate_algorithm) << "\t\t" << GaussianFilter::PrecisionName(candidate) << "\t\t";
+            if(!filter.CompareVariant(m_queue, candidate, width, height, m_iterations, time_ms, psnr)){
+                std::cout << "failed" << std::endl;
+                continue;
+            }
+
+            std::cout << std::fixed << std::setprecision(3) << time_ms << "\t\t" << megapixels / (time_ms * 1e-3) << "\t\t";
+            if(std::isinf(psnr)){
+                std::cout << "exact" << std::endl;
+            } else{
+                std::cout << psnr << std::endl;
+            }
+        }
+    }
+
+    // Restore the filter configuration
+    filter.SetAlgorithm(algorithm);
+    filter.SetPrecision(precision);
+}
+
+void Benchmark::CompareRecursive(GaussianFilter &filter, int width, int height)
+{
+    auto algorithm = filter.GetAlgorithm();
+    auto precision = filter.GetPrecision();
+    auto radius = filter.GetRadius();
+    auto sigma = filter.GetSigma();
+    double megapixels = (double)width * height * 1e-6;
+
+    cl_mem src_image = createImage(width, height);
+    cl_mem dst_image = createImage(width, height);
+    if(src_image == 0 || dst_image == 0){
+        std::cerr << "Error creating benchmark images" << std::endl;
+        return;
+    }
+
+    // PSNR is measured against the separable Gaussian on a noise pattern of the same size
+    std::cout << "\nRECURSIVE BENCHMARK (" << width << "x" << height << ", " << m_iterations << " iterations):" << std::endl;
+    displayDevice();
+    std::cout << "\tsigma\tseparable (ms)\tfloat (ms)\thalf (ms)\tspeed-up\tfloat (MP/s)\tfloat PSNR\thalf PSNR" << std::endl;
+
+    for(auto s : RECURSIVE_SIGMAS){
+        if(!filter.SetParameters(std::max(1, (int)std::ceil(RECURSIVE_EXTENT * s)), s)){
+            break;
+        }
+
+        filter.SetAlgorithm(FilterAlgorithm::SEPARABLE);
+        filter.SetPrecision(FilterPrecision::FLOAT);
+        double time_separable = Time([&](){ return filter.Enqueue(m_queue, src_image, dst_image, width, height); });
+
+        filter.SetAlgorithm(FilterAlgorithm::RECURSIVE);
+        double time_float = 0.0, time_half = 0.0, psnr_float = 0.0, psnr_half = 0.0;
+        if(time_separable < 0.0 ||
+           !filter.CompareDirect(m_queue, FilterPrecision::FLOAT, width, height, m_iterations, time_float, psnr_float) ||
+           !filter.CompareDirect(m_queue, FilterPrecision::HALF, width, height, m_iterations, time_half, psnr_half)){
+            std::cerr << "Error executing the benchmark kernels" << std::endl;
+            break;
+        }
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << "\t" << s << "\t" << time_separable << "\t\t" << time_float << "\t\t" << time_half << "\t\t" << time_separable / time_float << "x"
+                  << "\t\t" << megapixels / (time_float * 1e-3) << "\t" << psnr_float << "\t\t" << psnr_half << std::endl;
+    }
+
+    // Restore the filter configuration
+    filter.SetParameters(radius, sigma);
+    filter.SetAlgorithm(algorithm);
+    filter.SetPrecision(precision);
+
+    clReleaseMemObject(src_image);
+    clReleaseMemObject(dst_image);
+}
+
+void Benchmark::CompareReadback(int width, int height, bool as_buffer)
+{
+    Readback readback(m_context, m_queue, ReadbackStrategy::AUTO, as_buffer);
+
+    std::cout << "\nREADBACK BENCHMARK (" << width << "x" << height << (as_buffer ? " buffer" : " image") << ", " << m_iterations << " iterations):" << std::endl;
+    displayDevice();
+    std::cout << "\tstrategy\tGB/s" << std::endl;
+
+    for(auto strategy : {ReadbackStrategy::READ, ReadbackStrategy::MAP, ReadbackStrategy::HOST_PTR}){
+        double bandwidth = readback.MeasureBandwidth(strategy, width, height, m_iterations);
+
+        std::cout << "\t" << Readback::StrategyName(strategy) << "\t\t";
+        if(bandwidth < 0.0){
+            std::cout << "failed" << std::endl;
+        } else{
+            std::cout << std::fixed << std::setprecision(3) << bandwidth << std::endl;
+        }
+    }
+}
+
+void Benchmark::CompareFusion(KernelFusion &fusion, int width, int height)
+{
+    size_t image_size = (size_t)width * height * 4;
+
+    cl_mem src_image = createImage(width, height);
+    cl_mem dst_image = createImage(width, height);
+    if(src_image == 0 || dst_image == 0){
+        std::cerr << "Error creating benchmark images" << std::endl;
+        return;
+    }
+
+    // Every unfused pass reads and writes the full image, the fused kernel does so once
+    std::cout << "\nFUSION BENCHMARK (" << width << "x" << height << ", " << m_iterations << " iterations):" << std::endl;
+    displayDevice();
+    std::cout << "\t" << fusion.Describe() << std::endl;
+
+    double time_unfused = Time([&](){ return fusion.EnqueueUnfused(m_queue, src_image, dst_image, width, height); });
+    double time_fused = Time([&](){ return fusion.Enqueue(m_queue, src_image, dst_image, width, height); });
+
+    if(time_unfused < 0.0 || time_fused < 0.0){
+        std::cerr << "Error executing the benchmark kernels" << std::endl;
+    } else{
+        double unfused_bytes = 2.0 * image_size * fusion.GetPassCount();
+        double fused_bytes = 2.0 * image_size;
+
+        std::cout << "\tpasses\tunfused (ms)\tfused (ms)\tspeed-up\tunfused (MB)\tfused (MB)" << std::endl;
+        std::cout << std::fixed << std::setprecision(3)
+                  << "\t" << fusion.GetPassCount() << "->1\t" << time_unfused << "\t\t" << time_fused << "\t\t" << time_unfused / time_fused << "x"
+                  << "\t\t" << unfused_bytes * 1e-6 << "\t\t" << fused_bytes * 1e-6 << std::endl;
+    }
+
+    clReleaseMemObject(src_image);
+    clReleaseMemObject(dst_image);
+}
+
+void Benchmark::CompareIntegral(GaussianFilter &filter, IntegralImage &integral, int width, int height)
+{
+    auto algorithm = filter.GetAlgorithm();
+    auto radius = filter.GetRadius();
+    auto sigma = filter.GetSigma();
+    auto integral_sigma = integral.GetSigma();
+    double megapixels = (double)width * height * 1e-6;
+
+    cl_mem src_image = createImage(width, height);
+    cl_mem dst_image = createImage(width, height);
+    if(src_image == 0 || dst_image == 0){
+        std::cerr << "Error creating benchmark images" << std::endl;
+        return;
+    }
+
+    // Same sigma for every method, the box passes only approximate the Gaussian
+    std::cout << "\nSUMMED-AREA TABLE BENCHMARK (" << width << "x" << height << ", " << m_iterations << " iterations):" << std::endl;
+    displayDevice();
+    std::cout << "\tradius\tsigma\t2d (ms)\t\tseparable (ms)\tbox x" << IntegralImage::BOX_PASSES << " (ms)\tspeed-up\tbox (MP/s)\tbox radii" << std::endl;
+
+    for(auto r : INTEGRAL_RADII){
+        if(!filter.SetParameters(r, 0.0f) || !integral.SetSigma(filter.GetSigma())){
+            break;
+        }
+
+        double time_2d = 0.0;
+        if(r <= MAX_2D_RADIUS){
+            filter.SetAlgorithm(FilterAlgorithm::GAUSSIAN_2D);
+            time_2d = Time([&](){ return filter.Enqueue(m_queue, src_image, dst_image, width, height); });
+        }
+
+        filter.SetAlgorithm(FilterAlgorithm::SEPARABLE);
+        double time_separable = Time([&](){ return filter.Enqueue(m_queue, src_image, dst_image, width, height); });
+        double time_box = Time([&](){ return integral.Enqueue(m_queue, src_image, dst_image, width, height); });
+
+        if(time_2d < 0.0 || time_separable < 0.0 || time_box < 0.0){
+            std::cerr << "Error executing the benchmark kernels" << std::endl;
+            break;
+        }
+
+        std::string radii;
+        for(auto box_radius : integral.GetRadii()){
+            radii += (radii.empty() ? "" : ",") + std::to_string(box_radius);
+        }
+
+        std::cout << std::fixed << std::setprecision(3)
+                  << "\t" << r << "\t" << filter.GetSigma() << "\t" << (r <= MAX_2D_RADIUS ? std::to_string(time_2d) : std::string("-")) << "\t\t"
+                  << time_separable << "\t\t" << time_box << "\t\t" << time_separable / time_box << "x"
+                  << "\t\t" << megapixels / (time_box * 1e-3) << "\t\t" << radii << std::endl;
+    }
+
+    // Restore the filter configurations
+    filter.SetParameters(radius, sigma);
+    filter.SetAlgorithm(algorithm);
+    integral.SetSigma(integral_sigma);
+
+    clReleaseMemObject(src_image);
+    clReleaseMemObject(dst_image);
+}
+
+void Benchmark::ComparePlanes(GaussianFilter &filter, PlanarConverter &planar, int width, int height)
+{
+    if(filter.UsesBuffers()){
+        std::cout << "\nPlanar benchmark skipped, the " << GaussianFilter::AlgorithmName(filter.GetAlgorithm()) << " filter reads buffers" << std::endl;
+        return;
+    }
+
+    auto mode = planar.GetMode();
+    double megapixels = (double)width * height * 1e-6;
+
+    cl_int err_num;
+    cl_mem src_image = createImage(width, height);
+    cl_mem dst_image = createImage(width, height);
+    cl_mem src_plane = PlanarConverter::CreatePlane(m_context, width, height, &err_num);
+    cl_mem dst_plane = PlanarConverter::CreatePlane(m_context, width, height, &err_num);
+    if(src_image == 0 || dst_image == 0 || src_plane == 0 || dst_plane == 0){
+        std::cerr << "Error creating benchmark images" << std::endl;
+        for(auto object : {src_image, dst_image, src_plane, dst_plane}){
+            if(object != 0)
+                clReleaseMemObject(object);
+        }
+        return;
+    }
+
+    std::cout << "\nPLANAR BENCHMARK (" << width << "x" << height << ", " << GaussianFilter::AlgorithmName(filter.GetAlgorithm())
+              << " radius " << filter.GetRadius() << ", " << m_iterations << " iterations):" << std::endl;
+    displayDevice();
+    std::cout << "\tpath\t\t\ttime (ms)\tMP/s\t\tspeed-up" << std::endl;
+
+    double time_rgba = Time([&](){ return filter.Enqueue(m_queue, src_image, dst_image, width, height); });
+    auto display = [&](const std::string& path, double time_ms){
+        if(time_ms < 0.0){
+            std::cout << "\t" << path << "\tfailed" << std::endl;
+            return;
+        }
+        std::cout << std::fixed << std::setprecision(3) << "\t" << path << "\t" << time_ms << "\t\t" << megapixels / (time_ms * 1e-3)
+                  << "\t\t" << time_rgba / time_ms << "x" << std::endl;
+    };
+
+    // The filter alone on both layouts, then with the conversions the planar modes add
+    display("rgba filter\t", time_rgba);
+    display("plane filter\t", Time([&](){ return filter.Enqueue(m_queue, src_plane, dst_plane, width, height); }));
+
+    if(planar.SetMode(PlaneMode::GRAY, width, height)){
+        display("gray\t\t", Time([&](){ return planar.Enqueue(m_queue, filter, src_image, 0, width, height); }));
+        display("gray to rgba\t", Time([&](){ return planar.Enqueue(m_queue, filter, src_image, dst_image, width, height); }));
+    }
+    if(planar.SetMode(PlaneMode::LUMA, width, height)){
+        display("luma to rgba\t", Time([&](){ return planar.Enqueue(m_queue, filter, src_image, dst_image, width, height); }));
+    }
+
+    // Restore the converter configuration
+    planar.SetMode(mode, width, height);
+
+    for(auto object : {src_image, dst_image, src_plane, dst_plane}){
+        clReleaseMemObject(object);
+    }
+}
+
+void Benchmark::CompareHost(Controller &controller, GaussianFilter &filter, HostFilter &host, int width, int height)
+{
+    double megapixels = (double)width * height * 1e-6;
+    auto weights = HostFilter::Weights(filter.GetAlgorithm(), filter.GetRadius(), filter.GetSigma());
+
+    // Noise test pattern shared by every backend, PSNR is measured against the scalar host result
+    std::vector<char> input((size_t)width * height * 4), reference(input.size()), output(input.size());
+    unsigned int state = 12345;
+    for(auto& value : input){
+        state = state * 1664525u + 1013904223u;
+        value = (char)(state >> 24);
+    }
+
+    std::cout << "\nHOST BENCHMARK (" << width << "x" << height << ", " << GaussianFilter::AlgorithmName(filter.GetAlgorithm())
+              << " radius " << filter.GetRadius() << ", " << m_iterations << " iterations):" << std::endl;
+    std::cout << "\tbackend\t\ttime (ms)\tMP/s\t\tPSNR (dB)" << std::endl;
+
+    auto display = [&](const std::string& backend, double time_ms){
+        double psnr = ImageIO::PSNR((const unsigned char*)reference.data(), (const unsigned char*)output.data(), output.size());
+        std::cout << std::fixed << std::setprecision(3) << "\t" << backend << "\t" << time_ms << "\t\t" << megapixels / (time_ms * 1e-3) << "\t\t";
+        if(std::isinf(psnr)){
+            std::cout << "exact" << std::endl;
+        } else{
+            std::cout << psnr << std::endl;
+        }
+    };
+
+    // Host implementation with every instruction set this CPU supports
+    auto instruction_set = host.GetInstructionSet();
+    for(auto candidate : {HostInstructionSet::SCALAR, HostInstructionSet::SSE41, HostInstructionSet::AVX2}){
+        if(!host.SetInstructionSet(candidate)){
+            continue;
+        }
+
+        host.Apply(input.data(), output.data(), width, height, weights);
+        auto start = std::chrono::high_resolution_clock::now();
+        for(int i = 0; i < m_iterations; i++){
+            host.Apply(input.data(), output.data(), width, height, weights);
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+
+        if(candidate == HostInstructionSet::SCALAR){
+            reference = output;
+        }
+        display("host " + HostFilter::InstructionSetName(candidate) + " x" + std::to_string(host.GetThreadCount()), std::chrono::duration<double, std::milli>(end - start).count() / m_iterations);
+    }
+    host.SetInstructionSet(instruction_set);
+
+    // Look for an OpenCL CPU device with image support
+    cl_platform_id cpu_platform = 0;
+    cl_device_id cpu_device = 0, current_device = 0;
+    clGetCommandQueueInfo(m_queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &current_device, NULL);
+    findCPUDevice(cpu_platform, cpu_device);
+
+    // Run the same filter on the CPU device, or on the current device when there is none
+    cl_context context = m_context;
+    cl_command_queue queue = m_queue;
+    cl_program program = 0;
+    if(cpu_device != 0 && cpu_device != current_device){
+        context = controller.CreateContext(cpu_platform, {cpu_device});
+        queue = controller.CreateCommandQueue(context, cpu_device);
+        program = controller.CreateProgram(context, cpu_device, "gaussian_filter.cl");
+    } else if(cpu_device == 0){
+        std::cout << "\tNo OpenCL CPU device found, comparing against the current device" << std::endl;
+    }
+
+    if(context != 0 && queue != 0 && (program != 0 || context == m_context)){
+        displayDevice(queue);
+
+        auto precision = filter.GetPrecision();
+        GaussianFilter* device_filter = &filter;
+        GaussianFilter* cpu_filter = NULL;
+        if(context != m_context){
+            cpu_filter = new GaussianFilter(controller, context, cpu_device, program);
+            cpu_filter->SetParameters(filter.GetRadius(), filter.GetSigma());
+            cpu_filter->SetAlgorithm(filter.GetAlgorithm());
+            device_filter = cpu_filter;
+        }
+        device_filter->SetPrecision(FilterPrecision::FLOAT);
+
+        // Input and output in the layout the filter expects
+        cl_int err_num;
+        cl_mem objects[2] = {0, 0};
+        size_t origin[3] = {0, 0, 0};
+        size_t region[3] = {(size_t)width, (size_t)height, 1};
+        if(device_filter->UsesBuffers()){
+            objects[0] = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, input.size(), input.data(), &err_num);
+            objects[1] = clCreateBuffer(context, CL_MEM_WRITE_ONLY, input.size(), NULL, &err_num);
+        } else{
+            cl_image_format clImageFormat;
+            clImageFormat.image_channel_order = CL_RGBA;
+            clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+            objects[0] = clCreateImage2D(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &clImageFormat, width, height, 0, input.data(), &err_num);
+            objects[1] = clCreateImage2D(context, CL_MEM_WRITE_ONLY, &clImageFormat, width, height, 0, NULL, &err_num);
+        }
+
+        double time_ms = -1.0;
+        if(objects[0] != 0 && objects[1] != 0){
+            time_ms = Time(queue, [&](){ return device_filter->Enqueue(queue, objects[0], objects[1], width, height); });
+        }
+        if(time_ms >= 0.0){
+            if(device_filter->UsesBuffers()){
+                err_num = clEnqueueReadBuffer(queue, objects[1], CL_TRUE, 0, output.size(), output.data(), 0, NULL, NULL);
+            } else{
+                err_num = clEnqueueReadImage(queue, objects[1], CL_TRUE, origin, region, 0, 0, output.data(), 0, NULL, NULL);
+            }
+        }
+
+        if(time_ms < 0.0 || err_num != CL_SUCCESS){
+            std::cerr << "Error executing the OpenCL filter" << std::endl;
+        } else{
+            display("opencl float", time_ms);
+        }
+
+        for(auto object : objects){
+            if(object != 0)
+                clReleaseMemObject(object);
+        }
+
+        if(cpu_filter != NULL){
+            delete cpu_filter;
+        } else{
+            filter.SetPrecision(precision);
+        }
+    }
+
+    if(context != m_context){
+        controller.Cleanup(context, queue, program);
+    }
+}
+
+void Benchmark::CompareHistogram(Controller &controller, int width, int height)
+{
+    double megapixels = (double)width * height * 1e-6;
+
+    // Noise test pattern so that every bin sees traffic
+    std::vector<char> input((size_t)width * height * 4);
+    unsigned int state = 12345;
+    for(auto& value : input){
+        state = state * 1664525u + 1013904223u;
+        value = (char)(state >> 24);
+    }
+
+    std::cout << "\nHISTOGRAM BENCHMARK (" << width << "x" << height << ", " << m_iterations << " iterations):" << std::endl;
+
+    // Privatization trades local atomics against the merge of one private copy per group, which is measured on the CPU device
+    cl_platform_id cpu_platform = 0;
+    cl_device_id cpu_device = 0, current_device = 0;
+    clGetCommandQueueInfo(m_queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &current_device, NULL);
+    findCPUDevice(cpu_platform, cpu_device);
+
+    cl_context context = m_context;
+    cl_command_queue queue = m_queue;
+    cl_device_id device = current_device;
+    if(cpu_device != 0 && cpu_device != current_device){
+        context = controller.CreateContext(cpu_platform, {cpu_device});
+        queue = controller.CreateCommandQueue(context, cpu_device);
+        device = cpu_device;
+    } else if(cpu_device == 0){
+        std::cout << "\tNo OpenCL CPU device found, measuring the current device" << std::endl;
+    }
+
+    cl_program program = 0;
+    if(context != 0 && queue != 0){
+        program = controller.CreateProgram(context, device, "histogram.cl");
+    }
+    if(program == 0){
+        std::cerr << "Error creating the histogram program" << std::endl;
+        if(context != m_context){
+            controller.Cleanup(context, queue);
+        }
+        return;
+    }
+    displayDevice(queue);
+
+    cl_int err_num;
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = CL_RGBA;
+    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+    cl_mem src_image = clCreateImage2D(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &clImageFormat, width, height, 0, input.data(), &err_num);
+    cl_mem dst_image = clCreateImage2D(context, CL_MEM_WRITE_ONLY, &clImageFormat, width, height, 0, NULL, &err_num);
+
+    if(src_image != 0 && dst_image != 0){
+        Histogram histogram(controller, context, device, program);
+
+        std::cout << "\tgroup size\ttime (ms)\tMP/s\t\tGB/s" << std::endl;
+        for(auto group_size : HISTOGRAM_GROUP_SIZES){
+            if(group_size > histogram.GetMaxGroupSize() || !histogram.SetGroupSize(group_size)){
+                continue;
+            }
+
+            double time_ms = Time(queue, [&](){ return histogram.Enqueue(queue, src_image, width, height); });
+
+            // Every pixel lands in exactly one bin per channel
+            std::vector<cl_uint> bins;
+            cl_ulong total = 0;
+            if(time_ms >= 0.0 && histogram.Read(queue, bins)){
+                for(auto count : bins){
+                    total += count;
+                }
+            }
+
+            std::cout << "\t" << group_size << "\t\t";
+            if(time_ms < 0.0 || total != (cl_ulong)width * height * Histogram::CHANNELS){
+                std::cout << "failed" << std::endl;
+                continue;
+            }
+            std::cout << std::fixed << std::setprecision(3) << time_ms << "\t\t" << megapixels / (time_ms * 1e-3) << "\t\t"
+                      << (double)input.size() / (time_ms * 1e6) << std::endl;
+        }
+
+        // The whole equalization at the largest group size
+        histogram.SetGroupSize(0);
+        double time_ms = Time(queue, [&](){ return histogram.Equalize(queue, src_image, dst_image, width, height); });
+        if(time_ms >= 0.0){
+            std::cout << "\tEqualize (group size " << histogram.GetGroupSize() << "): " << std::fixed << std::setprecision(3) << time_ms << " ms, "
+                      << megapixels / (time_ms * 1e-3) << " MP/s" << std::endl;
+        } else{
+            std::cerr << "Error executing the equalization" << std::endl;
+        }
+    } else{
+        std::cerr << "Error creating benchmark images" << std::endl;
+    }
+
+    if(src_image != 0)
+        clReleaseMemObject(src_image);
+    if(dst_image != 0)
+        clReleaseMemObject(dst_image);
+
+    if(context != m_context){
+        controller.Cleanup(context, queue, program);
+    } else{
+        clReleaseProgram(program);
+    }
+}
+
+void Benchmark::CompareResize(Controller &controller, int width, int height)
+{
+    cl_device_id device;
+    clGetCommandQueueInfo(m_queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+
+    auto program = controller.CreateProgram(m_context, device, "resize.cl");
+    cl_mem src_image = createImage(width, height);
+    if(program == NULL || src_image == 0){
+        std::cerr << "Error creating the resize benchmark" << std::endl;
+        if(program != NULL)
+            clReleaseProgram(program);
+        if(src_image != 0)
+            clReleaseMemObject(src_image);
+        return;
+    }
+
+    std::cout << "\nRESIZE BENCHMARK (" << width << "x" << height << ", " << m_iterations << " iterations):" << std::endl;
+    displayDevice();
+    std::cout << "\tfactor\tsize\t\tlinear (ms)\tarea (ms)\tauto\t\tsource MP/s" << std::endl;
+
+    {
+        Resizer resizer(controller, m_context, program);
+        double megapixels = (double)width * height * 1e-6;
+
+        for(auto factor : RESIZE_FACTORS){
+            int dst_width = std::max(1, (int)(width / factor));
+            int dst_height = std::max(1, (int)(height / factor));
+            cl_mem dst_image = createImage(dst_width, dst_height);
+            if(dst_image == 0){
+                std::cerr << "Error creating benchmark images" << std::endl;
+                break;
+            }
+
+            resizer.SetMethod(ResizeMethod::LINEAR);
+            double time_linear = Time([&](){ return resizer.Enqueue(m_queue, src_image, dst_image, width, height, dst_width, dst_height); });
+            resizer.SetMethod(ResizeMethod::AREA);
+            double time_area = Time([&](){ return resizer.Enqueue(m_queue, src_image, dst_image, width, height, dst_width, dst_height); });
+            clReleaseMemObject(dst_image);
+
+            if(time_linear < 0.0 || time_area < 0.0){
+                std::cerr << "Error executing the resize kernels" << std::endl;
+                break;
+            }
+
+            // Throughput in source pixels, which is what a thumbnail batch is limited by
+            auto method = Resizer::SelectMethod(width, height, dst_width, dst_height);
+            double time_auto = (method == ResizeMethod::AREA) ? time_area : time_linear;
+            std::cout << std::fixed << std::setprecision(3) << "\t" << factor << "\t" << dst_width << "x" << dst_height << "\t"
+                      << (dst_width < 1000 ? "\t" : "") << time_linear << "\t\t" << time_area << "\t\t" << Resizer::MethodName(method)
+                      << "\t\t" << megapixels / (time_auto * 1e-3) << std::endl;
+        }
+    }
+
+    clReleaseMemObject(src_image);
+    clReleaseProgram(program);
+}
+
+void Benchmark::CompareScheduling(Controller &controller, GaussianFilter &filter, int width, int height)
+{
+    cl_device_id device;
+    clGetCommandQueueInfo(m_queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+
+    // Every image has its own objects and host memory, only the filter is shared
+    size_t size = (size_t)width * height * 4;
+    std::vector<char> input(size);
+    std::vector<std::vector<char>> outputs(SCHEDULING_IMAGES, std::vector<char>(size));
+    for(size_t i = 0; i < size; i++){
+        input[i] = (char)((i * 2654435761u) >> 24);
+    }
+
+    std::vector<cl_mem> objects;
+    for(int i = 0; i < 2 * SCHEDULING_IMAGES; i++){
+        cl_mem object = filter.UsesBuffers() ? createBuffer(size) : createImage(width, height);
+        if(object == 0){
+            std::cerr << "Error creating benchmark images" << std::endl;
+            break;
+        }
+        objects.push_back(object);
+    }
+
+    std::cout << "\nSCHEDULING BENCHMARK (" << SCHEDULING_IMAGES << " images of " << width << "x" << height << ", " << m_iterations << " iterations):" << std::endl;
+    displayDevice();
+    std::cout << "\tOut-of-order queues: " << (Controller::SupportsOutOfOrder(device) ? "supported" : "not supported") << std::endl;
+    std::cout << "\tqueues\t\t\ttime (ms)\timages/s\tspeedup" << std::endl;
+
+    double serial_ms = 0.0;
+    for(auto mode : {QueueMode::SERIAL, QueueMode::IN_ORDER, QueueMode::OUT_OF_ORDER}){
+        if((int)objects.size() != 2 * SCHEDULING_IMAGES || (mode == QueueMode::OUT_OF_ORDER && !Controller::SupportsOutOfOrder(device))){
+            break;
+        }
+
+        CommandScheduler scheduler(controller, m_context, device, mode);
+
+        // Upload, filter and read back every image. The filters also wait for each other because they share
+        // their intermediate objects, so an upload or readback is all that can overlap with a filter
+        auto run = [&](){
+            int previous_filter = -1;
+            for(int i = 0; i < SCHEDULING_IMAGES; i++){
+                cl_mem src = objects[2 * i], dst = objects[2 * i + 1];
+                char* output = outputs[i].data();
+
+                int upload = scheduler.Add(LANE_UPLOAD, {}, [&](cl_command_queue queue, cl_uint num_events, const cl_event* wait_list, cl_event* event){
+                    if(filter.UsesBuffers()){
+                        return clEnqueueWriteBuffer(queue, src, CL_FALSE, 0, size, input.data(), num_events, wait_list, event);
+                    }
+                    size_t origin[3] = {0, 0, 0};
+                    size_t region[3] = {(size_t)width, (size_t)height, 1};
+                    return clEnqueueWriteImage(queue, src, CL_FALSE, origin, region, 0, 0, input.data(), num_events, wait_list, event);
+                });
+
+                std::vector<int> dependencies = {upload};
+                if(previous_filter >= 0)
+                    dependencies.push_back(previous_filter);
+                int filtered = (upload < 0) ? -1 : scheduler.Add(LANE_COMPUTE, dependencies, [&](cl_command_queue queue, cl_uint num_events, const cl_event* wait_list, cl_event* event){
+                    return filter.Enqueue(queue, src, dst, width, height, num_events, wait_list, event);
+                });
+
+                int readback = (filtered < 0) ? -1 : scheduler.Add(LANE_DOWNLOAD, {filtered}, [&](cl_command_queue queue, cl_uint num_events, const cl_event* wait_list, cl_event* event){
+                    if(filter.UsesBuffers()){
+                        return clEnqueueReadBuffer(queue, dst, CL_FALSE, 0, size, output, num_events, wait_list, event);
+                    }
+                    size_t origin[3] = {0, 0, 0};
+                    size_t region[3] = {(size_t)width, (size_t)height, 1};
+                    return clEnqueueReadImage(queue, dst, CL_FALSE, origin, region, 0, 0, output, num_events, wait_list, event);
+                });
+
+                if(readback < 0){
+                    scheduler.Finish();
+                    return false;
+                }
+                previous_filter = filtered;
+            }
+            return scheduler.Finish() == CL_SUCCESS;
+        };
+
+        // Warm-up run so that lazy allocations are not measured
+        if(!run()){
+            std::cerr << "Error executing the " << CommandScheduler::ModeName(mode) << " workload" << std::endl;
+            break;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        auto result = true;
+        for(int i = 0; i < m_iterations && result; i++){
+            result = run();
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        if(!result){
+            std::cerr << "Error executing the " << CommandScheduler::ModeName(mode) << " workload" << std::endl;
+            break;
+        }
+
+        double time_ms = std::chrono::duration<double, std::milli>(end - start).count() / m_iterations;
+        if(mode == QueueMode::SERIAL){
+            serial_ms = time_ms;
+        }
+
+        auto name = CommandScheduler::ModeName(scheduler.GetMode()) + ((scheduler.GetMode() == QueueMode::IN_ORDER) ? " (" + std::to_string(CommandScheduler::DEFAULT_LANES) + " queues)" : "");
+        std::cout << std::fixed << std::setprecision(3) << "\t" << name << (name.size() < 16 ? "\t\t" : "\t") << time_ms << "\t\t"
+                  << std::setprecision(1) << SCHEDULING_IMAGES / (time_ms * 1e-3) << "\t\t" << std::setprecision(2) << serial_ms / time_ms << "x" << std::endl;
+    }
+
+    for(auto object : objects){
+        clReleaseMemObject(object);
+    }
+}
+
+void Benchmark::findCPUDevice(cl_platform_id &cpu_platform, cl_device_id &cpu_device)
+{
+    cpu_platform = 0;
+    cpu_device = 0;
+
+    cl_uint num_platforms = 0;
+    clGetPlatformIDs(0, NULL, &num_platforms);
+    std::vector<cl_platform_id> platforms(num_platforms);
+    clGetPlatformIDs(num_platforms, platforms.data(), NULL);
+    for(auto platform : platforms){
+        cl_device_id device;
+        cl_bool image_support = CL_FALSE;
+        if(cpu_device == 0 && clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL) == CL_SUCCESS &&
+           clGetDeviceInfo(device, CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &image_support, NULL) == CL_SUCCESS && image_support == CL_TRUE){
+            cpu_platform = platform;
+            cpu_device = device;
+        }
+    }
+}
+
+cl_mem Benchmark::createImage(int width, int height, cl_context context)
+{
+    cl_int err_num;
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = CL_RGBA;
+    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+    cl_mem image = clCreateImage2D(context != 0 ? context : m_context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, &err_num);
+    return (err_num == CL_SUCCESS) ? image : 0;
+}
+
+cl_mem Benchmark::createBuffer(size_t size, cl_context context)
+{
+    cl_int err_num;
+    cl_mem buffer = clCreateBuffer(context != 0 ? context : m_context, CL_MEM_READ_WRITE, size, NULL, &err_num);
+    return (err_num == CL_SUCCESS) ? buffer : 0;
+}
+
+void Benchmark::displayDevice(cl_command_queue queue)
+{
+    cl_device_id device;
+    cl_device_type type;
+    char name[256] = {};
+
+    clGetCommandQueueInfo(queue != 0 ? queue : m_queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_TYPE, sizeof(cl_device_type), &type, NULL);
+
+    std::cout << "\tDevice: " << name << ((type & CL_DEVICE_TYPE_CPU) ? " (CPU)" : (type & CL_DEVICE_TYPE_GPU) ? " (GPU)" : "") << std::endl;
+}
@@ -0,0 +1,141 @@
+#include "CommandScheduler.hpp"
+
+#include <algorithm>
+
+CommandScheduler::CommandScheduler(Controller& controller, cl_context context, cl_device_id device, QueueMode mode, int lanes, cl_command_queue_properties properties)
+    : m_mode{mode}
+{
+    auto out_of_order = Controller::SupportsOutOfOrder(device);
+    if(m_mode == QueueMode::AUTO){
+        m_mode = out_of_order ? QueueMode::OUT_OF_ORDER : QueueMode::IN_ORDER;
+    } else if(m_mode == QueueMode::OUT_OF_ORDER && !out_of_order){
+        std::cerr << "Device has no out-of-order queues, using " << std::max(lanes, 1) << " in-order queues" << std::endl;
+        m_mode = QueueMode::IN_ORDER;
+    }
+
+    int queues = (m_mode == QueueMode::IN_ORDER) ? std::max(lanes, 1) : 1;
+    if(m_mode == QueueMode::OUT_OF_ORDER){
+        properties |= CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
+    }
+    for(int i = 0; i < queues; i++){
+        auto queue = controller.CreateCommandQueue(context, device, properties);
+        if(queue == NULL){
+            controller.CheckError(CL_OUT_OF_RESOURCES, "clCreateCommandQueue");
+        }
+        m_queues.push_back(queue);
+    }
+}
+
+CommandScheduler::~CommandScheduler()
+{
+    Finish();
+
+    for(auto queue : m_queues){
+        clReleaseCommandQueue(queue);
+    }
+}
+
+bool CommandScheduler::ParseMode(const std::string &name, QueueMode &mode)
+{
+    if(name == "out-of-order"){
+        mode = QueueMode::OUT_OF_ORDER;
+    } else if(name == "in-order"){
+        mode = QueueMode::IN_ORDER;
+    } else if(name == "serial"){
+        mode = QueueMode::SERIAL;
+    } else if(name == "auto"){
+        mode = QueueMode::AUTO;
+    } else{
+        return false;
+    }
+    return true;
+}
+
+std::string CommandScheduler::ModeName(QueueMode mode)
+{
+    switch(mode){
+    case QueueMode::OUT_OF_ORDER:
+        return "out-of-order";
+    case QueueMode::IN_ORDER:
+        return "in-order";
+    case QueueMode::SERIAL:
+        return "serial";
+    case QueueMode::AUTO:
+        return "auto";
+    }
+    return "unknown";
+}
+
+QueueMode CommandScheduler::GetMode() const
+{
+    return m_mode;
+}
+
+int CommandScheduler::Add(int lane, const std::vector<int> &dependencies, const Command &command)
+{
+    int queue = std::max(lane, 0) % (int)m_queues.size();
+
+    // An in-order queue already runs its commands in order, only dependencies on other queues need events
+    std::vector<cl_event> wait_list;
+    for(auto node : dependencies){
+        if(node < 0 || node >= (int)m_events.size()){
+            std::cerr << "Invalid dependency on node " << node << std::endl;
+            return -1;
+        }
+        if(m_events[node] != 0 && (m_mode == QueueMode::OUT_OF_ORDER || m_node_queues[node] != queue)){
+            wait_list.push_back(m_events[node]);
+        }
+    }
+
+    cl_event event = 0;
+    cl_int err_num = command(m_queues[queue], (cl_uint)wait_list.size(), wait_list.empty() ? NULL : wait_list.data(), &event);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error enqueueing node " << m_events.size() << " (" << err_num << ")" << std::endl;
+        if(event != 0)
+            clReleaseEvent(event);
+        return -1;
+    }
+
+    // Submit right away, a command waiting on another queue must not depend on an unflushed one
+    clFlush(m_queues[queue]);
+
+    m_events.push_back(event);
+    m_node_queues.push_back(queue);
+    return (int)m_events.size() - 1;
+}
+
+cl_event CommandScheduler::GetEvent(int node) const
+{
+    return (node >= 0 && node < (int)m_events.size()) ? m_events[node] : 0;
+}
+
+void CommandScheduler::Release(int node)
+{
+    if(node >= 0 && node < (int)m_events.size() && m_events[node] != 0){
+        clReleaseEvent(m_events[node]);
+        m_events[node] = 0;
+    }
+}
+
+cl_int CommandScheduler::Finish()
+{
+    cl_int err_num = CL_SUCCESS;
+    for(auto queue : m_queues){
+        cl_int finish = clFinish(queue);
+        if(err_num == CL_SUCCESS)
+            err_num = finish;
+    }
+
+    releaseEvents();
+    return err_num;
+}
+
+void CommandScheduler::releaseEvents()
+{
+    for(auto event : m_events){
+        if(event != 0)
+            clReleaseEvent(event);
+    }
+    m_events.clear();
+    m_node_queues.clear();
+}
@@ -1,6 +1,90 @@
 #include "Controller.hpp"
 
-Controller::Controller() : num_platforms{0}, num_devices{0} {}
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <random>
+#ifndef _WIN32
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    // Cache files start with PROGRAM_CACHE_MAGIC, the key check, the binary size and its checksum
+    const char PROGRAM_CACHE_MAGIC[8] = {'C', 'L', 'B', 'I', 'N', '0', '0', '1'};
+    const uint64_t FNV_OFFSET = 14695981039346656037ull;
+    const uint64_t FNV_PRIME = 1099511628211ull;
+
+    // A second offset gives an independent hash of the key, stored in the file to catch collisions of the file name
+    const uint64_t FNV_CHECK_OFFSET = 0x9e3779b97f4a7c15ull;
+
+    uint64_t fnv1a(const char* data, size_t size, uint64_t hash = FNV_OFFSET)
+    {
+        for(size_t i = 0; i < size; i++){
+            hash = (hash ^ (unsigned char)data[i]) * FNV_PRIME;
+        }
+        return hash;
+    }
+
+    std::string deviceString(cl_device_id device, cl_device_info name)
+    {
+        size_t size = 0;
+        clGetDeviceInfo(device, name, 0, NULL, &size);
+        std::string value(size, '\0');
+        clGetDeviceInfo(device, name, size, &value[0], NULL);
+        return value;
+    }
+
+    // Cached binaries run on the device unchecked, so only files and directories nobody else can write are used
+    bool privateToUser(const std::filesystem::path& path)
+    {
+#ifdef _WIN32
+        // Per-user profile directories are already private
+        return true;
+#else
+        struct stat status;
+        if(lstat(path.c_str(), &status) != 0){
+            return false;
+        }
+        return status.st_uid == geteuid() && (status.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+#endif
+    }
+}
+
+Controller::Controller() : num_platforms{0}, num_devices{0}
+{
+    // FILTER_PROGRAM_CACHE moves the cache, set to an empty string it disables it. The default is per user
+    const char* directory = std::getenv("FILTER_PROGRAM_CACHE");
+#ifdef _WIN32
+    const char* user_cache = std::getenv("LOCALAPPDATA");
+    const char* home = NULL;
+#else
+    const char* user_cache = std::getenv("XDG_CACHE_HOME");
+    const char* home = std::getenv("HOME");
+#endif
+    if(directory != NULL){
+        m_cache_directory = directory;
+    } else if(user_cache != NULL && *user_cache != '\0'){
+        m_cache_directory = std::filesystem::path(user_cache) / "2DImageFilter";
+    } else if(home != NULL && *home != '\0'){
+        m_cache_directory = std::filesystem::path(home) / ".cache" / "2DImageFilter";
+    }
+}
+
+Controller::~Controller()
+{
+    // Drop the references held by the program cache
+    for(auto& program : m_programs){
+        clReleaseProgram(program.second);
+    }
+
+    for(auto device : m_sub_devices){
+        clReleaseDevice(device);
+    }
+}
 
 void Controller::CheckError(cl_int err, const char *name)
 {
@@ -63,6 +147,31 @@ std::vector<cl_device_id> Controller::GetDevices(cl_platform_id platform)
     return m_devices;
 }
 
+std::vector<cl_device_id> Controller::PartitionDevices(const std::vector<cl_device_id>& devices)
+{
+    std::vector<cl_device_id> partitioned;
+    cl_device_partition_property properties[] = {CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN, CL_DEVICE_AFFINITY_DOMAIN_NUMA, 0};
+
+    for(auto device : devices){
+        // Devices that cannot be split by NUMA node, or span only one, are used whole
+        cl_uint count = 0;
+        if(clCreateSubDevices(device, properties, 0, NULL, &count) == CL_SUCCESS && count > 1){
+            std::vector<cl_device_id> sub_devices(count);
+            if(clCreateSubDevices(device, properties, count, sub_devices.data(), NULL) == CL_SUCCESS){
+                partitioned.insert(partitioned.end(), sub_devices.begin(), sub_devices.end());
+                m_sub_devices.insert(m_sub_devices.end(), sub_devices.begin(), sub_devices.end());
+                continue;
+            }
+        }
+        partitioned.push_back(device);
+    }
+
+    if(partitioned.size() > devices.size()){
+        std::cout << "Partitioned " << devices.size() << " devices into " << partitioned.size() << " NUMA sub-devices" << std::endl;
+    }
+    return partitioned;
+}
+
 cl_context Controller::CreateContext(cl_platform_id platform, std::vector<cl_device_id> devices)
 {
     cl_int err_num;
@@ -74,19 +183,28 @@ cl_context Controller::CreateContext(cl_platform_id platform, std::vector<cl_dev
     std::memcpy(m_devices, devices.data(), devices.size() * sizeof(cl_device_id));
 
     // Create context
-    context = clCreateContext(context_properties, num_devices, m_devices, NULL, NULL, &err_num);
+    context = clCreateContext(context_properties, (cl_uint)devices.size(), m_devices, NULL, NULL, &err_num);
+    delete[] m_devices;
     CheckError(err_num, "clCreateContext");
 
     std::cout << "Successfully created a context" << std::endl;
     return context;
 }
 
-cl_command_queue Controller::CreateCommandQueue(cl_context context, cl_device_id device)
+bool Controller::SupportsOutOfOrder(cl_device_id device)
+{
+    // Same query as CL_DEVICE_QUEUE_ON_HOST_PROPERTIES of OpenCL 2.0
+    cl_command_queue_properties properties = 0;
+    clGetDeviceInfo(device, CL_DEVICE_QUEUE_PROPERTIES, sizeof(cl_command_queue_properties), &properties, NULL);
+    return (properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) != 0;
+}
+
+cl_command_queue Controller::CreateCommandQueue(cl_context context, cl_device_id device, cl_command_queue_properties properties)
 {
     cl_command_queue command_queue;
 
     // Create a command queue
-    command_queue = clCreateCommandQueue(context, device, 0, NULL);
+    command_queue = clCreateCommandQueue(context, device, properties, NULL);
     if(command_queue == NULL){
         std::cerr << "Failed to create CommandQueue" << std::endl;
         return NULL;
@@ -96,11 +214,8 @@ cl_command_queue Controller::CreateCommandQueue(cl_context context, cl_device_id
     return command_queue;
 }
 
-cl_program Controller::CreateProgram(cl_context context, cl_device_id device, const char *filename)
+cl_program Controller::CreateProgram(cl_context context, cl_device_id device, const char *filename, const std::string &build_options)
 {
-    cl_int err_num;
-    cl_program program;
-
     // Open the kernel file
     std::ifstream kernelFile(filename, std::ios::in);
     if(!kernelFile.is_open()){
@@ -112,9 +227,43 @@ cl_program Controller::CreateProgram(cl_context context, cl_device_id device, co
     std::ostringstream oss;
     oss << kernelFile.rdbuf();
 
-    // Convert the buffer from the output stream to a standard string
-    std::string srcStdStr = oss.str();
-    const char *srcStr = srcStdStr.c_str();
+    return CreateProgramWithSource(context, device, oss.str(), build_options);
+}
+
+cl_program Controller::CreateProgramWithSource(cl_context context, cl_device_id device, const std::string &source, const std::string &build_options)
+{
+    cl_int err_num;
+    cl_program program;
+
+    // Reuse a program already built from the same source
+    auto key = std::make_tuple(context, device, source, build_options);
+    auto cached = m_programs.find(key);
+    if(cached != m_programs.end()){
+        clRetainProgram(cached->second);
+        return cached->second;
+    }
+
+    // A binary built earlier for the same source, options, device and driver skips the compiler
+    std::string binary_key;
+    std::filesystem::path binary_path;
+    if(!m_cache_directory.empty()){
+        binary_key = binaryKey(device, source, build_options);
+
+        std::ostringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << fnv1a(binary_key.data(), binary_key.size()) << ".bin";
+        binary_path = m_cache_directory / name.str();
+
+        program = loadBinary(context, device, binary_path, binary_key, build_options);
+        if(program != NULL){
+            clRetainProgram(program);
+            m_programs[key] = program;
+
+            std::cout << "Successfully loaded a cached program binary" << std::endl;
+            return program;
+        }
+    }
+
+    const char *srcStr = source.c_str();
 
     // Create a program
     program = clCreateProgramWithSource(context, 1, (const char**)&srcStr, NULL, NULL);
@@ -123,8 +272,8 @@ cl_program Controller::CreateProgram(cl_context context, cl_device_id device, co
         return NULL;
     }
 
-    // Build the program    
-    err_num = clBuildProgram(program, 0, NULL, NULL, NULL, NULL);
+    // Build the program for the device it is requested for
+    err_num = clBuildProgram(program, 1, &device, build_options.c_str(), NULL, NULL);
     if(err_num != CL_SUCCESS){
         // Determine the reason for failure
         char buildLog[16384];
@@ -135,10 +284,159 @@ cl_program Controller::CreateProgram(cl_context context, cl_device_id device, co
         return NULL;
     }
 
+    if(!binary_path.empty()){
+        storeBinary(program, device, binary_path, binary_key);
+    }
+
+    // The cache keeps its own reference
+    clRetainProgram(program);
+    m_programs[key] = program;
+
     std::cout << "Successfully created a program" << std::endl;
     return program;
 }
 
+std::string Controller::binaryKey(cl_device_id device, const std::string &source, const std::string &build_options)
+{
+    cl_platform_id platform = 0;
+    clGetDeviceInfo(device, CL_DEVICE_PLATFORM, sizeof(cl_platform_id), &platform, NULL);
+
+    size_t size = 0;
+    clGetPlatformInfo(platform, CL_PLATFORM_VERSION, 0, NULL, &size);
+    std::string platform_version(size, '\0');
+    clGetPlatformInfo(platform, CL_PLATFORM_VERSION, size, &platform_version[0], NULL);
+
+    // A driver or platform update gives a new key, so binaries of the old one are never loaded
+    std::string key;
+    for(auto& part : {source, build_options, deviceString(device, CL_DEVICE_NAME), deviceString(device, CL_DRIVER_VERSION), platform_version}){
+        key += std::to_string(part.size()) + ":" + part + ";";
+    }
+    return key;
+}
+
+cl_program Controller::loadBinary(cl_context context, cl_device_id device, const std::filesystem::path &path, const std::string &key, const std::string &build_options)
+{
+    // Another user could have planted the file, skip the cache then
+    if(!privateToUser(path.parent_path()) || !privateToUser(path)){
+        return NULL;
+    }
+
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if(!file.is_open()){
+        return NULL;
+    }
+
+    // Header and checksum catch truncated or corrupt files, the key check a collision of the file name
+    char magic[sizeof(PROGRAM_CACHE_MAGIC)];
+    uint64_t key_check = 0, size = 0, checksum = 0;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&key_check, sizeof(key_check));
+    file.read((char*)&size, sizeof(size));
+    file.read((char*)&checksum, sizeof(checksum));
+
+    std::vector<unsigned char> binary;
+    bool valid = file.good() && std::memcmp(magic, PROGRAM_CACHE_MAGIC, sizeof(magic)) == 0 &&
+                 key_check == fnv1a(key.data(), key.size(), FNV_CHECK_OFFSET) && size > 0 && size < (1ull << 31);
+    if(valid){
+        binary.resize(size);
+        valid = file.read((char*)binary.data(), size) && file.peek() == std::char_traits<char>::eof() &&
+                fnv1a((const char*)binary.data(), binary.size()) == checksum;
+    }
+    file.close();
+
+    cl_program program = NULL;
+    if(valid){
+        const unsigned char* data = binary.data();
+        size_t binary_size = binary.size();
+        cl_int binary_status, err_num;
+
+        program = clCreateProgramWithBinary(context, 1, &device, &binary_size, &data, &binary_status, &err_num);
+        if(program != NULL && (err_num != CL_SUCCESS || binary_status != CL_SUCCESS || clBuildProgram(program, 1, &device, build_options.c_str(), NULL, NULL) != CL_SUCCESS)){
+            clReleaseProgram(program);
+            program = NULL;
+        }
+    }
+
+    // Rebuilt from source and stored again by the caller
+    if(program == NULL){
+        std::cerr << "Discarding stale program binary " << path.string() << std::endl;
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+    return program;
+}
+
+void Controller::storeBinary(cl_program program, cl_device_id device, const std::filesystem::path &path, const std::string &key)
+{
+    // The program belongs to every device of the context but is only built for `device`, find its entry
+    cl_uint num_program_devices = 0;
+    if(clGetProgramInfo(program, CL_PROGRAM_NUM_DEVICES, sizeof(cl_uint), &num_program_devices, NULL) != CL_SUCCESS || num_program_devices == 0){
+        return;
+    }
+    std::vector<cl_device_id> program_devices(num_program_devices);
+    std::vector<size_t> sizes(num_program_devices, 0);
+    if(clGetProgramInfo(program, CL_PROGRAM_DEVICES, sizeof(cl_device_id) * num_program_devices, program_devices.data(), NULL) != CL_SUCCESS ||
+       clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size_t) * num_program_devices, sizes.data(), NULL) != CL_SUCCESS){
+        return;
+    }
+
+    auto index = std::find(program_devices.begin(), program_devices.end(), device) - program_devices.begin();
+    if(index == (std::ptrdiff_t)num_program_devices || sizes[index] == 0){
+        return;
+    }
+    size_t size = sizes[index];
+
+    // Only the entry of `device` receives the binary, the other pointers are NULL and skipped
+    std::vector<unsigned char> binary(size);
+    std::vector<unsigned char*> binaries(num_program_devices, NULL);
+    binaries[index] = binary.data();
+    if(clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(unsigned char*) * num_program_devices, binaries.data(), NULL) != CL_SUCCESS){
+        return;
+    }
+
+    // The cache directory is created owner-only, one that others can write to is not used
+    std::error_code error;
+    auto directory = path.parent_path();
+    if(!std::filesystem::exists(directory, error)){
+        std::filesystem::create_directories(directory.parent_path(), error);
+#ifdef _WIN32
+        std::filesystem::create_directory(directory, error);
+#else
+        mkdir(directory.c_str(), S_IRWXU);
+#endif
+    }
+    if(!privateToUser(directory)){
+        std::cerr << "Not caching program binaries in " << directory.string() << ", it is writable by other users" << std::endl;
+        return;
+    }
+
+    // Write under a unique name and rename, so concurrent runs never see a partial file
+    auto temp = path;
+    temp += "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + "." + std::to_string(std::random_device{}()) + ".tmp";
+
+    uint64_t key_check = fnv1a(key.data(), key.size(), FNV_CHECK_OFFSET);
+    uint64_t binary_size = size;
+    uint64_t checksum = fnv1a((const char*)binary.data(), binary.size());
+
+    std::ofstream file(temp, std::ios::out | std::ios::binary);
+    file.write(PROGRAM_CACHE_MAGIC, sizeof(PROGRAM_CACHE_MAGIC));
+    file.write((const char*)&key_check, sizeof(key_check));
+    file.write((const char*)&binary_size, sizeof(binary_size));
+    file.write((const char*)&checksum, sizeof(checksum));
+    file.write((const char*)binary.data(), binary.size());
+    file.close();
+    std::filesystem::permissions(temp, std::filesystem::perms::owner_read | std::filesystem::perms::owner_write, error);
+
+    if(!file.good()){
+        std::filesystem::remove(temp, error);
+        return;
+    }
+    std::filesystem::rename(temp, path, error);
+    if(error){
+        std::filesystem::remove(temp, error);
+    }
+}
+
 cl_kernel Controller::CreateKernel(cl_program program, const char *kernel_name)
 {
     cl_int err_num;
@@ -151,12 +449,94 @@ cl_kernel Controller::CreateKernel(cl_program program, const char *kernel_name)
     return kernel;
 }
 
+MemoryPool& Controller::GetMemoryPool(cl_context context)
+{
+    auto& pool = m_pools[context];
+    if(!pool){
+        pool.reset(new MemoryPool(context));
+    }
+    return *pool;
+}
+
 void Controller::DisplayPlatformInformation(cl_platform_id platform)
 {
     InfoPlatform platform_handler(platform);
     platform_handler.Display();
 }
 
+size_t Controller::RoundUp(int group_size, int global_size)
+{
+    int r = global_size % group_size;
+
+    if(r == 0){
+        return global_size;
+    } else{
+        return global_size + group_size - r;
+    }
+}
+
+cl_ulong Controller::GetProfilingTime(cl_event event, cl_profiling_info name)
+{
+    cl_ulong time = 0;
+
+    // Requires a queue created with CL_QUEUE_PROFILING_ENABLE
+    clGetEventProfilingInfo(event, name, sizeof(cl_ulong), &time, NULL);
+    return time;
+}
+
+EventFuture Controller::EnqueueAsync(cl_command_queue queue, const std::function<cl_int(cl_event* event)>& enqueue, cl_int* err_num)
+{
+    cl_event event = 0;
+    cl_int err = enqueue(&event);
+
+    // Without a flush the command may never be submitted and its callback never fire
+    if(err == CL_SUCCESS){
+        err = clFlush(queue);
+    }
+
+    if(err_num != NULL){
+        *err_num = err;
+    }
+    if(err != CL_SUCCESS){
+        if(event != 0)
+            clReleaseEvent(event);
+        return EventFuture::Failed(err);
+    }
+    return EventFuture(event);
+}
+
+EventFuture Controller::WriteImageAsync(cl_command_queue queue, cl_mem image, int width, int height, const void* ptr, size_t row_pitch, cl_uint num_events, const cl_event* wait_list, cl_int* err_num)
+{
+    return EnqueueAsync(queue, [&](cl_event* event){
+        size_t origin[3] = {0, 0, 0};
+        size_t region[3] = {(size_t)width, (size_t)height, 1};
+        return clEnqueueWriteImage(queue, image, CL_FALSE, origin, region, row_pitch, 0, ptr, num_events, wait_list, event);
+    }, err_num);
+}
+
+EventFuture Controller::ReadImageAsync(cl_command_queue queue, cl_mem image, int width, int height, void* ptr, size_t row_pitch, cl_uint num_events, const cl_event* wait_list, cl_int* err_num)
+{
+    return EnqueueAsync(queue, [&](cl_event* event){
+        size_t origin[3] = {0, 0, 0};
+        size_t region[3] = {(size_t)width, (size_t)height, 1};
+        return clEnqueueReadImage(queue, image, CL_FALSE, origin, region, row_pitch, 0, ptr, num_events, wait_list, event);
+    }, err_num);
+}
+
+EventFuture Controller::WriteBufferAsync(cl_command_queue queue, cl_mem buffer, size_t size, const void* ptr, cl_uint num_events, const cl_event* wait_list, cl_int* err_num)
+{
+    return EnqueueAsync(queue, [&](cl_event* event){
+        return clEnqueueWriteBuffer(queue, buffer, CL_FALSE, 0, size, ptr, num_events, wait_list, event);
+    }, err_num);
+}
+
+EventFuture Controller::ReadBufferAsync(cl_command_queue queue, cl_mem buffer, size_t size, void* ptr, cl_uint num_events, const cl_event* wait_list, cl_int* err_num)
+{
+    return EnqueueAsync(queue, [&](cl_event* event){
+        return clEnqueueReadBuffer(queue, buffer, CL_FALSE, 0, size, ptr, num_events, wait_list, event);
+    }, err_num);
+}
+
 void Controller::Cleanup(cl_context context, cl_command_queue commandQueue, cl_program program, cl_kernel kernel, cl_sampler sampler, cl_mem *mem_objects, int num_mem_objects)
 {
     std::cout << "Performing cleanup" << std::endl;
@@ -181,9 +561,11 @@ void Controller::Cleanup(cl_context context, cl_command_queue commandQueue, cl_p
     if (program != 0)
         clReleaseProgram(program);
 
-    // Free the context
-    if (context != 0)
+    // Free the pooled memory objects and the context
+    if (context != 0){
+        m_pools.erase(context);
         clReleaseContext(context);
+    }
 
     // Free the sampler
     if (sampler != 0)
@@ -0,0 +1,128 @@
+#include "EventFuture.hpp"
+
+#include <iostream>
+
+EventFuture::State::~State()
+{
+    if(event != 0)
+        clReleaseEvent(event);
+}
+
+EventFuture::EventFuture() {}
+
+EventFuture::EventFuture(cl_event event) : m_state{std::make_shared<State>()}
+{
+    m_state->event = event;
+    m_state->complete = false;
+    m_state->status = CL_SUCCESS;
+
+    // The callback keeps the state alive until it has run, even after every handle is gone
+    auto user_data = new std::shared_ptr<State>(m_state);
+    cl_int err_num = clSetEventCallback(event, CL_COMPLETE, &EventFuture::onComplete, user_data);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error registering an event callback (" << err_num << ")" << std::endl;
+        delete user_data;
+        finish(err_num);
+    }
+}
+
+EventFuture EventFuture::Failed(cl_int err_num)
+{
+    EventFuture future;
+    future.m_state = std::make_shared<State>();
+    future.m_state->event = 0;
+    future.m_state->complete = true;
+    future.m_state->status = err_num;
+    return future;
+}
+
+bool EventFuture::Valid() const
+{
+    return m_state != nullptr;
+}
+
+cl_event EventFuture::GetEvent() const
+{
+    return m_state ? m_state->event : 0;
+}
+
+bool EventFuture::IsReady() const
+{
+    if(!m_state){
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->complete;
+}
+
+cl_int EventFuture::Wait() const
+{
+    if(!m_state){
+        return CL_INVALID_EVENT;
+    }
+
+    std::unique_lock<std::mutex> lock(m_state->mutex);
+    m_state->done.wait(lock, [this](){ return m_state->complete; });
+    return m_state->status;
+}
+
+std::future<void> EventFuture::Then(ThreadPool &pool, std::function<void(cl_int status)> continuation) const
+{
+    auto promise = std::make_shared<std::promise<void>>();
+    auto future = promise->get_future();
+
+    if(!m_state){
+        promise->set_value();
+        return future;
+    }
+
+    // Runs on the callback thread, which must not block, so the continuation itself goes to the pool
+    auto dispatch = [&pool, promise, continuation](cl_int status){
+        pool.Submit([promise, continuation, status](){
+            try{
+                continuation(status);
+                promise->set_value();
+            } catch(...){
+                promise->set_exception(std::current_exception());
+            }
+        });
+    };
+
+    std::unique_lock<std::mutex> lock(m_state->mutex);
+    if(m_state->complete){
+        auto status = m_state->status;
+        lock.unlock();
+        dispatch(status);
+    } else{
+        m_state->continuations.push_back(dispatch);
+    }
+    return future;
+}
+
+void CL_CALLBACK EventFuture::onComplete(cl_event event, cl_int status, void *user_data)
+{
+    auto state = static_cast<std::shared_ptr<State>*>(user_data);
+
+    EventFuture future;
+    future.m_state = *state;
+    delete state;
+
+    future.finish(status);
+}
+
+void EventFuture::finish(cl_int status) const
+{
+    std::vector<std::function<void(cl_int status)>> continuations;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->complete = true;
+        m_state->status = status;
+        continuations.swap(m_state->continuations);
+    }
+    m_state->done.notify_all();
+
+    for(auto& continuation : continuations){
+        continuation(status);
+    }
+}
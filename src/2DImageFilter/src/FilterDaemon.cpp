@@ -0,0 +1,399 @@
+#include "FilterDaemon.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <sstream>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char FIELD_SEPARATOR = '\t';
+    const int LISTEN_BACKLOG = 16;
+
+    // Jobs are served one at a time, a client that stalls longer than this is dropped
+    const int CLIENT_TIMEOUT_S = 5;
+
+    // A client that hung up must not kill the daemon with SIGPIPE
+#ifdef MSG_NOSIGNAL
+    const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+    const int SEND_FLAGS = 0;
+#endif
+
+    // Reject jobs that would need anything but the single-image Gaussian path
+    bool servable(const Options& options, std::string& error)
+    {
+        if(options.benchmark || !options.batch_dir.empty() || options.stream || !options.graph.empty() || !options.fuse.empty() ||
+           options.box || options.pyramid || options.equalize || options.planes != PlaneMode::RGBA || !options.thumbnails.empty() ||
+           !options.regression_dir.empty() || options.tile_size > 0 || options.host || !options.serve_socket.empty()){
+            error = "the daemon only runs single-image Gaussian jobs";
+            return false;
+        }
+
+        // Options of a single run that the daemon would otherwise ignore
+        Options defaults;
+        if(options.verify || options.multi_device){
+            error = "the daemon does not run --verify or --multi-device jobs";
+            return false;
+        }
+        if(options.ingest != defaults.ingest || options.readback != defaults.readback){
+            error = "the daemon uses its own transfers, --ingest and --readback are not supported";
+            return false;
+        }
+        return true;
+    }
+}
+
+FilterDaemon::FilterDaemon(Controller& controller, cl_context context, cl_command_queue queue, GaussianFilter& filter, double startup_ms)
+    : m_queue{queue}, m_filter{filter}, m_pool{controller.GetMemoryPool(context)}, m_startup_ms{startup_ms}
+{
+}
+
+FilterDaemon::~FilterDaemon()
+{
+}
+
+#ifdef _WIN32
+
+bool FilterDaemon::Serve(const std::string &socket_path)
+{
+    std::cerr << "The filter daemon needs Unix domain sockets" << std::endl;
+    return false;
+}
+
+int FilterDaemon::Submit(const std::string &socket_path, const std::vector<std::string> &args)
+{
+    std::cerr << "The filter daemon needs Unix domain sockets" << std::endl;
+    return 1;
+}
+
+bool FilterDaemon::readLine(int socket, std::string &line)
+{
+    return false;
+}
+
+bool FilterDaemon::writeLine(int socket, const std::string &line)
+{
+    return false;
+}
+
+#else
+
+bool FilterDaemon::Serve(const std::string &socket_path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(socket_path.size() >= sizeof(address.sun_path)){
+        std::cerr << "Socket path too long: " << socket_path << std::endl;
+        return false;
+    }
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    // A socket left behind by a daemon that did not stop cleanly would make bind fail, any other file is kept
+    struct stat status;
+    if(lstat(socket_path.c_str(), &status) == 0){
+        if(!S_ISSOCK(status.st_mode)){
+            std::cerr << "Refusing to replace " << socket_path << ", it is not a socket" << std::endl;
+            return false;
+        }
+        unlink(socket_path.c_str());
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    // Only the owner may connect, jobs write files wherever the client asks
+    if(listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || chmod(socket_path.c_str(), S_IRUSR | S_IWUSR) != 0 ||
+       listen(listener, LISTEN_BACKLOG) != 0){
+        std::cerr << "Failed to listen on " << socket_path << std::endl;
+        if(listener >= 0)
+            close(listener);
+        return false;
+    }
+
+    std::cout << "Serving filter jobs on " << socket_path << " (startup took " << std::fixed << std::setprecision(3) << m_startup_ms << " ms)" << std::endl;
+
+    bool running = true;
+    while(running){
+        int connection = accept(listener, NULL, NULL);
+        if(connection < 0){
+            continue;
+        }
+
+        timeval timeout = {CLIENT_TIMEOUT_S, 0};
+        setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        std::string line;
+        if(!readLine(connection, line)){
+            if(errno == EAGAIN || errno == EWOULDBLOCK){
+                std::cerr << "Dropping a client that sent no job within " << CLIENT_TIMEOUT_S << " s" << std::endl;
+            }
+            close(connection);
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while(std::getline(stream, field, FIELD_SEPARATOR)){
+            fields.push_back(field);
+        }
+
+        std::string reply;
+        if(fields.size() == 2 && fields[1] == "--stop"){
+            reply = "ok stopping";
+            running = false;
+        } else if(fields.empty()){
+            reply = "error empty job";
+        } else{
+            Job job;
+            std::string error;
+            std::vector<std::string> args(fields.begin() + 1, fields.end());
+            if(runJob(fields[0], args, job, error)){
+                std::ostringstream message;
+                message << std::fixed << std::setprecision(3) << "ok " << job.total_ms << " " << m_startup_ms;
+                reply = message.str();
+
+                std::cout << "Job " << m_jobs.size() << ": " << job.input << " (" << job.width << "x" << job.height << ") in " << job.total_ms
+                          << " ms [decode " << job.decode_ms << ", filter " << job.filter_ms << ", encode " << job.encode_ms << "]" << std::endl;
+            } else{
+                reply = "error " + error;
+                std::cerr << "Job failed: " << error << std::endl;
+            }
+        }
+
+        writeLine(connection, reply);
+        close(connection);
+    }
+
+    close(listener);
+    unlink(socket_path.c_str());
+    displayStatistics();
+    return true;
+}
+
+int FilterDaemon::Submit(const std::string &socket_path, const std::vector<std::string> &args)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Relative paths are resolved by the daemon against the directory of the client
+    std::string line = std::filesystem::current_path().string();
+    for(auto& arg : args){
+        if(arg.find_first_of("\t\n") != std::string::npos){
+            std::cerr << "Job arguments must not contain tabs or newlines" << std::endl;
+            return 1;
+        }
+        line += FIELD_SEPARATOR + arg;
+    }
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::strncpy(address.sun_path, socket_path.c_str(), sizeof(address.sun_path) - 1);
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(connection < 0 || connect(connection, (sockaddr*)&address, sizeof(address)) != 0){
+        std::cerr << "No filter daemon listening on " << socket_path << std::endl;
+        if(connection >= 0)
+            close(connection);
+        return 1;
+    }
+
+    std::string reply;
+    bool result = writeLine(connection, line) && readLine(connection, reply);
+    close(connection);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    if(!result || reply.compare(0, 3, "ok ") != 0){
+        std::cerr << "Job failed: " << (result ? reply : std::string("no reply from the daemon")) << std::endl;
+        return 1;
+    }
+
+    // A cold run pays the startup of the daemon on top of the job
+    double job_ms = 0.0, startup_ms = 0.0;
+    std::stringstream fields(reply.substr(3));
+    if(fields >> job_ms >> startup_ms){
+        double round_trip_ms = std::chrono::duration<double, std::milli>(end - start).count();
+        std::cout << std::fixed << std::setprecision(3) << "Job took " << job_ms << " ms in the daemon, " << round_trip_ms
+                  << " ms round trip, a cold start would take about " << startup_ms + job_ms << " ms" << std::endl;
+    } else{
+        std::cout << reply.substr(3) << std::endl;
+    }
+    return 0;
+}
+
+bool FilterDaemon::readLine(int socket, std::string &line)
+{
+    line.clear();
+
+    errno = 0;
+    char c;
+    while(recv(socket, &c, 1, 0) == 1){
+        if(c == '\n'){
+            return true;
+        }
+        line += c;
+    }
+    return false;
+}
+
+bool FilterDaemon::writeLine(int socket, const std::string &line)
+{
+    std::string data = line + "\n";
+    size_t sent = 0;
+    while(sent < data.size()){
+        auto count = send(socket, data.data() + sent, data.size() - sent, SEND_FLAGS);
+        if(count <= 0){
+            return false;
+        }
+        sent += count;
+    }
+    return true;
+}
+
+#endif
+
+bool FilterDaemon::runJob(const std::string &directory, const std::vector<std::string> &args, Job &job, std::string &error)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // The job carries the options of a normal run
+    std::vector<char*> argv{(char*)"2DImageFilter"};
+    for(auto& arg : args){
+        argv.push_back((char*)arg.c_str());
+    }
+
+    Options options;
+    if(!options.Parse((int)argv.size(), argv.data())){
+        error = "invalid options";
+        return false;
+    }
+    if(!servable(options, error) || !configure(options, error)){
+        return false;
+    }
+
+    std::filesystem::path input = std::filesystem::path(directory) / options.input;
+    std::filesystem::path output = std::filesystem::path(directory) / options.output;
+    job = {input.string(), 0, 0, 0.0, 0.0, 0.0, 0.0};
+
+    std::vector<char> pixels;
+    if(!ImageIO::Decode(input.string(), pixels, job.width, job.height)){
+        error = "failed to decode " + input.string();
+        return false;
+    }
+    auto decoded = std::chrono::high_resolution_clock::now();
+
+    // Same layout as a single run: RGBA8 images, or buffers for the tiled and integer paths.
+    // Jobs of the same size reuse the objects of earlier jobs through the pool
+    cl_int err_num[2];
+    MemoryLease objects[2];
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {(size_t)job.width, (size_t)job.height, 1};
+    bool as_buffer = m_filter.UsesBuffers();
+    if(as_buffer){
+        objects[0] = m_pool.AcquireBuffer(CL_MEM_READ_ONLY, pixels.size(), &err_num[0]);
+        objects[1] = m_pool.AcquireBuffer(CL_MEM_WRITE_ONLY, pixels.size(), &err_num[1]);
+    } else{
+        cl_image_format clImageFormat;
+        clImageFormat.image_channel_order = CL_RGBA;
+        clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+        objects[0] = m_pool.AcquireImage(CL_MEM_READ_ONLY, clImageFormat, job.width, job.height, &err_num[0]);
+        objects[1] = m_pool.AcquireImage(CL_MEM_WRITE_ONLY, clImageFormat, job.width, job.height, &err_num[1]);
+    }
+
+    // The write reads the pixels before the blocking read overwrites them, the queue is in order
+    err_num[0] = (objects[0] && objects[1]) ? CL_SUCCESS : CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    if(err_num[0] == CL_SUCCESS){
+        if(as_buffer){
+            err_num[0] = clEnqueueWriteBuffer(m_queue, objects[0].Get(), CL_FALSE, 0, pixels.size(), pixels.data(), 0, NULL, NULL);
+        } else{
+            err_num[0] = clEnqueueWriteImage(m_queue, objects[0].Get(), CL_FALSE, origin, region, 0, 0, pixels.data(), 0, NULL, NULL);
+        }
+    }
+    if(err_num[0] == CL_SUCCESS){
+        err_num[0] = m_filter.Enqueue(m_queue, objects[0].Get(), objects[1].Get(), job.width, job.height);
+    }
+    if(err_num[0] == CL_SUCCESS){
+        if(as_buffer){
+            err_num[0] = clEnqueueReadBuffer(m_queue, objects[1].Get(), CL_TRUE, 0, pixels.size(), pixels.data(), 0, NULL, NULL);
+        } else{
+            err_num[0] = clEnqueueReadImage(m_queue, objects[1].Get(), CL_TRUE, origin, region, 0, 0, pixels.data(), 0, NULL, NULL);
+        }
+    }
+    if(err_num[0] != CL_SUCCESS){
+        clFinish(m_queue);
+    }
+
+    if(err_num[0] != CL_SUCCESS){
+        error = "filter failed (" + std::to_string(err_num[0]) + ")";
+        return false;
+    }
+    auto filtered = std::chrono::high_resolution_clock::now();
+
+    if(!ImageIO::Encode(output.string(), pixels.data(), job.width, job.height, job.width * 4)){
+        error = "failed to save " + output.string();
+        return false;
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    job.decode_ms = std::chrono::duration<double, std::milli>(decoded - start).count();
+    job.filter_ms = std::chrono::duration<double, std::milli>(filtered - decoded).count();
+    job.encode_ms = std::chrono::duration<double, std::milli>(end - filtered).count();
+    job.total_ms = std::chrono::duration<double, std::milli>(end - start).count();
+    m_jobs.push_back(job);
+    return true;
+}
+
+bool FilterDaemon::configure(const Options &options, std::string &error)
+{
+    if(!m_filter.SetParameters(options.radius, options.sigma)){
+        error = "invalid radius or sigma";
+        return false;
+    }
+    m_filter.SetAlgorithm(options.algorithm);
+
+    // Selecting a precision times every variant, which only has to happen once per algorithm
+    if(options.precision == FilterPrecision::AUTO){
+        auto cached = m_precisions.find(options.algorithm);
+        if(cached == m_precisions.end()){
+            m_precisions[options.algorithm] = m_filter.SelectPrecision(m_queue);
+        } else{
+            m_filter.SetPrecision(cached->second);
+        }
+    } else if(!m_filter.SetPrecision(options.precision)){
+        error = "unsupported precision " + GaussianFilter::PrecisionName(options.precision);
+        return false;
+    }
+    return true;
+}
+
+void FilterDaemon::displayStatistics() const
+{
+    if(m_jobs.empty()){
+        std::cout << "No jobs served" << std::endl;
+        return;
+    }
+
+    double total_ms = 0.0, min_ms = m_jobs[0].total_ms, max_ms = m_jobs[0].total_ms;
+    for(auto& job : m_jobs){
+        total_ms += job.total_ms;
+        min_ms = std::min(min_ms, job.total_ms);
+        max_ms = std::max(max_ms, job.total_ms);
+    }
+    double mean_ms = total_ms / m_jobs.size();
+
+    // Every cold run would have paid the startup again
+    std::cout << "\nDAEMON STATISTICS (" << m_jobs.size() << " jobs):" << std::endl;
+    std::cout << std::fixed << std::setprecision(3)
+              << "\tjob latency (ms)\tmean " << mean_ms << ", min " << min_ms << ", max " << max_ms << std::endl
+              << "\tcold start (ms)\t\t" << m_startup_ms << " + job, about " << m_startup_ms + mean_ms << " per job" << std::endl
+              << "\tspeed-up\t\t" << (m_startup_ms + mean_ms) / mean_ms << "x" << std::endl;
+    std::cout << "\t";
+    m_pool.DisplayStatistics();
+}
@@ -0,0 +1,322 @@
+#include "FilterGraph.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <sstream>
+
+namespace
+{
+    // Slot of a node that writes straight into the graph's output image
+    const int OUTPUT_SLOT = -2;
+}
+
+FilterGraph::FilterGraph(Controller& controller, cl_context context, cl_program program)
+    : m_controller{controller}, m_context{context}, m_program{program}, m_output{-1}, m_compiled{false},
+      m_slot_count{0}, m_intermediate_width{0}, m_intermediate_height{0}
+{
+    cl_int err_num;
+
+    // Create sampler object
+    m_sampler = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &err_num);
+    controller.CheckError(err_num, "clCreateSampler");
+}
+
+FilterGraph::~FilterGraph()
+{
+    releaseIntermediates();
+
+    for(auto& kernel : m_kernels){
+        clReleaseKernel(kernel.second);
+    }
+
+    clReleaseSampler(m_sampler);
+}
+
+int FilterGraph::AddStage(const std::string &kernel_name, std::vector<int> inputs, std::vector<float> parameters)
+{
+    Node node = {kernel_name, getKernel(kernel_name), NULL, inputs, parameters, false, -1, -1};
+    m_nodes.push_back(node);
+    m_compiled = false;
+    return (int)m_nodes.size() - 1;
+}
+
+int FilterGraph::AddGaussian(GaussianFilter &filter, int input)
+{
+    Node node = {"gaussian", 0, &filter, {input}, {}, false, -1, -1};
+    m_nodes.push_back(node);
+    m_compiled = false;
+    return (int)m_nodes.size() - 1;
+}
+
+bool FilterGraph::Parse(const std::string &spec, GaussianFilter &filter)
+{
+    std::stringstream stream(spec);
+    std::string stage;
+    int previous = GRAPH_INPUT;
+
+    while(std::getline(stream, stage, ',')){
+        // Optional parameter after a colon, e.g. "unsharp:1.5"
+        std::string name = stage.substr(0, stage.find(':'));
+        float parameter = (stage.find(':') != std::string::npos) ? (float)std::atof(stage.substr(stage.find(':') + 1).c_str()) : 1.0f;
+
+        if(name == "blur"){
+            previous = AddGaussian(filter, previous);
+        } else if(name == "sharpen"){
+            previous = AddStage("sharpen", {previous});
+        } else if(name == "edge"){
+            previous = AddStage("sobel_edge", {previous});
+        } else if(name == "grayscale"){
+            previous = AddStage("grayscale", {previous});
+        } else if(name == "unsharp"){
+            // Unsharp mask: (1 + amount) * image - amount * blur(image)
+            int blurred = AddGaussian(filter, previous);
+            previous = AddStage("blend", {previous, blurred}, {1.0f + parameter, -parameter});
+        } else{
+            std::cerr << "Unrecognised filter graph stage: " << stage << std::endl;
+            return false;
+        }
+    }
+
+    return !m_nodes.empty();
+}
+
+void FilterGraph::SetOutput(int node)
+{
+    m_output = node;
+    m_compiled = false;
+}
+
+bool FilterGraph::Compile()
+{
+    if(m_nodes.empty()){
+        std::cerr << "Filter graph has no stages" << std::endl;
+        return false;
+    }
+
+    int output = (m_output < 0) ? (int)m_nodes.size() - 1 : m_output;
+    for(auto& node : m_nodes){
+        node.live = false;
+        node.last_use = -1;
+        node.slot = -1;
+    }
+
+    // Nodes are added after their inputs, so walking backwards from the output finds every live node
+    m_nodes[output].live = true;
+    for(int i = output; i >= 0; i--){
+        if(!m_nodes[i].live){
+            continue;
+        }
+
+        for(auto input : m_nodes[i].inputs){
+            if(input >= i || input < GRAPH_INPUT){
+                std::cerr << "Stage " << i << " (" << m_nodes[i].name << ") must read the input or an earlier stage" << std::endl;
+                return false;
+            }
+            if(input != GRAPH_INPUT){
+                m_nodes[input].live = true;
+                m_nodes[input].last_use = std::max(m_nodes[input].last_use, i);
+            }
+        }
+
+        if(m_nodes[i].gaussian != NULL && m_nodes[i].gaussian->UsesBuffers()){
+            std::cerr << "The filter graph needs an image-based Gaussian algorithm" << std::endl;
+            return false;
+        }
+    }
+
+    // Linear scan over the live ranges: an intermediate is reused once its last reader has been enqueued
+    std::vector<int> free_slots;
+    m_slot_count = 0;
+
+    for(int i = 0; i <= output; i++){
+        Node& node = m_nodes[i];
+        if(!node.live){
+            continue;
+        }
+
+        if(i == output){
+            node.slot = OUTPUT_SLOT;
+        } else if(!free_slots.empty()){
+            node.slot = free_slots.back();
+            free_slots.pop_back();
+        } else{
+            node.slot = m_slot_count++;
+        }
+
+        // Release the intermediates whose last reader is this node
+        for(auto input : node.inputs){
+            if(input != GRAPH_INPUT && m_nodes[input].last_use == i && m_nodes[input].slot >= 0 &&
+               std::find(free_slots.begin(), free_slots.end(), m_nodes[input].slot) == free_slots.end()){
+                free_slots.push_back(m_nodes[input].slot);
+            }
+        }
+    }
+
+    m_output = output;
+    m_compiled = true;
+
+    std::cout << "Filter graph: " << GetStageCount() << " live stages using " << m_slot_count << " intermediate images" << std::endl;
+    return true;
+}
+
+cl_int FilterGraph::Enqueue(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    cl_int err_num = CL_SUCCESS;
+
+    if(!m_compiled && !Compile()){
+        return CL_INVALID_OPERATION;
+    }
+    if(!allocateIntermediates(width, height)){
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+
+    // Completion event of every node and the events still reading each intermediate
+    std::vector<cl_event> node_events(m_nodes.size(), (cl_event)0);
+    std::vector<std::vector<cl_event>> slot_readers(m_slot_count);
+
+    auto image_of = [&](int index){
+        if(index == GRAPH_INPUT)
+            return src_image;
+        return (m_nodes[index].slot == OUTPUT_SLOT) ? dst_image : m_intermediates[m_nodes[index].slot];
+    };
+
+    for(int i = 0; i <= m_output && err_num == CL_SUCCESS; i++){
+        Node& node = m_nodes[i];
+        if(!node.live){
+            continue;
+        }
+
+        // Wait for the producers of the inputs, and for the readers of the intermediate being overwritten
+        std::vector<cl_event> wait(wait_list, wait_list + num_events);
+        for(auto input : node.inputs){
+            if(input != GRAPH_INPUT)
+                wait.push_back(node_events[input]);
+        }
+        if(node.slot >= 0){
+            wait.insert(wait.end(), slot_readers[node.slot].begin(), slot_readers[node.slot].end());
+        }
+
+        cl_mem target = image_of(i);
+        if(node.gaussian != NULL){
+            err_num = node.gaussian->Enqueue(queue, image_of(node.inputs[0]), target, width, height, (cl_uint)wait.size(), wait.empty() ? NULL : wait.data(), &node_events[i]);
+        } else{
+            // Set the kernel arguments: inputs, output, sampler, size and parameters
+            cl_uint index = 0;
+            for(auto input : node.inputs){
+                cl_mem image = image_of(input);
+                err_num |= clSetKernelArg(node.kernel, index++, sizeof(cl_mem), &image);
+            }
+            err_num |= clSetKernelArg(node.kernel, index++, sizeof(cl_mem), &target);
+            err_num |= clSetKernelArg(node.kernel, index++, sizeof(cl_sampler), &m_sampler);
+            err_num |= clSetKernelArg(node.kernel, index++, sizeof(cl_int), &width);
+            err_num |= clSetKernelArg(node.kernel, index++, sizeof(cl_int), &height);
+            for(auto parameter : node.parameters){
+                err_num |= clSetKernelArg(node.kernel, index++, sizeof(cl_float), &parameter);
+            }
+            if(err_num != CL_SUCCESS){
+                std::cerr << "Error setting kernel arguments for " << node.name << std::endl;
+                break;
+            }
+
+            // Initialise the work-size
+            size_t local_work_size[2] = {16, 16};
+            size_t global_work_size[2] = {Controller::RoundUp(local_work_size[0], width), Controller::RoundUp(local_work_size[1], height)};
+
+            err_num = clEnqueueNDRangeKernel(queue, node.kernel, 2, NULL, global_work_size, local_work_size, (cl_uint)wait.size(), wait.empty() ? NULL : wait.data(), &node_events[i]);
+        }
+        if(err_num != CL_SUCCESS){
+            std::cerr << "Error enqueueing filter graph stage " << node.name << " (" << err_num << ")" << std::endl;
+            break;
+        }
+
+        // The intermediate now holds this node's result
+        if(node.slot >= 0){
+            for(auto reader : slot_readers[node.slot])
+                clReleaseEvent(reader);
+            slot_readers[node.slot].clear();
+        }
+        for(auto input : node.inputs){
+            if(input != GRAPH_INPUT && m_nodes[input].slot >= 0){
+                clRetainEvent(node_events[i]);
+                slot_readers[m_nodes[input].slot].push_back(node_events[i]);
+            }
+        }
+    }
+
+    if(err_num == CL_SUCCESS && event != NULL){
+        clRetainEvent(node_events[m_output]);
+        *event = node_events[m_output];
+    }
+
+    // Release the bookkeeping events
+    for(auto node_event : node_events){
+        if(node_event != 0)
+            clReleaseEvent(node_event);
+    }
+    for(auto& readers : slot_readers){
+        for(auto reader : readers)
+            clReleaseEvent(reader);
+    }
+
+    return err_num;
+}
+
+int FilterGraph::GetStageCount() const
+{
+    return (int)std::count_if(m_nodes.begin(), m_nodes.end(), [](const Node& node){ return node.live; });
+}
+
+int FilterGraph::GetIntermediateCount() const
+{
+    return m_slot_count;
+}
+
+cl_kernel FilterGraph::getKernel(const std::string &kernel_name)
+{
+    // Stages running the same kernel share one kernel object, arguments are set at enqueue time
+    auto kernel = m_kernels.find(kernel_name);
+    if(kernel != m_kernels.end()){
+        return kernel->second;
+    }
+
+    cl_kernel created = m_controller.CreateKernel(m_program, kernel_name.c_str());
+    m_kernels[kernel_name] = created;
+    return created;
+}
+
+bool FilterGraph::allocateIntermediates(int width, int height)
+{
+    if((int)m_intermediates.size() == m_slot_count && m_intermediate_width == width && m_intermediate_height == height){
+        return true;
+    }
+
+    releaseIntermediates();
+
+    cl_int err_num;
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = CL_RGBA;
+    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+    for(int i = 0; i < m_slot_count; i++){
+        cl_mem image = clCreateImage2D(m_context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, &err_num);
+        if(err_num != CL_SUCCESS){
+            std::cerr << "Error creating filter graph intermediate image" << std::endl;
+            releaseIntermediates();
+            return false;
+        }
+        m_intermediates.push_back(image);
+    }
+
+    m_intermediate_width = width;
+    m_intermediate_height = height;
+    return true;
+}
+
+void FilterGraph::releaseIntermediates()
+{
+    for(auto image : m_intermediates){
+        clReleaseMemObject(image);
+    }
+    m_intermediates.clear();
+    m_intermediate_width = m_intermediate_height = 0;
+}
@@ -0,0 +1,733 @@
+#include "GaussianFilter.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include <ImageIO.hpp>
+
+namespace
+{
+    // Reduced precision variants must stay within this PSNR of the float path (1 LSB everywhere is 48 dB)
+    const double MIN_PSNR = 45.0;
+    const int PROBE_SIZE = 1024;
+    const int PROBE_ITERATIONS = 5;
+}
+
+GaussianFilter::GaussianFilter(Controller& controller, cl_context context, cl_device_id device, cl_program program)
+    : m_context{context}, m_device{device}, m_kernel_half{0}, m_sampler{0}, m_weights{0}, m_intermediate{0},
+      m_intermediate_width{0}, m_intermediate_height{0}, m_intermediate_type{CL_FLOAT}, m_intermediate_order{CL_RGBA}, m_half_images{false}, m_recursive_buffers{0, 0}, m_recursive_size{0},
+      m_algorithm{FilterAlgorithm::GAUSSIAN_3X3}, m_precision{FilterPrecision::FLOAT}, m_radius{0}, m_sigma{0.0f}
+{
+    cl_int err_num;
+
+    // Create every kernel up-front so that the algorithm can be switched at runtime
+    m_kernel_3x3 = controller.CreateKernel(program, "gaussian_filter");
+    m_kernel_2d = controller.CreateKernel(program, "gaussian_filter_2d");
+    m_kernel_horizontal = controller.CreateKernel(program, "gaussian_filter_horizontal");
+    m_kernel_vertical = controller.CreateKernel(program, "gaussian_filter_vertical");
+    m_kernel_tiled = controller.CreateKernel(program, "gaussian_filter_tiled");
+    m_kernel_uchar = controller.CreateKernel(program, "gaussian_filter_uchar");
+    m_kernel_recursive = controller.CreateKernel(program, "gaussian_filter_recursive");
+    m_kernel_recursive_transpose = controller.CreateKernel(program, "gaussian_filter_recursive_transpose");
+    m_kernel_recursive_transposed = controller.CreateKernel(program, "gaussian_filter_recursive_transposed");
+
+    // The half variant is only compiled when the device has cl_khr_fp16
+    size_t extensions_size = 0;
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, 0, NULL, &extensions_size);
+    std::string extensions(extensions_size, '\0');
+    clGetDeviceInfo(device, CL_DEVICE_EXTENSIONS, extensions_size, &extensions[0], NULL);
+    if(extensions.find("cl_khr_fp16") != std::string::npos){
+        m_kernel_half = clCreateKernel(program, "gaussian_filter_half", &err_num);
+        if(err_num != CL_SUCCESS){
+            m_kernel_half = 0;
+        }
+    }
+
+    // Check whether the separable intermediate can be stored in half precision
+    cl_uint num_formats = 0;
+    clGetSupportedImageFormats(context, CL_MEM_READ_WRITE, CL_MEM_OBJECT_IMAGE2D, 0, NULL, &num_formats);
+    std::vector<cl_image_format> formats(num_formats);
+    clGetSupportedImageFormats(context, CL_MEM_READ_WRITE, CL_MEM_OBJECT_IMAGE2D, num_formats, formats.data(), NULL);
+    for(auto& format : formats){
+        if(format.image_channel_order == CL_RGBA && format.image_channel_data_type == CL_HALF_FLOAT){
+            m_half_images = true;
+        }
+    }
+
+    // Create sampler object
+    m_sampler = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &err_num);
+    controller.CheckError(err_num, "clCreateSampler");
+
+    // Default to the same weights as the original 3x3 kernel
+    SetParameters(1, 0.0f);
+}
+
+GaussianFilter::~GaussianFilter()
+{
+    if(m_intermediate != 0)
+        clReleaseMemObject(m_intermediate);
+
+    if(m_weights != 0)
+        clReleaseMemObject(m_weights);
+
+    for(auto buffer : m_recursive_buffers){
+        if(buffer != 0)
+            clReleaseMemObject(buffer);
+    }
+
+    if(m_sampler != 0)
+        clReleaseSampler(m_sampler);
+
+    clReleaseKernel(m_kernel_3x3);
+    clReleaseKernel(m_kernel_2d);
+    clReleaseKernel(m_kernel_horizontal);
+    clReleaseKernel(m_kernel_vertical);
+    clReleaseKernel(m_kernel_tiled);
+    clReleaseKernel(m_kernel_uchar);
+    clReleaseKernel(m_kernel_recursive);
+    clReleaseKernel(m_kernel_recursive_transpose);
+    clReleaseKernel(m_kernel_recursive_transposed);
+    if(m_kernel_half != 0)
+        clReleaseKernel(m_kernel_half);
+}
+
+std::vector<float> GaussianFilter::ComputeWeights(int radius, float sigma)
+{
+    std::vector<float> weights(2 * radius + 1);
+    float sum = 0.0f;
+
+    // Evaluate the Gaussian at each tap
+    for(int i = -radius; i <= radius; i++){
+        weights[i + radius] = std::exp(-(i * i) / (2.0f * sigma * sigma));
+        sum += weights[i + radius];
+    }
+
+    // Normalise so that the filter preserves brightness
+    for(auto& weight : weights){
+        weight /= sum;
+    }
+
+    return weights;
+}
+
+bool GaussianFilter::ParseAlgorithm(const std::string &name, FilterAlgorithm &algorithm)
+{
+    if(name == "3x3"){
+        algorithm = FilterAlgorithm::GAUSSIAN_3X3;
+    } else if(name == "2d"){
+        algorithm = FilterAlgorithm::GAUSSIAN_2D;
+    } else if(name == "separable"){
+        algorithm = FilterAlgorithm::SEPARABLE;
+    } else if(name == "tiled"){
+        algorithm = FilterAlgorithm::TILED;
+    } else if(name == "recursive"){
+        algorithm = FilterAlgorithm::RECURSIVE;
+    } else{
+        return false;
+    }
+
+    return true;
+}
+
+std::string GaussianFilter::AlgorithmName(FilterAlgorithm algorithm)
+{
+    switch (algorithm)
+    {
+    case FilterAlgorithm::GAUSSIAN_3X3:
+        return "3x3";
+
+    case FilterAlgorithm::GAUSSIAN_2D:
+        return "2d";
+
+    case FilterAlgorithm::SEPARABLE:
+        return "separable";
+
+    case FilterAlgorithm::TILED:
+        return "tiled";
+
+    case FilterAlgorithm::RECURSIVE:
+        return "recursive";
+    }
+
+    return "unknown";
+}
+
+bool GaussianFilter::ParsePrecision(const std::string &name, FilterPrecision &precision)
+{
+    if(name == "float"){
+        precision = FilterPrecision::FLOAT;
+    } else if(name == "half"){
+        precision = FilterPrecision::HALF;
+    } else if(name == "integer"){
+        precision = FilterPrecision::INTEGER;
+    } else if(name == "auto"){
+        precision = FilterPrecision::AUTO;
+    } else{
+        return false;
+    }
+
+    return true;
+}
+
+std::string GaussianFilter::PrecisionName(FilterPrecision precision)
+{
+    switch (precision)
+    {
+    case FilterPrecision::FLOAT:
+        return "float";
+
+    case FilterPrecision::HALF:
+        return "half";
+
+    case FilterPrecision::INTEGER:
+        return "integer";
+
+    case FilterPrecision::AUTO:
+        return "auto";
+    }
+
+    return "unknown";
+}
+
+void GaussianFilter::RecursiveCoefficients(float sigma, cl_float4 &coefficients, cl_float16 &boundary)
+{
+    // Young & van Vliet (1995) fit, valid from sigma 0.5
+    double s = std::max(sigma, 0.5f);
+    double q = (s >= 2.5) ? 0.98711 * s - 0.96330 : 3.97156 - 4.14554 * std::sqrt(1.0 - 0.26891 * s);
+    double b0 = 1.57825 + 2.44413 * q + 1.4281 * q * q + 0.422205 * q * q * q;
+    double b[3] = {(2.44413 * q + 2.85619 * q * q + 1.26661 * q * q * q) / b0,
+                   -(1.4281 * q * q + 1.26661 * q * q * q) / b0,
+                   (0.422205 * q * q * q) / b0};
+    double gain = 1.0 - b[0] - b[1] - b[2];
+
+    coefficients.s[0] = (float)gain;
+    for(int i = 0; i < 3; i++){
+        coefficients.s[i + 1] = (float)b[i];
+    }
+
+    // Triggs & Sdika: the anti-causal history at the end of a column is linear in how far the causal
+    // history is from the last input value. Derive the matrix by running both passes over the
+    // (decaying) continuation of each unit deviation
+    int length = (int)(20.0 * s) + 64;
+    std::vector<double> tail(length);
+    for(int j = 0; j < 3; j++){
+        double history[3] = {0.0, 0.0, 0.0};
+        history[j] = 1.0;
+        for(int n = 0; n < length; n++){
+            tail[n] = b[0] * history[0] + b[1] * history[1] + b[2] * history[2];
+            history[2] = history[1];
+            history[1] = history[0];
+            history[0] = tail[n];
+        }
+
+        double future[3] = {0.0, 0.0, 0.0};
+        for(int n = length - 1; n >= 0; n--){
+            double value = gain * tail[n] + b[0] * future[0] + b[1] * future[1] + b[2] * future[2];
+            future[2] = future[1];
+            future[1] = future[0];
+            future[0] = value;
+            if(n < 3){
+                boundary.s[n * 3 + j] = (float)value;
+            }
+        }
+    }
+    for(int i = 9; i < 16; i++){
+        boundary.s[i] = 0.0f;
+    }
+}
+
+bool GaussianFilter::SetParameters(int radius, float sigma)
+{
+    cl_int err_num;
+
+    if(radius < 1){
+        std::cerr << "Filter radius must be at least 1" << std::endl;
+        return false;
+    }
+
+    // Derive sigma from the kernel size when it is not given (same rule as OpenCV)
+    if(sigma <= 0.0f){
+        sigma = 0.3f * (radius - 1) + 0.8f;
+    }
+
+    // The weights must fit into constant memory
+    cl_ulong max_constant_size = 0;
+    clGetDeviceInfo(m_device, CL_DEVICE_MAX_CONSTANT_BUFFER_SIZE, sizeof(cl_ulong), &max_constant_size, NULL);
+    if(sizeof(float) * (2 * radius + 1) > max_constant_size){
+        std::cerr << "Filter radius " << radius << " exceeds the device constant memory" << std::endl;
+        return false;
+    }
+
+    // Upload the weights
+    auto weights = ComputeWeights(radius, sigma);
+    cl_mem weights_buffer = clCreateBuffer(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(float) * weights.size(), weights.data(), &err_num);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error creating filter weights buffer" << std::endl;
+        return false;
+    }
+
+    if(m_weights != 0)
+        clReleaseMemObject(m_weights);
+
+    m_weights = weights_buffer;
+    m_radius = radius;
+    m_sigma = sigma;
+    RecursiveCoefficients(sigma, m_recursive_coefficients, m_recursive_boundary);
+    return true;
+}
+
+void GaussianFilter::SetAlgorithm(FilterAlgorithm algorithm)
+{
+    m_algorithm = algorithm;
+}
+
+bool GaussianFilter::SupportsPrecision(FilterPrecision precision) const
+{
+    switch (precision)
+    {
+    case FilterPrecision::HALF:
+        return (m_algorithm == FilterAlgorithm::GAUSSIAN_3X3 && m_kernel_half != 0) ||
+               (m_algorithm == FilterAlgorithm::SEPARABLE && m_half_images) ||
+               m_algorithm == FilterAlgorithm::RECURSIVE;
+
+    case FilterPrecision::INTEGER:
+        return m_algorithm == FilterAlgorithm::GAUSSIAN_3X3;
+
+    default:
+        return true;
+    }
+}
+
+bool GaussianFilter::SetPrecision(FilterPrecision precision)
+{
+    if(!SupportsPrecision(precision)){
+        std::cerr << "The " << AlgorithmName(m_algorithm) << " filter has no " << PrecisionName(precision) << " variant on this device" << std::endl;
+        return false;
+    }
+
+    m_precision = precision;
+    return true;
+}
+
+FilterPrecision GaussianFilter::SelectPrecision(cl_command_queue queue, bool allow_buffers)
+{
+    auto best = FilterPrecision::FLOAT;
+    m_precision = FilterPrecision::FLOAT;
+
+    std::vector<FilterPrecision> candidates;
+    for(auto precision : {FilterPrecision::HALF, FilterPrecision::INTEGER}){
+        if(SupportsPrecision(precision) && (precision != FilterPrecision::INTEGER || allow_buffers)){
+            candidates.push_back(precision);
+        }
+    }
+
+    double best_time = 0.0, psnr = 0.0;
+    if(candidates.empty() || !CompareVariant(queue, FilterPrecision::FLOAT, PROBE_SIZE, PROBE_SIZE, PROBE_ITERATIONS, best_time, psnr)){
+        return best;
+    }
+
+    // Only keep a reduced precision variant that is both faster and close enough to the float result
+    for(auto precision : candidates){
+        double time_ms = 0.0;
+        if(CompareVariant(queue, precision, PROBE_SIZE, PROBE_SIZE, PROBE_ITERATIONS, time_ms, psnr) && psnr >= MIN_PSNR && time_ms < best_time){
+            best = precision;
+            best_time = time_ms;
+        }
+    }
+
+    m_precision = best;
+    return best;
+}
+
+bool GaussianFilter::CompareVariant(cl_command_queue queue, FilterPrecision precision, int width, int height, int iterations, double &time_ms, double &psnr)
+{
+    auto input = testPattern(width, height);
+
+    std::vector<unsigned char> reference, output;
+    double reference_time = 0.0;
+    if(!runVariant(queue, FilterPrecision::FLOAT, input, reference, width, height, 1, reference_time) ||
+       !runVariant(queue, precision, input, output, width, height, iterations, time_ms)){
+        return false;
+    }
+
+    psnr = ImageIO::PSNR(reference.data(), output.data(), reference.size());
+    return true;
+}
+
+bool GaussianFilter::CompareDirect(cl_command_queue queue, FilterPrecision precision, int width, int height, int iterations, double &time_ms, double &psnr)
+{
+    auto input = testPattern(width, height);
+
+    // The separable kernel computes the same truncated Gaussian as the 2D kernel at a fraction of the cost
+    std::vector<unsigned char> reference, output;
+    double reference_time = 0.0;
+    auto algorithm = m_algorithm;
+    m_algorithm = FilterAlgorithm::SEPARABLE;
+    auto result = runVariant(queue, FilterPrecision::FLOAT, input, reference, width, height, 1, reference_time);
+    m_algorithm = algorithm;
+
+    if(!result || !runVariant(queue, precision, input, output, width, height, iterations, time_ms)){
+        return false;
+    }
+
+    psnr = ImageIO::PSNR(reference.data(), output.data(), reference.size());
+    return true;
+}
+
+int GaussianFilter::GetRadius() const
+{
+    // The original kernel always has a radius of 1
+    return (m_algorithm == FilterAlgorithm::GAUSSIAN_3X3) ? 1 : m_radius;
+}
+
+float GaussianFilter::GetSigma() const
+{
+    return m_sigma;
+}
+
+FilterAlgorithm GaussianFilter::GetAlgorithm() const
+{
+    return m_algorithm;
+}
+
+FilterPrecision GaussianFilter::GetPrecision() const
+{
+    return activePrecision();
+}
+
+bool GaussianFilter::UsesBuffers() const
+{
+    return m_algorithm == FilterAlgorithm::TILED || activePrecision() == FilterPrecision::INTEGER;
+}
+
+cl_int GaussianFilter::Enqueue(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    cl_int err_num;
+
+    if(m_algorithm == FilterAlgorithm::GAUSSIAN_3X3){
+        auto precision = activePrecision();
+
+        // Set the kernel arguments, the integer variant works on buffers and has no sampler
+        cl_kernel kernel = (precision == FilterPrecision::INTEGER) ? m_kernel_uchar : (precision == FilterPrecision::HALF) ? m_kernel_half : m_kernel_3x3;
+        cl_uint index = 0;
+        err_num = clSetKernelArg(kernel, index++, sizeof(cl_mem), &src_image);
+        err_num |= clSetKernelArg(kernel, index++, sizeof(cl_mem), &dst_image);
+        if(precision != FilterPrecision::INTEGER)
+            err_num |= clSetKernelArg(kernel, index++, sizeof(cl_sampler), &m_sampler);
+        err_num |= clSetKernelArg(kernel, index++, sizeof(cl_int), &width);
+        err_num |= clSetKernelArg(kernel, index++, sizeof(cl_int), &height);
+        if(err_num != CL_SUCCESS){
+            std::cerr << "Error setting kernel arguments." << std::endl;
+            return err_num;
+        }
+
+        // Initialise the work-size
+        size_t local_work_size[2] = {16, 16};
+        size_t global_work_size[2] = {Controller::RoundUp(local_work_size[0], width), Controller::RoundUp(local_work_size[1], height)};
+
+        return clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, num_events, wait_list, event);
+    }
+
+    if(m_algorithm == FilterAlgorithm::GAUSSIAN_2D){
+        return enqueueKernel(queue, m_kernel_2d, src_image, dst_image, width, height, num_events, wait_list, event);
+    }
+
+    if(m_algorithm == FilterAlgorithm::TILED){
+        return enqueueTiled(queue, src_image, dst_image, width, height, num_events, wait_list, event);
+    }
+
+    if(m_algorithm == FilterAlgorithm::RECURSIVE){
+        return enqueueRecursive(queue, src_image, dst_image, width, height, num_events, wait_list, event);
+    }
+
+    // Separable path needs an intermediate image to hold the horizontal pass, with the channels of the source
+    cl_image_format src_format;
+    err_num = clGetImageInfo(src_image, CL_IMAGE_FORMAT, sizeof(cl_image_format), &src_format, NULL);
+    if(err_num != CL_SUCCESS){
+        return err_num;
+    }
+    if(!createIntermediateImage(width, height, src_format.image_channel_order)){
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+
+    // Chain the vertical pass on the horizontal pass so that out-of-order queues are also correct
+    cl_event horizontal_event;
+    err_num = enqueueKernel(queue, m_kernel_horizontal, src_image, m_intermediate, width, height, num_events, wait_list, &horizontal_event);
+    if(err_num != CL_SUCCESS){
+        return err_num;
+    }
+
+    err_num = enqueueKernel(queue, m_kernel_vertical, m_intermediate, dst_image, width, height, 1, &horizontal_event, event);
+    clReleaseEvent(horizontal_event);
+    return err_num;
+}
+
+cl_int GaussianFilter::enqueueKernel(cl_command_queue queue, cl_kernel kernel, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    cl_int err_num;
+
+    // Set the kernel arguments
+    err_num = clSetKernelArg(kernel, 0, sizeof(cl_mem), &src_image);
+    err_num |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &dst_image);
+    err_num |= clSetKernelArg(kernel, 2, sizeof(cl_sampler), &m_sampler);
+    err_num |= clSetKernelArg(kernel, 3, sizeof(cl_mem), &m_weights);
+    err_num |= clSetKernelArg(kernel, 4, sizeof(cl_int), &m_radius);
+    err_num |= clSetKernelArg(kernel, 5, sizeof(cl_int), &width);
+    err_num |= clSetKernelArg(kernel, 6, sizeof(cl_int), &height);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error setting kernel arguments." << std::endl;
+        return err_num;
+    }
+
+    // Initialise the work-size
+    size_t local_work_size[2] = {16, 16};
+    size_t global_work_size[2] = {Controller::RoundUp(local_work_size[0], width), Controller::RoundUp(local_work_size[1], height)};
+
+    return clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, num_events, wait_list, event);
+}
+
+cl_int GaussianFilter::enqueueTiled(cl_command_queue queue, cl_mem src_buffer, cl_mem dst_buffer, int width, int height, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    cl_int err_num;
+
+    // Initialise the work-size
+    size_t local_work_size[2] = {16, 16};
+    size_t global_work_size[2] = {Controller::RoundUp(local_work_size[0], width), Controller::RoundUp(local_work_size[1], height)};
+
+    // The tile plus halo must fit into local memory
+    size_t tile_size = sizeof(cl_uchar4) * (local_work_size[0] + 2 * m_radius) * (local_work_size[1] + 2 * m_radius);
+    cl_ulong local_mem_size = 0;
+    clGetDeviceInfo(m_device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_mem_size, NULL);
+    if(tile_size > local_mem_size){
+        std::cerr << "Tile of " << tile_size << " bytes exceeds the device local memory (" << local_mem_size << " bytes)" << std::endl;
+        return CL_OUT_OF_RESOURCES;
+    }
+
+    // Set the kernel arguments
+    err_num = clSetKernelArg(m_kernel_tiled, 0, sizeof(cl_mem), &src_buffer);
+    err_num |= clSetKernelArg(m_kernel_tiled, 1, sizeof(cl_mem), &dst_buffer);
+    err_num |= clSetKernelArg(m_kernel_tiled, 2, sizeof(cl_mem), &m_weights);
+    err_num |= clSetKernelArg(m_kernel_tiled, 3, sizeof(cl_int), &m_radius);
+    err_num |= clSetKernelArg(m_kernel_tiled, 4, sizeof(cl_int), &width);
+    err_num |= clSetKernelArg(m_kernel_tiled, 5, sizeof(cl_int), &height);
+    err_num |= clSetKernelArg(m_kernel_tiled, 6, tile_size, NULL);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error setting kernel arguments." << std::endl;
+        return err_num;
+    }
+
+    return clEnqueueNDRangeKernel(queue, m_kernel_tiled, 2, NULL, global_work_size, local_work_size, num_events, wait_list, event);
+}
+
+cl_int GaussianFilter::enqueueRecursive(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    cl_int err_num;
+
+    // Half precision halves the traffic of both buffers, the recursion itself stays in float
+    cl_int half_storage = (activePrecision() == FilterPrecision::HALF) ? 1 : 0;
+    if(!createRecursiveBuffers((size_t)width * height * (half_storage ? sizeof(cl_half) : sizeof(cl_float)) * 4)){
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+
+    // One work-item per column, then per row of the transposed buffer
+    size_t local_work_size = 64;
+    size_t column_work_size = Controller::RoundUp((int)local_work_size, width);
+    size_t row_work_size = Controller::RoundUp((int)local_work_size, height);
+    size_t tile_size[2] = {16, 16};
+    size_t transpose_work_size[2] = {Controller::RoundUp(16, width), Controller::RoundUp(16, height)};
+
+    // Columns of the image into the first buffer
+    err_num = clSetKernelArg(m_kernel_recursive, 0, sizeof(cl_mem), &src_image);
+    err_num |= clSetKernelArg(m_kernel_recursive, 1, sizeof(cl_sampler), &m_sampler);
+    err_num |= clSetKernelArg(m_kernel_recursive, 2, sizeof(cl_mem), &m_recursive_buffers[0]);
+    err_num |= clSetKernelArg(m_kernel_recursive, 3, sizeof(cl_float4), &m_recursive_coefficients);
+    err_num |= clSetKernelArg(m_kernel_recursive, 4, sizeof(cl_float16), &m_recursive_boundary);
+    err_num |= clSetKernelArg(m_kernel_recursive, 5, sizeof(cl_int), &half_storage);
+    err_num |= clSetKernelArg(m_kernel_recursive, 6, sizeof(cl_int), &width);
+    err_num |= clSetKernelArg(m_kernel_recursive, 7, sizeof(cl_int), &height);
+
+    // Transpose into the second buffer
+    err_num |= clSetKernelArg(m_kernel_recursive_transpose, 0, sizeof(cl_mem), &m_recursive_buffers[0]);
+    err_num |= clSetKernelArg(m_kernel_recursive_transpose, 1, sizeof(cl_mem), &m_recursive_buffers[1]);
+    err_num |= clSetKernelArg(m_kernel_recursive_transpose, 2, sizeof(cl_int), &half_storage);
+    err_num |= clSetKernelArg(m_kernel_recursive_transpose, 3, sizeof(cl_int), &width);
+    err_num |= clSetKernelArg(m_kernel_recursive_transpose, 4, sizeof(cl_int), &height);
+
+    // Rows (columns of the transposed buffer) into the output image
+    err_num |= clSetKernelArg(m_kernel_recursive_transposed, 0, sizeof(cl_mem), &m_recursive_buffers[1]);
+    err_num |= clSetKernelArg(m_kernel_recursive_transposed, 1, sizeof(cl_mem), &dst_image);
+    err_num |= clSetKernelArg(m_kernel_recursive_transposed, 2, sizeof(cl_float4), &m_recursive_coefficients);
+    err_num |= clSetKernelArg(m_kernel_recursive_transposed, 3, sizeof(cl_float16), &m_recursive_boundary);
+    err_num |= clSetKernelArg(m_kernel_recursive_transposed, 4, sizeof(cl_int), &half_storage);
+    err_num |= clSetKernelArg(m_kernel_recursive_transposed, 5, sizeof(cl_int), &height);
+    err_num |= clSetKernelArg(m_kernel_recursive_transposed, 6, sizeof(cl_int), &width);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error setting kernel arguments." << std::endl;
+        return err_num;
+    }
+
+    // Chain the passes so that out-of-order queues are also correct
+    cl_event column_event, transpose_event;
+    err_num = clEnqueueNDRangeKernel(queue, m_kernel_recursive, 1, NULL, &column_work_size, &local_work_size, num_events, wait_list, &column_event);
+    if(err_num != CL_SUCCESS){
+        return err_num;
+    }
+
+    err_num = clEnqueueNDRangeKernel(queue, m_kernel_recursive_transpose, 2, NULL, transpose_work_size, tile_size, 1, &column_event, &transpose_event);
+    clReleaseEvent(column_event);
+    if(err_num != CL_SUCCESS){
+        return err_num;
+    }
+
+    err_num = clEnqueueNDRangeKernel(queue, m_kernel_recursive_transposed, 1, NULL, &row_work_size, &local_work_size, 1, &transpose_event, event);
+    clReleaseEvent(transpose_event);
+    return err_num;
+}
+
+bool GaussianFilter::createIntermediateImage(int width, int height, cl_channel_order order)
+{
+    // Half precision halves the traffic of the intermediate, a single channel plane quarters it
+    cl_channel_type type = (activePrecision() == FilterPrecision::HALF) ? CL_HALF_FLOAT : CL_FLOAT;
+    if(m_intermediate != 0 && m_intermediate_width == width && m_intermediate_height == height && m_intermediate_type == type && m_intermediate_order == order){
+        return true;
+    }
+
+    if(m_intermediate != 0){
+        clReleaseMemObject(m_intermediate);
+        m_intermediate = 0;
+    }
+
+    // Keep the intermediate result in floating point to avoid rounding to 8 bits between the passes
+    cl_int err_num;
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = order;
+    clImageFormat.image_channel_data_type = type;
+
+    m_intermediate = clCreateImage2D(m_context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, &err_num);
+
+    // Only RGBA is guaranteed for floating point images, single channel sources fall back to it
+    if(err_num == CL_IMAGE_FORMAT_NOT_SUPPORTED && order != CL_RGBA){
+        clImageFormat.image_channel_order = CL_RGBA;
+        m_intermediate = clCreateImage2D(m_context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, &err_num);
+    }
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error creating intermediate image object" << std::endl;
+        m_intermediate = 0;
+        return false;
+    }
+
+    m_intermediate_width = width;
+    m_intermediate_height = height;
+    m_intermediate_type = type;
+    m_intermediate_order = order;
+    return true;
+}
+
+bool GaussianFilter::createRecursiveBuffers(size_t size)
+{
+    if(m_recursive_size >= size){
+        return true;
+    }
+
+    for(auto& buffer : m_recursive_buffers){
+        if(buffer != 0)
+            clReleaseMemObject(buffer);
+        buffer = 0;
+    }
+    m_recursive_size = 0;
+
+    cl_int err_num;
+    for(auto& buffer : m_recursive_buffers){
+        buffer = clCreateBuffer(m_context, CL_MEM_READ_WRITE, size, NULL, &err_num);
+        if(err_num != CL_SUCCESS){
+            std::cerr << "Error creating the recursive filter buffers" << std::endl;
+            buffer = 0;
+            return false;
+        }
+    }
+
+    m_recursive_size = size;
+    return true;
+}
+
+std::vector<unsigned char> GaussianFilter::testPattern(int width, int height)
+{
+    // Noise is the worst case for a blur, every output pixel differs from its neighbours
+    std::vector<unsigned char> pattern((size_t)width * height * 4);
+    unsigned int state = 12345;
+    for(auto& value : pattern){
+        state = state * 1664525u + 1013904223u;
+        value = (unsigned char)(state >> 24);
+    }
+
+    return pattern;
+}
+
+bool GaussianFilter::runVariant(cl_command_queue queue, FilterPrecision precision, const std::vector<unsigned char> &input, std::vector<unsigned char> &output, int width, int height, int iterations, double &time_ms)
+{
+    cl_int err_num;
+    auto previous = m_precision;
+    m_precision = precision;
+
+    // Create the input and output objects the variant expects
+    cl_mem objects[2] = {0, 0};
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {(size_t)width, (size_t)height, 1};
+    output.resize(input.size());
+
+    if(UsesBuffers()){
+        objects[0] = clCreateBuffer(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, input.size(), (void*)input.data(), &err_num);
+        objects[1] = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, input.size(), NULL, &err_num);
+    } else{
+        cl_image_format clImageFormat;
+        clImageFormat.image_channel_order = CL_RGBA;
+        clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+        objects[0] = clCreateImage2D(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &clImageFormat, width, height, 0, (void*)input.data(), &err_num);
+        objects[1] = clCreateImage2D(m_context, CL_MEM_WRITE_ONLY, &clImageFormat, width, height, 0, NULL, &err_num);
+    }
+
+    // Warm-up run so that lazy allocations are not measured
+    err_num = (objects[0] != 0 && objects[1] != 0) ? Enqueue(queue, objects[0], objects[1], width, height) : CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    clFinish(queue);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < iterations && err_num == CL_SUCCESS; i++){
+        err_num = Enqueue(queue, objects[0], objects[1], width, height);
+    }
+    clFinish(queue);
+    auto end = std::chrono::high_resolution_clock::now();
+    time_ms = std::chrono::duration<double, std::milli>(end - start).count() / iterations;
+
+    // Read the result back
+    if(err_num == CL_SUCCESS){
+        if(UsesBuffers()){
+            err_num = clEnqueueReadBuffer(queue, objects[1], CL_TRUE, 0, output.size(), output.data(), 0, NULL, NULL);
+        } else{
+            err_num = clEnqueueReadImage(queue, objects[1], CL_TRUE, origin, region, 0, 0, output.data(), 0, NULL, NULL);
+        }
+    }
+
+    for(auto object : objects){
+        if(object != 0)
+            clReleaseMemObject(object);
+    }
+
+    m_precision = previous;
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error running the " << PrecisionName(precision) << " variant (" << err_num << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+FilterPrecision GaussianFilter::activePrecision() const
+{
+    // Algorithms without a reduced precision variant run in float
+    if(m_precision == FilterPrecision::AUTO || !SupportsPrecision(m_precision)){
+        return FilterPrecision::FLOAT;
+    }
+
+    return m_precision;
+}
@@ -0,0 +1,143 @@
+#include "Histogram.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    // Enough private copies to fill the device, few enough that merging them stays cheap
+    const cl_uint GROUPS_PER_COMPUTE_UNIT = 4;
+}
+
+Histogram::Histogram(Controller& controller, cl_context context, cl_device_id device, cl_program program)
+    : m_group_size{0}, m_max_group_size{1}, m_lut_group_size{1}, m_compute_units{1}
+{
+    cl_int err_num;
+
+    m_kernel_histogram = controller.CreateKernel(program, "histogram_local");
+    m_kernel_lut = controller.CreateKernel(program, "histogram_lut");
+    m_kernel_apply = controller.CreateKernel(program, "histogram_apply");
+
+    m_sampler = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &err_num);
+    controller.CheckError(err_num, "clCreateSampler");
+
+    m_bins = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint) * BINS * CHANNELS, NULL, &err_num);
+    controller.CheckError(err_num, "clCreateBuffer");
+    m_lut = clCreateBuffer(context, CL_MEM_READ_WRITE, sizeof(cl_uchar) * BINS * CHANNELS, NULL, &err_num);
+    controller.CheckError(err_num, "clCreateBuffer");
+
+    clGetDeviceInfo(device, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(cl_uint), &m_compute_units, NULL);
+    clGetKernelWorkGroupInfo(m_kernel_histogram, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &m_max_group_size, NULL);
+
+    // The scan of the lookup table kernel splits the bins evenly between a power of two work-items
+    size_t lut_limit = 1;
+    clGetKernelWorkGroupInfo(m_kernel_lut, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &lut_limit, NULL);
+    while(m_lut_group_size * 2 <= std::min(lut_limit, (size_t)BINS)){
+        m_lut_group_size *= 2;
+    }
+
+    SetGroupSize(0);
+}
+
+Histogram::~Histogram()
+{
+    clReleaseMemObject(m_bins);
+    clReleaseMemObject(m_lut);
+    clReleaseSampler(m_sampler);
+    clReleaseKernel(m_kernel_histogram);
+    clReleaseKernel(m_kernel_lut);
+    clReleaseKernel(m_kernel_apply);
+}
+
+bool Histogram::SetGroupSize(size_t group_size)
+{
+    if(group_size > m_max_group_size){
+        std::cerr << "Histogram work-group size " << group_size << " exceeds the kernel limit of " << m_max_group_size << std::endl;
+        return false;
+    }
+
+    m_group_size = (group_size == 0) ? m_max_group_size : group_size;
+    return true;
+}
+
+size_t Histogram::GetGroupSize() const
+{
+    return m_group_size;
+}
+
+size_t Histogram::GetMaxGroupSize() const
+{
+    return m_max_group_size;
+}
+
+cl_int Histogram::Enqueue(cl_command_queue queue, cl_mem src_image, int width, int height, cl_uint num_events, const cl_event* wait_list, cl_event* event)
+{
+    // Every work-item reads at least one pixel
+    size_t pixels = (size_t)width * height;
+    size_t groups = std::min((size_t)m_compute_units * GROUPS_PER_COMPUTE_UNIT, (pixels + m_group_size - 1) / m_group_size);
+    size_t global_work_size = std::max(groups, (size_t)1) * m_group_size;
+
+    cl_uint zero = 0;
+    cl_event cleared;
+    cl_int err_num = clEnqueueFillBuffer(queue, m_bins, &zero, sizeof(zero), 0, sizeof(cl_uint) * BINS * CHANNELS, num_events, wait_list, &cleared);
+    if(err_num != CL_SUCCESS){
+        return err_num;
+    }
+
+    err_num = clSetKernelArg(m_kernel_histogram, 0, sizeof(cl_mem), &src_image);
+    err_num |= clSetKernelArg(m_kernel_histogram, 1, sizeof(cl_sampler), &m_sampler);
+    err_num |= clSetKernelArg(m_kernel_histogram, 2, sizeof(cl_mem), &m_bins);
+    err_num |= clSetKernelArg(m_kernel_histogram, 3, sizeof(cl_int), &width);
+    err_num |= clSetKernelArg(m_kernel_histogram, 4, sizeof(cl_int), &height);
+    if(err_num == CL_SUCCESS){
+        err_num = clEnqueueNDRangeKernel(queue, m_kernel_histogram, 1, NULL, &global_work_size, &m_group_size, 1, &cleared, event);
+    }
+
+    clReleaseEvent(cleared);
+    return err_num;
+}
+
+cl_int Histogram::Equalize(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events, const cl_event* wait_list, cl_event* event)
+{
+    cl_int err_num = Enqueue(queue, src_image, width, height, num_events, wait_list, NULL);
+    if(err_num != CL_SUCCESS){
+        return err_num;
+    }
+
+    // One work-group per channel turns the bins into a lookup table
+    cl_int pixels = width * height;
+    size_t lut_global_size = m_lut_group_size * CHANNELS;
+    err_num = clSetKernelArg(m_kernel_lut, 0, sizeof(cl_mem), &m_bins);
+    err_num |= clSetKernelArg(m_kernel_lut, 1, sizeof(cl_mem), &m_lut);
+    err_num |= clSetKernelArg(m_kernel_lut, 2, sizeof(cl_int), &pixels);
+    if(err_num == CL_SUCCESS){
+        err_num = clEnqueueNDRangeKernel(queue, m_kernel_lut, 1, NULL, &lut_global_size, &m_lut_group_size, 0, NULL, NULL);
+    }
+    if(err_num != CL_SUCCESS){
+        return err_num;
+    }
+
+    err_num = clSetKernelArg(m_kernel_apply, 0, sizeof(cl_mem), &src_image);
+    err_num |= clSetKernelArg(m_kernel_apply, 1, sizeof(cl_mem), &dst_image);
+    err_num |= clSetKernelArg(m_kernel_apply, 2, sizeof(cl_sampler), &m_sampler);
+    err_num |= clSetKernelArg(m_kernel_apply, 3, sizeof(cl_mem), &m_lut);
+    err_num |= clSetKernelArg(m_kernel_apply, 4, sizeof(cl_int), &width);
+    err_num |= clSetKernelArg(m_kernel_apply, 5, sizeof(cl_int), &height);
+
+    size_t local_work_size[2] = {16, 16};
+    size_t global_work_size[2] = {Controller::RoundUp(16, width), Controller::RoundUp(16, height)};
+    if(err_num == CL_SUCCESS){
+        err_num = clEnqueueNDRangeKernel(queue, m_kernel_apply, 2, NULL, global_work_size, local_work_size, 0, NULL, event);
+    }
+    return err_num;
+}
+
+bool Histogram::Read(cl_command_queue queue, std::vector<cl_uint>& bins) const
+{
+    bins.resize(BINS * CHANNELS);
+    cl_int err_num = clEnqueueReadBuffer(queue, m_bins, CL_TRUE, 0, sizeof(cl_uint) * bins.size(), bins.data(), 0, NULL, NULL);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error reading the histogram (" << err_num << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
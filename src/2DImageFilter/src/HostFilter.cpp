@@ -0,0 +1,272 @@
+#include "HostFilter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define HOST_FILTER_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+namespace
+{
+    // Rows filtered per block, bounds the float intermediate of every worker
+    const int BLOCK_ROWS = 64;
+
+    // Horizontal pass: padded_row holds the row with `taps / 2` replicated pixels on both sides
+    void horizontalScalar(const uint8_t* padded_row, float* output, int width, const float* weights, int taps)
+    {
+        for(int x = 0; x < width; x++){
+            float sum[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            for(int k = 0; k < taps; k++){
+                const uint8_t* pixel = padded_row + (x + k) * 4;
+                for(int c = 0; c < 4; c++){
+                    sum[c] += weights[k] * pixel[c];
+                }
+            }
+            std::memcpy(output + x * 4, sum, sizeof(sum));
+        }
+    }
+
+    // Vertical pass over `count` floats of `taps` intermediate rows, rounded to nearest even and saturated
+    void verticalScalar(const float* const* rows, uint8_t* output, int count, const float* weights, int taps)
+    {
+        for(int i = 0; i < count; i++){
+            float sum = 0.0f;
+            for(int k = 0; k < taps; k++){
+                sum += weights[k] * rows[k][i];
+            }
+            output[i] = (uint8_t)std::min(std::max(std::nearbyint(sum), 0.0f), 255.0f);
+        }
+    }
+
+#ifdef HOST_FILTER_X86
+    TARGET_SSE41 void horizontalSSE41(const uint8_t* padded_row, float* output, int width, const float* weights, int taps)
+    {
+        // One RGBA pixel per vector
+        for(int x = 0; x < width; x++){
+            __m128 sum = _mm_setzero_ps();
+            for(int k = 0; k < taps; k++){
+                int32_t packed;
+                std::memcpy(&packed, padded_row + (x + k) * 4, sizeof(packed));
+                __m128 pixel = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+                sum = _mm_add_ps(sum, _mm_mul_ps(pixel, _mm_set1_ps(weights[k])));
+            }
+            _mm_storeu_ps(output + x * 4, sum);
+        }
+    }
+
+    TARGET_SSE41 void verticalSSE41(const float* const* rows, uint8_t* output, int count, const float* weights, int taps)
+    {
+        int i = 0;
+        for(; i + 4 <= count; i += 4){
+            __m128 sum = _mm_setzero_ps();
+            for(int k = 0; k < taps; k++){
+                sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + i), _mm_set1_ps(weights[k])));
+            }
+
+            // Round to nearest even and saturate to 8 bits
+            __m128i words = _mm_packus_epi32(_mm_cvtps_epi32(sum), _mm_setzero_si128());
+            int32_t packed = _mm_cvtsi128_si32(_mm_packus_epi16(words, words));
+            std::memcpy(output + i, &packed, sizeof(packed));
+        }
+
+        // The remaining columns go through the narrower path, sized for any number of taps
+        if(i < count){
+            std::vector<const float*> tail(taps);
+            for(int k = 0; k < taps; k++){
+                tail[k] = rows[k] + i;
+            }
+            verticalScalar(tail.data(), output + i, count - i, weights, taps);
+        }
+    }
+
+    TARGET_AVX2 void horizontalAVX2(const uint8_t* padded_row, float* output, int width, const float* weights, int taps)
+    {
+        // Two RGBA pixels per vector
+        int x = 0;
+        for(; x + 2 <= width; x += 2){
+            __m256 sum = _mm256_setzero_ps();
+            for(int k = 0; k < taps; k++){
+                __m128i pixels = _mm_loadl_epi64((const __m128i*)(padded_row + (x + k) * 4));
+                sum = _mm256_fmadd_ps(_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(pixels)), _mm256_set1_ps(weights[k]), sum);
+            }
+            _mm256_storeu_ps(output + x * 4, sum);
+        }
+
+        if(x < width){
+            horizontalSSE41(padded_row + x * 4, output + x * 4, width - x, weights, taps);
+        }
+    }
+
+    TARGET_AVX2 void verticalAVX2(const float* const* rows, uint8_t* output, int count, const float* weights, int taps)
+    {
+        int i = 0;
+        for(; i + 8 <= count; i += 8){
+            __m256 sum = _mm256_setzero_ps();
+            for(int k = 0; k < taps; k++){
+                sum = _mm256_fmadd_ps(_mm256_loadu_ps(rows[k] + i), _mm256_set1_ps(weights[k]), sum);
+            }
+
+            // Round to nearest even and saturate to 8 bits
+            __m256i values = _mm256_cvtps_epi32(sum);
+            __m128i words = _mm_packus_epi32(_mm256_castsi256_si128(values), _mm256_extracti128_si256(values, 1));
+            _mm_storel_epi64((__m128i*)(output + i), _mm_packus_epi16(words, words));
+        }
+
+        // The remaining columns go through the narrower path, sized for any number of taps
+        if(i < count){
+            std::vector<const float*> tail(taps);
+            for(int k = 0; k < taps; k++){
+                tail[k] = rows[k] + i;
+            }
+            verticalSSE41(tail.data(), output + i, count - i, weights, taps);
+        }
+    }
+#endif
+}
+
+HostFilter::HostFilter(int threads) : m_pool{threads}, m_instruction_set{DetectInstructionSet()} {}
+
+std::vector<float> HostFilter::Weights(FilterAlgorithm algorithm, int radius, float sigma)
+{
+    // The original kernel is the outer product of 1 2 1 / 4 with itself
+    if(algorithm == FilterAlgorithm::GAUSSIAN_3X3){
+        return {0.25f, 0.5f, 0.25f};
+    }
+
+    if(sigma <= 0.0f){
+        sigma = 0.3f * (radius - 1) + 0.8f;
+    }
+    return GaussianFilter::ComputeWeights(radius, sigma);
+}
+
+void HostFilter::Apply(const char *input, char *output, int width, int height, const std::vector<float> &weights)
+{
+    // Every worker filters a band of rows, reading a halo of source rows above and below it
+    m_pool.ParallelFor(height, [&](int begin, int end){
+        filterRows((const uint8_t*)input, (uint8_t*)output, width, height, weights, begin, end);
+    });
+}
+
+void HostFilter::Apply(const char *input, char *output, int width, int height, FilterAlgorithm algorithm, int radius, float sigma)
+{
+    Apply(input, output, width, height, Weights(algorithm, radius, sigma));
+}
+
+HostInstructionSet HostFilter::DetectInstructionSet()
+{
+#ifdef HOST_FILTER_X86
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool fma = (info[2] & (1 << 12)) != 0;
+    bool os_avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    bool avx2 = os_avx && fma && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    bool sse41 = __builtin_cpu_supports("sse4.1");
+    bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+    if(avx2)
+        return HostInstructionSet::AVX2;
+    if(sse41)
+        return HostInstructionSet::SSE41;
+#endif
+    return HostInstructionSet::SCALAR;
+}
+
+std::string HostFilter::InstructionSetName(HostInstructionSet instruction_set)
+{
+    switch (instruction_set)
+    {
+    case HostInstructionSet::SCALAR:
+        return "scalar";
+
+    case HostInstructionSet::SSE41:
+        return "sse4.1";
+
+    case HostInstructionSet::AVX2:
+        return "avx2";
+    }
+
+    return "unknown";
+}
+
+bool HostFilter::SetInstructionSet(HostInstructionSet instruction_set)
+{
+    if(instruction_set > DetectInstructionSet()){
+        return false;
+    }
+
+    m_instruction_set = instruction_set;
+    return true;
+}
+
+HostInstructionSet HostFilter::GetInstructionSet() const
+{
+    return m_instruction_set;
+}
+
+int HostFilter::GetThreadCount() const
+{
+    return m_pool.GetThreadCount();
+}
+
+void HostFilter::filterRows(const uint8_t *input, uint8_t *output, int width, int height, const std::vector<float> &weights, int begin, int end)
+{
+    int taps = (int)weights.size();
+    int radius = taps / 2;
+    size_t row_floats = (size_t)width * 4;
+
+    auto horizontal = horizontalScalar;
+    auto vertical = verticalScalar;
+#ifdef HOST_FILTER_X86
+    if(m_instruction_set == HostInstructionSet::AVX2){
+        horizontal = horizontalAVX2;
+        vertical = verticalAVX2;
+    } else if(m_instruction_set == HostInstructionSet::SSE41){
+        horizontal = horizontalSSE41;
+        vertical = verticalSSE41;
+    }
+#endif
+
+    std::vector<uint8_t> padded_row((size_t)(width + 2 * radius) * 4);
+    std::vector<float> intermediate((size_t)(BLOCK_ROWS + 2 * radius) * row_floats);
+    std::vector<const float*> rows(taps);
+
+    for(int block = begin; block < end; block += BLOCK_ROWS){
+        int block_end = std::min(block + BLOCK_ROWS, end);
+
+        // Horizontal pass over the block and its halo rows, replicating the edge pixels
+        for(int y = block - radius; y < block_end + radius; y++){
+            const uint8_t* source = input + (size_t)std::min(std::max(y, 0), height - 1) * row_floats;
+            for(int x = 0; x < radius; x++){
+                std::memcpy(&padded_row[x * 4], source, 4);
+                std::memcpy(&padded_row[(size_t)(radius + width + x) * 4], source + row_floats - 4, 4);
+            }
+            std::memcpy(&padded_row[(size_t)radius * 4], source, row_floats);
+
+            horizontal(padded_row.data(), &intermediate[(size_t)(y - block + radius) * row_floats], width, weights.data(), taps);
+        }
+
+        // Vertical pass from the intermediate rows
+        for(int y = block; y < block_end; y++){
+            for(int k = 0; k < taps; k++){
+                rows[k] = &intermediate[(size_t)(y - block + k) * row_floats];
+            }
+            vertical(rows.data(), output + (size_t)y * row_floats, (int)row_floats, weights.data(), taps);
+        }
+    }
+}
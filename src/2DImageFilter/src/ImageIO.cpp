@@ -0,0 +1,381 @@
+#include "ImageIO.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace
+{
+    // Page alignment lets CPU and unified-memory runtimes use CL_MEM_USE_HOST_PTR memory in place
+    const size_t HOST_ALIGNMENT = 4096;
+
+    // Host memory kept alive for the lifetime of a CL_MEM_USE_HOST_PTR object
+    struct HostMemory
+    {
+        FIBITMAP* image;
+        void* aligned;
+    };
+
+    // Alignment the device needs to use CL_MEM_USE_HOST_PTR memory in place, CL_DEVICE_MEM_BASE_ADDR_ALIGN is in bits
+    size_t deviceAlignment(cl_command_queue queue)
+    {
+        cl_device_id device = 0;
+        cl_uint align_bits = 0;
+        if(clGetCommandQueueInfo(queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL) != CL_SUCCESS ||
+           clGetDeviceInfo(device, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(cl_uint), &align_bits, NULL) != CL_SUCCESS || align_bits < 8){
+            return HOST_ALIGNMENT;
+        }
+        return align_bits / 8;
+    }
+}
+
+bool ImageIO::Decode(const std::string &filename, std::vector<char> &pixels, int &width, int &height)
+{
+    FIBITMAP* image = load(filename);
+    if(image == NULL){
+        return false;
+    }
+
+    // Get dimensions of image
+    width = FreeImage_GetWidth(image);
+    height = FreeImage_GetHeight(image);
+
+    pixels.resize((size_t)width * height * 4);
+    auto result = writePixels(image, pixels.data(), (size_t)width * 4);
+
+    FreeImage_Unload(image);
+    return result;
+}
+
+bool ImageIO::Encode(const std::string &filename, const char *pixels, int width, int height, int pitch)
+{
+    // Retrieve format
+    FREE_IMAGE_FORMAT format = FreeImage_GetFIFFromFilename(filename.c_str());
+    if(format == FIF_UNKNOWN){
+        std::cerr << "Unrecognised output format: " << filename << std::endl;
+        return false;
+    }
+
+    FIBITMAP *image = FreeImage_ConvertFromRawBits((BYTE*)pixels, width, height, pitch, 32, 0xFF000000, 0x00FF0000, 0x0000FF00);
+    if(image == NULL){
+        return false;
+    }
+
+    // Formats such as JPEG cannot store an alpha channel
+    if(!FreeImage_FIFSupportsExportBPP(format, 32)){
+        FIBITMAP *temp = image;
+        image = FreeImage_ConvertTo24Bits(image);
+        FreeImage_Unload(temp);
+        if(image == NULL){
+            return false;
+        }
+    }
+
+    auto result = FreeImage_Save(format, image, filename.c_str()) == TRUE;
+    FreeImage_Unload(image);
+    return result;
+}
+
+bool ImageIO::EncodeGray(const std::string &filename, const char *pixels, int width, int height, int pitch)
+{
+    FREE_IMAGE_FORMAT format = FreeImage_GetFIFFromFilename(filename.c_str());
+    if(format == FIF_UNKNOWN){
+        std::cerr << "Unrecognised output format: " << filename << std::endl;
+        return false;
+    }
+
+    // 8-bit bitmaps come with a linear gray palette
+    FIBITMAP *image = FreeImage_ConvertFromRawBits((BYTE*)pixels, width, height, pitch, 8, 0, 0, 0);
+    if(image == NULL){
+        return false;
+    }
+
+    if(!FreeImage_FIFSupportsExportBPP(format, 8)){
+        FIBITMAP *temp = image;
+        image = FreeImage_ConvertTo24Bits(image);
+        FreeImage_Unload(temp);
+        if(image == NULL){
+            return false;
+        }
+    }
+
+    auto result = FreeImage_Save(format, image, filename.c_str()) == TRUE;
+    FreeImage_Unload(image);
+    return result;
+}
+
+cl_mem ImageIO::LoadImage(cl_context context, cl_command_queue queue, const std::string &filename, int &width, int &height, IngestMode mode, bool as_buffer)
+{
+    FIBITMAP* image = load(filename);
+    if(image == NULL){
+        return 0;
+    }
+
+    // Get dimensions of image
+    width = FreeImage_GetWidth(image);
+    height = FreeImage_GetHeight(image);
+
+    // Create an OpenCL image
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = CL_RGBA;
+    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+    // Initialise OpenCL variables
+    cl_int err_num = CL_SUCCESS;
+    cl_mem cl_image = 0;
+    size_t pitch = (size_t)width * 4;
+
+    if(mode == IngestMode::HOST_PTR){
+        HostMemory* memory = new HostMemory{NULL, NULL};
+        void* pixels;
+
+        // 32-bit images are already in the layout of the OpenCL image, so FreeImage's own pixels are wrapped
+        // when they meet the alignment of the device, everything else is copied into page-aligned memory
+        if(FreeImage_GetImageType(image) == FIT_BITMAP && FreeImage_GetBPP(image) == 32 && (uintptr_t)FreeImage_GetBits(image) % deviceAlignment(queue) == 0){
+            pixels = FreeImage_GetBits(image);
+            pitch = FreeImage_GetPitch(image);
+            memory->image = image;
+            image = NULL;
+        } else{
+            memory->aligned = AllocateAligned(pitch * height);
+            pixels = memory->aligned;
+            if(pixels == NULL || !writePixels(image, (char*)pixels, pitch)){
+                err_num = CL_OUT_OF_HOST_MEMORY;
+            }
+        }
+
+        if(err_num == CL_SUCCESS){
+            if(as_buffer){
+                cl_image = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, pitch * height, pixels, &err_num);
+            } else{
+                cl_image = clCreateImage2D(context, CL_MEM_READ_ONLY | CL_MEM_USE_HOST_PTR, &clImageFormat, width, height, pitch, pixels, &err_num);
+            }
+        }
+
+        // The host memory is released together with the memory object
+        if(err_num == CL_SUCCESS){
+            err_num = clSetMemObjectDestructorCallback(cl_image, releaseHostMemory, memory);
+        }
+
+        // Without the callback the object must go before the memory it uses
+        if(err_num != CL_SUCCESS){
+            if(cl_image != 0)
+                clReleaseMemObject(cl_image);
+            cl_image = 0;
+            releaseHostMemory(0, memory);
+        }
+    } else if(mode == IngestMode::MAPPED){
+        if(as_buffer){
+            cl_image = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, pitch * height, NULL, &err_num);
+        } else{
+            cl_image = clCreateImage2D(context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, &clImageFormat, width, height, 0, NULL, &err_num);
+        }
+
+        // Convert the decoded scanlines directly into the mapped memory
+        char* mapped = NULL;
+        if(err_num == CL_SUCCESS){
+            if(as_buffer){
+                mapped = (char*)clEnqueueMapBuffer(queue, cl_image, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, 0, pitch * height, 0, NULL, NULL, &err_num);
+            } else{
+                size_t origin[3] = {0, 0, 0};
+                size_t region[3] = {(size_t)width, (size_t)height, 1};
+                mapped = (char*)clEnqueueMapImage(queue, cl_image, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, origin, region, &pitch, NULL, 0, NULL, NULL, &err_num);
+            }
+        }
+        if(err_num == CL_SUCCESS){
+            auto written = writePixels(image, mapped, pitch);
+            err_num = clEnqueueUnmapMemObject(queue, cl_image, mapped, 0, NULL, NULL);
+            if(err_num == CL_SUCCESS && !written)
+                err_num = CL_OUT_OF_HOST_MEMORY;
+        }
+    } else{
+        std::vector<char> pixels(pitch * height);
+        if(!writePixels(image, pixels.data(), pitch)){
+            err_num = CL_OUT_OF_HOST_MEMORY;
+        } else if(as_buffer){
+            cl_image = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, pitch * height, pixels.data(), &err_num);
+        } else{
+            cl_image = clCreateImage2D(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, &clImageFormat, width, height, pitch, pixels.data(), &err_num);
+        }
+    }
+
+    if(image != NULL){
+        FreeImage_Unload(image);
+    }
+
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error creating CL Image object (" << err_num << ")" << std::endl;
+        if(cl_image != 0)
+            clReleaseMemObject(cl_image);
+        return 0;
+    }
+
+    return cl_image;
+}
+
+bool ImageIO::ReadDimensions(const std::string &filename, int &width, int &height)
+{
+    FREE_IMAGE_FORMAT format = FreeImage_GetFileType(filename.c_str(), 0);
+    if(format == FIF_UNKNOWN){
+        format = FreeImage_GetFIFFromFilename(filename.c_str());
+    }
+
+    FIBITMAP* image = FreeImage_Load(format, filename.c_str(), FIF_LOAD_NOPIXELS);
+    if(image == NULL){
+        return false;
+    }
+
+    width = FreeImage_GetWidth(image);
+    height = FreeImage_GetHeight(image);
+
+    FreeImage_Unload(image);
+    return true;
+}
+
+bool ImageIO::IsSupported(const std::string &filename)
+{
+    FREE_IMAGE_FORMAT format = FreeImage_GetFileType(filename.c_str(), 0);
+    if(format == FIF_UNKNOWN){
+        format = FreeImage_GetFIFFromFilename(filename.c_str());
+    }
+
+    return format != FIF_UNKNOWN && FreeImage_FIFSupportsReading(format);
+}
+
+double ImageIO::PSNR(const unsigned char *reference, const unsigned char *test, size_t size)
+{
+    double squared_error = 0.0;
+    for(size_t i = 0; i < size; i++){
+        double difference = (double)reference[i] - (double)test[i];
+        squared_error += difference * difference;
+    }
+
+    if(squared_error == 0.0){
+        return std::numeric_limits<double>::infinity();
+    }
+
+    double mse = squared_error / size;
+    return 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+bool ImageIO::ParseIngestMode(const std::string &name, IngestMode &mode)
+{
+    if(name == "copy"){
+        mode = IngestMode::COPY;
+    } else if(name == "host-ptr"){
+        mode = IngestMode::HOST_PTR;
+    } else if(name == "mapped"){
+        mode = IngestMode::MAPPED;
+    } else{
+        return false;
+    }
+
+    return true;
+}
+
+std::string ImageIO::IngestModeName(IngestMode mode)
+{
+    switch (mode)
+    {
+    case IngestMode::COPY:
+        return "copy";
+
+    case IngestMode::HOST_PTR:
+        return "host-ptr";
+
+    case IngestMode::MAPPED:
+        return "mapped";
+    }
+
+    return "unknown";
+}
+
+FIBITMAP *ImageIO::load(const std::string &filename)
+{
+    // Initialise format and image from file
+    FREE_IMAGE_FORMAT format = FreeImage_GetFileType(filename.c_str(), 0);
+    if(format == FIF_UNKNOWN){
+        format = FreeImage_GetFIFFromFilename(filename.c_str());
+    }
+
+    FIBITMAP* image = FreeImage_Load(format, filename.c_str());
+    if(image == NULL){
+        std::cerr << "Failed to decode " << filename << std::endl;
+    }
+
+    return image;
+}
+
+bool ImageIO::writePixels(FIBITMAP *image, char *target, size_t pitch)
+{
+    int width = FreeImage_GetWidth(image);
+    int height = FreeImage_GetHeight(image);
+    unsigned bpp = FreeImage_GetBPP(image);
+
+    if(FreeImage_GetImageType(image) == FIT_BITMAP && (bpp == 32 || bpp == 24 || bpp == 8)){
+        // Convert the common decoder outputs scanline by scanline straight into the target
+        for(int y = 0; y < height; y++){
+            BYTE* source = FreeImage_GetScanLine(image, y);
+            BYTE* row = (BYTE*)target + (size_t)y * pitch;
+
+            if(bpp == 32){
+                std::memcpy(row, source, (size_t)width * 4);
+            } else if(bpp == 24){
+                FreeImage_ConvertLine24To32(row, source, width);
+            } else{
+                FreeImage_ConvertLine8To32(row, source, width, FreeImage_GetPalette(image));
+            }
+        }
+        return true;
+    }
+
+    // Other formats go through an intermediate 32-bit image
+    FIBITMAP* converted = FreeImage_ConvertTo32Bits(image);
+    if(converted == NULL){
+        std::cerr << "Failed to convert image to 32-bit" << std::endl;
+        return false;
+    }
+
+    for(int y = 0; y < height; y++){
+        std::memcpy(target + (size_t)y * pitch, FreeImage_GetScanLine(converted, y), (size_t)width * 4);
+    }
+
+    FreeImage_Unload(converted);
+    return true;
+}
+
+void *ImageIO::AllocateAligned(size_t size)
+{
+    // Round up to the alignment as required by aligned_alloc
+    size = (size + HOST_ALIGNMENT - 1) / HOST_ALIGNMENT * HOST_ALIGNMENT;
+#ifdef _WIN32
+    return _aligned_malloc(size, HOST_ALIGNMENT);
+#else
+    return std::aligned_alloc(HOST_ALIGNMENT, size);
+#endif
+}
+
+void ImageIO::FreeAligned(void *pointer)
+{
+#ifdef _WIN32
+    _aligned_free(pointer);
+#else
+    std::free(pointer);
+#endif
+}
+
+void CL_CALLBACK ImageIO::releaseHostMemory(cl_mem memobj, void *user_data)
+{
+    HostMemory* memory = static_cast<HostMemory*>(user_data);
+
+    if(memory->image != NULL)
+        FreeImage_Unload(memory->image);
+    if(memory->aligned != NULL)
+        FreeAligned(memory->aligned);
+
+    delete memory;
+}
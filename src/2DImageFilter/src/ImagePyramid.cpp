@@ -0,0 +1,253 @@
+#include "ImagePyramid.hpp"
+
+#include <algorithm>
+
+namespace
+{
+    // Must match TAIL_SIZE and TAIL_LEVELS in pyramid.cl
+    const int TAIL_SIZE = 32;
+    const int TAIL_LEVELS = 6;
+    const size_t TAIL_LOCAL_MEMORY = sizeof(cl_float4) * (TAIL_SIZE * TAIL_SIZE + TAIL_SIZE * TAIL_SIZE / 4);
+}
+
+ImagePyramid::ImagePyramid(Controller& controller, cl_context context, cl_device_id device, cl_program program)
+    : m_context{context}, m_placeholder{0}, m_tail_group_size{0}
+{
+    cl_int err_num;
+
+    // Profiling gives the time of every launch
+    m_queue = controller.CreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    if(m_queue == NULL){
+        controller.CheckError(CL_OUT_OF_RESOURCES, "clCreateCommandQueue");
+    }
+
+    m_kernel_reduce = controller.CreateKernel(program, "pyramid_reduce");
+    m_kernel_tail = controller.CreateKernel(program, "pyramid_tail");
+
+    m_sampler = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &err_num);
+    controller.CheckError(err_num, "clCreateSampler");
+
+    // The tail needs its two level buffers in local memory, without them every level takes its own launch
+    cl_ulong local_memory = 0;
+    clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_memory, NULL);
+    if(local_memory >= TAIL_LOCAL_MEMORY){
+        clGetKernelWorkGroupInfo(m_kernel_tail, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &m_tail_group_size, NULL);
+        m_tail_group_size = std::min(m_tail_group_size, (size_t)256);
+    }
+
+    // Unused image arguments of the tail kernel point at a 1x1 image
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = CL_RGBA;
+    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+    m_placeholder = clCreateImage2D(context, CL_MEM_READ_WRITE, &clImageFormat, 1, 1, 0, NULL, &err_num);
+    controller.CheckError(err_num, "clCreateImage2D");
+}
+
+ImagePyramid::~ImagePyramid()
+{
+    releaseLevels();
+
+    clReleaseMemObject(m_placeholder);
+    clReleaseSampler(m_sampler);
+    clReleaseKernel(m_kernel_reduce);
+    clReleaseKernel(m_kernel_tail);
+    clReleaseCommandQueue(m_queue);
+}
+
+bool ImagePyramid::Build(cl_mem src_image, int width, int height)
+{
+    cl_int err_num = CL_SUCCESS;
+
+    if(!allocate(width, height)){
+        return false;
+    }
+    m_levels[0].image = src_image;
+
+    // One launch per level until the rest fits into the tail work-group
+    std::vector<std::pair<size_t, cl_event>> launches;
+    size_t level = 1;
+    while(level < m_levels.size() && err_num == CL_SUCCESS){
+        auto& src = m_levels[level - 1];
+        auto& dst = m_levels[level];
+        cl_event event = 0;
+
+        if(m_tail_group_size > 0 && dst.width <= TAIL_SIZE && dst.height <= TAIL_SIZE){
+            int levels = (int)std::min(m_levels.size() - level, (size_t)TAIL_LEVELS);
+            cl_uint index = 0;
+
+            err_num = clSetKernelArg(m_kernel_tail, index++, sizeof(cl_mem), &src.image);
+            for(int i = 0; i < TAIL_LEVELS; i++){
+                cl_mem image = (i < levels) ? m_levels[level + i].image : m_placeholder;
+                err_num |= clSetKernelArg(m_kernel_tail, index++, sizeof(cl_mem), &image);
+            }
+            err_num |= clSetKernelArg(m_kernel_tail, index++, sizeof(cl_sampler), &m_sampler);
+            err_num |= clSetKernelArg(m_kernel_tail, index++, sizeof(cl_int), &src.width);
+            err_num |= clSetKernelArg(m_kernel_tail, index++, sizeof(cl_int), &src.height);
+            err_num |= clSetKernelArg(m_kernel_tail, index++, sizeof(cl_int), &levels);
+
+            size_t local_work_size = m_tail_group_size;
+            if(err_num == CL_SUCCESS){
+                err_num = clEnqueueNDRangeKernel(m_queue, m_kernel_tail, 1, NULL, &local_work_size, &local_work_size, 0, NULL, &event);
+            }
+
+            // The source is read once, every tail level is written once
+            size_t bytes = (size_t)src.width * src.height * 4;
+            for(int i = 0; i < levels; i++){
+                auto& tail = m_levels[level + i];
+                tail.first = (i == 0);
+                tail.bytes = 0;
+                bytes += (size_t)tail.width * tail.height * 4;
+            }
+            m_levels[level].bytes = bytes;
+
+            launches.push_back({level, event});
+            level += levels;
+            continue;
+        }
+
+        err_num = clSetKernelArg(m_kernel_reduce, 0, sizeof(cl_mem), &src.image);
+        err_num |= clSetKernelArg(m_kernel_reduce, 1, sizeof(cl_mem), &dst.image);
+        err_num |= clSetKernelArg(m_kernel_reduce, 2, sizeof(cl_sampler), &m_sampler);
+        err_num |= clSetKernelArg(m_kernel_reduce, 3, sizeof(cl_int), &dst.width);
+        err_num |= clSetKernelArg(m_kernel_reduce, 4, sizeof(cl_int), &dst.height);
+
+        size_t local_work_size[2] = {16, 16};
+        size_t global_work_size[2] = {Controller::RoundUp(16, dst.width), Controller::RoundUp(16, dst.height)};
+        if(err_num == CL_SUCCESS){
+            err_num = clEnqueueNDRangeKernel(m_queue, m_kernel_reduce, 2, NULL, global_work_size, local_work_size, 0, NULL, &event);
+        }
+
+        // Each source pixel is fetched from memory once, the neighbouring taps hit the texture cache
+        dst.bytes = (size_t)(src.width * src.height + dst.width * dst.height) * 4;
+        dst.first = true;
+
+        launches.push_back({level, event});
+        level++;
+    }
+
+    clFinish(m_queue);
+    for(auto& launch : launches){
+        if(launch.second == 0)
+            continue;
+
+        m_levels[launch.first].time_ms = (Controller::GetProfilingTime(launch.second, CL_PROFILING_COMMAND_END) -
+                                          Controller::GetProfilingTime(launch.second, CL_PROFILING_COMMAND_START)) * 1e-6;
+        clReleaseEvent(launch.second);
+    }
+
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error building the image pyramid (" << err_num << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int ImagePyramid::GetLevelCount() const
+{
+    return (int)m_levels.size();
+}
+
+cl_mem ImagePyramid::GetLevel(int level) const
+{
+    return (level >= 0 && level < (int)m_levels.size()) ? m_levels[level].image : 0;
+}
+
+void ImagePyramid::GetLevelSize(int level, int &width, int &height) const
+{
+    width = height = 0;
+    if(level >= 0 && level < (int)m_levels.size()){
+        width = m_levels[level].width;
+        height = m_levels[level].height;
+    }
+}
+
+void ImagePyramid::DisplayStatistics() const
+{
+    double total_ms = 0.0;
+    size_t total_bytes = 0, launches = 0;
+
+    std::cout << "\nPYRAMID (" << m_levels.size() - 1 << " levels):" << std::endl;
+    std::cout << "\tlevel\tsize\t\ttime (ms)\tbytes moved" << std::endl;
+
+    for(size_t level = 1; level < m_levels.size(); level++){
+        auto& current = m_levels[level];
+        std::cout << "\t" << level << "\t" << current.width << "x" << current.height << "\t\t";
+
+        // Levels after the first one of a fused launch are included in its numbers
+        if(current.first){
+            std::cout << std::fixed << std::setprecision(3) << current.time_ms << "\t\t" << current.bytes << std::endl;
+            total_ms += current.time_ms;
+            total_bytes += current.bytes;
+            launches++;
+        } else{
+            std::cout << "(fused)" << std::endl;
+        }
+    }
+
+    std::cout << "\t" << launches << " launches, " << total_ms << " ms, " << total_bytes << " bytes moved" << std::endl;
+}
+
+bool ImagePyramid::ReadLevel(int level, std::vector<char> &pixels) const
+{
+    if(level < 0 || level >= (int)m_levels.size()){
+        return false;
+    }
+
+    auto& current = m_levels[level];
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {(size_t)current.width, (size_t)current.height, 1};
+    pixels.resize((size_t)current.width * current.height * 4);
+
+    cl_int err_num = clEnqueueReadImage(m_queue, current.image, CL_TRUE, origin, region, 0, 0, pixels.data(), 0, NULL, NULL);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error reading pyramid level " << level << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ImagePyramid::allocate(int width, int height)
+{
+    // Keep the levels of an image with the same size
+    if(!m_levels.empty() && m_levels[0].width == width && m_levels[0].height == height){
+        for(auto& level : m_levels){
+            level.time_ms = 0.0;
+            level.bytes = 0;
+            level.first = false;
+        }
+        return true;
+    }
+
+    releaseLevels();
+    m_levels.push_back({0, width, height, 0.0, 0, false});
+
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = CL_RGBA;
+    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+    // Halve until 1x1, rounding down like mipmaps
+    while(width > 1 || height > 1){
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+
+        cl_int err_num;
+        cl_mem image = clCreateImage2D(m_context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, &err_num);
+        if(err_num != CL_SUCCESS){
+            std::cerr << "Error creating a " << width << "x" << height << " pyramid level" << std::endl;
+            releaseLevels();
+            return false;
+        }
+        m_levels.push_back({image, width, height, 0.0, 0, false});
+    }
+
+    return true;
+}
+
+void ImagePyramid::releaseLevels()
+{
+    // Level 0 belongs to the caller
+    for(size_t level = 1; level < m_levels.size(); level++){
+        clReleaseMemObject(m_levels[level].image);
+    }
+    m_levels.clear();
+}
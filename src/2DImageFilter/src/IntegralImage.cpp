@@ -0,0 +1,184 @@
+#include "IntegralImage.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const size_t MAX_ROWS_GROUP_SIZE = 256;
+}
+
+IntegralImage::IntegralImage(Controller& controller, cl_context context, cl_device_id device, cl_program program)
+    : m_context{context}, m_device{device}, m_sat{0}, m_intermediate{0, 0}, m_width{0}, m_height{0}, m_sigma{0.0f}
+{
+    m_kernel_rows = controller.CreateKernel(program, "sat_rows");
+    m_kernel_columns = controller.CreateKernel(program, "sat_columns");
+    m_kernel_box = controller.CreateKernel(program, "box_filter");
+
+    // The row scan needs one uint4 of local memory per work-item
+    m_rows_group_size = MAX_ROWS_GROUP_SIZE;
+    size_t kernel_group_size = 0;
+    cl_ulong local_memory = 0;
+    if(clGetKernelWorkGroupInfo(m_kernel_rows, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &kernel_group_size, NULL) == CL_SUCCESS){
+        m_rows_group_size = std::min(m_rows_group_size, kernel_group_size);
+    }
+    if(clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &local_memory, NULL) == CL_SUCCESS){
+        m_rows_group_size = std::min(m_rows_group_size, (size_t)(local_memory / sizeof(cl_uint4)));
+    }
+
+    SetSigma(1.0f);
+}
+
+IntegralImage::~IntegralImage()
+{
+    if(m_sat != 0)
+        clReleaseMemObject(m_sat);
+
+    for(auto image : m_intermediate){
+        if(image != 0)
+            clReleaseMemObject(image);
+    }
+
+    clReleaseKernel(m_kernel_rows);
+    clReleaseKernel(m_kernel_columns);
+    clReleaseKernel(m_kernel_box);
+}
+
+std::vector<int> IntegralImage::BoxRadii(float sigma, int passes)
+{
+    // Ideal box width for n passes: n * (w^2 - 1) / 12 = sigma^2, split between the odd widths below and above it
+    double ideal = std::sqrt(12.0 * sigma * sigma / passes + 1.0);
+    int lower = (int)std::floor(ideal);
+    if(lower % 2 == 0)
+        lower--;
+    int upper = lower + 2;
+
+    int lower_passes = (int)std::lround((12.0 * sigma * sigma - passes * lower * lower - 4.0 * passes * lower - 3.0 * passes) / (-4.0 * lower - 4.0));
+    lower_passes = std::max(0, std::min(passes, lower_passes));
+
+    std::vector<int> radii;
+    for(int i = 0; i < passes; i++){
+        radii.push_back(((i < lower_passes ? lower : upper) - 1) / 2);
+    }
+    return radii;
+}
+
+bool IntegralImage::SetSigma(float sigma)
+{
+    if(sigma <= 0.0f){
+        std::cerr << "Box blur sigma must be positive" << std::endl;
+        return false;
+    }
+
+    m_sigma = sigma;
+    m_radii = BoxRadii(sigma);
+    return true;
+}
+
+float IntegralImage::GetSigma() const
+{
+    return m_sigma;
+}
+
+std::vector<int> IntegralImage::GetRadii() const
+{
+    return m_radii;
+}
+
+cl_int IntegralImage::EnqueueBox(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, int radius)
+{
+    cl_int err_num;
+
+    if(!reserve(width, height)){
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+
+    // Rows: one work-group per row
+    size_t rows_local = m_rows_group_size;
+    size_t rows_global = rows_local * height;
+    err_num = clSetKernelArg(m_kernel_rows, 0, sizeof(cl_mem), &src_image);
+    err_num |= clSetKernelArg(m_kernel_rows, 1, sizeof(cl_mem), &m_sat);
+    err_num |= clSetKernelArg(m_kernel_rows, 2, sizeof(cl_uint4) * rows_local, NULL);
+    err_num |= clSetKernelArg(m_kernel_rows, 3, sizeof(int), &width);
+    err_num |= clSetKernelArg(m_kernel_rows, 4, sizeof(int), &height);
+    err_num |= clEnqueueNDRangeKernel(queue, m_kernel_rows, 1, NULL, &rows_global, &rows_local, 0, NULL, NULL);
+
+    // Columns: one work-item per column
+    size_t columns_local = 64;
+    size_t columns_global = Controller::RoundUp((int)columns_local, width);
+    err_num |= clSetKernelArg(m_kernel_columns, 0, sizeof(cl_mem), &m_sat);
+    err_num |= clSetKernelArg(m_kernel_columns, 1, sizeof(int), &width);
+    err_num |= clSetKernelArg(m_kernel_columns, 2, sizeof(int), &height);
+    err_num |= clEnqueueNDRangeKernel(queue, m_kernel_columns, 1, NULL, &columns_global, &columns_local, 0, NULL, NULL);
+
+    // Box mean from four corners
+    size_t local_work_size[2] = {16, 16};
+    size_t global_work_size[2] = {Controller::RoundUp((int)local_work_size[0], width), Controller::RoundUp((int)local_work_size[1], height)};
+    err_num |= clSetKernelArg(m_kernel_box, 0, sizeof(cl_mem), &m_sat);
+    err_num |= clSetKernelArg(m_kernel_box, 1, sizeof(cl_mem), &dst_image);
+    err_num |= clSetKernelArg(m_kernel_box, 2, sizeof(int), &width);
+    err_num |= clSetKernelArg(m_kernel_box, 3, sizeof(int), &height);
+    err_num |= clSetKernelArg(m_kernel_box, 4, sizeof(int), &radius);
+    err_num |= clEnqueueNDRangeKernel(queue, m_kernel_box, 2, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+
+    return err_num;
+}
+
+cl_int IntegralImage::Enqueue(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height)
+{
+    if(!reserve(width, height)){
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+
+    // src -> intermediate 0 -> intermediate 1 -> ... -> dst, the in-order queue serialises the passes
+    cl_int err_num = CL_SUCCESS;
+    cl_mem input = src_image;
+    for(size_t pass = 0; pass < m_radii.size() && err_num == CL_SUCCESS; pass++){
+        cl_mem output = pass + 1 == m_radii.size() ? dst_image : m_intermediate[pass % 2];
+        err_num = EnqueueBox(queue, input, output, width, height, m_radii[pass]);
+        input = output;
+    }
+
+    return err_num;
+}
+
+bool IntegralImage::reserve(int width, int height)
+{
+    if(width == m_width && height == m_height)
+        return true;
+
+    if(m_sat != 0)
+        clReleaseMemObject(m_sat);
+    for(auto& image : m_intermediate){
+        if(image != 0)
+            clReleaseMemObject(image);
+        image = 0;
+    }
+    m_sat = 0;
+    m_width = m_height = 0;
+
+    cl_int err_num;
+    m_sat = clCreateBuffer(m_context, CL_MEM_READ_WRITE, sizeof(cl_uint4) * width * height, NULL, &err_num);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error creating the " << width << "x" << height << " summed-area table" << std::endl;
+        m_sat = 0;
+        return false;
+    }
+
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = CL_RGBA;
+    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+    for(auto& image : m_intermediate){
+        image = clCreateImage2D(m_context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, &err_num);
+        if(err_num != CL_SUCCESS){
+            std::cerr << "Error creating the box filter intermediate images" << std::endl;
+            image = 0;
+            return false;
+        }
+    }
+
+    m_width = width;
+    m_height = height;
+    return true;
+}
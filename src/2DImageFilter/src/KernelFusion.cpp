@@ -0,0 +1,384 @@
+#include "KernelFusion.hpp"
+
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+
+#include <GaussianFilter.hpp>
+
+KernelFusion::KernelFusion(Controller& controller, cl_context context, cl_device_id device)
+    : m_controller{controller}, m_context{context}, m_device{device}, m_built{false}, m_program{0}, m_kernel{0},
+      m_intermediates{0, 0}, m_intermediate_width{0}, m_intermediate_height{0}
+{
+    cl_int err_num;
+
+    // Create sampler object
+    m_sampler = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &err_num);
+    controller.CheckError(err_num, "clCreateSampler");
+}
+
+KernelFusion::~KernelFusion()
+{
+    release();
+    clReleaseSampler(m_sampler);
+}
+
+void KernelFusion::AddGain(float gain)
+{
+    m_operations.push_back({FusedOperation::GAIN, {gain}});
+    m_built = false;
+}
+
+void KernelFusion::AddGamma(float gamma)
+{
+    m_operations.push_back({FusedOperation::GAMMA, {gamma}});
+    m_built = false;
+}
+
+void KernelFusion::AddColorMatrix(const std::array<float, 9> &matrix)
+{
+    m_operations.push_back({FusedOperation::COLOR_MATRIX, std::vector<float>(matrix.begin(), matrix.end())});
+    m_built = false;
+}
+
+void KernelFusion::AddThreshold(float threshold)
+{
+    m_operations.push_back({FusedOperation::THRESHOLD, {threshold}});
+    m_built = false;
+}
+
+bool KernelFusion::AddGaussian(int radius, float sigma)
+{
+    // A single kernel can only gather one stencil
+    for(auto& operation : m_operations){
+        if(operation.type == FusedOperation::GAUSSIAN){
+            std::cerr << "Only one stencil can be fused into a kernel" << std::endl;
+            return false;
+        }
+    }
+
+    if(sigma <= 0.0f){
+        sigma = 0.3f * (radius - 1) + 0.8f;
+    }
+
+    m_operations.push_back({FusedOperation::GAUSSIAN, {(float)radius, sigma}});
+    m_built = false;
+    return true;
+}
+
+bool KernelFusion::Parse(const std::string &spec, int radius, float sigma)
+{
+    std::stringstream stream(spec);
+    std::string stage;
+
+    while(std::getline(stream, stage, ',')){
+        // Optional parameter after a colon, e.g. "gamma:2.2"
+        auto colon = stage.find(':');
+        std::string name = stage.substr(0, colon);
+        bool has_value = colon != std::string::npos;
+        float value = has_value ? (float)std::atof(stage.substr(colon + 1).c_str()) : 0.0f;
+
+        if(name == "blur"){
+            if(!AddGaussian(radius, sigma))
+                return false;
+        } else if(name == "gain" && has_value){
+            AddGain(value);
+        } else if(name == "gamma" && has_value && value > 0.0f){
+            AddGamma(value);
+        } else if(name == "threshold" && has_value){
+            AddThreshold(value);
+        } else if(name == "sepia"){
+            AddColorMatrix({0.393f, 0.769f, 0.189f,
+                            0.349f, 0.686f, 0.168f,
+                            0.272f, 0.534f, 0.131f});
+        } else if(name == "saturation" && has_value){
+            // Interpolate between the luminance and the original colour
+            float s = value;
+            AddColorMatrix({0.299f * (1 - s) + s, 0.587f * (1 - s), 0.114f * (1 - s),
+                            0.299f * (1 - s), 0.587f * (1 - s) + s, 0.114f * (1 - s),
+                            0.299f * (1 - s), 0.587f * (1 - s), 0.114f * (1 - s) + s});
+        } else{
+            std::cerr << "Unrecognised fused operation: " << stage << std::endl;
+            return false;
+        }
+    }
+
+    return !m_operations.empty();
+}
+
+std::string KernelFusion::GenerateSource() const
+{
+    return generateSource(m_operations);
+}
+
+bool KernelFusion::Build()
+{
+    if(m_built){
+        return true;
+    }
+
+    if(m_operations.empty()){
+        std::cerr << "No operations to fuse" << std::endl;
+        return false;
+    }
+
+    release();
+    m_kernel = buildKernel(m_operations, m_program);
+    m_built = m_kernel != 0;
+    return m_built;
+}
+
+cl_int KernelFusion::Enqueue(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    if(!Build()){
+        return CL_BUILD_PROGRAM_FAILURE;
+    }
+
+    return enqueueKernel(queue, m_kernel, src_image, dst_image, width, height, num_events, wait_list, event);
+}
+
+cl_int KernelFusion::EnqueueUnfused(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int width, int height)
+{
+    cl_int err_num;
+
+    if(!Build()){
+        return CL_BUILD_PROGRAM_FAILURE;
+    }
+
+    // Build one kernel per operation
+    if(m_pass_kernels.empty()){
+        for(auto& operation : m_operations){
+            cl_program program = 0;
+            cl_kernel kernel = buildKernel({operation}, program);
+            if(kernel == 0){
+                return CL_BUILD_PROGRAM_FAILURE;
+            }
+            m_pass_programs.push_back(program);
+            m_pass_kernels.push_back(kernel);
+        }
+    }
+
+    // Ping-pong between two intermediate images
+    if(m_pass_kernels.size() > 1 && (m_intermediate_width != width || m_intermediate_height != height)){
+        cl_image_format clImageFormat;
+        clImageFormat.image_channel_order = CL_RGBA;
+        clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+        for(auto& intermediate : m_intermediates){
+            if(intermediate != 0)
+                clReleaseMemObject(intermediate);
+            intermediate = clCreateImage2D(m_context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, &err_num);
+            if(err_num != CL_SUCCESS){
+                std::cerr << "Error creating unfused intermediate image" << std::endl;
+                return err_num;
+            }
+        }
+        m_intermediate_width = width;
+        m_intermediate_height = height;
+    }
+
+    cl_mem input = src_image;
+    for(size_t i = 0; i < m_pass_kernels.size(); i++){
+        cl_mem output = (i + 1 == m_pass_kernels.size()) ? dst_image : m_intermediates[i % 2];
+        err_num = enqueueKernel(queue, m_pass_kernels[i], input, output, width, height, 0, NULL, NULL);
+        if(err_num != CL_SUCCESS){
+            return err_num;
+        }
+        input = output;
+    }
+
+    return CL_SUCCESS;
+}
+
+int KernelFusion::GetPassCount() const
+{
+    return (int)m_operations.size();
+}
+
+std::string KernelFusion::Describe() const
+{
+    std::ostringstream description;
+
+    for(size_t i = 0; i < m_operations.size(); i++){
+        auto& operation = m_operations[i];
+        description << (i > 0 ? " -> " : "");
+
+        switch(operation.type){
+        case FusedOperation::GAIN:
+            description << "gain(" << operation.parameters[0] << ")";
+            break;
+        case FusedOperation::GAMMA:
+            description << "gamma(" << operation.parameters[0] << ")";
+            break;
+        case FusedOperation::COLOR_MATRIX:
+            description << "colour matrix";
+            break;
+        case FusedOperation::THRESHOLD:
+            description << "threshold(" << operation.parameters[0] << ")";
+            break;
+        case FusedOperation::GAUSSIAN:
+            description << "gaussian(r=" << (int)operation.parameters[0] << ", sigma=" << operation.parameters[1] << ")";
+            break;
+        }
+    }
+
+    return description.str();
+}
+
+std::string KernelFusion::generateSource(const std::vector<Operation> &operations)
+{
+    std::ostringstream source;
+    std::ostringstream pre_operations, post_operations;
+    const Operation* stencil = NULL;
+
+    // Point-wise operations before the stencil are applied to every tap it reads
+    for(auto& operation : operations){
+        if(operation.type == FusedOperation::GAUSSIAN){
+            stencil = &operation;
+        } else{
+            (stencil == NULL ? pre_operations : post_operations) << generateOperation(operation);
+        }
+    }
+
+    source << "/* Generated by KernelFusion. FreeImage pixels are BGRA, so a CL_RGBA image\n"
+           << "   holds (b, g, r, a) and the colour channels are .xyz */\n\n";
+
+    if(stencil != NULL){
+        int radius = (int)stencil->parameters[0];
+        auto weights = GaussianFilter::ComputeWeights(radius, stencil->parameters[1]);
+
+        source << "#define RADIUS " << radius << "\n"
+               << "__constant float WEIGHTS[" << weights.size() << "] = {";
+        for(size_t i = 0; i < weights.size(); i++){
+            source << (i > 0 ? ", " : "") << literal(weights[i]);
+        }
+        source << "};\n\n";
+    }
+
+    source << "float4 pre_operations(float4 p)\n{\n" << pre_operations.str() << "    return p;\n}\n\n"
+           << "float4 post_operations(float4 p)\n{\n" << post_operations.str() << "    return p;\n}\n\n";
+
+    source << "__kernel void fused_filter(__read_only image2d_t src_image,\n"
+           << "                           __write_only image2d_t dst_image,\n"
+           << "                           sampler_t sampler,\n"
+           << "                           int width, int height)\n"
+           << "{\n"
+           << "    int2 coord = (int2)(get_global_id(0), get_global_id(1));\n\n"
+           << "    if(coord.x < width && coord.y < height){\n";
+
+    if(stencil != NULL){
+        source << "        float4 p = (float4)(0.0f);\n"
+               << "        for(int y = -RADIUS; y <= RADIUS; y++){\n"
+               << "            for(int x = -RADIUS; x <= RADIUS; x++){\n"
+               << "                float4 tap = pre_operations(read_imagef(src_image, sampler, coord + (int2)(x, y)));\n"
+               << "                p += WEIGHTS[y + RADIUS] * WEIGHTS[x + RADIUS] * tap;\n"
+               << "            }\n"
+               << "        }\n";
+    } else{
+        source << "        float4 p = pre_operations(read_imagef(src_image, sampler, coord));\n";
+    }
+
+    source << "        write_imagef(dst_image, coord, post_operations(p));\n"
+           << "    }\n"
+           << "}\n";
+
+    return source.str();
+}
+
+std::string KernelFusion::generateOperation(const Operation &operation)
+{
+    std::ostringstream code;
+    auto& p = operation.parameters;
+
+    switch(operation.type){
+    case FusedOperation::GAIN:
+        code << "    p.xyz *= " << literal(p[0]) << ";\n";
+        break;
+    case FusedOperation::GAMMA:
+        code << "    p.xyz = powr(p.xyz, " << literal(1.0f / p[0]) << ");\n";
+        break;
+    case FusedOperation::COLOR_MATRIX:
+        // Rows are given for (r, g, b), the pixel holds (b, g, r)
+        code << "    {\n"
+             << "        float3 rgb = p.zyx;\n"
+             << "        p.z = dot((float3)(" << literal(p[0]) << ", " << literal(p[1]) << ", " << literal(p[2]) << "), rgb);\n"
+             << "        p.y = dot((float3)(" << literal(p[3]) << ", " << literal(p[4]) << ", " << literal(p[5]) << "), rgb);\n"
+             << "        p.x = dot((float3)(" << literal(p[6]) << ", " << literal(p[7]) << ", " << literal(p[8]) << "), rgb);\n"
+             << "    }\n";
+        break;
+    case FusedOperation::THRESHOLD:
+        code << "    p.xyz = (float3)(dot(p.xyz, (float3)(0.114f, 0.587f, 0.299f)) >= " << literal(p[0]) << " ? 1.0f : 0.0f);\n";
+        break;
+    case FusedOperation::GAUSSIAN:
+        break;
+    }
+
+    // Saturate like the 8-bit image between unfused passes would
+    code << "    p = clamp(p, 0.0f, 1.0f);\n";
+    return code.str();
+}
+
+std::string KernelFusion::literal(float value)
+{
+    std::ostringstream text;
+    text << std::scientific << std::setprecision(8) << value << "f";
+    return text.str();
+}
+
+cl_kernel KernelFusion::buildKernel(const std::vector<Operation> &operations, cl_program &program)
+{
+    // Identical sequences share the program cached by the controller
+    program = m_controller.CreateProgramWithSource(m_context, m_device, generateSource(operations));
+    if(program == NULL){
+        return 0;
+    }
+
+    return m_controller.CreateKernel(program, "fused_filter");
+}
+
+cl_int KernelFusion::enqueueKernel(cl_command_queue queue, cl_kernel kernel, cl_mem src_image, cl_mem dst_image, int width, int height, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    cl_int err_num = 0;
+
+    // Set the kernel arguments
+    err_num |= clSetKernelArg(kernel, 0, sizeof(cl_mem), &src_image);
+    err_num |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &dst_image);
+    err_num |= clSetKernelArg(kernel, 2, sizeof(cl_sampler), &m_sampler);
+    err_num |= clSetKernelArg(kernel, 3, sizeof(cl_int), &width);
+    err_num |= clSetKernelArg(kernel, 4, sizeof(cl_int), &height);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error setting fused kernel arguments" << std::endl;
+        return err_num;
+    }
+
+    // Initialise the work-size
+    size_t local_work_size[2] = {16, 16};
+    size_t global_work_size[2] = {Controller::RoundUp(local_work_size[0], width), Controller::RoundUp(local_work_size[1], height)};
+
+    return clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, num_events, wait_list, event);
+}
+
+void KernelFusion::release()
+{
+    if(m_kernel != 0)
+        clReleaseKernel(m_kernel);
+    if(m_program != 0)
+        clReleaseProgram(m_program);
+    m_kernel = 0;
+    m_program = 0;
+
+    for(auto kernel : m_pass_kernels)
+        clReleaseKernel(kernel);
+    for(auto program : m_pass_programs)
+        clReleaseProgram(program);
+    m_pass_kernels.clear();
+    m_pass_programs.clear();
+
+    for(auto& intermediate : m_intermediates){
+        if(intermediate != 0)
+            clReleaseMemObject(intermediate);
+        intermediate = 0;
+    }
+    m_intermediate_width = m_intermediate_height = 0;
+}
@@ -0,0 +1,224 @@
+#include "MemoryPool.hpp"
+
+MemoryLease::MemoryLease() : m_pool{NULL}, m_object{0} {}
+
+MemoryLease::MemoryLease(MemoryPool* pool, cl_mem object) : m_pool{pool}, m_object{object} {}
+
+MemoryLease::MemoryLease(MemoryLease&& other) : m_pool{other.m_pool}, m_object{other.m_object}
+{
+    other.m_pool = NULL;
+    other.m_object = 0;
+}
+
+MemoryLease& MemoryLease::operator=(MemoryLease&& other)
+{
+    if(this != &other){
+        Reset();
+        m_pool = other.m_pool;
+        m_object = other.m_object;
+        other.m_pool = NULL;
+        other.m_object = 0;
+    }
+    return *this;
+}
+
+MemoryLease::~MemoryLease()
+{
+    Reset();
+}
+
+cl_mem MemoryLease::Get() const
+{
+    return m_object;
+}
+
+MemoryLease::operator bool() const
+{
+    return m_object != 0;
+}
+
+void MemoryLease::Reset()
+{
+    if(m_pool != NULL && m_object != 0){
+        m_pool->release(m_object);
+    }
+    m_pool = NULL;
+    m_object = 0;
+}
+
+MemoryPool::MemoryPool(cl_context context, size_t capacity)
+    : m_context{context}, m_capacity{capacity}, m_idle_bytes{0}, m_leased_bytes{0}, m_hits{0}, m_misses{0}
+{
+}
+
+MemoryPool::~MemoryPool()
+{
+    Trim(0);
+
+    // Leases still out are released here, their handles must not be used afterwards
+    for(auto& leased : m_leased){
+        clReleaseMemObject(leased.first);
+    }
+}
+
+MemoryLease MemoryPool::AcquireImage(cl_mem_flags flags, const cl_image_format &format, int width, int height, cl_int *err_num)
+{
+    // 4 bytes per pixel is exact for RGBA8 and close enough for the accounting of the other formats
+    size_t pixel_size = (format.image_channel_order == CL_R) ? 1 : 4;
+    if(format.image_channel_data_type == CL_FLOAT){
+        pixel_size *= 4;
+    } else if(format.image_channel_data_type == CL_HALF_FLOAT){
+        pixel_size *= 2;
+    }
+
+    return acquire(Key{format.image_channel_order, format.image_channel_data_type, (size_t)width, (size_t)height, flags}, pixel_size * width * height, err_num);
+}
+
+MemoryLease MemoryPool::AcquireBuffer(cl_mem_flags flags, size_t size, cl_int *err_num)
+{
+    return acquire(Key{0, 0, size, 0, flags}, size, err_num);
+}
+
+MemoryLease MemoryPool::acquire(const Key &key, size_t bytes, cl_int *err_num)
+{
+    cl_int err = CL_SUCCESS;
+    cl_mem object = 0;
+    auto flags = std::get<4>(key);
+
+    if(flags & (CL_MEM_USE_HOST_PTR | CL_MEM_COPY_HOST_PTR)){
+        std::cerr << "Pooled memory objects cannot wrap host memory" << std::endl;
+        err = CL_INVALID_VALUE;
+    } else{
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto idle = m_index.find(key);
+        if(idle != m_index.end()){
+            auto entry = idle->second;
+            object = entry->object;
+            m_idle_bytes -= entry->bytes;
+            m_idle.erase(entry);
+            m_index.erase(idle);
+            m_hits++;
+        } else{
+            // Make room among the idle objects before allocating
+            if(m_idle_bytes + m_leased_bytes + bytes > m_capacity){
+                trim((m_capacity > m_leased_bytes + bytes) ? m_capacity - m_leased_bytes - bytes : 0);
+            }
+
+            if(std::get<0>(key) == 0){
+                object = clCreateBuffer(m_context, flags, std::get<2>(key), NULL, &err);
+            } else{
+                cl_image_format format = {std::get<0>(key), std::get<1>(key)};
+                object = clCreateImage2D(m_context, flags, &format, std::get<2>(key), std::get<3>(key), 0, NULL, &err);
+            }
+            m_misses++;
+        }
+
+        if(err == CL_SUCCESS){
+            m_leased[object] = Entry{object, key, bytes};
+            m_leased_bytes += bytes;
+        }
+    }
+
+    if(err_num != NULL){
+        *err_num = err;
+    }
+    return (err == CL_SUCCESS) ? MemoryLease(this, object) : MemoryLease();
+}
+
+void MemoryPool::release(cl_mem object)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    auto leased = m_leased.find(object);
+    if(leased == m_leased.end()){
+        return;
+    }
+
+    auto entry = leased->second;
+    m_leased.erase(leased);
+    m_leased_bytes -= entry.bytes;
+
+    m_idle.push_front(entry);
+    m_index.insert({entry.key, m_idle.begin()});
+    m_idle_bytes += entry.bytes;
+
+    if(m_idle_bytes + m_leased_bytes > m_capacity){
+        trim((m_capacity > m_leased_bytes) ? m_capacity - m_leased_bytes : 0);
+    }
+}
+
+void MemoryPool::SetCapacity(size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_capacity = capacity;
+    trim((m_capacity > m_leased_bytes) ? m_capacity - m_leased_bytes : 0);
+}
+
+size_t MemoryPool::GetCapacity() const
+{
+    return m_capacity;
+}
+
+void MemoryPool::Trim(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    trim(bytes);
+}
+
+void MemoryPool::trim(size_t idle_bytes)
+{
+    while(m_idle_bytes > idle_bytes && !m_idle.empty()){
+        auto& entry = m_idle.back();
+
+        // Objects with the same key are filed in any order, find this one
+        auto range = m_index.equal_range(entry.key);
+        for(auto index = range.first; index != range.second; ++index){
+            if(index->second->object == entry.object){
+                m_index.erase(index);
+                break;
+            }
+        }
+
+        clReleaseMemObject(entry.object);
+        m_idle_bytes -= entry.bytes;
+        m_idle.pop_back();
+    }
+}
+
+size_t MemoryPool::GetHits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+size_t MemoryPool::GetMisses() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_misses;
+}
+
+size_t MemoryPool::GetIdleBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_idle_bytes;
+}
+
+size_t MemoryPool::GetLeasedBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_leased_bytes;
+}
+
+void MemoryPool::DisplayStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t requests = m_hits + m_misses;
+    std::cout << "Memory pool: " << m_hits << " hits, " << m_misses << " misses";
+    if(requests > 0){
+        std::cout << " (" << std::fixed << std::setprecision(1) << 100.0 * m_hits / requests << "% reused)";
+    }
+    std::cout << ", " << m_idle_bytes / 1024 << " KiB idle, " << m_leased_bytes / 1024 << " KiB leased of " << m_capacity / 1024 << " KiB" << std::endl;
+}
@@ -0,0 +1,247 @@
+#include "MultiDeviceProcessor.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    const int CALIBRATION_ROWS = 256;
+    const int CALIBRATION_ITERATIONS = 3;
+}
+
+MultiDeviceProcessor::MultiDeviceProcessor(Controller& controller, cl_context context, const std::vector<cl_device_id>& devices, const GaussianFilter& filter)
+    : m_context{context}, m_pool{controller.GetMemoryPool(context)}, m_halo{filter.GetRadius()}, m_total_ms{0.0}
+{
+    // The recursive filter reaches about four sigma, further than its radius
+    if(filter.GetAlgorithm() == FilterAlgorithm::RECURSIVE){
+        m_halo = std::max(m_halo, (int)std::ceil(4.0f * filter.GetSigma()));
+    }
+
+    m_bands.reserve(devices.size());
+    for(auto device : devices){
+        cl_bool image_support = CL_FALSE;
+        clGetDeviceInfo(device, CL_DEVICE_IMAGE_SUPPORT, sizeof(cl_bool), &image_support, NULL);
+
+        char name[256] = {0};
+        clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(name) - 1, name, NULL);
+        if(image_support != CL_TRUE){
+            std::cerr << "Skipping " << name << ", it does not support images" << std::endl;
+            continue;
+        }
+
+        // Programs are only built for the device they were created for
+        auto program = controller.CreateProgram(context, device, "gaussian_filter.cl");
+        if(program == NULL){
+            std::cerr << "Skipping " << name << ", the filter does not build for it" << std::endl;
+            continue;
+        }
+
+        m_bands.emplace_back();
+        Band& band = m_bands.back();
+        band.device = device;
+        band.name = std::string(name) + " #" + std::to_string(m_bands.size() - 1);
+        band.queue = controller.CreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+        band.program = program;
+        band.rows_per_ms = 1.0;
+        band.y0 = band.rows = band.src_y0 = band.src_rows = 0;
+        band.upload = band.readback = 0;
+        band.time_ms = 0.0;
+
+        band.filter.reset(new GaussianFilter(controller, context, device, program));
+        band.filter->SetParameters(filter.GetRadius(), filter.GetSigma());
+        band.filter->SetAlgorithm(filter.GetAlgorithm());
+
+        // Fall back to float on devices without the selected variant, e.g. no cl_khr_fp16
+        if(!band.filter->SupportsPrecision(filter.GetPrecision()) || !band.filter->SetPrecision(filter.GetPrecision())){
+            band.filter->SetPrecision(FilterPrecision::FLOAT);
+        }
+    }
+}
+
+MultiDeviceProcessor::~MultiDeviceProcessor()
+{
+    for(auto& band : m_bands){
+        clFinish(band.queue);
+        releaseEvents(band);
+
+        band.src.Reset();
+        band.dst.Reset();
+        band.filter.reset();
+        clReleaseProgram(band.program);
+        clReleaseCommandQueue(band.queue);
+    }
+}
+
+int MultiDeviceProcessor::GetDeviceCount() const
+{
+    return (int)m_bands.size();
+}
+
+bool MultiDeviceProcessor::Calibrate(int width, int height)
+{
+    if(m_bands.empty()){
+        std::cerr << "No device of the context can run the filter" << std::endl;
+        return false;
+    }
+
+    // One device at a time, so that devices sharing memory bandwidth are measured on their own
+    int rows = std::min(height, CALIBRATION_ROWS);
+    for(auto& band : m_bands){
+        double time_ms = 0.0, psnr = 0.0;
+        if(!band.filter->CompareVariant(band.queue, band.filter->GetPrecision(), width, rows, CALIBRATION_ITERATIONS, time_ms, psnr)){
+            std::cerr << "Error calibrating " << band.name << std::endl;
+            return false;
+        }
+        band.rows_per_ms = rows / std::max(time_ms, 1e-3);
+    }
+
+    partition(height);
+    return true;
+}
+
+bool MultiDeviceProcessor::Process(const std::vector<char> &input, std::vector<char> &output, int width, int height)
+{
+    cl_int err_num = CL_SUCCESS;
+
+    if(m_bands.empty()){
+        std::cerr << "No device of the context can run the filter" << std::endl;
+        return false;
+    }
+    if(m_bands.back().y0 + m_bands.back().rows != height){
+        partition(height);
+    }
+
+    output.resize((size_t)width * height * 4);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    // Every queue is flushed right after its band is enqueued so that the devices start as early as possible
+    for(auto& band : m_bands){
+        if(band.rows > 0 && err_num == CL_SUCCESS){
+            err_num = enqueueBand(band, input, output, width);
+            clFlush(band.queue);
+        }
+    }
+
+    for(auto& band : m_bands){
+        clFinish(band.queue);
+    }
+    m_total_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error processing the image bands (" << err_num << ")" << std::endl;
+        return false;
+    }
+
+    // Device time of each band from its upload to its readback
+    for(auto& band : m_bands){
+        if(band.upload != 0 && band.readback != 0){
+            cl_ulong begin = Controller::GetProfilingTime(band.upload, CL_PROFILING_COMMAND_START);
+            cl_ulong end = Controller::GetProfilingTime(band.readback, CL_PROFILING_COMMAND_END);
+            band.time_ms = (end - begin) / 1e6;
+        }
+        releaseEvents(band);
+    }
+
+    DisplayStatistics();
+    return true;
+}
+
+void MultiDeviceProcessor::DisplayStatistics() const
+{
+    std::cout << "Filtered " << m_bands.size() << " bands (halo " << m_halo << ") in " << std::fixed << std::setprecision(2) << m_total_ms << " ms" << std::endl;
+    for(auto& band : m_bands){
+        std::cout << "  " << std::left << std::setw(40) << band.name << std::right << std::setw(6) << band.rows << " rows "
+                  << std::setw(10) << std::setprecision(1) << band.rows_per_ms << " rows/ms calibrated "
+                  << std::setw(10) << std::setprecision(2) << band.time_ms << " ms" << std::endl;
+    }
+}
+
+void MultiDeviceProcessor::partition(int height)
+{
+    double total = 0.0;
+    for(auto& band : m_bands){
+        total += band.rows_per_ms;
+    }
+
+    // Band boundaries follow the running share of the throughput, a much slower device may get no rows
+    double share = 0.0;
+    int y = 0;
+    for(size_t i = 0; i < m_bands.size(); i++){
+        Band& band = m_bands[i];
+        share += band.rows_per_ms;
+
+        int end = (i + 1 == m_bands.size()) ? height : std::min(height, (int)std::lround(height * share / total));
+        band.y0 = y;
+        band.rows = end - y;
+        band.src_y0 = std::max(y - m_halo, 0);
+        band.src_rows = std::min(end + m_halo, height) - band.src_y0;
+        y = end;
+    }
+}
+
+cl_int MultiDeviceProcessor::enqueueBand(Band &band, const std::vector<char> &input, std::vector<char> &output, int width)
+{
+    cl_int err_num;
+    size_t pitch = (size_t)width * 4;
+    bool buffers = band.filter->UsesBuffers();
+
+    // Bands of the same size come back from the pool when the image is processed again
+    if(buffers){
+        band.src = m_pool.AcquireBuffer(CL_MEM_READ_ONLY, pitch * band.src_rows, &err_num);
+        if(err_num == CL_SUCCESS)
+            band.dst = m_pool.AcquireBuffer(CL_MEM_WRITE_ONLY, pitch * band.src_rows, &err_num);
+    } else{
+        cl_image_format clImageFormat;
+        clImageFormat.image_channel_order = CL_RGBA;
+        clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+        band.src = m_pool.AcquireImage(CL_MEM_READ_ONLY, clImageFormat, width, band.src_rows, &err_num);
+        if(err_num == CL_SUCCESS)
+            band.dst = m_pool.AcquireImage(CL_MEM_WRITE_ONLY, clImageFormat, width, band.src_rows, &err_num);
+    }
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error creating the band objects for " << band.name << std::endl;
+        return err_num;
+    }
+
+    // Upload the band with its halo, rows past the image edges are clamped by the filter as for the whole image
+    const char* src_rows = input.data() + (size_t)band.src_y0 * pitch;
+    if(buffers){
+        err_num = clEnqueueWriteBuffer(band.queue, band.src.Get(), CL_FALSE, 0, pitch * band.src_rows, src_rows, 0, NULL, &band.upload);
+    } else{
+        size_t origin[3] = {0, 0, 0};
+        size_t region[3] = {(size_t)width, (size_t)band.src_rows, 1};
+        err_num = clEnqueueWriteImage(band.queue, band.src.Get(), CL_FALSE, origin, region, pitch, 0, src_rows, 0, NULL, &band.upload);
+    }
+
+    if(err_num == CL_SUCCESS){
+        err_num = band.filter->Enqueue(band.queue, band.src.Get(), band.dst.Get(), width, band.src_rows);
+    }
+
+    // Read only the rows the band owns straight into their place in the output
+    if(err_num == CL_SUCCESS){
+        size_t halo_rows = (size_t)(band.y0 - band.src_y0);
+        char* dst_rows = output.data() + (size_t)band.y0 * pitch;
+        if(buffers){
+            err_num = clEnqueueReadBuffer(band.queue, band.dst.Get(), CL_FALSE, halo_rows * pitch, pitch * band.rows, dst_rows, 0, NULL, &band.readback);
+        } else{
+            size_t origin[3] = {0, halo_rows, 0};
+            size_t region[3] = {(size_t)width, (size_t)band.rows, 1};
+            err_num = clEnqueueReadImage(band.queue, band.dst.Get(), CL_FALSE, origin, region, pitch, 0, dst_rows, 0, NULL, &band.readback);
+        }
+    }
+
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error enqueueing the band of " << band.name << " (" << err_num << ")" << std::endl;
+    }
+    return err_num;
+}
+
+void MultiDeviceProcessor::releaseEvents(Band &band)
+{
+    if(band.upload != 0)
+        clReleaseEvent(band.upload);
+    if(band.readback != 0)
+        clReleaseEvent(band.readback);
+    band.upload = band.readback = 0;
+}
@@ -0,0 +1,257 @@
+#include "Options.hpp"
+
+#include <cstdio>
+
+Options::Options()
+    : input{"blurry_photo.jpeg"}, output{"edited.jpeg"}, algorithm{FilterAlgorithm::GAUSSIAN_3X3}, precision{FilterPrecision::AUTO}, radius{1}, sigma{0.0f},
+      benchmark{false}, benchmark_iterations{10}, output_dir{"edited"}, batch_depth{2}, queue_mode{QueueMode::AUTO}, tile_size{0}, multi_device{false}, ingest{IngestMode::HOST_PTR}, readback{ReadbackStrategy::AUTO}, box{false}, pyramid{false}, equalize{false}, planes{PlaneMode::RGBA},
+      resize_method{ResizeMethod::AUTO},
+      host{false}, verify{false}, threads{0}, stream{false}, stream_format{StreamFormat::RAW_RGBA}, stream_width{0}, stream_height{0},
+      update_baseline{false}, pool_mb{256}, stop{false} {}
+
+bool Options::Parse(int argc, char **argv)
+{
+    bool algorithm_given = false;
+    int positional = 0;
+
+    for(int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+
+        // Options that take a value
+        if((arg == "--algorithm" || arg == "--precision" || arg == "--radius" || arg == "--sigma" || arg == "--iterations" ||
+            arg == "--batch" || arg == "--output-dir" || arg == "--depth" || arg == "--queue-mode" || arg == "--tile-size" || arg == "--ingest" || arg == "--readback" || arg == "--graph" || arg == "--fuse" || arg == "--planes" || arg == "--thumbnails" || arg == "--resize" || arg == "--stream" || arg == "--size" || arg == "--threads" || arg == "--regression" || arg == "--serve" || arg == "--client" || arg == "--pool-mb") && i + 1 >= argc){
+            std::cerr << "Missing value for " << arg << std::endl;
+            return false;
+        }
+
+        if(arg == "--help" || arg == "-h"){
+            return false;
+        } else if(arg == "--algorithm"){
+            if(!GaussianFilter::ParseAlgorithm(argv[++i], algorithm)){
+                std::cerr << "Unrecognised algorithm: " << argv[i] << std::endl;
+                return false;
+            }
+            algorithm_given = true;
+        } else if(arg == "--precision"){
+            if(!GaussianFilter::ParsePrecision(argv[++i], precision)){
+                std::cerr << "Unrecognised precision: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if(arg == "--radius"){
+            radius = std::atoi(argv[++i]);
+        } else if(arg == "--sigma"){
+            sigma = std::atof(argv[++i]);
+        } else if(arg == "--benchmark"){
+            benchmark = true;
+        } else if(arg == "--iterations"){
+            benchmark_iterations = std::atoi(argv[++i]);
+        } else if(arg == "--batch"){
+            batch_dir = argv[++i];
+        } else if(arg == "--output-dir"){
+            output_dir = argv[++i];
+        } else if(arg == "--depth"){
+            batch_depth = std::atoi(argv[++i]);
+        } else if(arg == "--queue-mode"){
+            if(!CommandScheduler::ParseMode(argv[++i], queue_mode)){
+                std::cerr << "Unrecognised queue mode: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if(arg == "--tile-size"){
+            tile_size = std::atoi(argv[++i]);
+        } else if(arg == "--multi-device"){
+            multi_device = true;
+        } else if(arg == "--ingest"){
+            if(!ImageIO::ParseIngestMode(argv[++i], ingest)){
+                std::cerr << "Unrecognised ingest mode: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if(arg == "--readback"){
+            if(!Readback::ParseStrategy(argv[++i], readback)){
+                std::cerr << "Unrecognised readback strategy: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if(arg == "--graph"){
+            graph = argv[++i];
+        } else if(arg == "--fuse"){
+            fuse = argv[++i];
+        } else if(arg == "--box"){
+            box = true;
+        } else if(arg == "--pyramid"){
+            pyramid = true;
+        } else if(arg == "--equalize"){
+            equalize = true;
+        } else if(arg == "--thumbnails"){
+            thumbnails = argv[++i];
+        } else if(arg == "--resize"){
+            if(!Resizer::ParseMethod(argv[++i], resize_method)){
+                std::cerr << "Unrecognised resize method: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if(arg == "--planes"){
+            if(!PlanarConverter::ParseMode(argv[++i], planes)){
+                std::cerr << "Unrecognised plane mode: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if(arg == "--host"){
+            host = true;
+        } else if(arg == "--verify"){
+            verify = true;
+        } else if(arg == "--threads"){
+            threads = std::atoi(argv[++i]);
+        } else if(arg == "--stream"){
+            if(!StreamProcessor::ParseFormat(argv[++i], stream_format)){
+                std::cerr << "Unrecognised stream format: " << argv[i] << std::endl;
+                return false;
+            }
+            stream = true;
+        } else if(arg == "--size"){
+            if(std::sscanf(argv[++i], "%dx%d", &stream_width, &stream_height) != 2){
+                std::cerr << "Frame size must be given as WxH: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if(arg == "--regression"){
+            regression_dir = argv[++i];
+        } else if(arg == "--update-baseline"){
+            update_baseline = true;
+        } else if(arg == "--pool-mb"){
+            pool_mb = std::atoi(argv[++i]);
+        } else if(arg == "--serve"){
+            serve_socket = argv[++i];
+        } else if(arg == "--client"){
+            client_socket = argv[++i];
+        } else if(arg == "--stop"){
+            stop = true;
+        } else if(arg.rfind("--", 0) == 0){
+            std::cerr << "Unrecognised option: " << arg << std::endl;
+            return false;
+        } else if(positional == 0){
+            input = arg;
+            positional++;
+        } else if(positional == 1){
+            output = arg;
+            positional++;
+        } else{
+            std::cerr << "Unexpected argument: " << arg << std::endl;
+            return false;
+        }
+    }
+
+    // A wider blur cannot be done by the original 3x3 kernel
+    if(!algorithm_given && (radius != 1 || sigma > 0.0f)){
+        algorithm = FilterAlgorithm::SEPARABLE;
+    }
+
+    // Streams default to stdin and stdout
+    if(stream && positional < 2){
+        output = "-";
+        if(positional == 0)
+            input = "-";
+    }
+
+    if(!serve_socket.empty() && !client_socket.empty()){
+        std::cerr << "Use only one of --serve and --client" << std::endl;
+        return false;
+    }
+
+    if(stop && client_socket.empty()){
+        std::cerr << "--stop requires --client" << std::endl;
+        return false;
+    }
+
+    if(update_baseline && regression_dir.empty()){
+        std::cerr << "--update-baseline requires --regression" << std::endl;
+        return false;
+    }
+
+    if((int)!graph.empty() + (int)!fuse.empty() + (int)box > 1){
+        std::cerr << "Use only one of --graph, --fuse and --box" << std::endl;
+        return false;
+    }
+
+    if(planes != PlaneMode::RGBA && (!graph.empty() || !fuse.empty() || box)){
+        std::cerr << "--planes only applies to the Gaussian filter" << std::endl;
+        return false;
+    }
+
+    if(multi_device && (!batch_dir.empty() || stream || !regression_dir.empty() || !serve_socket.empty() || host || tile_size > 0 ||
+                        !graph.empty() || !fuse.empty() || box || pyramid || equalize || planes != PlaneMode::RGBA || !thumbnails.empty())){
+        std::cerr << "--multi-device only filters single images with the Gaussian filter" << std::endl;
+        return false;
+    }
+
+    if(queue_mode != QueueMode::AUTO && batch_dir.empty()){
+        std::cerr << "--queue-mode only applies to --batch" << std::endl;
+        return false;
+    }
+
+    std::vector<std::pair<int, int>> sizes;
+    if(!thumbnails.empty() && !Resizer::ParseSizes(thumbnails, sizes)){
+        return false;
+    }
+
+    if(tile_size < 0 || pool_mb < 0){
+        std::cerr << "Tile size and pool size must not be negative" << std::endl;
+        return false;
+    }
+
+    if(radius < 1 || benchmark_iterations < 1 || batch_depth < 1){
+        std::cerr << "Radius, iterations and depth must be at least 1" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void Options::PrintUsage(const char *program)
+{
+    std::cout << "Usage: " << program << " [options] [input] [output]\n"
+              << "\t--algorithm <3x3|2d|separable|tiled|recursive>\n"
+              << "\t\t\t\t\tGaussian filter algorithm (default: 3x3)\n"
+              << "\t--precision <float|half|integer|auto>\tArithmetic of the 3x3, separable and recursive filters (default: auto)\n"
+              << "\t--radius <r>\t\t\tFilter radius for 2d, separable and tiled (default: 1)\n"
+              << "\t--sigma <s>\t\t\tGaussian sigma (default: derived from radius)\n"
+              << "\t--benchmark\t\t\tCompare the kernels and readback strategies\n"
+              << "\t--iterations <n>\t\tIterations per benchmark measurement (default: 10)\n"
+              << "\t--ingest <copy|host-ptr|mapped>\tHow the decoded image reaches the device (default: host-ptr)\n"
+              << "\t--readback <read|map|host-ptr|auto>\tHow the output reaches the host (default: auto)\n"
+              << "\t--graph <stages>\t\tRun a chain of blur, sharpen, edge, grayscale and unsharp[:amount]\n"
+              << "\t\t\t\t\ton the device, e.g. blur,unsharp:1.5,grayscale\n"
+              << "\t--fuse <operations>\t\tApply gain:k, gamma:g, sepia, saturation:s, threshold:t and blur\n"
+              << "\t\t\t\t\tin one generated kernel, e.g. gain:1.2,blur,gamma:2.2\n"
+              << "\t--box\t\t\t\tApproximate the Gaussian with box passes over a summed-area table,\n"
+              << "\t\t\t\t\tthe cost does not grow with the radius\n"
+              << "\t--pyramid\t\t\tBuild the blurred 2x pyramid of the input down to 1x1 on the device\n"
+              << "\t\t\t\t\tand save each level next to the output as <output>_level<n>\n"
+              << "\t--equalize\t\t\tEqualize the colour channel histograms of the input before filtering\n"
+              << "\t--thumbnails <sizes>\t\tSave resized copies of the input, e.g. 1024,320x240,64 (a single\n"
+              << "\t\t\t\t\tnumber is the longest side), as <output>_<W>x<H>\n"
+              << "\t--resize <linear|area|auto>\tThumbnail filter, auto averages areas beyond 2x reduction (default: auto)\n"
+              << "\t--planes <rgba|gray|luma>\tFilter a single CL_R plane: gray saves an 8-bit gray image, luma\n"
+              << "\t\t\t\t\tblurs Y and keeps Cb/Cr (default: rgba)\n"
+              << "\t--stream <raw|y4m>\t\tFilter a stream of frames, input and output default to stdin/stdout\n"
+              << "\t--size <WxH>\t\t\tFrame size of raw RGBA streams\n"
+              << "\t--host\t\t\t\tFilter on the host instead of an OpenCL device\n"
+              << "\t\t\t\t\t(automatic without an image-capable device)\n"
+              << "\t--verify\t\t\tCompare the device result with the host filter\n"
+              << "\t--threads <n>\t\t\tHost filter threads (default: one per hardware thread)\n"
+              << "\t--regression <dir>\t\tCheck every algorithm against golden images and timing baselines\n"
+              << "\t--update-baseline\t\tRegenerate the golden images and the timing baseline\n"
+              << "\t--pool-mb <n>\t\t\tMemory kept in reusable device images for batch and daemon jobs (default: 256)\n"
+              << "\t--serve <socket>\t\tKeep the device initialised and filter the jobs sent to a Unix socket\n"
+              << "\t--client <socket>\t\tSend the other options as a job to a running daemon\n"
+              << "\t--stop\t\t\t\tWith --client, stop the daemon\n"
+              << "\t--batch <dir>\t\t\tFilter every image in a directory\n"
+              << "\t--output-dir <dir>\t\tOutput directory for batch mode (default: edited)\n"
+              << "\t--depth <n>\t\t\tImages or tiles in flight (default: 2)\n"
+              << "\t--queue-mode <auto|out-of-order|in-order|serial>\n"
+              << "\t\t\t\t\tQueues of batch mode: one out-of-order queue, one in-order queue per\n"
+              << "\t\t\t\t\tstage or a single queue (default: auto, out-of-order where supported)\n"
+              << "\t--tile-size <n>\t\t\tProcess the image in tiles of at most n x n pixels\n"
+              << "\t\t\t\t\t(automatic when the image exceeds the device limits)\n"
+              << "\t--multi-device\t\t\tSplit the image into bands filtered concurrently by every device of the\n"
+              << "\t\t\t\t\tplatform, NUMA nodes become sub-devices, bands follow measured throughput\n"
+              << "\t--help\t\t\t\tShow this message\n"
+              << "Built kernels are cached in FILTER_PROGRAM_CACHE (default: $XDG_CACHE_HOME/2DImageFilter or\n"
+              << "~/.cache/2DImageFilter, created owner-only; caches writable by other users are skipped),\n"
+              << "an empty FILTER_PROGRAM_CACHE disables the cache" << std::endl;
+}
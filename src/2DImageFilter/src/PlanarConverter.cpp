@@ -0,0 +1,202 @@
+#include "PlanarConverter.hpp"
+
+PlanarConverter::PlanarConverter(Controller& controller, cl_context context, cl_program program)
+    : m_context{context}, m_mode{PlaneMode::RGBA}, m_width{0}, m_height{0}, m_filtered{0}
+{
+    cl_int err_num;
+
+    m_kernel_gray = controller.CreateKernel(program, "rgba_to_gray");
+    m_kernel_planes = controller.CreateKernel(program, "rgba_to_planes");
+    m_kernel_merge = controller.CreateKernel(program, "planes_to_rgba");
+    m_kernel_gray_merge = controller.CreateKernel(program, "gray_to_rgba");
+
+    m_sampler = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &err_num);
+    controller.CheckError(err_num, "clCreateSampler");
+}
+
+PlanarConverter::~PlanarConverter()
+{
+    releasePlanes();
+
+    clReleaseSampler(m_sampler);
+    clReleaseKernel(m_kernel_gray);
+    clReleaseKernel(m_kernel_planes);
+    clReleaseKernel(m_kernel_merge);
+    clReleaseKernel(m_kernel_gray_merge);
+}
+
+bool PlanarConverter::ParseMode(const std::string &name, PlaneMode &mode)
+{
+    if(name == "rgba"){
+        mode = PlaneMode::RGBA;
+    } else if(name == "gray"){
+        mode = PlaneMode::GRAY;
+    } else if(name == "luma"){
+        mode = PlaneMode::LUMA;
+    } else{
+        return false;
+    }
+    return true;
+}
+
+std::string PlanarConverter::ModeName(PlaneMode mode)
+{
+    switch(mode){
+    case PlaneMode::RGBA:
+        return "rgba";
+    case PlaneMode::GRAY:
+        return "gray";
+    case PlaneMode::LUMA:
+        return "luma";
+    }
+    return "unknown";
+}
+
+cl_mem PlanarConverter::CreatePlane(cl_context context, int width, int height, cl_int *err_num)
+{
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = CL_R;
+    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+    return clCreateImage2D(context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, err_num);
+}
+
+bool PlanarConverter::SetMode(PlaneMode mode, int width, int height)
+{
+    if(mode == m_mode && width == m_width && height == m_height){
+        return true;
+    }
+
+    releasePlanes();
+    m_mode = mode;
+    m_width = width;
+    m_height = height;
+    if(mode == PlaneMode::RGBA){
+        return true;
+    }
+
+    // One input plane for gray, three for Y'CbCr, plus the plane the filter writes
+    size_t count = (mode == PlaneMode::GRAY) ? 2 : 4;
+    for(size_t i = 0; i < count; i++){
+        cl_int err_num;
+        cl_mem plane = CreatePlane(m_context, width, height, &err_num);
+        if(err_num != CL_SUCCESS){
+            std::cerr << "Error creating a " << width << "x" << height << " plane (" << err_num << ")" << std::endl;
+            releasePlanes();
+            m_mode = PlaneMode::RGBA;
+            return false;
+        }
+        m_planes.push_back(plane);
+    }
+
+    m_filtered = m_planes.back();
+    m_planes.pop_back();
+    return true;
+}
+
+PlaneMode PlanarConverter::GetMode() const
+{
+    return m_mode;
+}
+
+cl_int PlanarConverter::Split(cl_command_queue queue, cl_mem src_image, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    if(m_planes.empty()){
+        return CL_INVALID_MEM_OBJECT;
+    }
+
+    std::vector<cl_mem> images{src_image};
+    images.insert(images.end(), m_planes.begin(), m_planes.end());
+    return enqueueKernel(queue, (m_mode == PlaneMode::GRAY) ? m_kernel_gray : m_kernel_planes, images, num_events, wait_list, event);
+}
+
+cl_int PlanarConverter::Merge(cl_command_queue queue, cl_mem plane, cl_mem dst_image, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    if(m_planes.empty()){
+        return CL_INVALID_MEM_OBJECT;
+    }
+
+    if(m_mode == PlaneMode::GRAY){
+        return enqueueKernel(queue, m_kernel_gray_merge, {plane, dst_image}, num_events, wait_list, event);
+    }
+    return enqueueKernel(queue, m_kernel_merge, {plane, m_planes[1], m_planes[2], dst_image}, num_events, wait_list, event);
+}
+
+cl_int PlanarConverter::Enqueue(cl_command_queue queue, GaussianFilter &filter, cl_mem src_image, cl_mem dst_image, int width, int height)
+{
+    if(filter.UsesBuffers()){
+        std::cerr << "Planar modes need an image-based filter algorithm" << std::endl;
+        return CL_INVALID_OPERATION;
+    }
+    if((width != m_width || height != m_height) && !SetMode(m_mode, width, height)){
+        return CL_MEM_OBJECT_ALLOCATION_FAILURE;
+    }
+
+    // The filter reads and writes CL_R images like RGBA ones, with a quarter of the traffic
+    cl_int err_num = Split(queue, src_image);
+    if(err_num == CL_SUCCESS){
+        err_num = filter.Enqueue(queue, m_planes[0], m_filtered, width, height);
+    }
+    if(err_num == CL_SUCCESS && dst_image != 0){
+        err_num = Merge(queue, m_filtered, dst_image);
+    }
+    return err_num;
+}
+
+cl_mem PlanarConverter::GetPlane() const
+{
+    return m_planes.empty() ? 0 : m_planes[0];
+}
+
+cl_mem PlanarConverter::GetFilteredPlane() const
+{
+    return m_filtered;
+}
+
+bool PlanarConverter::ReadPlane(cl_command_queue queue, cl_mem plane, std::vector<char> &pixels) const
+{
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {(size_t)m_width, (size_t)m_height, 1};
+    pixels.resize((size_t)m_width * m_height);
+
+    cl_int err_num = clEnqueueReadImage(queue, plane, CL_TRUE, origin, region, 0, 0, pixels.data(), 0, NULL, NULL);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error reading the plane (" << err_num << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+cl_int PlanarConverter::enqueueKernel(cl_command_queue queue, cl_kernel kernel, const std::vector<cl_mem>& images, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    // Every conversion kernel takes its images, the sampler and the size
+    cl_int err_num = CL_SUCCESS;
+    cl_uint index = 0;
+    for(auto& image : images){
+        err_num |= clSetKernelArg(kernel, index++, sizeof(cl_mem), &image);
+    }
+    err_num |= clSetKernelArg(kernel, index++, sizeof(cl_sampler), &m_sampler);
+    err_num |= clSetKernelArg(kernel, index++, sizeof(cl_int), &m_width);
+    err_num |= clSetKernelArg(kernel, index++, sizeof(cl_int), &m_height);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error setting kernel arguments." << std::endl;
+        return err_num;
+    }
+
+    size_t local_work_size[2] = {16, 16};
+    size_t global_work_size[2] = {Controller::RoundUp(16, m_width), Controller::RoundUp(16, m_height)};
+    return clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, num_events, wait_list, event);
+}
+
+void PlanarConverter::releasePlanes()
+{
+    for(auto plane : m_planes){
+        clReleaseMemObject(plane);
+    }
+    m_planes.clear();
+
+    if(m_filtered != 0){
+        clReleaseMemObject(m_filtered);
+        m_filtered = 0;
+    }
+}
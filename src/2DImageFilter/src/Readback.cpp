@@ -0,0 +1,231 @@
+#include "Readback.hpp"
+
+namespace
+{
+    const int PROBE_ITERATIONS = 3;
+}
+
+std::map<std::tuple<cl_device_id, int, int, bool>, ReadbackStrategy> Readback::s_probed;
+
+Readback::Readback(cl_context context, cl_command_queue queue, ReadbackStrategy strategy, bool as_buffer)
+    : m_context{context}, m_queue{queue}, m_strategy{strategy}, m_as_buffer{as_buffer} {}
+
+ReadbackStrategy Readback::Select(int width, int height)
+{
+    if(m_strategy != ReadbackStrategy::AUTO){
+        return m_strategy;
+    }
+
+    cl_device_id device;
+    clGetCommandQueueInfo(m_queue, CL_QUEUE_DEVICE, sizeof(cl_device_id), &device, NULL);
+
+    // Reuse an earlier probe of the same device and size
+    auto key = std::make_tuple(device, width, height, m_as_buffer);
+    auto probed = s_probed.find(key);
+    if(probed != s_probed.end()){
+        m_strategy = probed->second;
+        return m_strategy;
+    }
+
+    // Pick the strategy with the highest bandwidth
+    double best = -1.0;
+    ReadbackStrategy selected = ReadbackStrategy::READ;
+    for(auto strategy : {ReadbackStrategy::READ, ReadbackStrategy::MAP, ReadbackStrategy::HOST_PTR}){
+        double bandwidth = MeasureBandwidth(strategy, width, height, PROBE_ITERATIONS);
+        if(bandwidth > best){
+            best = bandwidth;
+            selected = strategy;
+        }
+    }
+
+    std::cout << "Readback probe selected " << StrategyName(selected) << " for " << width << "x" << height << std::endl;
+    s_probed[key] = selected;
+    m_strategy = selected;
+    return m_strategy;
+}
+
+cl_mem Readback::CreateOutput(int width, int height, cl_int *err_num)
+{
+    size_t pitch = (size_t)width * 4;
+    cl_mem output = 0;
+
+    // Create an OpenCL image
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = CL_RGBA;
+    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+    switch (Select(width, height))
+    {
+    case ReadbackStrategy::HOST_PTR:
+        {
+            // The host memory is released together with the memory object
+            void* pixels = ImageIO::AllocateAligned(pitch * height);
+            if(pixels == NULL){
+                *err_num = CL_OUT_OF_HOST_MEMORY;
+                return 0;
+            }
+
+            if(m_as_buffer){
+                output = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, pitch * height, pixels, err_num);
+            } else{
+                output = clCreateImage2D(m_context, CL_MEM_WRITE_ONLY | CL_MEM_USE_HOST_PTR, &clImageFormat, width, height, pitch, pixels, err_num);
+            }
+
+            if(*err_num == CL_SUCCESS){
+                *err_num = clSetMemObjectDestructorCallback(output, releaseHostMemory, pixels);
+            }
+
+            // Without the callback the object must go before the memory it uses
+            if(*err_num != CL_SUCCESS){
+                if(output != 0)
+                    clReleaseMemObject(output);
+                output = 0;
+                ImageIO::FreeAligned(pixels);
+            }
+        }
+        break;
+
+    case ReadbackStrategy::MAP:
+        if(m_as_buffer){
+            output = clCreateBuffer(m_context, CL_MEM_READ_WRITE, pitch * height, NULL, err_num);
+        } else{
+            output = clCreateImage2D(m_context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, err_num);
+        }
+        break;
+
+    default:
+        if(m_as_buffer){
+            output = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, pitch * height, NULL, err_num);
+        } else{
+            output = clCreateImage2D(m_context, CL_MEM_WRITE_ONLY, &clImageFormat, width, height, 0, NULL, err_num);
+        }
+        break;
+    }
+
+    return (*err_num == CL_SUCCESS) ? output : 0;
+}
+
+char *Readback::Acquire(cl_mem output, int width, int height, size_t &row_pitch, cl_int *err_num)
+{
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {(size_t)width, (size_t)height, 1};
+    size_t size = (size_t)width * height * 4;
+    row_pitch = (size_t)width * 4;
+
+    // Read into host memory owned by this object
+    if(Select(width, height) == ReadbackStrategy::READ){
+        m_host.resize(size);
+        if(m_as_buffer){
+            *err_num = clEnqueueReadBuffer(m_queue, output, CL_TRUE, 0, size, m_host.data(), 0, NULL, NULL);
+        } else{
+            *err_num = clEnqueueReadImage(m_queue, output, CL_TRUE, origin, region, 0, 0, m_host.data(), 0, NULL, NULL);
+        }
+        return (*err_num == CL_SUCCESS) ? m_host.data() : NULL;
+    }
+
+    // Map the output; the runtime decides the row pitch of a mapped image
+    if(m_as_buffer){
+        return (char*)clEnqueueMapBuffer(m_queue, output, CL_TRUE, CL_MAP_READ, 0, size, 0, NULL, NULL, err_num);
+    }
+    return (char*)clEnqueueMapImage(m_queue, output, CL_TRUE, CL_MAP_READ, origin, region, &row_pitch, NULL, 0, NULL, NULL, err_num);
+}
+
+cl_int Readback::Release(cl_mem output, char *pixels)
+{
+    if(m_strategy == ReadbackStrategy::READ){
+        return CL_SUCCESS;
+    }
+
+    return clEnqueueUnmapMemObject(m_queue, output, pixels, 0, NULL, NULL);
+}
+
+double Readback::MeasureBandwidth(ReadbackStrategy strategy, int width, int height, int iterations)
+{
+    cl_int err_num;
+    size_t row_pitch;
+    size_t size = (size_t)width * height * 4;
+
+    // Measure with a temporary readback so that this object keeps its strategy
+    Readback readback(m_context, m_queue, strategy, m_as_buffer);
+    cl_mem output = readback.CreateOutput(width, height, &err_num);
+    if(output == 0){
+        return -1.0;
+    }
+
+    // Touch the object on the device so that lazy allocation is not measured
+    cl_uint pattern = 0;
+    if(m_as_buffer){
+        err_num = clEnqueueFillBuffer(m_queue, output, &pattern, sizeof(pattern), 0, size, 0, NULL, NULL);
+    } else{
+        float colour[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+        size_t origin[3] = {0, 0, 0};
+        size_t region[3] = {(size_t)width, (size_t)height, 1};
+        err_num = clEnqueueFillImage(m_queue, output, colour, origin, region, 0, NULL, NULL);
+    }
+    clFinish(m_queue);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for(int i = 0; i < iterations && err_num == CL_SUCCESS; i++){
+        char* pixels = readback.Acquire(output, width, height, row_pitch, &err_num);
+        if(err_num == CL_SUCCESS){
+            err_num = readback.Release(output, pixels);
+        }
+        clFinish(m_queue);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    clReleaseMemObject(output);
+    if(err_num != CL_SUCCESS){
+        return -1.0;
+    }
+
+    double seconds = std::chrono::duration<double>(end - start).count() / iterations;
+    return size / (seconds * 1e9);
+}
+
+ReadbackStrategy Readback::GetStrategy() const
+{
+    return m_strategy;
+}
+
+bool Readback::ParseStrategy(const std::string &name, ReadbackStrategy &strategy)
+{
+    if(name == "read"){
+        strategy = ReadbackStrategy::READ;
+    } else if(name == "map"){
+        strategy = ReadbackStrategy::MAP;
+    } else if(name == "host-ptr"){
+        strategy = ReadbackStrategy::HOST_PTR;
+    } else if(name == "auto"){
+        strategy = ReadbackStrategy::AUTO;
+    } else{
+        return false;
+    }
+
+    return true;
+}
+
+std::string Readback::StrategyName(ReadbackStrategy strategy)
+{
+    switch (strategy)
+    {
+    case ReadbackStrategy::READ:
+        return "read";
+
+    case ReadbackStrategy::MAP:
+        return "map";
+
+    case ReadbackStrategy::HOST_PTR:
+        return "host-ptr";
+
+    case ReadbackStrategy::AUTO:
+        return "auto";
+    }
+
+    return "unknown";
+}
+
+void CL_CALLBACK Readback::releaseHostMemory(cl_mem memobj, void *user_data)
+{
+    ImageIO::FreeAligned(user_data);
+}
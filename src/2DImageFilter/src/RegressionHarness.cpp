@@ -0,0 +1,376 @@
+#include "RegressionHarness.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <regex>
+#include <sstream>
+
+namespace
+{
+    // Golden comparison thresholds: reduced precision variants may be 1 LSB off on rounding ties
+    const double MIN_PSNR = 45.0;
+    const int MAX_ERROR = 2;
+
+    // A stage regresses when it is slower than the baseline by both margins
+    const double REGRESSION_TOLERANCE = 0.25;
+    const double REGRESSION_NOISE_MS = 0.05;
+
+    // Every case runs this often, the fastest run of each stage is kept
+    const int REPEATS = 3;
+
+    const char* STAGES[] = {"decode", "upload", "kernel", "readback", "encode"};
+
+    const char* PATTERNS[] = {"gradient", "checker", "noise", "zoneplate"};
+    const int SIZES[][2] = {{256, 256}, {641, 479}, {1920, 1080}};
+}
+
+RegressionHarness::RegressionHarness(Controller& controller, cl_context context, cl_device_id device, GaussianFilter& filter, HostFilter& host)
+    : m_context{context}, m_device{device}, m_filter{filter}, m_host{host}
+{
+    // Profiling gives the device time of the upload, kernel and readback stages
+    m_queue = controller.CreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE);
+    if(m_queue == NULL){
+        controller.CheckError(CL_OUT_OF_RESOURCES, "clCreateCommandQueue");
+    }
+}
+
+RegressionHarness::~RegressionHarness()
+{
+    clReleaseCommandQueue(m_queue);
+}
+
+bool RegressionHarness::Run(const std::string &directory, bool update)
+{
+    namespace fs = std::filesystem;
+    std::error_code error;
+
+    for(auto subdirectory : {"corpus", "golden", "output"}){
+        fs::create_directories(fs::path(directory) / subdirectory, error);
+        if(error){
+            std::cerr << "Failed to create " << (fs::path(directory) / subdirectory).string() << std::endl;
+            return false;
+        }
+    }
+
+    std::vector<Case> cases;
+    if(!createCorpus(directory, cases)){
+        return false;
+    }
+
+    // Keep the filter configuration of the caller
+    auto algorithm = m_filter.GetAlgorithm();
+    auto radius = m_filter.GetRadius();
+    auto sigma = m_filter.GetSigma();
+
+    std::cout << "\nREGRESSION (" << cases.size() << " cases, " << GaussianFilter::PrecisionName(m_filter.GetPrecision()) << " precision):" << std::endl;
+    std::cout << "\tcase\t\t\t\t\tdecode\tupload\tkernel\treadback\tencode (ms)\tPSNR (dB)\tmax error" << std::endl;
+
+    std::map<std::string, Result> results;
+    bool passed = true;
+    for(auto& testcase : cases){
+        Result result;
+        if(!runCase(testcase, directory, update, result)){
+            passed = false;
+            continue;
+        }
+
+        std::cout << std::fixed << std::setprecision(3) << "\t" << std::left << std::setw(40) << testcase.name << std::right;
+        for(auto stage : STAGES){
+            std::cout << result.stages[stage] << "\t";
+        }
+        std::cout << "\t" << (std::isinf(result.psnr) ? std::string("exact") : std::to_string(result.psnr)) << "\t" << result.max_error
+                  << (result.passed ? "" : "\tFAILED") << std::endl;
+
+        passed = passed && result.passed;
+        results[testcase.name] = result;
+    }
+
+    m_filter.SetParameters(radius, sigma);
+    m_filter.SetAlgorithm(algorithm);
+
+    // Record the timings and compare them with the baseline
+    std::string timings_file = (fs::path(directory) / "timings.json").string();
+    std::string baseline_file = (fs::path(directory) / "baseline.json").string();
+    if(!writeTimings(timings_file, results)){
+        return false;
+    }
+    std::cout << "Timings written to " << timings_file << std::endl;
+
+    Timings baseline;
+    if(update){
+        writeTimings(baseline_file, results);
+        std::cout << "Baseline written to " << baseline_file << std::endl;
+    } else if(readTimings(baseline_file, baseline)){
+        int regressions = 0;
+        for(auto& result : results){
+            auto expected = baseline.find(result.first);
+            if(expected == baseline.end())
+                continue;
+
+            for(auto& stage : result.second.stages){
+                auto reference = expected->second.find(stage.first);
+                if(reference != expected->second.end() && stage.second > reference->second * (1.0 + REGRESSION_TOLERANCE) &&
+                   stage.second - reference->second > REGRESSION_NOISE_MS){
+                    std::cout << "\tREGRESSION " << result.first << " " << stage.first << ": " << reference->second << " -> " << stage.second << " ms" << std::endl;
+                    regressions++;
+                }
+            }
+        }
+        std::cout << regressions << " timing regressions against " << baseline_file << std::endl;
+        passed = passed && regressions == 0;
+    } else{
+        std::cout << "No baseline at " << baseline_file << ", run with --update-baseline to create one" << std::endl;
+    }
+
+    std::cout << (passed ? "Regression passed" : "Regression FAILED") << std::endl;
+    return passed;
+}
+
+bool RegressionHarness::createCorpus(const std::string &directory, std::vector<Case> &cases)
+{
+    namespace fs = std::filesystem;
+
+    // Filter configurations covering every kernel
+    const struct { FilterAlgorithm algorithm; int radius; } configurations[] = {
+        {FilterAlgorithm::GAUSSIAN_3X3, 1},
+        {FilterAlgorithm::GAUSSIAN_2D, 3},
+        {FilterAlgorithm::SEPARABLE, 5},
+        {FilterAlgorithm::TILED, 3}
+    };
+
+    for(auto pattern : PATTERNS){
+        for(auto& size : SIZES){
+            int width = size[0], height = size[1];
+            std::string name = std::string(pattern) + "_" + std::to_string(width) + "x" + std::to_string(height);
+            std::string corpus = (fs::path(directory) / "corpus" / (name + ".png")).string();
+
+            // The corpus is synthetic and lossless so that it can be regenerated anywhere
+            if(!fs::exists(corpus)){
+                std::vector<unsigned char> pixels((size_t)width * height * 4);
+                unsigned int state = 12345;
+
+                for(int y = 0; y < height; y++){
+                    for(int x = 0; x < width; x++){
+                        unsigned char* pixel = &pixels[((size_t)y * width + x) * 4];
+                        if(std::string(pattern) == "gradient"){
+                            pixel[0] = (unsigned char)(255 * x / (width - 1));
+                            pixel[1] = (unsigned char)(255 * y / (height - 1));
+                            pixel[2] = (unsigned char)(255 - 255 * x / (width - 1));
+                        } else if(std::string(pattern) == "checker"){
+                            pixel[0] = pixel[1] = pixel[2] = (((x / 8) + (y / 8)) % 2) ? 255 : 0;
+                        } else if(std::string(pattern) == "noise"){
+                            for(int c = 0; c < 3; c++){
+                                state = state * 1664525u + 1013904223u;
+                                pixel[c] = (unsigned char)(state >> 24);
+                            }
+                        } else{
+                            // Zone plate: the frequency rises towards the edges
+                            double dx = x - width / 2.0, dy = y - height / 2.0;
+                            pixel[0] = pixel[1] = pixel[2] = (unsigned char)std::lround(127.5 + 127.5 * std::cos((dx * dx + dy * dy) * 3.14159265 / width));
+                        }
+                        pixel[3] = 255;
+                    }
+                }
+
+                if(!ImageIO::Encode(corpus, (const char*)pixels.data(), width, height, width * 4)){
+                    std::cerr << "Failed to create corpus image " << corpus << std::endl;
+                    return false;
+                }
+            }
+
+            for(auto& configuration : configurations){
+                std::string case_name = name + "_" + GaussianFilter::AlgorithmName(configuration.algorithm) + "_r" + std::to_string(configuration.radius);
+                cases.push_back({case_name, corpus, configuration.algorithm, configuration.radius});
+            }
+        }
+    }
+
+    return true;
+}
+
+bool RegressionHarness::runCase(const Case &testcase, const std::string &directory, bool update, Result &result)
+{
+    namespace fs = std::filesystem;
+    std::string output_file = (fs::path(directory) / "output" / (testcase.name + ".png")).string();
+    std::string golden_file = (fs::path(directory) / "golden" / (testcase.name + ".png")).string();
+
+    m_filter.SetAlgorithm(testcase.algorithm);
+    if(!m_filter.SetParameters(testcase.radius, 0.0f)){
+        return false;
+    }
+
+    std::vector<char> input, output;
+    int width = 0, height = 0;
+
+    for(auto stage : STAGES){
+        result.stages[stage] = INFINITY;
+    }
+
+    for(int repeat = 0; repeat < REPEATS; repeat++){
+        std::map<std::string, double> stages;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        if(!ImageIO::Decode(testcase.corpus, input, width, height)){
+            return false;
+        }
+        stages["decode"] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        if(!runStages(input, output, width, height, stages)){
+            std::cerr << "Failed to run " << testcase.name << std::endl;
+            return false;
+        }
+
+        start = std::chrono::high_resolution_clock::now();
+        if(!ImageIO::Encode(output_file, output.data(), width, height, width * 4)){
+            return false;
+        }
+        stages["encode"] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+        for(auto& stage : stages){
+            result.stages[stage.first] = std::min(result.stages[stage.first], stage.second);
+        }
+    }
+
+    // Golden images come from the host filter, so they do not depend on the device that created them
+    std::vector<char> golden;
+    int golden_width = 0, golden_height = 0;
+    if(update || !fs::exists(golden_file)){
+        golden.resize(input.size());
+        m_host.Apply(input.data(), golden.data(), width, height, testcase.algorithm, testcase.radius, 0.0f);
+        if(!ImageIO::Encode(golden_file, golden.data(), width, height, width * 4)){
+            return false;
+        }
+    }
+    if(!ImageIO::Decode(golden_file, golden, golden_width, golden_height) || golden_width != width || golden_height != height){
+        std::cerr << "Golden image " << golden_file << " does not match " << testcase.name << std::endl;
+        return false;
+    }
+
+    result.psnr = ImageIO::PSNR((const unsigned char*)golden.data(), (const unsigned char*)output.data(), golden.size());
+    result.max_error = 0;
+    for(size_t i = 0; i < golden.size(); i++){
+        result.max_error = std::max(result.max_error, std::abs((int)(unsigned char)golden[i] - (int)(unsigned char)output[i]));
+    }
+    result.passed = result.psnr >= MIN_PSNR && result.max_error <= MAX_ERROR;
+    return true;
+}
+
+bool RegressionHarness::runStages(const std::vector<char> &input, std::vector<char> &output, int width, int height, std::map<std::string, double> &stages)
+{
+    cl_int err_num, err_num_dst;
+    cl_mem src, dst;
+    cl_event upload = 0, kernel_start = 0, kernel = 0, readback = 0;
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {(size_t)width, (size_t)height, 1};
+    output.resize(input.size());
+
+    if(m_filter.UsesBuffers()){
+        src = clCreateBuffer(m_context, CL_MEM_READ_ONLY, input.size(), NULL, &err_num);
+        dst = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, input.size(), NULL, &err_num_dst);
+    } else{
+        cl_image_format clImageFormat;
+        clImageFormat.image_channel_order = CL_RGBA;
+        clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+        src = clCreateImage2D(m_context, CL_MEM_READ_ONLY, &clImageFormat, width, height, 0, NULL, &err_num);
+        dst = clCreateImage2D(m_context, CL_MEM_WRITE_ONLY, &clImageFormat, width, height, 0, NULL, &err_num_dst);
+    }
+    if(err_num != CL_SUCCESS || err_num_dst != CL_SUCCESS){
+        std::cerr << "Error creating regression memory objects" << std::endl;
+        if(err_num == CL_SUCCESS)
+            clReleaseMemObject(src);
+        if(err_num_dst == CL_SUCCESS)
+            clReleaseMemObject(dst);
+        return false;
+    }
+
+    // Upload, filter and read back, the marker records when the kernels may start
+    if(m_filter.UsesBuffers()){
+        err_num = clEnqueueWriteBuffer(m_queue, src, CL_FALSE, 0, input.size(), input.data(), 0, NULL, &upload);
+    } else{
+        err_num = clEnqueueWriteImage(m_queue, src, CL_FALSE, origin, region, 0, 0, input.data(), 0, NULL, &upload);
+    }
+    if(err_num == CL_SUCCESS){
+        err_num = clEnqueueMarkerWithWaitList(m_queue, 0, NULL, &kernel_start);
+    }
+    if(err_num == CL_SUCCESS){
+        err_num = m_filter.Enqueue(m_queue, src, dst, width, height, 0, NULL, &kernel);
+    }
+    if(err_num == CL_SUCCESS){
+        if(m_filter.UsesBuffers()){
+            err_num = clEnqueueReadBuffer(m_queue, dst, CL_TRUE, 0, output.size(), output.data(), 0, NULL, &readback);
+        } else{
+            err_num = clEnqueueReadImage(m_queue, dst, CL_TRUE, origin, region, 0, 0, output.data(), 0, NULL, &readback);
+        }
+    }
+
+    if(err_num == CL_SUCCESS){
+        stages["upload"] = (Controller::GetProfilingTime(upload, CL_PROFILING_COMMAND_END) - Controller::GetProfilingTime(upload, CL_PROFILING_COMMAND_START)) * 1e-6;
+        stages["kernel"] = (Controller::GetProfilingTime(kernel, CL_PROFILING_COMMAND_END) - Controller::GetProfilingTime(kernel_start, CL_PROFILING_COMMAND_END)) * 1e-6;
+        stages["readback"] = (Controller::GetProfilingTime(readback, CL_PROFILING_COMMAND_END) - Controller::GetProfilingTime(readback, CL_PROFILING_COMMAND_START)) * 1e-6;
+    }
+
+    clFinish(m_queue);
+    for(auto event : {upload, kernel_start, kernel, readback}){
+        if(event != 0)
+            clReleaseEvent(event);
+    }
+    clReleaseMemObject(src);
+    clReleaseMemObject(dst);
+    return err_num == CL_SUCCESS;
+}
+
+bool RegressionHarness::writeTimings(const std::string &filename, const std::map<std::string, Result> &results)
+{
+    std::ofstream file(filename);
+    if(!file.is_open()){
+        std::cerr << "Failed to open file for writing: " << filename << std::endl;
+        return false;
+    }
+
+    char device_name[256] = {};
+    clGetDeviceInfo(m_device, CL_DEVICE_NAME, sizeof(device_name) - 1, device_name, NULL);
+
+    // One object per case with the best time of every stage in milliseconds
+    file << "{\n  \"device\": \"" << device_name << "\",\n  \"cases\": [\n";
+    size_t index = 0;
+    for(auto& result : results){
+        file << "    {\"name\": \"" << result.first << "\"";
+        for(auto& stage : result.second.stages){
+            file << ", \"" << stage.first << "_ms\": " << std::fixed << std::setprecision(4) << stage.second;
+        }
+        file << ", \"psnr\": " << (std::isinf(result.second.psnr) ? 999.0 : result.second.psnr)
+             << ", \"max_error\": " << result.second.max_error << "}" << (++index < results.size() ? "," : "") << "\n";
+    }
+    file << "  ]\n}\n";
+
+    return file.good();
+}
+
+bool RegressionHarness::readTimings(const std::string &filename, Timings &timings)
+{
+    std::ifstream file(filename);
+    if(!file.is_open()){
+        return false;
+    }
+
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    std::string json = contents.str();
+
+    // Only reads the flat case objects written by writeTimings
+    std::regex object_pattern("\\{\"name\": \"([^\"]+)\"([^{}]*)\\}");
+    std::regex stage_pattern("\"(\\w+)_ms\": ([-0-9.eE+]+)");
+
+    for(auto object = std::sregex_iterator(json.begin(), json.end(), object_pattern); object != std::sregex_iterator(); ++object){
+        std::string fields = (*object)[2].str();
+        auto& stages = timings[(*object)[1].str()];
+
+        for(auto stage = std::sregex_iterator(fields.begin(), fields.end(), stage_pattern); stage != std::sregex_iterator(); ++stage){
+            stages[(*stage)[1].str()] = std::atof((*stage)[2].str().c_str());
+        }
+    }
+
+    return !timings.empty();
+}
@@ -0,0 +1,226 @@
+#include "Resizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace
+{
+    // Bilinear taps stop covering every source pixel past a 2x reduction
+    const float AREA_THRESHOLD = 2.0f;
+}
+
+Resizer::Resizer(Controller& controller, cl_context context, cl_program program)
+    : m_context{context}, m_method{ResizeMethod::AUTO}
+{
+    cl_int err_num;
+
+    m_kernel_linear = controller.CreateKernel(program, "resize_linear");
+    m_kernel_area = controller.CreateKernel(program, "resize_area");
+
+    // Normalized coordinates make the same sampler work for every output size
+    m_sampler_linear = clCreateSampler(context, CL_TRUE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_LINEAR, &err_num);
+    controller.CheckError(err_num, "clCreateSampler");
+    m_sampler_nearest = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &err_num);
+    controller.CheckError(err_num, "clCreateSampler");
+}
+
+Resizer::~Resizer()
+{
+    releaseOutputs();
+
+    clReleaseSampler(m_sampler_linear);
+    clReleaseSampler(m_sampler_nearest);
+    clReleaseKernel(m_kernel_linear);
+    clReleaseKernel(m_kernel_area);
+}
+
+bool Resizer::ParseMethod(const std::string &name, ResizeMethod &method)
+{
+    if(name == "linear"){
+        method = ResizeMethod::LINEAR;
+    } else if(name == "area"){
+        method = ResizeMethod::AREA;
+    } else if(name == "auto"){
+        method = ResizeMethod::AUTO;
+    } else{
+        return false;
+    }
+    return true;
+}
+
+std::string Resizer::MethodName(ResizeMethod method)
+{
+    switch(method){
+    case ResizeMethod::LINEAR:
+        return "linear";
+    case ResizeMethod::AREA:
+        return "area";
+    case ResizeMethod::AUTO:
+        return "auto";
+    }
+    return "unknown";
+}
+
+bool Resizer::ParseSizes(const std::string &list, std::vector<std::pair<int, int>> &sizes)
+{
+    sizes.clear();
+
+    std::stringstream stream(list);
+    std::string item;
+    while(std::getline(stream, item, ',')){
+        int width = 0, height = 0;
+        char separator = 0, trailing = 0;
+        std::stringstream size(item);
+
+        // A single number is the longest side, its height is filled in by FitSize
+        if(item.find('x') != std::string::npos){
+            if(!(size >> width >> separator >> height) || separator != 'x' || (size >> trailing)){
+                width = 0;
+            }
+        } else if(!(size >> width) || (size >> trailing)){
+            width = 0;
+        }
+
+        if(width <= 0 || height < 0){
+            std::cerr << "Invalid size: " << item << std::endl;
+            return false;
+        }
+        sizes.push_back({width, height});
+    }
+
+    return !sizes.empty();
+}
+
+std::pair<int, int> Resizer::FitSize(const std::pair<int, int> &size, int width, int height)
+{
+    if(size.second > 0){
+        return size;
+    }
+
+    // Scale the longest side to the requested length
+    double scale = (double)size.first / std::max(width, height);
+    return {std::max(1, (int)std::lround(width * scale)), std::max(1, (int)std::lround(height * scale))};
+}
+
+ResizeMethod Resizer::SelectMethod(int src_width, int src_height, int dst_width, int dst_height)
+{
+    float reduction = std::max((float)src_width / dst_width, (float)src_height / dst_height);
+    return (reduction > AREA_THRESHOLD) ? ResizeMethod::AREA : ResizeMethod::LINEAR;
+}
+
+void Resizer::SetMethod(ResizeMethod method)
+{
+    m_method = method;
+}
+
+ResizeMethod Resizer::GetMethod() const
+{
+    return m_method;
+}
+
+cl_int Resizer::Enqueue(cl_command_queue queue, cl_mem src_image, cl_mem dst_image, int src_width, int src_height, int dst_width, int dst_height, cl_uint num_events, const cl_event *wait_list, cl_event *event)
+{
+    cl_int err_num;
+    auto method = (m_method == ResizeMethod::AUTO) ? SelectMethod(src_width, src_height, dst_width, dst_height) : m_method;
+
+    cl_kernel kernel = m_kernel_linear;
+    if(method == ResizeMethod::LINEAR){
+        err_num = clSetKernelArg(kernel, 0, sizeof(cl_mem), &src_image);
+        err_num |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &dst_image);
+        err_num |= clSetKernelArg(kernel, 2, sizeof(cl_sampler), &m_sampler_linear);
+        err_num |= clSetKernelArg(kernel, 3, sizeof(cl_int), &dst_width);
+        err_num |= clSetKernelArg(kernel, 4, sizeof(cl_int), &dst_height);
+    } else{
+        kernel = m_kernel_area;
+        err_num = clSetKernelArg(kernel, 0, sizeof(cl_mem), &src_image);
+        err_num |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &dst_image);
+        err_num |= clSetKernelArg(kernel, 2, sizeof(cl_sampler), &m_sampler_nearest);
+        err_num |= clSetKernelArg(kernel, 3, sizeof(cl_int), &src_width);
+        err_num |= clSetKernelArg(kernel, 4, sizeof(cl_int), &src_height);
+        err_num |= clSetKernelArg(kernel, 5, sizeof(cl_int), &dst_width);
+        err_num |= clSetKernelArg(kernel, 6, sizeof(cl_int), &dst_height);
+    }
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error setting kernel arguments." << std::endl;
+        return err_num;
+    }
+
+    size_t local_work_size[2] = {16, 16};
+    size_t global_work_size[2] = {Controller::RoundUp(16, dst_width), Controller::RoundUp(16, dst_height)};
+    return clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, local_work_size, num_events, wait_list, event);
+}
+
+bool Resizer::Resize(cl_command_queue queue, cl_mem src_image, int width, int height, const std::vector<std::pair<int, int>> &sizes)
+{
+    releaseOutputs();
+
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = CL_RGBA;
+    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+    // The source is uploaded once and every size reads it, nothing waits between the launches
+    for(auto& requested : sizes){
+        auto size = FitSize(requested, width, height);
+
+        cl_int err_num;
+        cl_mem image = clCreateImage2D(m_context, CL_MEM_READ_WRITE, &clImageFormat, size.first, size.second, 0, NULL, &err_num);
+        if(err_num != CL_SUCCESS){
+            std::cerr << "Error creating a " << size.first << "x" << size.second << " output image" << std::endl;
+            return false;
+        }
+        m_outputs.push_back({image, size.first, size.second});
+
+        err_num = Enqueue(queue, src_image, image, width, height, size.first, size.second);
+        if(err_num != CL_SUCCESS){
+            std::cerr << "Error resizing to " << size.first << "x" << size.second << " (" << err_num << ")" << std::endl;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int Resizer::GetOutputCount() const
+{
+    return (int)m_outputs.size();
+}
+
+void Resizer::GetOutputSize(int index, int &width, int &height) const
+{
+    width = height = 0;
+    if(index >= 0 && index < (int)m_outputs.size()){
+        width = m_outputs[index].width;
+        height = m_outputs[index].height;
+    }
+}
+
+bool Resizer::ReadOutputs(cl_command_queue queue, std::vector<std::vector<char>> &outputs) const
+{
+    cl_int err_num = CL_SUCCESS;
+    outputs.resize(m_outputs.size());
+
+    for(size_t i = 0; i < m_outputs.size() && err_num == CL_SUCCESS; i++){
+        size_t origin[3] = {0, 0, 0};
+        size_t region[3] = {(size_t)m_outputs[i].width, (size_t)m_outputs[i].height, 1};
+        outputs[i].resize((size_t)m_outputs[i].width * m_outputs[i].height * 4);
+
+        err_num = clEnqueueReadImage(queue, m_outputs[i].image, CL_FALSE, origin, region, 0, 0, outputs[i].data(), 0, NULL, NULL);
+    }
+
+    // Wait for the reads even after an error, they write into the vectors
+    cl_int finish = clFinish(queue);
+    if(err_num != CL_SUCCESS || finish != CL_SUCCESS){
+        std::cerr << "Error reading the resized images" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void Resizer::releaseOutputs()
+{
+    for(auto& output : m_outputs){
+        clReleaseMemObject(output.image);
+    }
+    m_outputs.clear();
+}
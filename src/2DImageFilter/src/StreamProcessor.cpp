@@ -0,0 +1,380 @@
+#include "StreamProcessor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+StreamProcessor::StreamProcessor(Controller& controller, cl_context context, cl_device_id device, cl_command_queue queue, GaussianFilter& filter)
+    : m_context{context}, m_queue{queue}, m_filter{filter}, m_src{0}, m_dst{0}, m_frame_in{0}, m_frame_out{0},
+      m_format{StreamFormat::RAW_RGBA}, m_chroma_shift{0}
+{
+    cl_int err_num;
+
+    // Y4M frames are converted to and from RGBA on the device
+    m_program = controller.CreateProgram(context, device, "color_convert.cl");
+    if(m_program == NULL){
+        controller.CheckError(CL_BUILD_PROGRAM_FAILURE, "CreateProgram");
+    }
+    m_kernel_to_rgba = controller.CreateKernel(m_program, "yuv_to_rgba");
+    m_kernel_to_yuv = controller.CreateKernel(m_program, "rgba_to_yuv");
+
+    // Create sampler object
+    m_sampler = clCreateSampler(context, CL_FALSE, CL_ADDRESS_CLAMP_TO_EDGE, CL_FILTER_NEAREST, &err_num);
+    controller.CheckError(err_num, "clCreateSampler");
+}
+
+StreamProcessor::~StreamProcessor()
+{
+    for(auto object : {m_src, m_dst, m_frame_in, m_frame_out}){
+        if(object != 0)
+            clReleaseMemObject(object);
+    }
+
+    clReleaseSampler(m_sampler);
+    clReleaseKernel(m_kernel_to_rgba);
+    clReleaseKernel(m_kernel_to_yuv);
+    clReleaseProgram(m_program);
+}
+
+bool StreamProcessor::Run(const std::string &input, const std::string &output, StreamFormat format, int width, int height)
+{
+    m_format = format;
+    m_chroma_shift = 0;
+    m_latencies.clear();
+
+    // Frames are binary, also on the standard streams
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    FILE* input_file = (input == "-") ? stdin : std::fopen(input.c_str(), "rb");
+    FILE* output_file = (output == "-") ? stdout : std::fopen(output.c_str(), "wb");
+    if(input_file == NULL || output_file == NULL){
+        std::cerr << "Failed to open " << (input_file == NULL ? input : output) << std::endl;
+        if(input_file != NULL && input_file != stdin)
+            std::fclose(input_file);
+        if(output_file != NULL && output_file != stdout)
+            std::fclose(output_file);
+        return false;
+    }
+
+    // Y4M carries the frame size in its header, raw frames need it from the command line
+    std::string header;
+    bool result = true;
+    if(format == StreamFormat::Y4M){
+        result = readHeader(input_file, header, width, height, m_chroma_shift);
+        if(result && m_filter.UsesBuffers()){
+            std::cerr << "Y4M streaming needs an image-based filter algorithm" << std::endl;
+            result = false;
+        }
+    } else if(width <= 0 || height <= 0){
+        std::cerr << "Raw streaming needs the frame size (--size WxH)" << std::endl;
+        result = false;
+    }
+
+    size_t frame_size = (size_t)width * height * 4;
+    if(format == StreamFormat::Y4M){
+        size_t chroma_size = (size_t)((width + (1 << m_chroma_shift) - 1) >> m_chroma_shift) * ((height + (1 << m_chroma_shift) - 1) >> m_chroma_shift);
+        frame_size = (size_t)width * height + 2 * chroma_size;
+    }
+
+    if(result){
+        result = allocate(width, height, frame_size);
+    }
+    if(result && format == StreamFormat::Y4M){
+        result = std::fwrite(header.data(), 1, header.size(), output_file) == header.size();
+    }
+
+    std::cerr << "Streaming " << width << "x" << height << " " << FormatName(format) << " frames" << std::endl;
+
+    // Read the next frame while the device filters the current one
+    Slot slots[2];
+    for(auto& slot : slots){
+        slot.input.resize(frame_size);
+        slot.output.resize(frame_size);
+        slot.done = 0;
+        slot.busy = false;
+    }
+
+    int frames = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    while(result){
+        Slot& slot = slots[frames % 2];
+        Slot& previous = slots[(frames + 1) % 2];
+
+        if(!readFrame(input_file, slot.input)){
+            break;
+        }
+        slot.start = std::chrono::high_resolution_clock::now();
+
+        result = submit(slot, width, height);
+        if(result && previous.busy){
+            result = complete(previous, output_file);
+        }
+        frames++;
+    }
+
+    // Drain the last frame
+    for(auto& slot : slots){
+        if(slot.busy){
+            result = complete(slot, output_file) && result;
+        }
+    }
+    std::fflush(output_file);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    if(input_file != stdin)
+        std::fclose(input_file);
+    if(output_file != stdout)
+        std::fclose(output_file);
+
+    if(result){
+        displayStatistics(frames, std::chrono::duration<double, std::milli>(end - start).count());
+    }
+    return result;
+}
+
+bool StreamProcessor::ParseFormat(const std::string &name, StreamFormat &format)
+{
+    if(name == "raw"){
+        format = StreamFormat::RAW_RGBA;
+    } else if(name == "y4m"){
+        format = StreamFormat::Y4M;
+    } else{
+        return false;
+    }
+
+    return true;
+}
+
+std::string StreamProcessor::FormatName(StreamFormat format)
+{
+    switch (format)
+    {
+    case StreamFormat::RAW_RGBA:
+        return "raw";
+
+    case StreamFormat::Y4M:
+        return "y4m";
+    }
+
+    return "unknown";
+}
+
+bool StreamProcessor::readHeader(FILE *input, std::string &header, int &width, int &height, int &chroma_shift)
+{
+    // The header is a single line: YUV4MPEG2 W<width> H<height> [F.. I.. A.. C<colour space> X..]
+    int c;
+    while((c = std::fgetc(input)) != EOF){
+        header += (char)c;
+        if(c == '\n')
+            break;
+    }
+
+    if(header.rfind("YUV4MPEG2", 0) != 0){
+        std::cerr << "Input is not a YUV4MPEG2 stream" << std::endl;
+        return false;
+    }
+
+    std::istringstream tokens(header.substr(9));
+    std::string token;
+    std::string colour_space = "420jpeg";
+    width = height = 0;
+
+    while(tokens >> token){
+        if(token[0] == 'W'){
+            width = std::atoi(token.c_str() + 1);
+        } else if(token[0] == 'H'){
+            height = std::atoi(token.c_str() + 1);
+        } else if(token[0] == 'C'){
+            colour_space = token.substr(1);
+        }
+    }
+
+    if(colour_space.rfind("420", 0) == 0){
+        chroma_shift = 1;
+    } else if(colour_space == "444"){
+        chroma_shift = 0;
+    } else{
+        std::cerr << "Unsupported Y4M colour space " << colour_space << " (4:2:0 and 4:4:4 are supported)" << std::endl;
+        return false;
+    }
+
+    if(width <= 0 || height <= 0){
+        std::cerr << "Invalid Y4M frame size" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool StreamProcessor::readFrame(FILE *input, std::vector<char> &frame)
+{
+    // Every Y4M frame starts with a FRAME line that may carry parameters
+    if(m_format == StreamFormat::Y4M){
+        std::string line;
+        int c;
+        while((c = std::fgetc(input)) != EOF && c != '\n'){
+            line += (char)c;
+        }
+
+        if(line.empty() && c == EOF){
+            return false;
+        }
+        if(line.rfind("FRAME", 0) != 0){
+            std::cerr << "Missing FRAME marker in the Y4M stream" << std::endl;
+            return false;
+        }
+    }
+
+    size_t read = std::fread(frame.data(), 1, frame.size(), input);
+    if(read != frame.size()){
+        if(read > 0){
+            std::cerr << "Dropping incomplete frame of " << read << " bytes" << std::endl;
+        }
+        return false;
+    }
+
+    return true;
+}
+
+bool StreamProcessor::allocate(int width, int height, size_t frame_size)
+{
+    cl_int err_num = CL_SUCCESS;
+
+    if(m_format == StreamFormat::Y4M){
+        m_frame_in = clCreateBuffer(m_context, CL_MEM_READ_ONLY, frame_size, NULL, &err_num);
+        if(err_num == CL_SUCCESS)
+            m_frame_out = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, frame_size, NULL, &err_num);
+    }
+
+    if(err_num == CL_SUCCESS && m_filter.UsesBuffers()){
+        m_src = clCreateBuffer(m_context, CL_MEM_READ_WRITE, (size_t)width * height * 4, NULL, &err_num);
+        if(err_num == CL_SUCCESS)
+            m_dst = clCreateBuffer(m_context, CL_MEM_READ_WRITE, (size_t)width * height * 4, NULL, &err_num);
+    } else if(err_num == CL_SUCCESS){
+        cl_image_format clImageFormat;
+        clImageFormat.image_channel_order = CL_RGBA;
+        clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+        m_src = clCreateImage2D(m_context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, &err_num);
+        if(err_num == CL_SUCCESS)
+            m_dst = clCreateImage2D(m_context, CL_MEM_READ_WRITE, &clImageFormat, width, height, 0, NULL, &err_num);
+    }
+
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error creating stream memory objects (" << err_num << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool StreamProcessor::submit(Slot &slot, int width, int height)
+{
+    cl_int err_num;
+    size_t origin[3] = {0, 0, 0};
+    size_t region[3] = {(size_t)width, (size_t)height, 1};
+
+    // Initialise the work-size
+    size_t local_work_size[2] = {16, 16};
+    size_t global_work_size[2] = {Controller::RoundUp(local_work_size[0], width), Controller::RoundUp(local_work_size[1], height)};
+
+    if(m_format == StreamFormat::Y4M){
+        int chroma_width = (width + (1 << m_chroma_shift) - 1) >> m_chroma_shift;
+        int chroma_height = (height + (1 << m_chroma_shift) - 1) >> m_chroma_shift;
+        size_t chroma_work_size[2] = {Controller::RoundUp(local_work_size[0], chroma_width), Controller::RoundUp(local_work_size[1], chroma_height)};
+
+        // Upload the planar frame and convert it to RGBA
+        err_num = clEnqueueWriteBuffer(m_queue, m_frame_in, CL_FALSE, 0, slot.input.size(), slot.input.data(), 0, NULL, NULL);
+        err_num |= clSetKernelArg(m_kernel_to_rgba, 0, sizeof(cl_mem), &m_frame_in);
+        err_num |= clSetKernelArg(m_kernel_to_rgba, 1, sizeof(cl_mem), &m_src);
+        err_num |= clSetKernelArg(m_kernel_to_rgba, 2, sizeof(cl_int), &m_chroma_shift);
+        err_num |= clSetKernelArg(m_kernel_to_rgba, 3, sizeof(cl_int), &width);
+        err_num |= clSetKernelArg(m_kernel_to_rgba, 4, sizeof(cl_int), &height);
+        err_num |= clEnqueueNDRangeKernel(m_queue, m_kernel_to_rgba, 2, NULL, global_work_size, local_work_size, 0, NULL, NULL);
+
+        err_num |= m_filter.Enqueue(m_queue, m_src, m_dst, width, height);
+
+        // Convert the result back and read it
+        err_num |= clSetKernelArg(m_kernel_to_yuv, 0, sizeof(cl_mem), &m_dst);
+        err_num |= clSetKernelArg(m_kernel_to_yuv, 1, sizeof(cl_sampler), &m_sampler);
+        err_num |= clSetKernelArg(m_kernel_to_yuv, 2, sizeof(cl_mem), &m_frame_out);
+        err_num |= clSetKernelArg(m_kernel_to_yuv, 3, sizeof(cl_int), &m_chroma_shift);
+        err_num |= clSetKernelArg(m_kernel_to_yuv, 4, sizeof(cl_int), &width);
+        err_num |= clSetKernelArg(m_kernel_to_yuv, 5, sizeof(cl_int), &height);
+        err_num |= clEnqueueNDRangeKernel(m_queue, m_kernel_to_yuv, 2, NULL, chroma_work_size, local_work_size, 0, NULL, NULL);
+        err_num |= clEnqueueReadBuffer(m_queue, m_frame_out, CL_FALSE, 0, slot.output.size(), slot.output.data(), 0, NULL, &slot.done);
+    } else if(m_filter.UsesBuffers()){
+        err_num = clEnqueueWriteBuffer(m_queue, m_src, CL_FALSE, 0, slot.input.size(), slot.input.data(), 0, NULL, NULL);
+        err_num |= m_filter.Enqueue(m_queue, m_src, m_dst, width, height);
+        err_num |= clEnqueueReadBuffer(m_queue, m_dst, CL_FALSE, 0, slot.output.size(), slot.output.data(), 0, NULL, &slot.done);
+    } else{
+        err_num = clEnqueueWriteImage(m_queue, m_src, CL_FALSE, origin, region, 0, 0, slot.input.data(), 0, NULL, NULL);
+        err_num |= m_filter.Enqueue(m_queue, m_src, m_dst, width, height);
+        err_num |= clEnqueueReadImage(m_queue, m_dst, CL_FALSE, origin, region, 0, 0, slot.output.data(), 0, NULL, &slot.done);
+    }
+
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error enqueueing the frame" << std::endl;
+        return false;
+    }
+
+    clFlush(m_queue);
+    slot.busy = true;
+    return true;
+}
+
+bool StreamProcessor::complete(Slot &slot, FILE *output)
+{
+    cl_int err_num = clWaitForEvents(1, &slot.done);
+    clReleaseEvent(slot.done);
+    slot.done = 0;
+    slot.busy = false;
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error filtering the frame (" << err_num << ")" << std::endl;
+        return false;
+    }
+
+    if(m_format == StreamFormat::Y4M && std::fputs("FRAME\n", output) == EOF){
+        return false;
+    }
+    if(std::fwrite(slot.output.data(), 1, slot.output.size(), output) != slot.output.size()){
+        std::cerr << "Failed to write the frame" << std::endl;
+        return false;
+    }
+
+    // Latency from the frame being read to the filtered frame being written
+    auto end = std::chrono::high_resolution_clock::now();
+    m_latencies.push_back(std::chrono::duration<double, std::milli>(end - slot.start).count());
+    return true;
+}
+
+void StreamProcessor::displayStatistics(int frames, double wall_ms)
+{
+    if(frames == 0){
+        std::cerr << "No frames in the stream" << std::endl;
+        return;
+    }
+
+    auto latencies = m_latencies;
+    std::sort(latencies.begin(), latencies.end());
+
+    // Nearest-rank percentile
+    auto percentile = [&](double p){
+        size_t rank = (size_t)std::ceil(p * latencies.size());
+        return latencies[std::min(std::max(rank, (size_t)1), latencies.size()) - 1];
+    };
+
+    // Statistics go to stderr so that stdout only carries frames
+    std::cerr << std::fixed << std::setprecision(3)
+              << "\nSTREAM (" << frames << " frames in " << wall_ms << " ms):\n"
+              << "\tframes/s\t" << frames / (wall_ms * 1e-3) << "\n"
+              << "\tlatency (ms)\tp50 " << percentile(0.50) << "\tp90 " << percentile(0.90)
+              << "\tp99 " << percentile(0.99) << "\tmax " << latencies.back() << std::endl;
+}
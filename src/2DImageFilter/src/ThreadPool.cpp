@@ -0,0 +1,96 @@
+#include "ThreadPool.hpp"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads) : m_stop{false}
+{
+    if(threads <= 0){
+        threads = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+
+    for(int i = 0; i < threads; i++){
+        m_threads.emplace_back(&ThreadPool::worker, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_task_available.notify_all();
+
+    for(auto& thread : m_threads){
+        thread.join();
+    }
+}
+
+int ThreadPool::GetThreadCount() const
+{
+    return (int)m_threads.size();
+}
+
+void ThreadPool::ParallelFor(int count, const std::function<void(int begin, int end)> &function)
+{
+    int ranges = std::min(count, GetThreadCount());
+    if(ranges <= 1){
+        if(count > 0)
+            function(0, count);
+        return;
+    }
+
+    // Ranges of this call still running, concurrent calls only wait for their own
+    int pending = ranges;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for(int i = 0; i < ranges; i++){
+            int begin = (int)((long long)count * i / ranges);
+            int end = (int)((long long)count * (i + 1) / ranges);
+            m_tasks.push_back([this, &function, &pending, begin, end](){
+                function(begin, end);
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                pending--;
+                m_tasks_done.notify_all();
+            });
+        }
+    }
+    m_task_available.notify_all();
+
+    // Wait for the ranges of this call
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_tasks_done.wait(lock, [&pending](){ return pending == 0; });
+}
+
+std::future<void> ThreadPool::Submit(std::function<void()> task)
+{
+    // std::function needs a copyable target, the packaged task is shared
+    auto packaged = std::make_shared<std::packaged_task<void()>>(std::move(task));
+    auto future = packaged->get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back([packaged](){ (*packaged)(); });
+    }
+    m_task_available.notify_one();
+    return future;
+}
+
+void ThreadPool::worker()
+{
+    for(;;){
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_task_available.wait(lock, [this](){ return m_stop || !m_tasks.empty(); });
+            if(m_stop && m_tasks.empty()){
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+
+        task();
+    }
+}
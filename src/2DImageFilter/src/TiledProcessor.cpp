@@ -0,0 +1,233 @@
+#include "TiledProcessor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+TiledProcessor::TiledProcessor(Controller& controller, cl_context context, cl_device_id device, GaussianFilter& filter, int max_tile_size, int pool_size)
+    : m_context{context}, m_device{device}, m_filter{filter}, m_max_tile_size{max_tile_size}, m_tile_width{0}, m_tile_height{0}, m_halo{0}
+{
+    m_queue = controller.CreateCommandQueue(context, device);
+    if(m_queue == NULL){
+        controller.CheckError(CL_OUT_OF_RESOURCES, "clCreateCommandQueue");
+    }
+
+    m_pool.resize(std::max(pool_size, 1));
+    for(auto& tile : m_pool){
+        tile.src = tile.dst = 0;
+        tile.readback = 0;
+    }
+}
+
+TiledProcessor::~TiledProcessor()
+{
+    clFinish(m_queue);
+
+    for(auto& tile : m_pool){
+        if(tile.readback != 0)
+            clReleaseEvent(tile.readback);
+        if(tile.src != 0)
+            clReleaseMemObject(tile.src);
+        if(tile.dst != 0)
+            clReleaseMemObject(tile.dst);
+    }
+
+    clReleaseCommandQueue(m_queue);
+}
+
+bool TiledProcessor::NeedsTiling(cl_device_id device, int width, int height)
+{
+    size_t max_width = 0, max_height = 0;
+    cl_ulong max_alloc = 0;
+
+    clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(size_t), &max_width, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(size_t), &max_height, NULL);
+    clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &max_alloc, NULL);
+
+    // The separable path also allocates a float intermediate image of the same size
+    return (size_t)width > max_width || (size_t)height > max_height || (cl_ulong)width * height * 16 > max_alloc;
+}
+
+bool TiledProcessor::Process(const std::vector<char> &input, std::vector<char> &output, int width, int height)
+{
+    cl_int err_num = CL_SUCCESS;
+
+    if(!computeTileSize(width, height) || !allocatePool()){
+        return false;
+    }
+
+    int core_width = m_tile_width - 2 * m_halo;
+    int core_height = m_tile_height - 2 * m_halo;
+    int tiles_x = (width + core_width - 1) / core_width;
+    int tiles_y = (height + core_height - 1) / core_height;
+
+    double pool_mb = m_pool.size() * 2.0 * m_tile_width * m_tile_height * 4 / (1024.0 * 1024.0);
+    std::cout << "Processing " << width << "x" << height << " image as " << tiles_x << "x" << tiles_y << " tiles of "
+              << m_tile_width << "x" << m_tile_height << " (halo " << m_halo << ", pool of " << m_pool.size() << " tiles, "
+              << std::fixed << std::setprecision(2) << pool_mb << " MB)" << std::endl;
+
+    output.resize((size_t)width * height * 4);
+    auto start = std::chrono::high_resolution_clock::now();
+
+    int index = 0;
+    for(int y0 = 0; y0 < height && err_num == CL_SUCCESS; y0 += core_height){
+        for(int x0 = 0; x0 < width && err_num == CL_SUCCESS; x0 += core_width, index++){
+            Tile& tile = m_pool[index % m_pool.size()];
+
+            // Wait until the previous tile of this slot has been stitched before reusing it
+            if(tile.readback != 0){
+                clWaitForEvents(1, &tile.readback);
+                clReleaseEvent(tile.readback);
+                tile.readback = 0;
+            }
+
+            int tile_core_width = std::min(core_width, width - x0);
+            int tile_core_height = std::min(core_height, height - y0);
+
+            // Edge tiles replicate the last pixels over the unused part of the tile, so that the recursive
+            // filter running across the whole tile never sees stale pixels of an earlier tile
+            pack(input, width, height, x0, y0, tile);
+
+            // Upload the tile with its halo
+            size_t tile_pitch = (size_t)m_tile_width * 4;
+            if(m_filter.UsesBuffers()){
+                size_t origin[3] = {0, 0, 0};
+                size_t region[3] = {(size_t)m_tile_width * 4, (size_t)m_tile_height, 1};
+                err_num = clEnqueueWriteBufferRect(m_queue, tile.src, CL_FALSE, origin, origin, region, tile_pitch, 0, tile_pitch, 0, tile.staging.data(), 0, NULL, NULL);
+            } else{
+                size_t origin[3] = {0, 0, 0};
+                size_t region[3] = {(size_t)m_tile_width, (size_t)m_tile_height, 1};
+                err_num = clEnqueueWriteImage(m_queue, tile.src, CL_FALSE, origin, region, tile_pitch, 0, tile.staging.data(), 0, NULL, NULL);
+            }
+
+            // Always filter the full pool extent so that the intermediate images keep their size
+            if(err_num == CL_SUCCESS){
+                err_num = m_filter.Enqueue(m_queue, tile.src, tile.dst, m_tile_width, m_tile_height);
+            }
+
+            // Read the core of the tile straight into its place in the output image
+            if(err_num == CL_SUCCESS){
+                size_t image_pitch = (size_t)width * 4;
+                if(m_filter.UsesBuffers()){
+                    size_t buffer_origin[3] = {(size_t)m_halo * 4, (size_t)m_halo, 0};
+                    size_t host_origin[3] = {(size_t)x0 * 4, (size_t)y0, 0};
+                    size_t region[3] = {(size_t)tile_core_width * 4, (size_t)tile_core_height, 1};
+                    err_num = clEnqueueReadBufferRect(m_queue, tile.dst, CL_FALSE, buffer_origin, host_origin, region, tile_pitch, 0, image_pitch, 0, output.data(), 0, NULL, &tile.readback);
+                } else{
+                    size_t origin[3] = {(size_t)m_halo, (size_t)m_halo, 0};
+                    size_t region[3] = {(size_t)tile_core_width, (size_t)tile_core_height, 1};
+                    err_num = clEnqueueReadImage(m_queue, tile.dst, CL_FALSE, origin, region, image_pitch, 0, output.data() + ((size_t)y0 * width + x0) * 4, 0, NULL, &tile.readback);
+                }
+            }
+
+            clFlush(m_queue);
+        }
+    }
+
+    clFinish(m_queue);
+    if(err_num != CL_SUCCESS){
+        std::cerr << "Error processing tile " << index << " (" << err_num << ")" << std::endl;
+        return false;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    std::cout << "Processed " << index << " tiles in " << std::chrono::duration<double, std::milli>(end - start).count() << " ms" << std::endl;
+    return true;
+}
+
+bool TiledProcessor::computeTileSize(int width, int height)
+{
+    size_t max_width = 0, max_height = 0;
+    cl_ulong max_alloc = 0;
+
+    clGetDeviceInfo(m_device, CL_DEVICE_IMAGE2D_MAX_WIDTH, sizeof(size_t), &max_width, NULL);
+    clGetDeviceInfo(m_device, CL_DEVICE_IMAGE2D_MAX_HEIGHT, sizeof(size_t), &max_height, NULL);
+    clGetDeviceInfo(m_device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &max_alloc, NULL);
+
+    if(m_max_tile_size > 0){
+        max_width = std::min(max_width, (size_t)m_max_tile_size);
+        max_height = std::min(max_height, (size_t)m_max_tile_size);
+    }
+
+    // Halos equal the filter radius, the recursive filter reaches about four sigma
+    m_halo = m_filter.GetRadius();
+    if(m_filter.GetAlgorithm() == FilterAlgorithm::RECURSIVE){
+        m_halo = std::max(m_halo, (int)std::ceil(4.0f * m_filter.GetSigma()));
+    }
+    m_tile_width = (int)std::min(max_width, (size_t)width + 2 * m_halo);
+    m_tile_height = (int)std::min(max_height, (size_t)height + 2 * m_halo);
+
+    // Largest single allocation per tile (the separable and recursive paths hold float intermediates)
+    auto algorithm = m_filter.GetAlgorithm();
+    cl_ulong bytes_per_pixel = (algorithm == FilterAlgorithm::SEPARABLE || algorithm == FilterAlgorithm::RECURSIVE) ? 16 : 4;
+    while((cl_ulong)m_tile_width * m_tile_height * bytes_per_pixel > max_alloc && m_tile_height > 2 * m_halo + 1){
+        m_tile_height /= 2;
+    }
+
+    if(m_tile_width <= 2 * m_halo || m_tile_height <= 2 * m_halo){
+        std::cerr << "Device limits are too small for a tile with a halo of " << m_halo << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool TiledProcessor::allocatePool()
+{
+    cl_int err_num = CL_SUCCESS;
+    size_t tile_bytes = (size_t)m_tile_width * m_tile_height * 4;
+
+    cl_image_format clImageFormat;
+    clImageFormat.image_channel_order = CL_RGBA;
+    clImageFormat.image_channel_data_type = CL_UNORM_INT8;
+
+    for(auto& tile : m_pool){
+        if(tile.src != 0)
+            clReleaseMemObject(tile.src);
+        if(tile.dst != 0)
+            clReleaseMemObject(tile.dst);
+        tile.src = tile.dst = 0;
+
+        if(m_filter.UsesBuffers()){
+            tile.src = clCreateBuffer(m_context, CL_MEM_READ_ONLY, tile_bytes, NULL, &err_num);
+            if(err_num == CL_SUCCESS)
+                tile.dst = clCreateBuffer(m_context, CL_MEM_WRITE_ONLY, tile_bytes, NULL, &err_num);
+        } else{
+            tile.src = clCreateImage2D(m_context, CL_MEM_READ_ONLY, &clImageFormat, m_tile_width, m_tile_height, 0, NULL, &err_num);
+            if(err_num == CL_SUCCESS)
+                tile.dst = clCreateImage2D(m_context, CL_MEM_WRITE_ONLY, &clImageFormat, m_tile_width, m_tile_height, 0, NULL, &err_num);
+        }
+
+        if(err_num != CL_SUCCESS){
+            std::cerr << "Error creating tile pool objects (" << err_num << ")" << std::endl;
+            return false;
+        }
+
+        tile.staging.resize(tile_bytes);
+    }
+
+    return true;
+}
+
+void TiledProcessor::pack(const std::vector<char> &input, int width, int height, int x0, int y0, Tile &tile)
+{
+    // Columns of the tile that lie inside the image, the rest replicate the edge pixels
+    int first_x = std::max(x0 - m_halo, 0);
+    int last_x = std::min(x0 - m_halo + m_tile_width, width);
+    int left = first_x - (x0 - m_halo);
+    int right = m_tile_width - left - (last_x - first_x);
+
+    for(int y = 0; y < m_tile_height; y++){
+        int source_y = std::clamp(y0 - m_halo + y, 0, height - 1);
+        const char* source_row = input.data() + (size_t)source_y * width * 4;
+        char* tile_row = tile.staging.data() + (size_t)y * m_tile_width * 4;
+
+        for(int x = 0; x < left; x++){
+            std::memcpy(tile_row + x * 4, source_row, 4);
+        }
+        std::memcpy(tile_row + left * 4, source_row + (size_t)first_x * 4, (size_t)(last_x - first_x) * 4);
+        for(int x = 0; x < right; x++){
+            std::memcpy(tile_row + (left + last_x - first_x + x) * 4, source_row + (size_t)(width - 1) * 4, 4);
+        }
+    }
+}
@@ -3,9 +3,14 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <functional>
 
 #include <InfoDevice.hpp>
 #include <InfoPlatform.hpp>
+#include <FFTConvolution.hpp>
 
 // Enum
 enum USING_DEVICE {
@@ -17,6 +22,11 @@ enum USING_DEVICE {
 // Constants
 bool TIME_KERNEL = true;
 int INTENDED_DEVICE = 3;    // 1 - CPU, 2 - iGPU, 3 - GPU
+int CONVOLUTION_METHOD = 0; // 0 - automatic (measured crossover), 1 - direct, 2 - FFT
+bool VERIFY_OUTPUT = true;
+
+// Direct convolution is timed with this mask to estimate its cost per mask element
+const unsigned int probe_mask_width = 7;
 
 // Input signal
 const unsigned int input_signal_width = 1300;
@@ -24,13 +34,7 @@ const unsigned int input_signal_height = 1300;
 
 cl_uint input_signal [input_signal_width][input_signal_height];
 
-// Output signal
-const unsigned int output_signal_width = 1298;
-const unsigned int output_signal_height = 1298;
-
-cl_uint output_signal [output_signal_width][output_signal_height] = {};
-
-// Mask matrix
+// Mask matrix (default, a mask width on the command line selects a random mask instead)
 const unsigned int mask_width = 3;
 const unsigned int mask_height = 3;
 
@@ -49,6 +53,19 @@ void InitialiseMatrix(){
     }
 }
 
+std::vector<cl_uint> CreateMask(unsigned int width){
+    // Use the default mask unless another size is requested
+    std::vector<cl_uint> values;
+    if(width == mask_width){
+        values.assign(&mask[0][0], &mask[0][0] + mask_width * mask_height);
+    } else{
+        for(unsigned int i = 0; i < width * width; i++){
+            values.push_back(rand() % 16);
+        }
+    }
+    return values;
+}
+
 void CheckIntendedDevice(USING_DEVICE intended_device){
     std::string str_intended_device = {};
 
@@ -78,6 +95,27 @@ inline void CheckError(cl_int error, const char* name){
     }
 }
 
+double TimeConvolution(cl_command_queue queue, const std::function<cl_int()>& enqueue, const char* name){
+    // Host time from the first enqueue to completion, which includes the launch overhead of every pass
+    auto start = std::chrono::high_resolution_clock::now();
+    CheckError(enqueue(), name);
+    CheckError(clFinish(queue), "clFinish");
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+cl_int EnqueueDirect(cl_command_queue queue, cl_kernel kernel, cl_mem input, cl_mem mask_values, cl_mem output, cl_uint width){
+    cl_uint input_width = input_signal_width;
+    cl_int err_num = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input);
+    err_num |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &mask_values);
+    err_num |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &output);
+    err_num |= clSetKernelArg(kernel, 3, sizeof(cl_uint), &input_width);
+    err_num |= clSetKernelArg(kernel, 4, sizeof(cl_uint), &width);
+
+    // One work-item per output element
+    const size_t global_work_size[2] = {input_signal_width - width + 1, input_signal_height - width + 1};
+    return err_num | clEnqueueNDRangeKernel(queue, kernel, 2, NULL, global_work_size, NULL, 0, NULL, NULL);
+}
+
 void CL_CALLBACK contextCallback(const char* error_info, const void* private_info, size_t cb, void* user_data){
     std::cout << "Error orccured during context use: " << error_info << std::endl;
     exit(EXIT_FAILURE);
@@ -111,10 +149,17 @@ void DisplayDeviceProperties(cl_device_id* device_IDs, cl_uint num_devices_index
     std::cout << std::endl;
 }
 
-int main()
+int main(int argc, char** argv)
 {
     std::cout << "Hello from Convolution!" << std::endl;
 
+    // Optional mask width
+    cl_uint selected_mask_width = argc > 1 ? std::atoi(argv[1]) : mask_width;
+    if(selected_mask_width < 1 || selected_mask_width > input_signal_width){
+        std::cerr << "Mask width must be between 1 and " << input_signal_width << std::endl;
+        exit(-1);
+    }
+
     // Initialise matrix
     InitialiseMatrix();
 
@@ -265,59 +310,101 @@ int main()
     kernel = clCreateKernel(program, "convolve", &err_num);
     CheckError(err_num, "clCreateKernel");
 
+    // Output size of the valid region
+    const unsigned int output_signal_width = input_signal_width - selected_mask_width + 1;
+    const unsigned int output_signal_height = input_signal_height - selected_mask_width + 1;
+
+    std::vector<cl_uint> mask_values = CreateMask(selected_mask_width);
+    std::vector<cl_uint> probe_mask_values = CreateMask(probe_mask_width);
+    std::vector<cl_uint> output_signal(output_signal_width * output_signal_height);
+
     // Create memory objects (input signal)
     input_signal_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * input_signal_height * input_signal_width, static_cast<void*>(input_signal), &err_num);
     CheckError(err_num, "clCreateBuffer: input_signal_buffer");
 
     // Create memory objects (mask signal)
-    mask_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * mask_height * mask_width, static_cast<void*>(mask), &err_num);
+    mask_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * mask_values.size(), mask_values.data(), &err_num);
     CheckError(err_num, "clCreateBuffer: mask_buffer");
 
-    // Create memory objects (mask signal)
-    output_signal_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(cl_uint) * output_signal_height * output_signal_width, NULL, &err_num);
+    // Create memory objects (output signal)
+    output_signal_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(cl_uint) * output_signal.size(), NULL, &err_num);
     CheckError(err_num, "clCreateBuffer: output_signal_buffer");
 
     // Create a command queue
     queue = clCreateCommandQueue(context, device_IDs[0], CL_QUEUE_PROFILING_ENABLE, &err_num);
     CheckError(err_num, "clCreateCommandQueue");
 
-    // Set kernel arguments
-    err_num = clSetKernelArg(kernel, 0, sizeof(cl_mem), &input_signal_buffer);
-    err_num |= clSetKernelArg(kernel, 1, sizeof(cl_mem), &mask_buffer);
-    err_num |= clSetKernelArg(kernel, 2, sizeof(cl_mem), &output_signal_buffer);
-    err_num |= clSetKernelArg(kernel, 3, sizeof(cl_uint), &input_signal_width);
-    err_num |= clSetKernelArg(kernel, 4, sizeof(cl_uint), &mask_width);
-    CheckError(err_num, "clSetKernelArg");
-
-    // Initialise the work-size
-    const size_t global_work_size[1] = {output_signal_width * output_signal_height};
-    const size_t local_work_size[1] = {1};
-
-    // Create an event
-    cl_event event;
-    
-    // Initialise the NDRange and perform the calculation
-    err_num = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, global_work_size, local_work_size, 0, NULL, &event);
-    CheckError(err_num, "clEnqueueNDRangeKernel");
+    // The FFT backend needs a whole padded row in local memory
+    FFTConvolution fft(context, device_IDs[0], program);
+    int transform_size = fft.TransformSize(input_signal_width, input_signal_height);
+
+    auto enqueue_direct = [&](){ return EnqueueDirect(queue, kernel, input_signal_buffer, mask_buffer, output_signal_buffer, selected_mask_width); };
+    auto enqueue_fft = [&](){ return fft.Enqueue(queue, input_signal_buffer, mask_buffer, output_signal_buffer, input_signal_width, input_signal_height, selected_mask_width); };
+
+    // Direct cost grows with the mask area while the FFT cost only depends on the transform size,
+    // so one timing of each gives the mask width where the FFT starts to win on this device
+    bool use_fft = CONVOLUTION_METHOD == 2;
+    if(transform_size == 0){
+        std::cout << "FFT backend unavailable (a padded row does not fit in local memory)" << std::endl;
+        use_fft = false;
+    } else if(CONVOLUTION_METHOD == 0){
+        cl_mem probe_mask_buffer = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(cl_uint) * probe_mask_values.size(), probe_mask_values.data(), &err_num);
+        CheckError(err_num, "clCreateBuffer: probe_mask_buffer");
+        cl_mem probe_output_buffer = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(cl_uint) * input_signal_width * input_signal_height, NULL, &err_num);
+        CheckError(err_num, "clCreateBuffer: probe_output_buffer");
+
+        auto enqueue_probe = [&](){ return EnqueueDirect(queue, kernel, input_signal_buffer, probe_mask_buffer, probe_output_buffer, probe_mask_width); };
+
+        // The first runs only warm up (program compilation, FFT buffer allocation)
+        TimeConvolution(queue, enqueue_probe, "Direct convolution");
+        TimeConvolution(queue, enqueue_fft, "FFT convolution");
+        double direct_ms = TimeConvolution(queue, enqueue_probe, "Direct convolution");
+        double fft_ms = TimeConvolution(queue, enqueue_fft, "FFT convolution");
+
+        double crossover_width = std::sqrt(fft_ms / (direct_ms / (probe_mask_width * probe_mask_width)));
+        use_fft = selected_mask_width > crossover_width;
+
+        std::cout << "Direct " << probe_mask_width << "x" << probe_mask_width << ": " << direct_ms << " ms, FFT " << transform_size << "x" << transform_size << ": " << fft_ms
+                  << " ms, crossover at a " << std::fixed << std::setprecision(1) << crossover_width << " wide mask" << std::endl;
+
+        clReleaseMemObject(probe_mask_buffer);
+        clReleaseMemObject(probe_output_buffer);
+    }
 
-    // Wait for the event to complete
-    clWaitForEvents(1, &event);
+    std::cout << "Convolving " << input_signal_width << "x" << input_signal_height << " with a " << selected_mask_width << "x" << selected_mask_width
+              << " mask using " << (use_fft ? "FFT" : "direct") << " convolution" << std::endl;
 
-    // Get the timing
-    cl_ulong start, end;
-    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
-    clGetEventProfilingInfo(event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+    // Perform the calculation
+    double time_ms = use_fft ? TimeConvolution(queue, enqueue_fft, "FFT convolution") : TimeConvolution(queue, enqueue_direct, "Direct convolution");
 
     // Get the duration
     if(TIME_KERNEL){
-        double time_ms = (end - start) * 1e-6;
         std::cout << "Kernel execution time: " << time_ms << " ms" << std::endl;
         std::cout << "\n-------------------- END OF KERNEL EXEUCTION DETAILS --------------------" << std::endl;
         std::cout << std::endl;
     }
 
     // Read the buffer
-    err_num = clEnqueueReadBuffer(queue, output_signal_buffer, CL_TRUE, 0, sizeof(cl_uint) * output_signal_height * output_signal_width, output_signal, 0, NULL, NULL);
+    err_num = clEnqueueReadBuffer(queue, output_signal_buffer, CL_TRUE, 0, sizeof(cl_uint) * output_signal.size(), output_signal.data(), 0, NULL, NULL);
     CheckError(err_num, "clEnqueueReadBuffer");
+
+    // Spot check against the host, the FFT result is only exact up to float rounding
+    if(VERIFY_OUTPUT){
+        double max_error = 0.0;
+        for(int sample = 0; sample < 1000; sample++){
+            unsigned int x = rand() % output_signal_width;
+            unsigned int y = rand() % output_signal_height;
+
+            double expected = 0.0;
+            for(unsigned int r = 0; r < selected_mask_width; r++){
+                for(unsigned int c = 0; c < selected_mask_width; c++){
+                    expected += (double)mask_values[r * selected_mask_width + c] * input_signal[y + r][x + c];
+                }
+            }
+            max_error = std::max(max_error, std::abs(output_signal[y * output_signal_width + x] - expected) / std::max(expected, 1.0));
+        }
+        std::cout << "Maximum relative error of 1000 samples: " << std::scientific << max_error << std::endl;
+    }
+
     return 0;
-}
\ No newline at end of file
+}
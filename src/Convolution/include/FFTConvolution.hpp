@@ -0,0 +1,42 @@
+#ifndef FFTCONVOLUTION_H
+#define FFTCONVOLUTION_H
+
+#include <CL/cl.h>
+#include <iostream>
+
+class FFTConvolution
+{
+public:
+    FFTConvolution(cl_context context, cl_device_id device, cl_program program);
+    ~FFTConvolution();
+
+    // Side of the padded power-of-two transform, 0 when a row does not fit in local memory
+    int TransformSize(int input_width, int input_height) const;
+
+    // Same result as the convolve kernel, at a cost independent of the mask size
+    cl_int Enqueue(cl_command_queue queue, cl_mem input, cl_mem mask, cl_mem output, int input_width, int input_height, int mask_width);
+
+private:
+    cl_int transform(cl_command_queue queue, cl_mem data, cl_mem transposed, float direction);
+    cl_int pad(cl_command_queue queue, cl_mem signal, cl_mem data, int width, int height);
+    bool reserve(int n);
+
+    cl_context m_context;
+    cl_device_id m_device;
+
+    cl_kernel m_kernel_pad;
+    cl_kernel m_kernel_rows;
+    cl_kernel m_kernel_transpose;
+    cl_kernel m_kernel_multiply;
+    cl_kernel m_kernel_extract;
+
+    // Padded signal, padded mask and the transposed scratch grid
+    cl_mem m_signal;
+    cl_mem m_mask;
+    cl_mem m_scratch;
+    int m_size;
+    cl_ulong m_local_memory;
+    size_t m_max_work_group;
+};
+
+#endif // FFTCONVOLUTION_H
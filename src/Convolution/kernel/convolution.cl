@@ -22,4 +22,132 @@ __kernel void convolve(
 
     // Set to the output array
     output[y*get_global_size(0) + x] = sum;
-}
\ No newline at end of file
+}
+
+// FFT backend: valid-region correlation through an n x n transform (n a power of two)
+
+// Reverse the lowest `bits` bits of an index
+inline int reverse_bits(int value, const int bits)
+{
+    int reversed = 0;
+    for(int i = 0; i < bits; i++){
+        reversed = (reversed << 1) | (value & 1);
+        value >>= 1;
+    }
+    return reversed;
+}
+
+// Copy a uint signal into the top-left corner of a zero padded complex n x n grid
+__kernel void fft_pad(
+    const __global uint* const input,
+    __global float2* const data,
+    const int width,
+    const int height,
+    const int n)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+
+    if(x >= n || y >= n)
+        return;
+
+    const float value = (x < width && y < height) ? (float)input[y * width + x] : 0.0f;
+    data[y * n + x] = (float2)(value, 0.0f);
+}
+
+// Radix-2 FFT of every row, one work-group per row staged through __local memory.
+// `direction` is -1 for the forward and +1 for the (1/n scaled) inverse transform
+__kernel void fft_rows(
+    __global float2* const data,
+    __local float2* const line,
+    const int n,
+    const int log2n,
+    const float direction)
+{
+    const int lid = get_local_id(0);
+    const int local_size = get_local_size(0);
+    __global float2* const row = data + (size_t)get_group_id(0) * n;
+
+    // Load in bit-reversed order so the butterflies can run in place
+    for(int i = lid; i < n; i += local_size){
+        line[reverse_bits(i, log2n)] = row[i];
+    }
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    for(int half = 1; half < n; half <<= 1){
+        for(int k = lid; k < n / 2; k += local_size){
+            const int j = k & (half - 1);
+            const int i0 = ((k - j) << 1) + j;
+            const int i1 = i0 + half;
+
+            float cosine;
+            const float sine = sincos(direction * M_PI_F * j / half, &cosine);
+
+            const float2 a = line[i0];
+            const float2 b = line[i1];
+            const float2 t = (float2)(b.x * cosine - b.y * sine, b.x * sine + b.y * cosine);
+
+            line[i0] = a + t;
+            line[i1] = a - t;
+        }
+        barrier(CLK_LOCAL_MEM_FENCE);
+    }
+
+    const float scale = direction > 0.0f ? 1.0f / n : 1.0f;
+    for(int i = lid; i < n; i += local_size){
+        row[i] = line[i] * scale;
+    }
+}
+
+// Transpose an n x n complex grid through 16x16 __local tiles, turning the column pass into a row pass
+__kernel __attribute__((reqd_work_group_size(16, 16, 1)))
+void fft_transpose(
+    const __global float2* const src,
+    __global float2* const dst,
+    const int n)
+{
+    __local float2 tile[16][17];
+
+    const int lx = get_local_id(0);
+    const int ly = get_local_id(1);
+    const int gx = get_group_id(0) * 16;
+    const int gy = get_group_id(1) * 16;
+
+    tile[ly][lx] = src[(gy + ly) * n + gx + lx];
+    barrier(CLK_LOCAL_MEM_FENCE);
+
+    dst[(gx + ly) * n + gy + lx] = tile[lx][ly];
+}
+
+// Multiply the signal spectrum by the conjugate mask spectrum (correlation, as the convolve kernel computes)
+__kernel void fft_multiply(
+    __global float2* const signal,
+    const __global float2* const mask,
+    const int count)
+{
+    const int i = get_global_id(0);
+
+    if(i >= count)
+        return;
+
+    const float2 a = signal[i];
+    const float2 b = mask[i];
+    signal[i] = (float2)(a.x * b.x + a.y * b.y, a.y * b.x - a.x * b.y);
+}
+
+// Round the real part of the valid region back to uint
+__kernel void fft_extract(
+    const __global float2* const data,
+    __global uint* const output,
+    const int output_width,
+    const int output_height,
+    const int n)
+{
+    const int x = get_global_id(0);
+    const int y = get_global_id(1);
+
+    if(x >= output_width || y >= output_height)
+        return;
+
+    output[y * output_width + x] = (uint)rint(fmax(data[y * n + x].x, 0.0f));
+}
@@ -0,0 +1,168 @@
+#include "FFTConvolution.hpp"
+
+#include <algorithm>
+
+FFTConvolution::FFTConvolution(cl_context context, cl_device_id device, cl_program program)
+    : m_context{context}, m_device{device}, m_signal{0}, m_mask{0}, m_scratch{0}, m_size{0}, m_local_memory{0}, m_max_work_group{1}
+{
+    cl_int err_num[5];
+
+    m_kernel_pad = clCreateKernel(program, "fft_pad", &err_num[0]);
+    m_kernel_rows = clCreateKernel(program, "fft_rows", &err_num[1]);
+    m_kernel_transpose = clCreateKernel(program, "fft_transpose", &err_num[2]);
+    m_kernel_multiply = clCreateKernel(program, "fft_multiply", &err_num[3]);
+    m_kernel_extract = clCreateKernel(program, "fft_extract", &err_num[4]);
+    if(std::any_of(err_num, err_num + 5, [](cl_int err){ return err != CL_SUCCESS; })){
+        std::cerr << "Failed to create the FFT kernels, only direct convolution is available" << std::endl;
+        for(auto kernel : {m_kernel_pad, m_kernel_rows, m_kernel_transpose, m_kernel_multiply, m_kernel_extract}){
+            if(kernel != 0)
+                clReleaseKernel(kernel);
+        }
+        m_kernel_pad = m_kernel_rows = m_kernel_transpose = m_kernel_multiply = m_kernel_extract = 0;
+        return;
+    }
+
+    // A whole row is staged in local memory, which bounds the transform size
+    clGetDeviceInfo(device, CL_DEVICE_LOCAL_MEM_SIZE, sizeof(cl_ulong), &m_local_memory, NULL);
+    clGetKernelWorkGroupInfo(m_kernel_rows, device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(size_t), &m_max_work_group, NULL);
+}
+
+FFTConvolution::~FFTConvolution()
+{
+    for(auto kernel : {m_kernel_pad, m_kernel_rows, m_kernel_transpose, m_kernel_multiply, m_kernel_extract}){
+        if(kernel != 0)
+            clReleaseKernel(kernel);
+    }
+
+    for(auto buffer : {m_signal, m_mask, m_scratch}){
+        if(buffer != 0)
+            clReleaseMemObject(buffer);
+    }
+}
+
+int FFTConvolution::TransformSize(int input_width, int input_height) const
+{
+    // The transpose works on 16x16 tiles
+    int n = 16;
+    while(n < std::max(input_width, input_height))
+        n <<= 1;
+
+    if(m_kernel_rows == 0 || n * sizeof(cl_float2) > m_local_memory)
+        return 0;
+
+    return n;
+}
+
+cl_int FFTConvolution::Enqueue(cl_command_queue queue, cl_mem input, cl_mem mask, cl_mem output, int input_width, int input_height, int mask_width)
+{
+    int n = TransformSize(input_width, input_height);
+    if(n == 0 || !reserve(n)){
+        return CL_INVALID_WORK_GROUP_SIZE;
+    }
+
+    // The mask sits at the origin, so the cyclic correlation equals the direct one over the valid region
+    cl_int err_num = pad(queue, input, m_signal, input_width, input_height);
+    err_num |= pad(queue, mask, m_mask, mask_width, mask_width);
+
+    // Both spectra end up transposed in m_scratch and m_mask
+    err_num |= transform(queue, m_signal, m_scratch, -1.0f);
+    err_num |= transform(queue, m_mask, m_signal, -1.0f);
+    std::swap(m_mask, m_signal);
+
+    int count = n * n;
+    size_t global_size = count;
+    err_num |= clSetKernelArg(m_kernel_multiply, 0, sizeof(cl_mem), &m_scratch);
+    err_num |= clSetKernelArg(m_kernel_multiply, 1, sizeof(cl_mem), &m_mask);
+    err_num |= clSetKernelArg(m_kernel_multiply, 2, sizeof(int), &count);
+    err_num |= clEnqueueNDRangeKernel(queue, m_kernel_multiply, 1, NULL, &global_size, NULL, 0, NULL, NULL);
+
+    // The inverse transform transposes back into m_signal
+    err_num |= transform(queue, m_scratch, m_signal, 1.0f);
+
+    int output_width = input_width - mask_width + 1;
+    int output_height = input_height - mask_width + 1;
+    size_t output_size[2] = {(size_t)output_width, (size_t)output_height};
+    err_num |= clSetKernelArg(m_kernel_extract, 0, sizeof(cl_mem), &m_signal);
+    err_num |= clSetKernelArg(m_kernel_extract, 1, sizeof(cl_mem), &output);
+    err_num |= clSetKernelArg(m_kernel_extract, 2, sizeof(int), &output_width);
+    err_num |= clSetKernelArg(m_kernel_extract, 3, sizeof(int), &output_height);
+    err_num |= clSetKernelArg(m_kernel_extract, 4, sizeof(int), &n);
+    err_num |= clEnqueueNDRangeKernel(queue, m_kernel_extract, 2, NULL, output_size, NULL, 0, NULL, NULL);
+
+    return err_num;
+}
+
+cl_int FFTConvolution::transform(cl_command_queue queue, cl_mem data, cl_mem transposed, float direction)
+{
+    int n = m_size;
+    int log2n = 0;
+    while((1 << log2n) < n)
+        log2n++;
+
+    // One work-group per row, each work-item loops over its share of the n / 2 butterflies
+    size_t local_size = std::min((size_t)n / 2, m_max_work_group);
+    size_t global_size = local_size * n;
+    size_t tile_size[2] = {16, 16};
+    size_t grid_size[2] = {(size_t)n, (size_t)n};
+
+    // Rows, transpose, then rows again for the columns
+    cl_int err_num = CL_SUCCESS;
+    for(auto buffer : {data, transposed}){
+        err_num |= clSetKernelArg(m_kernel_rows, 0, sizeof(cl_mem), &buffer);
+        err_num |= clSetKernelArg(m_kernel_rows, 1, n * sizeof(cl_float2), NULL);
+        err_num |= clSetKernelArg(m_kernel_rows, 2, sizeof(int), &n);
+        err_num |= clSetKernelArg(m_kernel_rows, 3, sizeof(int), &log2n);
+        err_num |= clSetKernelArg(m_kernel_rows, 4, sizeof(float), &direction);
+        err_num |= clEnqueueNDRangeKernel(queue, m_kernel_rows, 1, NULL, &global_size, &local_size, 0, NULL, NULL);
+
+        if(buffer == data){
+            err_num |= clSetKernelArg(m_kernel_transpose, 0, sizeof(cl_mem), &data);
+            err_num |= clSetKernelArg(m_kernel_transpose, 1, sizeof(cl_mem), &transposed);
+            err_num |= clSetKernelArg(m_kernel_transpose, 2, sizeof(int), &n);
+            err_num |= clEnqueueNDRangeKernel(queue, m_kernel_transpose, 2, NULL, grid_size, tile_size, 0, NULL, NULL);
+        }
+    }
+
+    return err_num;
+}
+
+cl_int FFTConvolution::pad(cl_command_queue queue, cl_mem signal, cl_mem data, int width, int height)
+{
+    size_t grid_size[2] = {(size_t)m_size, (size_t)m_size};
+
+    cl_int err_num = clSetKernelArg(m_kernel_pad, 0, sizeof(cl_mem), &signal);
+    err_num |= clSetKernelArg(m_kernel_pad, 1, sizeof(cl_mem), &data);
+    err_num |= clSetKernelArg(m_kernel_pad, 2, sizeof(int), &width);
+    err_num |= clSetKernelArg(m_kernel_pad, 3, sizeof(int), &height);
+    err_num |= clSetKernelArg(m_kernel_pad, 4, sizeof(int), &m_size);
+    err_num |= clEnqueueNDRangeKernel(queue, m_kernel_pad, 2, NULL, grid_size, NULL, 0, NULL, NULL);
+
+    return err_num;
+}
+
+bool FFTConvolution::reserve(int n)
+{
+    if(n == m_size)
+        return true;
+
+    for(auto buffer : {m_signal, m_mask, m_scratch}){
+        if(buffer != 0)
+            clReleaseMemObject(buffer);
+    }
+    m_signal = m_mask = m_scratch = 0;
+    m_size = 0;
+
+    // Three complex n x n grids
+    cl_int err_num, err_num_mask, err_num_scratch;
+    size_t size = sizeof(cl_float2) * n * n;
+    m_signal = clCreateBuffer(m_context, CL_MEM_READ_WRITE, size, NULL, &err_num);
+    m_mask = clCreateBuffer(m_context, CL_MEM_READ_WRITE, size, NULL, &err_num_mask);
+    m_scratch = clCreateBuffer(m_context, CL_MEM_READ_WRITE, size, NULL, &err_num_scratch);
+    if(err_num != CL_SUCCESS || err_num_mask != CL_SUCCESS || err_num_scratch != CL_SUCCESS){
+        std::cerr << "Failed to allocate the " << n << "x" << n << " FFT buffers" << std::endl;
+        return false;
+    }
+
+    m_size = n;
+    return true;
+}